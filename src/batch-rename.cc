@@ -0,0 +1,425 @@
+/**
+ * @file batch-rename.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+
+#include "batch-rename.h"
+
+using namespace std;
+
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+#define PROGRESS_STEPS  256             // renames between two calls of the progress function
+
+static const guint NO_ITEM = G_MAXUINT;
+
+
+BatchRename::BatchRename(): n_tmp(0)
+{
+}
+
+
+BatchRename::~BatchRename()
+{
+    for (map<string,int>::iterator i=dir_fds.begin(); i!=dir_fds.end(); ++i)
+        if (i->second>=0)
+            close (i->second);
+}
+
+
+guint BatchRename::add(const gchar *dir, const gchar *old_name, const gchar *new_name)
+{
+    Item item;
+
+    item.dir = dir;
+    item.old_name = old_name;
+    item.new_name = new_name;
+    item.status = PENDING;
+    item.error = 0;
+
+    items.push_back(item);
+
+    return items.size()-1;
+}
+
+
+static inline string join_path (const string &dir, const string &name)
+{
+    return dir.empty() || dir[dir.size()-1]!=G_DIR_SEPARATOR ? dir + G_DIR_SEPARATOR + name : dir + name;
+}
+
+
+static inline gboolean is_valid_name (const string &name)
+{
+    return !name.empty() && name!="." && name!=".." && name.find(G_DIR_SEPARATOR)==string::npos;
+}
+
+
+guint BatchRename::check()
+{
+    map<string,guint> sources;              // path of the file before the rename -> item
+    map<string,guint> targets;              // path of the file after the rename -> item
+    vector<guint> conflicts;
+    struct stat st_source, st_target;
+
+    plan.clear();
+
+    for (guint n=0; n<items.size(); ++n)
+    {
+        Item &item = items[n];
+
+        if (item.status!=PENDING)
+            continue;
+
+        if (item.new_name==item.old_name)
+            item.status = UNCHANGED;
+        else
+            if (!is_valid_name (item.new_name))
+            {
+                item.status = CONFLICT;
+                item.error = EINVAL;
+            }
+
+        // the same file twice, only the first one may be renamed
+        if (!sources.insert(make_pair(join_path (item.dir, item.old_name), n)).second && item.status==PENDING)
+        {
+            item.status = CONFLICT;
+            item.error = EINVAL;
+        }
+    }
+
+    for (guint n=0; n<items.size(); ++n)
+    {
+        Item &item = items[n];
+
+        if (item.status!=PENDING)
+            continue;
+
+        pair<map<string,guint>::iterator,bool> target = targets.insert(make_pair(join_path (item.dir, item.new_name), n));
+
+        // two files getting the same name, neither of them is renamed
+        if (!target.second)
+        {
+            Item &other = items[target.first->second];
+
+            if (other.status==PENDING)
+            {
+                other.status = CONFLICT;
+                other.error = EEXIST;
+                conflicts.push_back(target.first->second);
+            }
+
+            item.status = CONFLICT;
+            item.error = EEXIST;
+            conflicts.push_back(n);
+        }
+    }
+
+    for (guint n=0; n<items.size(); ++n)
+    {
+        Item &item = items[n];
+
+        if (item.status!=PENDING)
+            continue;
+
+        string source_path = join_path (item.dir, item.old_name);
+        string target_path = join_path (item.dir, item.new_name);
+
+        if (lstat (source_path.c_str(), &st_source)!=0)
+        {
+            item.status = CONFLICT;
+            item.error = errno;
+            conflicts.push_back(n);
+            continue;
+        }
+
+        map<string,guint>::const_iterator blocker = sources.find(target_path);
+
+        // the name is freed by another rename, unless that one turns out to be a conflict
+        if (blocker!=sources.end() && blocker->second!=n && items[blocker->second].status==PENDING)
+            continue;
+
+        // an existing file, unless it is the file itself on a case insensitive file system
+        if (lstat (target_path.c_str(), &st_target)==0 && (st_target.st_dev!=st_source.st_dev || st_target.st_ino!=st_source.st_ino))
+        {
+            item.status = CONFLICT;
+            item.error = EEXIST;
+            conflicts.push_back(n);
+        }
+    }
+
+    // a file which isn't renamed keeps its name from the file waiting for it, and so on
+    while (!conflicts.empty())
+    {
+        guint c = conflicts.back();
+
+        conflicts.pop_back();
+
+        map<string,guint>::const_iterator waiting = targets.find(join_path (items[c].dir, items[c].old_name));
+
+        if (waiting!=targets.end() && items[waiting->second].status==PENDING)
+        {
+            items[waiting->second].status = CONFLICT;
+            items[waiting->second].error = EEXIST;
+            conflicts.push_back(waiting->second);
+        }
+    }
+
+    // order the renames, the file holding the new name of a file is renamed before it
+    vector<guint> blockers(items.size(), NO_ITEM);
+
+    for (guint n=0; n<items.size(); ++n)
+        if (items[n].status==PENDING)
+        {
+            map<string,guint>::const_iterator blocker = sources.find(join_path (items[n].dir, items[n].new_name));
+
+            if (blocker!=sources.end() && blocker->second!=n && items[blocker->second].status==PENDING)
+                blockers[n] = blocker->second;
+        }
+
+    enum {NEW, ON_PATH, PLANNED};
+
+    vector<guint8> state(items.size(), NEW);
+    vector<guint> path;
+    guint n_conflicts = 0;
+
+    for (guint n=0; n<items.size(); ++n)
+    {
+        if (items[n].status==CONFLICT)
+            ++n_conflicts;
+
+        if (items[n].status!=PENDING || state[n]!=NEW)
+            continue;
+
+        path.clear();
+
+        guint j = n;
+
+        for (; j!=NO_ITEM && state[j]==NEW; j=blockers[j])
+        {
+            state[j] = ON_PATH;
+            path.push_back(j);
+        }
+
+        guint cycle_start = path.size();
+
+        // a cycle, its first file is moved out of the way to a temporary name
+        if (j!=NO_ITEM && state[j]==ON_PATH)
+        {
+            cycle_start = find(path.begin(), path.end(), j) - path.begin();
+
+            Item &item = items[j];
+            string tmp_name = make_tmp_name(item.dir);
+            Step tmp_step = {j, item.old_name, tmp_name, FALSE};
+            Step final_step = {j, tmp_name, item.new_name, TRUE};
+
+            plan.push_back(tmp_step);
+
+            for (guint k=path.size()-1; k>cycle_start; --k)
+                add_step(path[k]);
+
+            plan.push_back(final_step);
+        }
+
+        for (guint k=cycle_start; k-->0; )
+            add_step(path[k]);
+
+        for (vector<guint>::const_iterator k=path.begin(); k!=path.end(); ++k)
+            state[*k] = PLANNED;
+    }
+
+    return n_conflicts;
+}
+
+
+void BatchRename::add_step(guint n)
+{
+    Step step = {n, items[n].old_name, items[n].new_name, TRUE};
+
+    plan.push_back(step);
+}
+
+
+string BatchRename::make_tmp_name(const string &dir)
+{
+    struct stat st;
+
+    for (;;)
+    {
+        gchar *name = g_strdup_printf (".gcmd-rename-%i-%u", (int) getpid (), n_tmp++);
+        string tmp_name = name;
+
+        g_free (name);
+
+        if (lstat (join_path (dir, tmp_name).c_str(), &st)!=0 && errno==ENOENT)
+            return tmp_name;
+    }
+}
+
+
+int BatchRename::get_dir_fd(const string &dir)
+{
+    map<string,int>::iterator i = dir_fds.find(dir);
+
+    if (i!=dir_fds.end())
+        return i->second;
+
+    int fd = open (dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd>=0)
+        dir_fds[dir] = fd;
+
+    return fd;
+}
+
+
+static gboolean is_same_file (int dir_fd, const char *name1, const char *name2)
+{
+    struct stat st1, st2;
+
+    return fstatat (dir_fd, name1, &st1, AT_SYMLINK_NOFOLLOW)==0 && fstatat (dir_fd, name2, &st2, AT_SYMLINK_NOFOLLOW)==0 &&
+           st1.st_dev==st2.st_dev && st1.st_ino==st2.st_ino;
+}
+
+
+// renames within dir without replacing an existing file, returns 0 or an errno
+int BatchRename::rename_at(const string &dir, const string &from, const string &to)
+{
+    int fd = get_dir_fd(dir);
+
+    if (fd<0)
+        return errno;
+
+#ifdef SYS_renameat2
+    static gboolean have_renameat2 = TRUE;
+
+    if (have_renameat2)
+    {
+        if (syscall (SYS_renameat2, fd, from.c_str(), fd, to.c_str(), RENAME_NOREPLACE)==0)
+            return 0;
+
+        // ENOSYS: an old kernel, EINVAL: a file system without support for the flag
+        if (errno==ENOSYS)
+            have_renameat2 = FALSE;
+        else
+            if (errno!=EINVAL && (errno!=EEXIST || !is_same_file (fd, from.c_str(), to.c_str())))
+                return errno;
+    }
+#endif
+
+    struct stat st;
+
+    if (fstatat (fd, to.c_str(), &st, AT_SYMLINK_NOFOLLOW)==0 && !is_same_file (fd, from.c_str(), to.c_str()))
+        return EEXIST;
+
+    return renameat (fd, from.c_str(), fd, to.c_str())==0 ? 0 : errno;
+}
+
+
+gboolean BatchRename::run(gboolean rollback, const gboolean *stop_flag, ProgressFunc progress, gpointer user_data)
+{
+    vector<guint> done;
+    gboolean failed = FALSE;
+
+    done.reserve(plan.size());
+
+    for (guint s=0; s<plan.size(); ++s)
+    {
+        if (stop_flag && *stop_flag)
+        {
+            failed = TRUE;
+            break;
+        }
+
+        const Step &step = plan[s];
+        Item &item = items[step.item];
+
+        if (item.status!=PENDING)           // the first step of a cycle has failed
+            continue;
+
+        int error = rename_at(item.dir, step.from, step.to);
+
+        if (error)
+        {
+            item.status = FAILED;
+            item.error = error;
+            failed = TRUE;
+
+            if (rollback)
+                break;
+
+            // don't leave the file under its temporary name, unless the rest of the cycle has taken its old one by now
+            if (step.from!=item.old_name && rename_at(item.dir, step.from, item.old_name)!=0)
+                item.tmp_name = step.from;
+
+            continue;
+        }
+
+        done.push_back(s);
+
+        if (step.last)
+            item.status = DONE;
+
+        if (progress && (s+1) % PROGRESS_STEPS==0)
+            progress(s+1, plan.size(), user_data);
+    }
+
+    if (failed && rollback)
+        for (vector<guint>::reverse_iterator s=done.rbegin(); s!=done.rend(); ++s)
+        {
+            const Step &step = plan[*s];
+            Item &item = items[step.item];
+
+            int error = rename_at(item.dir, step.to, step.from);
+
+            if (!error)
+            {
+                if (item.status!=FAILED)
+                    item.status = ROLLED_BACK;
+            }
+            else
+            {
+                g_warning ("Failed to rename %s back to %s in %s", step.to.c_str(), step.from.c_str(), item.dir.c_str());
+
+                if (!step.last)             // stuck under the temporary name of a cycle
+                {
+                    if (item.status!=FAILED)
+                        item.error = error;
+                    item.status = FAILED;
+                    item.tmp_name = step.to;
+                }
+            }
+        }
+
+    if (progress)
+        progress(plan.size(), plan.size(), user_data);
+
+    return !failed;
+}
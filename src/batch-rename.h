@@ -0,0 +1,105 @@
+/**
+ * @file batch-rename.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __BATCH_RENAME_H__
+#define __BATCH_RENAME_H__
+
+#include <glib.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * Renames many local files at once with plain POSIX calls.
+ *
+ * check() finds the renames which can't be done before anything is
+ * touched: two files getting the same name, invalid names, and names of
+ * existing files which are not renamed themselves. The others are ordered
+ * so that every file is renamed after the file holding its new name has
+ * been moved out of the way, and cycles like a->b, b->a go through a
+ * temporary name. No rename ever replaces an existing file.
+ *
+ * run() does the renames, typically in a thread of its own. If one of them
+ * fails and @a rollback is set, all renames done so far are undone. A file
+ * of a cycle which can't get back its old name stays under its temporary
+ * name, which get_tmp_name() tells.
+ */
+class BatchRename
+{
+  public:
+
+    enum Status
+    {
+        PENDING,
+        DONE,
+        UNCHANGED,              // the new name is the old one
+        CONFLICT,               // found by check(), error tells why
+        FAILED,
+        ROLLED_BACK
+    };
+
+    typedef void (* ProgressFunc) (guint done, guint total, gpointer user_data);      // called from the thread of run()
+
+    BatchRename();
+    ~BatchRename();
+
+    guint add(const gchar *dir, const gchar *old_name, const gchar *new_name);       // returns the index of the rename
+
+    guint check();                          // returns the number of conflicts
+    gboolean run(gboolean rollback, const gboolean *stop_flag=NULL, ProgressFunc progress=NULL, gpointer user_data=NULL);
+
+    guint size() const                      {  return items.size();  }
+    Status get_status(guint n) const        {  return items[n].status;  }
+    int get_error(guint n) const            {  return items[n].error;  }       // errno of a conflict or failed rename
+    const gchar *get_tmp_name(guint n) const        {  return items[n].tmp_name.empty() ? NULL : items[n].tmp_name.c_str();  }
+
+  private:
+
+    struct Item
+    {
+        std::string dir;
+        std::string old_name;
+        std::string new_name;
+        Status status;
+        int error;
+        std::string tmp_name;               // the file has been left under this name
+    };
+
+    struct Step                             // a single rename within a directory
+    {
+        guint item;
+        std::string from;
+        std::string to;
+        gboolean last;                      // the item has got its new name
+    };
+
+    std::vector<Item> items;
+    std::vector<Step> plan;                 // made by check()
+    std::map<std::string,int> dir_fds;
+    guint n_tmp;
+
+    int get_dir_fd(const std::string &dir);
+    int rename_at(const std::string &dir, const std::string &from, const std::string &to);
+    void add_step(guint n);                 // the rename of the item n in a single step
+    std::string make_tmp_name(const std::string &dir);
+};
+
+#endif // __BATCH_RENAME_H__
@@ -26,7 +26,12 @@
 #include <errno.h>
 #include <gtk/gtkdialog.h>
 
+#include <set>
+#include <vector>
+#include <algorithm>
+
 #include "gnome-cmd-includes.h"
+#include "batch-rename.h"
 #include "gnome-cmd-advrename-dialog.h"
 #include "gnome-cmd-advrename-lexer.h"
 #include "gnome-cmd-advrename-regex-dialog.h"
@@ -57,6 +62,34 @@ struct GnomeCmdAdvrenameDialog::Private
     GtkWidget *files_view;
     GtkWidget *profile_menu_button;
 
+    guint metadata_load_id;                             // metadata for $T() tags being loaded in the background
+    set<GnomeCmdTagClass> metadata_classes;
+
+    vector<GnomeCmd::RegexReplace *> preview_rx;        // the valid regexes of the profile
+    vector<gboolean> preview_done;                      // per row, whether its new name is up to date
+    gint preview_next;                                  // the first row the idle handler hasn't looked at yet
+    guint preview_idle_id;
+
+    BatchRename *batch;                                 // the renames of local files, done in batch_thread
+    vector<GtkTreeIter> batch_rows;                     // per rename of batch
+    GThread *batch_thread;
+    gboolean batch_stop;
+    gint batch_finished;
+    gint batch_done;
+    gint batch_total;
+    guint batch_updater_id;
+    gchar *old_focused_file_name;
+    gchar *new_focused_file_name;
+    GtkWidget *progress_bar;
+
+    void update_new_filename(GnomeCmdAdvrenameDialog *dialog, GtkTreeIter *iter, gint row);
+    void update_visible_new_filenames(GnomeCmdAdvrenameDialog *dialog);
+    void finish_new_filenames(GnomeCmdAdvrenameDialog *dialog);
+    void cancel_new_filenames();
+
+    void start_renames(GnomeCmdAdvrenameDialog *dialog);
+    void finish_renames(GnomeCmdAdvrenameDialog *dialog);
+
     Private();
     ~Private();
 
@@ -73,7 +106,10 @@ struct GnomeCmdAdvrenameDialog::Private
     static void on_profile_template_changed (GnomeCmdAdvrenameProfileComponent *component, GnomeCmdAdvrenameDialog *dialog);
     static void on_profile_counter_changed (GnomeCmdAdvrenameProfileComponent *component, GnomeCmdAdvrenameDialog *dialog);
     static void on_profile_regex_changed (GnomeCmdAdvrenameProfileComponent *component, GnomeCmdAdvrenameDialog *dialog);
+    static void on_files_model_row_inserted (GtkTreeModel *files, GtkTreePath *path, GtkTreeIter *iter, GnomeCmdAdvrenameDialog *dialog);
     static void on_files_model_row_deleted (GtkTreeModel *files, GtkTreePath *path, GnomeCmdAdvrenameDialog *dialog);
+    static void on_files_view_scrolled (GtkAdjustment *adjustment, GnomeCmdAdvrenameDialog *dialog);
+    static gboolean on_preview_idle (GnomeCmdAdvrenameDialog *dialog);
     static void on_files_view_popup_menu__remove (GtkWidget *menuitem, GtkTreeView *treeview);
     static void on_files_view_popup_menu__view_file (GtkWidget *menuitem, GtkTreeView *treeview);
     static void on_files_view_popup_menu__show_properties (GtkWidget *menuitem, GtkTreeView *treeview);
@@ -87,6 +123,12 @@ struct GnomeCmdAdvrenameDialog::Private
     static gboolean on_dialog_delete (GtkWidget *widget, GdkEvent *event, GnomeCmdAdvrenameDialog *dialog);
     static void on_dialog_size_allocate (GtkWidget *widget, GtkAllocation *allocation, GnomeCmdAdvrenameDialog *dialog);
     static void on_dialog_response (GnomeCmdAdvrenameDialog *dialog, int response_id, gpointer data);
+
+    static void on_metadata_loaded (gboolean done, GnomeCmdAdvrenameDialog *dialog);
+
+    static gpointer rename_func (GnomeCmdAdvrenameDialog *dialog);
+    static void on_rename_progress (guint done, guint total, GnomeCmdAdvrenameDialog::Private *priv);
+    static gboolean update_rename_status (GnomeCmdAdvrenameDialog *dialog);
 };
 
 
@@ -97,11 +139,39 @@ inline GnomeCmdAdvrenameDialog::Private::Private()
     vbox = NULL;
     profile_component = NULL;
     files_view = NULL;
+    metadata_load_id = 0;
+    preview_next = 0;
+    preview_idle_id = 0;
+    batch = NULL;
+    batch_thread = NULL;
+    batch_stop = FALSE;
+    batch_finished = FALSE;
+    batch_done = 0;
+    batch_total = 0;
+    batch_updater_id = 0;
+    old_focused_file_name = NULL;
+    new_focused_file_name = NULL;
+    progress_bar = NULL;
 }
 
 
 inline GnomeCmdAdvrenameDialog::Private::~Private()
 {
+    gcmd_tags_cancel_load (metadata_load_id);
+    cancel_new_filenames();
+
+    if (batch_updater_id)
+        g_source_remove (batch_updater_id);
+
+    if (batch_thread)
+    {
+        batch_stop = TRUE;              // the renames done so far are undone
+        g_thread_join (batch_thread);
+    }
+
+    delete batch;
+    g_free (old_focused_file_name);
+    g_free (new_focused_file_name);
 }
 
 
@@ -244,8 +314,33 @@ void GnomeCmdAdvrenameDialog::Private::on_profile_regex_changed (GnomeCmdAdvrena
 }
 
 
+void GnomeCmdAdvrenameDialog::Private::on_files_model_row_inserted (GtkTreeModel *files, GtkTreePath *path, GtkTreeIter *iter, GnomeCmdAdvrenameDialog *dialog)
+{
+    vector<gboolean> &done = dialog->priv->preview_done;
+    gint row = gtk_tree_path_get_indices (path)[0];
+
+    if (row <= (gint) done.size())
+        done.insert(done.begin()+row, FALSE);
+
+    if (row < dialog->priv->preview_next)
+        dialog->priv->preview_next = row;
+
+    if (!dialog->priv->preview_idle_id)
+        dialog->priv->preview_idle_id = g_idle_add ((GSourceFunc) on_preview_idle, dialog);
+}
+
+
 void GnomeCmdAdvrenameDialog::Private::on_files_model_row_deleted (GtkTreeModel *files, GtkTreePath *path, GnomeCmdAdvrenameDialog *dialog)
 {
+    vector<gboolean> &done = dialog->priv->preview_done;
+    gint row = gtk_tree_path_get_indices (path)[0];
+
+    if (row < (gint) done.size())
+        done.erase(done.begin()+row);
+
+    if (row < dialog->priv->preview_next)
+        dialog->priv->preview_next--;
+
     if (dialog->priv->template_has_counters)
         dialog->update_new_filenames();
 }
@@ -441,61 +536,228 @@ void GnomeCmdAdvrenameDialog::Private::on_dialog_size_allocate (GtkWidget *widge
 }
 
 
-void GnomeCmdAdvrenameDialog::Private::on_dialog_response (GnomeCmdAdvrenameDialog *dialog, int response_id, gpointer unused)
+void GnomeCmdAdvrenameDialog::Private::on_metadata_loaded (gboolean done, GnomeCmdAdvrenameDialog *dialog)
+{
+    if (done)
+        dialog->priv->metadata_load_id = 0;
+
+    dialog->update_new_filenames();
+}
+
+
+gpointer GnomeCmdAdvrenameDialog::Private::rename_func (GnomeCmdAdvrenameDialog *dialog)
+{
+    Private *priv = dialog->priv;
+
+    priv->batch->run(TRUE, &priv->batch_stop, (BatchRename::ProgressFunc) on_rename_progress, priv);
+    g_atomic_int_set (&priv->batch_finished, TRUE);
+
+    return NULL;
+}
+
+
+// called by the batch renamer in its thread
+void GnomeCmdAdvrenameDialog::Private::on_rename_progress (guint done, guint total, GnomeCmdAdvrenameDialog::Private *priv)
+{
+    g_atomic_int_set (&priv->batch_done, done);
+    g_atomic_int_set (&priv->batch_total, total);
+}
+
+
+gboolean GnomeCmdAdvrenameDialog::Private::update_rename_status (GnomeCmdAdvrenameDialog *dialog)
+{
+    Private *priv = dialog->priv;
+    gint total = g_atomic_int_get (&priv->batch_total);
+
+    if (total)
+        gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (priv->progress_bar), (gdouble) g_atomic_int_get (&priv->batch_done) / total);
+
+    if (!g_atomic_int_get (&priv->batch_finished))
+        return TRUE;
+
+    priv->batch_updater_id = 0;
+    g_thread_join (priv->batch_thread);
+    priv->batch_thread = NULL;
+    priv->finish_renames(dialog);
+
+    return FALSE;
+}
+
+
+void GnomeCmdAdvrenameDialog::Private::start_renames(GnomeCmdAdvrenameDialog *dialog)
 {
     GtkTreeIter i;
-    gchar *old_focused_file_name = NULL;
-    gchar *new_focused_file_name = NULL;
 
-    switch (response_id)
+    old_focused_file_name = g_strdup (main_win->fs(ACTIVE)->file_list()->get_focused_file()->get_name());
+
+    batch = new BatchRename;
+    batch_rows.clear();
+
+    //  local files are renamed all at once in a thread, the others one by one by gnome-vfs
+    for (gboolean valid_iter=gtk_tree_model_get_iter_first (dialog->files, &i); valid_iter; valid_iter=gtk_tree_model_iter_next (dialog->files, &i))
     {
-        case GTK_RESPONSE_OK:
-        case GTK_RESPONSE_APPLY:
+        GnomeCmdFile *f;
+        gchar *new_name;
 
-            old_focused_file_name = main_win->fs(ACTIVE)->file_list()->get_focused_file()->get_name();
+        gtk_tree_model_get (dialog->files, &i,
+                            COL_FILE, &f,
+                            COL_NEW_NAME, &new_name,
+                            -1);
 
-            for (gboolean valid_iter=gtk_tree_model_get_iter_first (dialog->files, &i); valid_iter; valid_iter=gtk_tree_model_iter_next (dialog->files, &i))
+        if (strcmp (f->info->name, new_name) == 0)
+            gtk_list_store_set (GTK_LIST_STORE (dialog->files), &i,
+                                COL_RENAME_FAILED, FALSE,
+                                -1);
+        else
+            if (f->is_local())
             {
-                GnomeCmdFile *f;
-                gchar *new_name;
+                gchar *dir = f->get_unescaped_dirname();
 
-                gtk_tree_model_get (dialog->files, &i,
-                                    COL_FILE, &f,
-                                    COL_NEW_NAME, &new_name,
-                                    -1);
+                batch->add(dir, f->info->name, new_name);
+                batch_rows.push_back(i);
 
+                g_free (dir);
+            }
+            else
+            {
                 gchar *old_name = g_strdup (f->info->name);
-                GnomeVFSResult result = GNOME_VFS_OK;
-
-                if (strcmp (f->info->name, new_name) != 0)
-                    result = f->rename(new_name);
+                GnomeVFSResult result = f->rename(new_name);
 
                 gtk_list_store_set (GTK_LIST_STORE (dialog->files), &i,
                                     COL_NAME, f->get_name(),
                                     COL_RENAME_FAILED, result!=GNOME_VFS_OK,
                                     -1);
 
-                if (!new_focused_file_name && (result == GNOME_VFS_OK) && !strcmp(old_focused_file_name, old_name))
-                    new_focused_file_name = g_strdup(new_name);
+                if (!new_focused_file_name && result==GNOME_VFS_OK && !strcmp (old_focused_file_name, old_name))
+                    new_focused_file_name = g_strdup (new_name);
 
-                g_free (new_name);
                 g_free (old_name);
             }
-            if (new_focused_file_name)
-            {
-                main_win->fs(ACTIVE)->file_list()->focus_file(new_focused_file_name, TRUE);
-                g_free (new_focused_file_name);
-		new_focused_file_name = NULL;
-            }
-            dialog->update_new_filenames();
-            dialog->defaults.templates.add(dialog->priv->profile_component->get_template_entry());
-            dialog->priv->profile_component->set_template_history(dialog->defaults.templates.ents);
+
+        g_free (new_name);
+    }
+
+    if (!batch->size())
+    {
+        finish_renames(dialog);
+        return;
+    }
+
+    //  conflicting renames are left out, the others are undone if one of them fails
+    batch->check();
+
+    batch_stop = FALSE;
+    batch_finished = FALSE;
+    batch_done = 0;
+    batch_total = 0;
+
+    gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (progress_bar), 0.0);
+    gtk_widget_show (progress_bar);
+    gtk_widget_set_sensitive (files_view, FALSE);
+    gtk_widget_set_sensitive (*profile_component, FALSE);
+    gtk_dialog_set_response_sensitive (*dialog, GTK_RESPONSE_APPLY, FALSE);
+    gtk_dialog_set_response_sensitive (*dialog, GCMD_RESPONSE_RESET, FALSE);
+    gtk_dialog_set_response_sensitive (*dialog, GCMD_RESPONSE_PROFILES, FALSE);
+
+    batch_thread = g_thread_new (NULL, (GThreadFunc) rename_func, dialog);
+    batch_updater_id = g_timeout_add (gnome_cmd_data.gui_update_rate, (GSourceFunc) update_rename_status, dialog);
+}
+
+
+void GnomeCmdAdvrenameDialog::Private::finish_renames(GnomeCmdAdvrenameDialog *dialog)
+{
+    gchar *failed_msg = NULL;
+
+    for (guint n=0; n<batch->size(); ++n)
+    {
+        GtkTreeIter *i = &batch_rows[n];
+        GnomeCmdFile *f;
+        gchar *new_name;
+
+        gtk_tree_model_get (dialog->files, i,
+                            COL_FILE, &f,
+                            COL_NEW_NAME, &new_name,
+                            -1);
+
+        BatchRename::Status status = batch->get_status(n);
+
+        if (status==BatchRename::DONE)
+        {
+            if (!new_focused_file_name && !strcmp (old_focused_file_name, f->info->name))
+                new_focused_file_name = g_strdup (new_name);
+
+            f->renamed(new_name);
+        }
+        else
+            if (status==BatchRename::FAILED && !failed_msg)
+                failed_msg = batch->get_tmp_name(n) ?
+                             g_strdup_printf (_("Renaming %s failed: %s, it has been left as %s"), f->get_name(), g_strerror (batch->get_error(n)), batch->get_tmp_name(n)) :
+                             g_strdup_printf (_("Renaming %s failed: %s"), f->get_name(), g_strerror (batch->get_error(n)));
+
+        gtk_list_store_set (GTK_LIST_STORE (dialog->files), i,
+                            COL_NAME, f->get_name(),
+                            COL_RENAME_FAILED, status!=BatchRename::DONE && status!=BatchRename::UNCHANGED,
+                            -1);
+
+        g_free (new_name);
+    }
+
+    gtk_widget_hide (progress_bar);
+    gtk_widget_set_sensitive (files_view, TRUE);
+    gtk_widget_set_sensitive (*profile_component, TRUE);
+    gtk_dialog_set_response_sensitive (*dialog, GTK_RESPONSE_APPLY, TRUE);
+    gtk_dialog_set_response_sensitive (*dialog, GCMD_RESPONSE_RESET, TRUE);
+    gtk_dialog_set_response_sensitive (*dialog, GCMD_RESPONSE_PROFILES, TRUE);
+
+    if (new_focused_file_name)
+        main_win->fs(ACTIVE)->file_list()->focus_file(new_focused_file_name, TRUE);
+
+    if (failed_msg)
+    {
+        gnome_cmd_show_message (*dialog, failed_msg, _("The files renamed before were given back their old names."));
+        g_free (failed_msg);
+    }
+
+    delete batch;
+    batch = NULL;
+    batch_rows.clear();
+
+    g_free (old_focused_file_name);
+    g_free (new_focused_file_name);
+    old_focused_file_name = NULL;
+    new_focused_file_name = NULL;
+
+    dialog->update_new_filenames();
+    dialog->defaults.templates.add(profile_component->get_template_entry());
+    profile_component->set_template_history(dialog->defaults.templates.ents);
+}
+
+
+void GnomeCmdAdvrenameDialog::Private::on_dialog_response (GnomeCmdAdvrenameDialog *dialog, int response_id, gpointer unused)
+{
+    switch (response_id)
+    {
+        case GTK_RESPONSE_OK:
+        case GTK_RESPONSE_APPLY:
+            if (dialog->priv->batch_thread)
+                break;
+
+            //  the new names have to be made of the complete metadata
+            gcmd_tags_wait_load (dialog->priv->metadata_load_id);
+            dialog->priv->finish_new_filenames(dialog);
+            dialog->priv->start_renames(dialog);
             break;
 
         case GTK_RESPONSE_NONE:
         case GTK_RESPONSE_DELETE_EVENT:
         case GTK_RESPONSE_CANCEL:
         case GTK_RESPONSE_CLOSE:
+            if (dialog->priv->batch_thread)                             //  stop the renames, the done ones are undone
+            {
+                dialog->priv->batch_stop = TRUE;
+                g_signal_stop_emission_by_name (dialog, "response");
+                break;
+            }
             dialog->priv->profile_component->copy();
             gtk_widget_hide (*dialog);
             dialog->unset();
@@ -556,6 +818,10 @@ static void gnome_cmd_advrename_dialog_init (GnomeCmdAdvrenameDialog *dialog)
     dialog->priv->files_view = create_files_view ();
     gtk_container_add (GTK_CONTAINER (scrolled_window), dialog->priv->files_view);
 
+    dialog->priv->progress_bar = gtk_progress_bar_new ();
+    gtk_widget_set_no_show_all (dialog->priv->progress_bar, TRUE);
+    gtk_box_pack_start (GTK_BOX (vbox), dialog->priv->progress_bar, FALSE, FALSE, 0);
+
     GtkTreeSelection *selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (dialog->priv->files_view));
     gtk_tree_selection_set_mode (selection, GTK_SELECTION_BROWSE);
 }
@@ -645,7 +911,40 @@ void GnomeCmdAdvrenameDialog::update_new_filenames()
                                        defaults.default_profile.counter_step);
     GtkTreeIter i;
 
-    vector<GnomeCmd::RegexReplace *> rx;
+    //  start loading the metadata of $T() tags, new names are made again as it arrives
+    set<GnomeCmdTagClass> tag_classes;
+
+    gnome_cmd_advrename_get_tag_classes (tag_classes);
+
+    if (!priv->metadata_load_id || !includes (priv->metadata_classes.begin(), priv->metadata_classes.end(), tag_classes.begin(), tag_classes.end()))
+    {
+        GList *file_list = NULL;
+
+        for (gboolean valid_iter=gtk_tree_model_get_iter_first (files, &i); valid_iter; valid_iter=gtk_tree_model_iter_next (files, &i))
+        {
+            GnomeCmdFile *f;
+
+            gtk_tree_model_get (files, &i,
+                                COL_FILE, &f,
+                                -1);
+            if (f)
+                file_list = g_list_prepend (file_list, f);
+        }
+
+        if (priv->metadata_load_id)
+        {
+            gcmd_tags_cancel_load (priv->metadata_load_id);
+            tag_classes.insert (priv->metadata_classes.begin(), priv->metadata_classes.end());
+        }
+
+        priv->metadata_classes = tag_classes;
+        priv->metadata_load_id = gcmd_tags_load_async (file_list, tag_classes, (GnomeCmdTagsLoadFunc) Private::on_metadata_loaded, this);
+
+        g_list_free (file_list);
+    }
+
+    //  the new names of the visible rows are made at once, the others when idle
+    priv->preview_rx.clear();
 
     GtkTreeModel *regexes = priv->profile_component->get_regex_model();
 
@@ -657,38 +956,138 @@ void GnomeCmdAdvrenameDialog::update_new_filenames()
                             GnomeCmdAdvrenameProfileComponent::COL_REGEX, &r,
                             -1);
         if (r && *r)                            //  ignore regex pattern if it can't be retrieved or if it is malformed
-            rx.push_back(r);
+            priv->preview_rx.push_back(r);
     }
 
-    for (gboolean valid_iter=gtk_tree_model_get_iter_first (files, &i); valid_iter; valid_iter=gtk_tree_model_iter_next (files, &i))
+    priv->preview_done.assign(gtk_tree_model_iter_n_children (files, NULL), FALSE);
+    priv->preview_next = 0;
+
+    priv->update_visible_new_filenames(this);
+
+    if (!priv->preview_idle_id)
+        priv->preview_idle_id = g_idle_add ((GSourceFunc) Private::on_preview_idle, this);
+}
+
+
+void GnomeCmdAdvrenameDialog::Private::update_new_filename(GnomeCmdAdvrenameDialog *dialog, GtkTreeIter *iter, gint row)
+{
+    if (row >= (gint) preview_done.size() || preview_done[row])
+        return;
+
+    preview_done[row] = TRUE;
+
+    GnomeCmdFile *f;
+    gchar *old_new_name;
+
+    gtk_tree_model_get (dialog->files, iter,
+                        COL_FILE, &f,
+                        COL_NEW_NAME, &old_new_name,
+                        -1);
+    if (!f)
     {
-        GnomeCmdFile *f;
+        g_free (old_new_name);
+        return;
+    }
 
-        gtk_tree_model_get (files, &i,
-                            COL_FILE, &f,
-                            -1);
-        if (!f)
-            continue;
+    gchar *fname = gnome_cmd_advrename_gen_fname (f, row);
 
-        gchar *fname = gnome_cmd_advrename_gen_fname (f);
+    for (vector<GnomeCmd::RegexReplace *>::iterator j=preview_rx.begin(); j!=preview_rx.end(); ++j)
+    {
+        GnomeCmd::RegexReplace *&r = *j;
 
-        for (vector<GnomeCmd::RegexReplace *>::iterator j=rx.begin(); j!=rx.end(); ++j)
-        {
-            GnomeCmd::RegexReplace *&r = *j;
+        gchar *prev_fname = fname;
 
-            gchar *prev_fname = fname;
+        fname = r->replace(prev_fname);
 
-            fname = r->replace(prev_fname);
+        g_free (prev_fname);
+    }
 
-            g_free (prev_fname);
-        }
+    fname = profile_component->trim_blanks (profile_component->convert_case (fname));
 
-        fname = priv->profile_component->trim_blanks (priv->profile_component->convert_case (fname));
-        gtk_list_store_set (GTK_LIST_STORE (files), &i,
+    //  don't bother the view with rows which haven't changed
+    if (!old_new_name || strcmp (old_new_name, fname)!=0)
+        gtk_list_store_set (GTK_LIST_STORE (dialog->files), iter,
                             COL_NEW_NAME, fname,
                             -1);
-        g_free (fname);
+    g_free (fname);
+    g_free (old_new_name);
+}
+
+
+void GnomeCmdAdvrenameDialog::Private::update_visible_new_filenames(GnomeCmdAdvrenameDialog *dialog)
+{
+    GtkTreePath *start_path, *end_path;
+
+    if (!gtk_tree_view_get_visible_range (GTK_TREE_VIEW (files_view), &start_path, &end_path))
+        return;
+
+    gint row = gtk_tree_path_get_indices (start_path)[0];
+    gint end = gtk_tree_path_get_indices (end_path)[0];
+    GtkTreeIter iter;
+
+    for (gboolean valid_iter=gtk_tree_model_get_iter (dialog->files, &iter, start_path); valid_iter && row<=end; valid_iter=gtk_tree_model_iter_next (dialog->files, &iter), ++row)
+        update_new_filename(dialog, &iter, row);
+
+    gtk_tree_path_free (start_path);
+    gtk_tree_path_free (end_path);
+}
+
+
+gboolean GnomeCmdAdvrenameDialog::Private::on_preview_idle (GnomeCmdAdvrenameDialog *dialog)
+{
+    const gdouble PREVIEW_IDLE_TIME = 0.02;     //  seconds spent on new names per idle call
+
+    Private *priv = dialog->priv;
+    GtkTreeIter iter;
+    gint row = priv->preview_next;
+    GTimer *timer = g_timer_new ();
+    gboolean valid_iter;
+
+    for (valid_iter=gtk_tree_model_iter_nth_child (dialog->files, &iter, NULL, row); valid_iter; valid_iter=gtk_tree_model_iter_next (dialog->files, &iter))
+    {
+        priv->update_new_filename(dialog, &iter, row++);
+
+        if (row % 64==0 && g_timer_elapsed (timer, NULL) > PREVIEW_IDLE_TIME)
+            break;
     }
+
+    g_timer_destroy (timer);
+
+    priv->preview_next = row;
+
+    if (valid_iter && gtk_tree_model_iter_next (dialog->files, &iter))
+        return TRUE;
+
+    priv->preview_idle_id = 0;
+
+    return FALSE;
+}
+
+
+void GnomeCmdAdvrenameDialog::Private::finish_new_filenames(GnomeCmdAdvrenameDialog *dialog)
+{
+    GtkTreeIter iter;
+    gint row = 0;
+
+    for (gboolean valid_iter=gtk_tree_model_get_iter_first (dialog->files, &iter); valid_iter; valid_iter=gtk_tree_model_iter_next (dialog->files, &iter))
+        update_new_filename(dialog, &iter, row++);
+
+    cancel_new_filenames();
+}
+
+
+void GnomeCmdAdvrenameDialog::Private::cancel_new_filenames()
+{
+    if (preview_idle_id)
+        g_source_remove (preview_idle_id);
+    preview_idle_id = 0;
+}
+
+
+void GnomeCmdAdvrenameDialog::Private::on_files_view_scrolled (GtkAdjustment *adjustment, GnomeCmdAdvrenameDialog *dialog)
+{
+    if (dialog->priv->preview_idle_id)
+        dialog->priv->update_visible_new_filenames(dialog);
 }
 
 
@@ -721,7 +1120,9 @@ GnomeCmdAdvrenameDialog::GnomeCmdAdvrenameDialog(GnomeCmdData::AdvrenameConfig &
     g_signal_connect (priv->profile_component, "template-changed", G_CALLBACK (Private::on_profile_template_changed), this);
     g_signal_connect (priv->profile_component, "counter-changed", G_CALLBACK (Private::on_profile_counter_changed), this);
     g_signal_connect (priv->profile_component, "regex-changed", G_CALLBACK (Private::on_profile_regex_changed), this);
+    g_signal_connect (files, "row-inserted", G_CALLBACK (Private::on_files_model_row_inserted), this);
     g_signal_connect (files, "row-deleted", G_CALLBACK (Private::on_files_model_row_deleted), this);
+    g_signal_connect (gtk_tree_view_get_vadjustment (GTK_TREE_VIEW (priv->files_view)), "value-changed", G_CALLBACK (Private::on_files_view_scrolled), this);
     g_signal_connect (priv->files_view, "button-press-event", G_CALLBACK (Private::on_files_view_button_pressed), this);
     g_signal_connect (priv->files_view, "popup-menu", G_CALLBACK (Private::on_files_view_popup_menu), this);
     g_signal_connect (priv->files_view, "row-activated", G_CALLBACK (Private::on_files_view_row_activated), this);
@@ -776,6 +1177,12 @@ void GnomeCmdAdvrenameDialog::unset()
         f->unref();
     }
 
+    gcmd_tags_cancel_load (priv->metadata_load_id);
+    priv->metadata_load_id = 0;
+
+    priv->cancel_new_filenames();
+    priv->preview_done.clear();
+
     g_signal_handlers_block_by_func (files, gpointer (Private::on_files_model_row_deleted), this);
     gtk_list_store_clear (GTK_LIST_STORE (files));
     g_signal_handlers_unblock_by_func (files, gpointer (Private::on_files_model_row_deleted), this);
@@ -20,6 +20,10 @@
  */
 
 #include <config.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <glib/gstdio.h>
 
 #include "gnome-cmd-includes.h"
 #include "gnome-cmd-data.h"
@@ -27,6 +31,7 @@
 #include "gnome-cmd-file-list.h"
 #include "gnome-cmd-main-win.h"
 #include "utils.h"
+#include "local-delete.h"
 #include "dialogs/gnome-cmd-delete-dialog.h"
 
 using namespace std;
@@ -42,18 +47,30 @@ struct DeleteData
     gint problem_action;          // where the answer is delivered
     gchar *problem_file;          // the filename of the file that can't be deleted
     GnomeVFSResult vfs_status;    // the cause that the file cant be deleted
+    int error;                    // likewise, when local_delete can't delete it
     GThread *thread;              // the work thread
     GList *files;                 // the files that should be deleted
+    LocalDelete *local_delete;    // deletes them instead of gnome-vfs when they are all local
     gboolean stop;                // tells the work thread to stop working
     gboolean delete_done;         // tells the main thread that the work thread is done
     gchar *msg;                   // a message descriping the current status of the delete operation
     gfloat progress;              // a float values between 0 and 1 representing the progress of the whole operation
     GMutex mutex;                 // used to sync the main and worker thread
+    gchar *staging_list;          // names the hidden directories of a background delete until they are gone
+    int staging_list_fd;          // locked meanwhile
 };
 
 
 inline void cleanup (DeleteData *data)
 {
+    if (data->staging_list)
+    {
+        g_unlink (data->staging_list);
+        close (data->staging_list_fd);
+        g_free (data->staging_list);
+    }
+
+    delete data->local_delete;
     gnome_cmd_file_list_free (data->files);
     g_free (data);
 }
@@ -108,6 +125,55 @@ static gint delete_progress_callback (GnomeVFSXferProgressInfo *info, DeleteData
 }
 
 
+static LocalDelete::ErrorAnswer local_delete_error (const gchar *path, int error, DeleteData *data)
+{
+    g_mutex_lock (&data->mutex);
+
+    data->error = error;
+    data->problem_file = g_filename_display_name (path);
+    data->problem = TRUE;
+
+    g_mutex_unlock (&data->mutex);
+    while (data->problem_action == -1)
+        g_thread_yield ();
+    g_mutex_lock (&data->mutex);
+
+    gint ret = data->problem_action;
+
+    data->problem_action = -1;
+    g_free (data->problem_file);
+    data->problem_file = NULL;
+    data->error = 0;
+
+    g_mutex_unlock (&data->mutex);
+
+    return (LocalDelete::ErrorAnswer) ret;
+}
+
+
+// turns the progress of the local deletion into the fields delete_progress_callback() fills for gnome-vfs
+inline void update_local_delete_progress (DeleteData *data)
+{
+    LocalDelete::Progress progress;
+
+    data->local_delete->get_progress(progress);
+
+    if (progress.files_found == 0)
+        return;
+
+    // the total grows while the directories are read
+    gfloat f = (gfloat) progress.files_done/(gfloat) progress.files_found;
+    g_free (data->msg);
+    data->msg = g_strdup_printf (ngettext("Deleted %ld of %ld file",
+                                          "Deleted %ld of %ld files",
+                                          progress.files_found),
+                                 (glong) progress.files_done, (glong) progress.files_found);
+    if (f < 0.001f) f = 0.001f;
+    if (f > 0.999f) f = 0.999f;
+    data->progress = f;
+}
+
+
 static void on_cancel (GtkButton *btn, DeleteData *data)
 {
     data->stop = TRUE;
@@ -160,6 +226,13 @@ inline void create_delete_progress_win (DeleteData *data)
 
 static void perform_delete_operation (DeleteData *data)
 {
+    if (data->local_delete)
+    {
+        data->local_delete->run(&data->stop, (LocalDelete::ErrorFunc) local_delete_error, data);
+        data->delete_done = TRUE;
+        return;
+    }
+
     GList *uri_list = NULL;
 
     // go through all files and add the uri of the appropriate ones to a list
@@ -196,12 +269,15 @@ static gboolean update_delete_status_widgets (DeleteData *data)
 {
     g_mutex_lock (&data->mutex);
 
+    if (data->local_delete)
+        update_local_delete_progress (data);
+
     gtk_label_set_text (GTK_LABEL (data->proglabel), data->msg);
     gtk_progress_set_percentage (GTK_PROGRESS (data->progbar), data->progress);
 
     if (data->problem)
     {
-        const gchar *error = gnome_vfs_result_to_string (data->vfs_status);
+        const gchar *error = data->error ? g_strerror (data->error) : gnome_vfs_result_to_string (data->vfs_status);
         gchar *msg = g_strdup_printf (_("Error while deleting \"%s\"\n\n%s"), data->problem_file, error);
 
         data->problem_action = run_simple_dialog (
@@ -255,6 +331,132 @@ inline void do_delete (DeleteData *data)
 }
 
 
+// returns NULL unless all files are local
+static LocalDelete *create_local_delete (GList *files)
+{
+    LocalDelete *local_delete = new LocalDelete;
+
+    for (GList *i=files; i; i=i->next)
+    {
+        GnomeCmdFile *f = (GnomeCmdFile *) i->data;
+
+        if (f->is_dotdot || strcmp(f->info->name, ".") == 0)
+            continue;
+
+        gchar *path = f->is_local() ? f->get_real_path() : NULL;
+
+        if (!path)
+        {
+            delete local_delete;
+            return NULL;
+        }
+
+        local_delete->add(path);
+        g_free (path);
+    }
+
+    return local_delete;
+}
+
+
+static void perform_background_delete (DeleteData *data)
+{
+    data->local_delete->run(&data->stop);
+    data->delete_done = TRUE;
+}
+
+
+static gboolean check_background_delete (DeleteData *data)
+{
+    if (!data->delete_done)
+        return TRUE;
+
+    g_thread_join (data->thread);
+
+    LocalDelete::Progress progress;
+
+    data->local_delete->get_progress(progress);
+
+    if (progress.files_failed)
+    {
+        string dirs;
+
+        for (vector<string>::const_iterator i=data->local_delete->get_items().begin(); i!=data->local_delete->get_items().end(); ++i)
+            dirs += *i + '\n';
+
+        gnome_cmd_show_message (*main_win, _("Some files could not be deleted, they are left in:"), dirs.c_str());
+    }
+
+    cleanup (data);
+
+    return FALSE;
+}
+
+
+inline gchar *get_staging_list_dir ()
+{
+    return config_dir ? g_build_filename (config_dir, "delete-staging", NULL) : g_build_filename (g_get_home_dir (), "." PACKAGE, "delete-staging", NULL);
+}
+
+
+// remembers the hidden directories, so they are deleted at the next start if this one doesn't get to it
+static void write_staging_list (DeleteData *data)
+{
+    static guint lists = 0;
+    gchar *dir = get_staging_list_dir ();
+
+    if (g_mkdir_with_parents (dir, 0700)==0)
+    {
+        gchar *fname = g_strdup_printf ("%ld-%d-%u.list", (long) time (NULL), (int) getpid (), lists++);
+        gchar *path = g_build_filename (dir, fname, NULL);
+        int fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        string s;
+
+        for (vector<string>::const_iterator i=data->local_delete->get_items().begin(); i!=data->local_delete->get_items().end(); ++i)
+            s += *i + '\n';
+
+        if (fd>=0 && flock (fd, LOCK_EX)==0 && write (fd, s.data(), s.size())==(ssize_t) s.size())
+        {
+            data->staging_list = path;
+            data->staging_list_fd = fd;
+        }
+        else
+        {
+            if (fd>=0)
+            {
+                g_unlink (path);
+                close (fd);
+            }
+
+            g_free (path);
+        }
+
+        g_free (fname);
+    }
+
+    g_free (dir);
+}
+
+
+/**
+ * The files have been moved out of sight by LocalDelete::stage() already,
+ * so they leave the file lists at once and are deleted without a
+ * progress window. Errors are skipped and reported at the end.
+ */
+inline void do_background_delete (DeleteData *data)
+{
+    for (GList *i = data->files; i; i = i->next)
+        GNOME_CMD_FILE (i->data)->is_deleted();
+
+    if (!data->staging_list)
+        write_staging_list (data);
+
+    data->delete_done = FALSE;
+    data->thread = g_thread_new (NULL, (GThreadFunc) perform_background_delete, data);
+    g_timeout_add (gnome_cmd_data.gui_update_rate, (GSourceFunc) check_background_delete, data);
+}
+
+
 void gnome_cmd_delete_dialog_show (GList *files)
 {
     g_return_if_fail (files != NULL);
@@ -297,11 +499,89 @@ void gnome_cmd_delete_dialog_show (GList *files)
     DeleteData *data = g_new0 (DeleteData, 1);
 
     data->files = gnome_cmd_file_list_copy (files);
+    data->local_delete = create_local_delete (data->files);
     // data->stop = FALSE;
     // data->problem = FALSE;
     // data->delete_done = FALSE;
     // data->mutex = NULL;
     // data->msg = NULL;
 
-    do_delete (data);
+    if (data->local_delete && gnome_cmd_data.background_delete && data->local_delete->stage())
+        do_background_delete (data);
+    else
+        do_delete (data);
+}
+
+
+// deletes the hidden directories left behind by a crash or by quitting while a background delete ran
+static gboolean delete_staging_leftovers (gpointer unused)
+{
+    gchar *list_dir = get_staging_list_dir ();
+    GDir *dir = g_dir_open (list_dir, 0, NULL);
+    const gchar *fname;
+
+    while (dir && (fname = g_dir_read_name (dir)))
+    {
+        if (!g_str_has_suffix (fname, ".list"))
+            continue;
+
+        gchar *path = g_build_filename (list_dir, fname, NULL);
+        int fd = open (path, O_RDONLY | O_CLOEXEC);
+
+        // another instance may still be deleting them
+        if (fd<0 || flock (fd, LOCK_EX | LOCK_NB)!=0)
+        {
+            if (fd>=0)
+                close (fd);
+
+            g_free (path);
+            continue;
+        }
+
+        gchar *contents = NULL;
+        LocalDelete *local_delete = new LocalDelete;
+
+        if (g_file_get_contents (path, &contents, NULL, NULL))
+        {
+            gchar **lines = g_strsplit (contents, "\n", -1);
+
+            // nothing but the directories LocalDelete::stage() makes is deleted
+            for (gchar **i=lines; *i; ++i)
+                if (LocalDelete::is_staged(*i) && g_file_test (*i, G_FILE_TEST_IS_DIR))
+                    local_delete->add(*i);
+
+            g_strfreev (lines);
+            g_free (contents);
+        }
+
+        if (local_delete->get_items().empty())
+        {
+            delete local_delete;
+            g_unlink (path);
+            close (fd);
+            g_free (path);
+            continue;
+        }
+
+        DeleteData *data = g_new0 (DeleteData, 1);
+
+        data->local_delete = local_delete;
+        data->staging_list = path;
+        data->staging_list_fd = fd;
+
+        do_background_delete (data);
+    }
+
+    if (dir)
+        g_dir_close (dir);
+
+    g_free (list_dir);
+
+    return FALSE;
+}
+
+
+void gnome_cmd_delete_init ()
+{
+    g_timeout_add (1, delete_staging_leftovers, NULL);
 }
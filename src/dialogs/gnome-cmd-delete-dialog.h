@@ -23,4 +23,6 @@
 
 void gnome_cmd_delete_dialog_show (GList *files);
 
+void gnome_cmd_delete_init ();
+
 #endif // __GNOME_CMD_DELETE_DIALOG_H__
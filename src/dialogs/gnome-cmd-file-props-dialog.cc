@@ -67,53 +67,11 @@ struct GnomeCmdFilePropsDialogPrivate
 };
 
 
-static void calc_tree_size_r (GnomeCmdFilePropsDialogPrivate *data, GnomeVFSURI *uri)
+// called by the tree size service with the totals so far
+static void update_tree_size (const TreeSize &done, GnomeCmdFilePropsDialogPrivate *data)
 {
-    GList *list = NULL;
-    gchar *uri_str;
-
-    if (data->stop)
-        g_thread_exit (NULL);
-
-    if (!uri) return;
-    uri_str = gnome_vfs_uri_to_string (uri, GNOME_VFS_URI_HIDE_PASSWORD);
-    if (!uri_str) return;
-
-    GnomeVFSResult result = gnome_vfs_directory_list_load (&list, uri_str, GNOME_VFS_FILE_INFO_DEFAULT);
-
-    if (result != GNOME_VFS_OK) return;
-    if (!list) return;
-
-    for (GList *i = list; i; i = i->next)
-    {
-        GnomeVFSFileInfo *info = (GnomeVFSFileInfo *) i->data;
-
-        if (strcmp (info->name, ".") != 0 && strcmp (info->name, "..") != 0)
-        {
-            if (info->type == GNOME_VFS_FILE_TYPE_DIRECTORY)
-            {
-                GnomeVFSURI *new_uri = gnome_vfs_uri_append_file_name (uri, info->name);
-                calc_tree_size_r (data, new_uri);
-                gnome_vfs_uri_unref (new_uri);
-            }
-            else
-                data->size += info->size;
-        }
-    }
-
-    for (GList *i = list; i; i = i->next)
-    {
-        GnomeVFSFileInfo *info = (GnomeVFSFileInfo *) i->data;
-        gnome_vfs_file_info_unref (info);
-    }
-
-    g_list_free (list);
-    g_free (uri_str);
-
-    if (data->stop)
-        g_thread_exit (NULL);
-
     g_mutex_lock (&data->mutex);
+    data->size = done.size;
     g_free (data->msg);
     data->msg = create_nice_size_str (data->size);
     g_mutex_unlock (&data->mutex);
@@ -122,7 +80,16 @@ static void calc_tree_size_r (GnomeCmdFilePropsDialogPrivate *data, GnomeVFSURI
 
 static void calc_tree_size_func (GnomeCmdFilePropsDialogPrivate *data)
 {
-    calc_tree_size_r (data, data->uri);
+    GnomeVFSFileSize size = calc_tree_size (data->uri, NULL, &data->stop, (TreeSizeService::ProgressFunc) update_tree_size, data);
+
+    if (!data->stop)
+    {
+        g_mutex_lock (&data->mutex);
+        data->size = size;
+        g_free (data->msg);
+        data->msg = create_nice_size_str (data->size);
+        g_mutex_unlock (&data->mutex);
+    }
 
     data->count_done = TRUE;
 }
@@ -21,7 +21,8 @@
 
 #include <config.h>
 #include <sys/types.h>
-#include <regex.h>
+#include <sys/socket.h>
+#include <fcntl.h>
 
 #include "gnome-cmd-includes.h"
 #include "gnome-cmd-data.h"
@@ -34,6 +35,8 @@
 #include "gnome-cmd-selection-profile-component.h"
 #include "gnome-cmd-manage-profiles-dialog.h"
 #include "filter.h"
+#include "gnome-cmd-search-index.h"
+#include "search-engine.h"
 #include "utils.h"
 
 using namespace std;
@@ -47,9 +50,6 @@ static char *msgs[] = {N_("Search local directories only"),
 
 #define PBAR_MAX   50 /**< Absolute width of a progress bar */
 
-#define SEARCH_JUMP_SIZE     4096U
-#define SEARCH_BUFFER_SIZE  (SEARCH_JUMP_SIZE * 10U)
-
 #define GNOME_SEARCH_TOOL_REFRESH_DURATION  50000
 
 
@@ -59,14 +59,11 @@ struct GnomeCmdSearchDialogClass
 };
 
 
-struct SearchFileData
+struct ContentSearchJob
 {
-    GnomeVFSResult  result;
-    gchar          *uri_str;
-    GnomeVFSHandle *handle;
-    gint            offset;
-    guint           len;
-    gchar           mem[SEARCH_BUFFER_SIZE];     /**< memory to search in the content of a file */
+    GnomeCmdFile     *f;                        /**< refed by the search thread, unrefed in the main thread */
+    gchar            *uri_str;
+    GnomeVFSFileSize  size;
 };
 
 
@@ -75,10 +72,11 @@ struct SearchData
     struct ProtectedData
     {
         GList  *files;
+        GList  *unmatched;                      /**< files rejected by the content search, to be unrefed in the main thread */
         gchar  *msg;
         GMutex *mutex;
 
-        ProtectedData(): files(0), msg(0), mutex(0)     {}
+        ProtectedData(): files(0), unmatched(0), msg(0), mutex(0)     {}
     };
 
     GnomeCmdSearchDialog *dialog;
@@ -86,7 +84,12 @@ struct SearchData
     GnomeCmdDir *start_dir;                     /**< the directory to start searching from */
 
     Filter *name_filter;
-    regex_t *content_regex;
+    ContentMatcher *content_matcher;
+    GThreadPool *content_pool;                  /**< the threads checking the content of the files found by search_dir_r() */
+    LocalSearch *local_search;                  /**< the native search of local directories */
+    gchar *local_search_path;
+    int found_fd;                               /**< the local search writes the paths of the files found here */
+    GMutex *found_mutex;                        /**< keeps the lines written to found_fd in one piece */
     gint context_id;                            /**< the context id of the status bar */
     GList *match_dirs;                          /**< the directories which we found matching files in */
     GThread *thread;
@@ -100,15 +103,15 @@ struct SearchData
     explicit SearchData(GnomeCmdSearchDialog *dlg);
 
     void set_statusmsg(const gchar *msg=NULL);
-    gchar *build_search_command();
     void search_dir_r(GnomeCmdDir *dir, long level);  /**< searches a given directory for files that matches the criteria given by data */
 
     gboolean name_matches(gchar *name)   {  return name_filter->match(name);  }     /**< determines if the name of a file matches an regexp */
-    gboolean content_matches(GnomeCmdFile *f);                                      /**< determines if the content of a file matches an regexp */
-    gboolean read_search_file(SearchFileData *, GnomeCmdFile *f);                   /**< loads a file in chunks and returns the content */
+    gboolean content_matches(ContentSearchJob *job);                                /**< reads a file in big chunks and checks its content, called from the content pool */
     gboolean start_generic_search();
     gboolean start_local_search();
 
+    static void check_content_func(ContentSearchJob *job, SearchData *data);
+    static void local_file_found(const gchar *path, SearchData *data);
     static gboolean join_thread_func(SearchData *data);
 };
 
@@ -268,7 +271,12 @@ inline SearchData::SearchData(GnomeCmdSearchDialog *dlg): dialog(dlg)
     start_dir = NULL;
 
     name_filter = NULL;
-    content_regex = NULL;
+    content_matcher = NULL;
+    content_pool = NULL;
+    local_search = NULL;
+    local_search_path = NULL;
+    found_fd = -1;
+    found_mutex = NULL;
     context_id = 0;
     match_dirs = NULL;
     thread = NULL;
@@ -283,91 +291,53 @@ inline SearchData::SearchData(GnomeCmdSearchDialog *dlg): dialog(dlg)
 G_DEFINE_TYPE (GnomeCmdSearchDialog, gnome_cmd_search_dialog, GTK_TYPE_DIALOG)
 
 
-inline void free_search_file_data (SearchFileData *searchfile_data)
+static gssize read_vfs_handle (GnomeVFSHandle *handle, gchar *buf, gsize count)
 {
-    if (searchfile_data->handle)
-        gnome_vfs_close (searchfile_data->handle);
+    GnomeVFSFileSize bytes_read;
+    GnomeVFSResult result = gnome_vfs_read (handle, buf, count, &bytes_read);
+
+    if (result == GNOME_VFS_ERROR_EOF)
+        return 0;
 
-    g_free (searchfile_data->uri_str);
-    g_free (searchfile_data);
+    return result==GNOME_VFS_OK ? (gssize) bytes_read : -1;
 }
 
 
-gboolean SearchData::read_search_file(SearchFileData *searchfile_data, GnomeCmdFile *f)
+gboolean SearchData::content_matches(ContentSearchJob *job)
 {
-    if (stopped)     // if the stop button was pressed, let's abort here
-    {
-        free_search_file_data (searchfile_data);
+    if (job->size==0)
         return FALSE;
-    }
 
-    if (searchfile_data->len)
-    {
-      if ((searchfile_data->offset + searchfile_data->len) >= f->info->size)   // end, all has been read
-      {
-          free_search_file_data (searchfile_data);
-          return FALSE;
-      }
-
-      // jump a big step backward to give the regex a chance
-      searchfile_data->offset += searchfile_data->len - SEARCH_JUMP_SIZE;
-      if (f->info->size < (searchfile_data->offset + (SEARCH_BUFFER_SIZE - 1)))
-          searchfile_data->len = f->info->size - searchfile_data->offset;
-      else
-          searchfile_data->len = SEARCH_BUFFER_SIZE - 1;
-    }
-    else   // first time call of this function
-        searchfile_data->len = MIN (f->info->size, SEARCH_BUFFER_SIZE - 1);
+    GnomeVFSHandle *handle;
+    GnomeVFSResult result = gnome_vfs_open (&handle, job->uri_str, GNOME_VFS_OPEN_READ);
 
-    searchfile_data->result = gnome_vfs_seek (searchfile_data->handle, GNOME_VFS_SEEK_START, searchfile_data->offset);
-    if (searchfile_data->result != GNOME_VFS_OK)
+    if (result != GNOME_VFS_OK)
     {
-        g_warning (_("Failed to read file %s: %s"), searchfile_data->uri_str, gnome_vfs_result_to_string (searchfile_data->result));
-        free_search_file_data (searchfile_data);
+        g_warning (_("Failed to read file %s: %s"), job->uri_str, gnome_vfs_result_to_string (result));
         return FALSE;
     }
 
-    GnomeVFSFileSize ret;
-    searchfile_data->result = gnome_vfs_read (searchfile_data->handle, searchfile_data->mem, searchfile_data->len, &ret);
-    if (searchfile_data->result != GNOME_VFS_OK)
-    {
-        g_warning (_("Failed to read file %s: %s"), searchfile_data->uri_str, gnome_vfs_result_to_string (searchfile_data->result));
-        free_search_file_data (searchfile_data);
-        return FALSE;
-    }
+    gboolean found = content_matcher->matches((ContentMatcher::ReadFunc) read_vfs_handle, handle, job->size, &stopped);
 
-    searchfile_data->mem[searchfile_data->len] = '\0';
+    gnome_vfs_close (handle);
 
-    return TRUE;
+    return found;
 }
 
 
-inline gboolean SearchData::content_matches(GnomeCmdFile *f)
+void SearchData::check_content_func(ContentSearchJob *job, SearchData *data)
 {
-    g_return_val_if_fail (f != NULL, FALSE);
-    g_return_val_if_fail (f->info != NULL, FALSE);
-
-    if (f->info->size==0)
-        return FALSE;
-
-    SearchFileData *search_file = g_new0 (SearchFileData, 1);
-    search_file->uri_str = f->get_uri_str();
-    search_file->result  = gnome_vfs_open (&search_file->handle, search_file->uri_str, GNOME_VFS_OPEN_READ);
-
-    if (search_file->result != GNOME_VFS_OK)
-    {
-        g_warning (_("Failed to read file %s: %s"), search_file->uri_str, gnome_vfs_result_to_string (search_file->result));
-        free_search_file_data (search_file);
-        return FALSE;
-    }
-
-    regmatch_t match;
+    gboolean found = !data->stopped && data->content_matches(job);
 
-    while (read_search_file(search_file, f))
-        if (regexec (content_regex, search_file->mem, 1, &match, 0) != REG_NOMATCH)
-            return TRUE;        // stop on first match
+    g_mutex_lock (data->pdata.mutex);
+    if (found)
+        data->pdata.files = g_list_prepend (data->pdata.files, job->f);
+    else
+        data->pdata.unmatched = g_list_prepend (data->pdata.unmatched, job->f);
+    g_mutex_unlock (data->pdata.mutex);
 
-    return FALSE;
+    g_free (job->uri_str);
+    g_free (job);
 }
 
 
@@ -445,15 +415,25 @@ void SearchData::search_dir_r(GnomeCmdDir *dir, long level)
                 if (!name_matches(f->info->name))                       // if the name doesn't match, let's go to the next file
                     continue;
 
-                if (dialog->defaults.default_profile.content_search && !content_matches(f))              // if the user wants to we should do some content matching here
-                    continue;
+                if (dialog->defaults.default_profile.content_search)   // if the user wants to we should do some content matching here
+                {
+                    ContentSearchJob *job = g_new (ContentSearchJob, 1);     // the pool adds the file to the list if its content matches
 
-                g_mutex_lock (pdata.mutex);                             // the file matched the search criteria, let's add it to the list
-                pdata.files = g_list_append (pdata.files, f->ref());
-                g_mutex_unlock (pdata.mutex);
+                    job->f = f->ref();
+                    job->uri_str = f->get_uri_str();
+                    job->size = f->info->size;
 
-                if (g_list_index (match_dirs, dir) == -1)               // also ref each directory that has a matching file
-                    match_dirs = g_list_append (match_dirs, gnome_cmd_dir_ref (dir));
+                    g_thread_pool_push (content_pool, job, NULL);
+                }
+                else
+                {
+                    g_mutex_lock (pdata.mutex);                         // the file matched the search criteria, let's add it to the list
+                    pdata.files = g_list_prepend (pdata.files, f->ref());
+                    g_mutex_unlock (pdata.mutex);
+                }
+
+                if (!match_dirs || match_dirs->data!=dir)               // also ref each directory that has a (possibly) matching file
+                    match_dirs = g_list_prepend (match_dirs, gnome_cmd_dir_ref (dir));
             }
     }
 }
@@ -471,16 +451,19 @@ static gpointer perform_search_operation (SearchData *data)
 
     data->search_dir_r(data->start_dir, data->dialog->defaults.default_profile.max_depth);
 
+    // wait for the content checks of the files found
+    if (data->content_pool)
+    {
+        g_thread_pool_free (data->content_pool, FALSE, TRUE);
+        data->content_pool = NULL;
+    }
+
     // free regexps
     delete data->name_filter;
     data->name_filter = NULL;
 
-    if (data->dialog->defaults.default_profile.content_search)
-    {
-        regfree (data->content_regex);
-        g_free (data->content_regex);
-        data->content_regex = NULL;
-    }
+    delete data->content_matcher;
+    data->content_matcher = NULL;
 
     gnome_cmd_dir_unref (data->start_dir);      //  FIXME:  ???
     data->start_dir = NULL;
@@ -499,8 +482,10 @@ static gboolean update_search_status_widgets (SearchData *data)
     {
         g_mutex_lock (data->pdata.mutex);
 
-        GList *files = data->pdata.files;
+        GList *files = g_list_reverse (data->pdata.files);
+        GList *unmatched = data->pdata.unmatched;
         data->pdata.files = NULL;
+        data->pdata.unmatched = NULL;
 
         data->set_statusmsg(data->pdata.msg);                       // update status bar with the latest message
 
@@ -512,6 +497,7 @@ static gboolean update_search_status_widgets (SearchData *data)
             fl->append_file(GNOME_CMD_FILE (i->data));
 
         gnome_cmd_file_list_free (files);
+        gnome_cmd_file_list_free (unmatched);
     }
 
     if (!data->search_done && !data->stopped || data->pdata.files)
@@ -566,6 +552,9 @@ gboolean SearchData::join_thread_func (SearchData *data)
     if (data->pdata.mutex)
         g_mutex_free (data->pdata.mutex);
 
+    if (data->found_mutex)
+        g_mutex_free (data->found_mutex);
+
     return FALSE;
 }
 
@@ -575,15 +564,17 @@ gboolean SearchData::start_generic_search()
     // create an re for file name matching
     name_filter = new Filter(dialog->defaults.default_profile.filename_pattern.c_str(), dialog->defaults.default_profile.match_case, dialog->defaults.default_profile.syntax);
 
-    // if we're going to search through file content create an re for that too
+    if (!pdata.mutex)
+        pdata.mutex = g_mutex_new ();
+
+    // if we're going to search through file content create an re for that too, and the threads to check the files
     if (dialog->defaults.default_profile.content_search)
     {
-        content_regex = g_new0 (regex_t, 1);
-        regcomp (content_regex, dialog->defaults.default_profile.text_pattern.c_str(), dialog->defaults.default_profile.match_case ? 0 : REG_ICASE);
-    }
+        content_matcher = new ContentMatcher(dialog->defaults.default_profile.text_pattern.c_str(), dialog->defaults.default_profile.match_case, FALSE);
 
-    if (!pdata.mutex)
-        pdata.mutex = g_mutex_new ();
+        gint n_threads = gnome_cmd_data.search_threads ? gnome_cmd_data.search_threads : g_get_num_processors ();
+        content_pool = g_thread_pool_new ((GFunc) check_content_func, this, n_threads, FALSE, NULL);
+    }
 
     thread = g_thread_create ((GThreadFunc) perform_search_operation, this, TRUE, NULL);
 
@@ -592,101 +583,53 @@ gboolean SearchData::start_generic_search()
 
 
 /**
- * local search - using findutils
+ * local search - the search engine runs in its own thread and writes the
+ * paths of the files found into a socket, which is read on the main thread
  */
-gchar *SearchData::build_search_command()
+void SearchData::local_file_found(const gchar *path, SearchData *data)
 {
-    gchar *file_pattern_utf8 = g_strdup (dialog->defaults.default_profile.filename_pattern.c_str());
-    GError *error = NULL;
+    gchar *line = g_strconcat (path, "\n", NULL);
+    gsize len = strlen (line);
+    gsize written = 0;
 
-    switch (dialog->defaults.default_profile.syntax)
-    {
-        case Filter::TYPE_FNMATCH:
-            if (!file_pattern_utf8 || !*file_pattern_utf8)
-            {
-                g_free (file_pattern_utf8);
-                file_pattern_utf8 = g_strdup ("*");
-            }
-            else
-                if (!g_utf8_strchr (file_pattern_utf8, -1, '*') && !g_utf8_strchr (file_pattern_utf8, -1, '?'))
-                {
-                    gchar *tmp = file_pattern_utf8;
-                    file_pattern_utf8 = g_strconcat ("*", file_pattern_utf8, "*", NULL);
-                    g_free (tmp);
-                }
-            break;
-
-        case Filter::TYPE_REGEX:
-            break;
-
-        default:
-            break;
-    }
-
-    gchar *file_pattern_locale = g_locale_from_utf8 (file_pattern_utf8, -1, NULL, NULL, &error);
-
-    if (!file_pattern_locale)
-    {
-        gnome_cmd_error_message (file_pattern_utf8, error);
-        g_free (file_pattern_utf8);
-        return NULL;
-    }
-
-    gchar *file_pattern_quoted = quote_if_needed (file_pattern_locale);
-    gchar *look_in_folder_utf8 = GNOME_CMD_FILE (start_dir)->get_real_path();
-    gchar *look_in_folder_locale = g_locale_from_utf8 (look_in_folder_utf8, -1, NULL, NULL, NULL);
+    // the threads of the search share the socket, so keep the lines in one piece. The main thread
+    // doesn't need this mutex to drain the socket, so it may be held while waiting for it.
+    g_mutex_lock (data->found_mutex);
 
-    if (!look_in_folder_locale)     // if for some reason a path was not returned, fallback to the user's home directory
-        look_in_folder_locale = g_strconcat (g_get_home_dir (), G_DIR_SEPARATOR_S, NULL);
-
-    gchar *look_in_folder_quoted = quote_if_needed (look_in_folder_locale);
-
-    GString *command = g_string_sized_new (512);
-
-    g_string_append (command, "find ");
-    g_string_append (command, look_in_folder_quoted);
-
-    if (dialog->defaults.default_profile.max_depth!=-1)
-        g_string_append_printf (command, " -maxdepth %i", dialog->defaults.default_profile.max_depth+1);
-
-    switch (dialog->defaults.default_profile.syntax)
-    {
-        case Filter::TYPE_FNMATCH:
-            g_string_append_printf (command, " -iname '%s'", file_pattern_utf8);
-            break;
-
-        case Filter::TYPE_REGEX:
-            g_string_append_printf (command, " -regextype posix-extended -iregex '.*/.*%s.*'", file_pattern_utf8);
-            break;
-    }
-
-    if (dialog->defaults.default_profile.content_search)
+    while (written < len && !data->stopped)
     {
-        static const gchar GREP_COMMAND[] = "grep";
+        gssize n = send (data->found_fd, line+written, len-written, MSG_NOSIGNAL);
 
-        if (dialog->defaults.default_profile.match_case)
-            g_string_append_printf (command, " '!' -type p -exec %s -E -q '%s' {} \\;", GREP_COMMAND, dialog->defaults.default_profile.text_pattern.c_str());
+        if (n >= 0)
+            written += n;
         else
-            g_string_append_printf (command, " '!' -type p -exec %s -E -q -i '%s' {} \\;", GREP_COMMAND, dialog->defaults.default_profile.text_pattern.c_str());
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                g_usleep (1000);        // the main thread is busy with the files found so far
+            else
+                if (errno != EINTR)
+                    break;
     }
 
-    g_string_append (command, " -print");
-
-    g_free (file_pattern_utf8);
-    g_free (file_pattern_locale);
-    g_free (file_pattern_quoted);
-    g_free (look_in_folder_utf8);
-    g_free (look_in_folder_locale);
-    g_free (look_in_folder_quoted);
+    g_mutex_unlock (data->found_mutex);
 
-    return g_string_free (command, FALSE);
+    g_free (line);
 }
 
 
-static void child_command_set_pgid_cb (gpointer unused)
+static gpointer perform_local_search (SearchData *data)
 {
-    if (setpgid (0, 0) < 0)
-        g_print (_("Failed to set process group id of child %d: %s.\n"), getpid (), g_strerror (errno));
+    data->local_search->run(data->local_search_path, (LocalSearch::FoundFunc) SearchData::local_file_found, data, &data->stopped);
+
+    delete data->local_search;
+    data->local_search = NULL;
+    g_free (data->local_search_path);
+    data->local_search_path = NULL;
+
+    // closing the socket lets the main thread know that the search is done
+    close (data->found_fd);
+    data->found_fd = -1;
+
+    return NULL;
 }
 
 
@@ -798,49 +741,68 @@ static gboolean handle_search_command_stdout_io (GIOChannel *ioc, GIOCondition c
 
 gboolean SearchData::start_local_search()
 {
-    gchar *command = build_search_command();
+    gchar *look_in_folder_utf8 = GNOME_CMD_FILE (start_dir)->get_real_path();
 
-    g_return_val_if_fail (command!=NULL, FALSE);
+    local_search_path = look_in_folder_utf8 ? g_filename_from_utf8 (look_in_folder_utf8, -1, NULL, NULL, NULL) : NULL;
+    g_free (look_in_folder_utf8);
 
-    DEBUG ('g', "running: %s\n", command);
+    if (!local_search_path)     // if for some reason a path was not returned, fallback to the user's home directory
+        local_search_path = g_strdup (g_get_home_dir ());
 
-    GError *error = NULL;
-    gchar **argv  = NULL;
-    gint child_stdout;
+    int fds[2];
 
-    if (!g_shell_parse_argv (command, NULL, &argv, &error))
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) < 0)
     {
-        gnome_cmd_error_message (_("Error parsing the search command."), error);
+        gnome_cmd_error_message (_("Error running the search."), g_error_new_literal (G_FILE_ERROR, g_file_error_from_errno (errno), g_strerror (errno)));
 
-        g_free (command);
-        g_strfreev (argv);
+        g_free (local_search_path);
+        local_search_path = NULL;
 
         return FALSE;
     }
 
-    g_free (command);
+    found_fd = fds[1];
+    fcntl (found_fd, F_SETFL, fcntl (found_fd, F_GETFL) | O_NONBLOCK);
+    fcntl (found_fd, F_SETFD, FD_CLOEXEC);
+    fcntl (fds[0], F_SETFD, FD_CLOEXEC);
 
-    if (!g_spawn_async_with_pipes (NULL, argv, NULL, GSpawnFlags (G_SPAWN_SEARCH_PATH | G_SPAWN_STDERR_TO_DEV_NULL), child_command_set_pgid_cb, NULL, NULL, NULL, &child_stdout, NULL, &error))
-    {
-        gnome_cmd_error_message (_("Error running the search command."), error);
+    if (!pdata.mutex)
+        pdata.mutex = g_mutex_new ();
 
-        g_strfreev (argv);
+    if (!found_mutex)
+        found_mutex = g_mutex_new ();
 
-        return FALSE;
+    GnomeCmdData::Selection &profile = dialog->defaults.default_profile;
+
+    local_search = new LocalSearch(profile.filename_pattern.c_str(), profile.syntax, profile.match_case, profile.max_depth,
+                                   profile.content_search ? profile.text_pattern.c_str() : NULL,
+                                   gnome_cmd_data.search_threads);
+
+    // names only searches are answered from the index of the directory, if there is one, which is then brought up to date for the next search
+    SearchIndex *index = profile.content_search ? NULL : gcmd_search_index_find (local_search_path);
+
+    if (index)
+    {
+        local_search->use_index (index);
+        gcmd_search_index_refresh ();
     }
 
+    DEBUG ('g', "searching %s natively\n", local_search_path);
+
 #ifdef G_OS_WIN32
-    GIOChannel *ioc_stdout = g_io_channel_win32_new_fd (child_stdout);
+    GIOChannel *ioc_found = g_io_channel_win32_new_fd (fds[0]);
 #else
-    GIOChannel *ioc_stdout = g_io_channel_unix_new (child_stdout);
+    GIOChannel *ioc_found = g_io_channel_unix_new (fds[0]);
 #endif
 
-    g_io_channel_set_encoding (ioc_stdout, NULL, NULL);
-    g_io_channel_set_flags (ioc_stdout, G_IO_FLAG_NONBLOCK, NULL);
-    g_io_add_watch (ioc_stdout, GIOCondition (G_IO_IN | G_IO_HUP), (GIOFunc) handle_search_command_stdout_io, this);
+    g_io_channel_set_close_on_unref (ioc_found, TRUE);
+    g_io_channel_set_encoding (ioc_found, NULL, NULL);
+    g_io_channel_set_flags (ioc_found, G_IO_FLAG_NONBLOCK, NULL);
+    g_io_add_watch (ioc_found, GIOCondition (G_IO_IN | G_IO_HUP), (GIOFunc) handle_search_command_stdout_io, this);
+
+    g_io_channel_unref (ioc_found);
 
-    g_io_channel_unref (ioc_stdout);
-    g_strfreev (argv);
+    thread = g_thread_new ("local-search", (GThreadFunc) perform_local_search, this);
 
     return TRUE;
 }
@@ -914,12 +876,22 @@ void GnomeCmdSearchDialog::Private::on_dialog_response(GtkDialog *window, int re
                     data.thread = NULL;
                 }
 
+                // drop what a stopped search has found after its last GUI update
+                if (data.pdata.mutex)
+                {
+                    g_mutex_lock (data.pdata.mutex);
+                    gnome_cmd_file_list_free (data.pdata.files);
+                    gnome_cmd_file_list_free (data.pdata.unmatched);
+                    data.pdata.files = NULL;
+                    data.pdata.unmatched = NULL;
+                    g_mutex_unlock (data.pdata.mutex);
+                }
+
                 data.search_done = TRUE;
                 data.stopped = TRUE;
                 data.dialog_destroyed = FALSE;
 
                 data.context_id = gtk_statusbar_get_context_id (GTK_STATUSBAR (dialog->priv->statusbar), "info");
-                data.content_regex = NULL;
                 data.match_dirs = NULL;
 
                 gchar *dir_str = gtk_file_chooser_get_uri (GTK_FILE_CHOOSER (dialog->priv->dir_browser));
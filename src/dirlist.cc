@@ -52,9 +52,13 @@ on_files_listed (GnomeVFSAsyncHandle *handle,
     if (entries_read > 0 && list != NULL)
     {
         g_list_foreach (list, (GFunc) gnome_vfs_file_info_ref, NULL);
-        dir->infolist = g_list_concat (dir->infolist, g_list_copy (list));
         dir->list_counter += entries_read;
         DEBUG ('l', "files listed: %d\n", dir->list_counter);
+
+        if (dir->partial_func)
+            dir->partial_func (dir, g_list_copy (list));
+        else
+            dir->infolist = g_list_concat (dir->infolist, g_list_copy (list));
     }
 
     if (result == GNOME_VFS_ERROR_EOF)
@@ -73,8 +77,11 @@ static gboolean update_list_progress (GnomeCmdDir *dir)
     if (dir->state == GnomeCmdDir::STATE_LISTING)
     {
         gchar *msg = g_strdup_printf (ngettext ("%d file listed", "%d files listed", dir->list_counter), dir->list_counter);
-        gtk_label_set_text (GTK_LABEL (dir->label), msg);
-        progress_bar_update (dir->pbar, 50);
+        if (dir->dialog)
+        {
+            gtk_label_set_text (GTK_LABEL (dir->label), msg);
+            progress_bar_update (dir->pbar, 50);
+        }
         DEBUG('l', "%s\n", msg);
         g_free (msg);
         return TRUE;
@@ -138,7 +145,8 @@ void dirlist_list (GnomeCmdDir *dir, gboolean visprog)
     dir->list_result = GNOME_VFS_OK;
     dir->state = GnomeCmdDir::STATE_LISTING;
 
-    if (!visprog)
+    // incremental listing needs the asynchronous job even if no progress dialog is shown
+    if (!visprog && !dir->partial_func)
     {
         blocking_list (dir);
         return;
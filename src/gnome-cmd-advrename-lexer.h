@@ -22,7 +22,10 @@
 #ifndef __GNOME_CMD_ADVRENAME_LEXER_H__
 #define __GNOME_CMD_ADVRENAME_LEXER_H__
 
+#include <set>
+
 #include "gnome-cmd-file.h"
+#include "tags/gnome-cmd-tags.h"
 
 #ifndef NAME_MAX
 #define NAME_MAX (FILENAME_MAX)
@@ -30,6 +33,7 @@
 
 void gnome_cmd_advrename_reset_counter(int n, long start=1, int precision=-1, int step=1);
 void gnome_cmd_advrename_parse_template(const char *template_string, gboolean &has_counters);
-char *gnome_cmd_advrename_gen_fname(GnomeCmdFile *f, size_t new_fname_size=NAME_MAX);
+char *gnome_cmd_advrename_gen_fname(GnomeCmdFile *f, long index, size_t new_fname_size=NAME_MAX);     // index is the position of f in the renamed files, for counters
+void gnome_cmd_advrename_get_tag_classes(std::set<GnomeCmdTagClass> &tag_classes);    // of the $T() tags of the parsed template
 
 #endif // __GNOME_CMD_ADVRENAME_LEXER_H__
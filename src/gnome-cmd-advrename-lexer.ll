@@ -34,6 +34,7 @@
 
 #include <string>
 #include <vector>
+#include <set>
 #include <algorithm>
 
 #include "gnome-cmd-includes.h"
@@ -381,6 +382,14 @@ void gnome_cmd_advrename_parse_template(const char *template_string, gboolean &h
 }
 
 
+void gnome_cmd_advrename_get_tag_classes(set<GnomeCmdTagClass> &tag_classes)
+{
+  for (vector<CHUNK *>::const_iterator i=fname_template.begin(); i!=fname_template.end(); ++i)
+    if ((*i)->type==METATAG && (*i)->tag.tag!=TAG_NONE)
+      tag_classes.insert(gcmd_tags_get_class((*i)->tag.tag));
+}
+
+
 inline void mk_substr (int src_len, const CHUNK *p, int &pos, int &len)
 {
   pos = p->tag.beg<0 ? p->tag.beg+src_len : p->tag.beg;
@@ -464,7 +473,7 @@ inline gboolean convert (char *s, char from, char to)
 }
 
 
-char *gnome_cmd_advrename_gen_fname (GnomeCmdFile *f, size_t new_fname_size)
+char *gnome_cmd_advrename_gen_fname (GnomeCmdFile *f, long index, size_t new_fname_size)
 {
   if (fname_template.empty())
     return g_strdup ("");
@@ -522,10 +531,8 @@ char *gnome_cmd_advrename_gen_fname (GnomeCmdFile *f, size_t new_fname_size)
                     {
                       static char counter_value[MAX_PRECISION+1];
 
-                      snprintf (counter_value, MAX_PRECISION+1, (*i)->counter.fmt, (*i)->counter.n);
+                      snprintf (counter_value, MAX_PRECISION+1, (*i)->counter.fmt, (*i)->counter.n + index*(*i)->counter.step);
                       fmt += counter_value;
-
-                      (*i)->counter.n += (*i)->counter.step;
                     }
                     break;
 
@@ -857,6 +857,11 @@ void on_use_gcmd_block_changed()
     gnome_cmd_data.use_gcmd_block = g_settings_get_boolean (gnome_cmd_data.options.gcmd_settings->programs, GCMD_SETTINGS_USE_GCMD_BLOCK);
 }
 
+void on_incremental_listing_changed()
+{
+    gnome_cmd_data.incremental_listing = g_settings_get_boolean (gnome_cmd_data.options.gcmd_settings->general, GCMD_SETTINGS_INCREMENTAL_LISTING);
+}
+
 static void gcmd_settings_class_init (GcmdSettingsClass *klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
@@ -1258,6 +1263,11 @@ static void gcmd_connect_gsettings_signals(GcmdSettings *gs)
                       G_CALLBACK (on_use_gcmd_block_changed),
                       NULL);
 
+    g_signal_connect (gs->general,
+                      "changed::incremental-listing",
+                      G_CALLBACK (on_incremental_listing_changed),
+                      NULL);
+
     g_signal_connect (gs->network,
                       "changed::ftp-anonymous-password",
                       G_CALLBACK (on_ftp_anonymous_password_changed),
@@ -2598,6 +2608,10 @@ GnomeCmdData::GnomeCmdData(): search_defaults(selections)
     dev_icon_size = 16;
     memset(fs_col_width, 0, sizeof(fs_col_width));
     gui_update_rate = DEFAULT_GUI_UPDATE_RATE;
+    incremental_listing = TRUE;
+    search_threads = 0;
+    search_index_dirs = NULL;
+    background_delete = FALSE;
 
     cmdline_history = NULL;
     cmdline_history_length = 0;
@@ -3490,6 +3504,10 @@ void GnomeCmdData::load()
     cmdline_history_length = g_settings_get_uint (options.gcmd_settings->general, GCMD_SETTINGS_CMDLINE_HISTORY_LENGTH);
     horizontal_orientation = g_settings_get_boolean (options.gcmd_settings->general, GCMD_SETTINGS_HORIZONTAL_ORIENTATION);
     gui_update_rate = g_settings_get_uint (options.gcmd_settings->general, GCMD_SETTINGS_GUI_UPDATE_RATE);
+    incremental_listing = g_settings_get_boolean (options.gcmd_settings->general, GCMD_SETTINGS_INCREMENTAL_LISTING);
+    search_threads = g_settings_get_uint (options.gcmd_settings->general, GCMD_SETTINGS_SEARCH_THREADS);
+    search_index_dirs = get_list_from_gsettings_string_array (options.gcmd_settings->general, GCMD_SETTINGS_SEARCH_INDEX_DIRS);
+    background_delete = g_settings_get_boolean (options.gcmd_settings->general, GCMD_SETTINGS_BACKGROUND_DELETE);
     options.main_win_pos[0] = g_settings_get_int (options.gcmd_settings->general, GCMD_SETTINGS_MAIN_WIN_POS_X);
     options.main_win_pos[1] = g_settings_get_int (options.gcmd_settings->general, GCMD_SETTINGS_MAIN_WIN_POS_Y);
 
@@ -4099,6 +4117,9 @@ void GnomeCmdData::save()
     set_gsettings_when_changed      (options.gcmd_settings->general, GCMD_SETTINGS_CMDLINE_HISTORY_LENGTH, &(cmdline_history_length));
     set_gsettings_when_changed      (options.gcmd_settings->general, GCMD_SETTINGS_HORIZONTAL_ORIENTATION, &(horizontal_orientation));
     set_gsettings_when_changed      (options.gcmd_settings->general, GCMD_SETTINGS_GUI_UPDATE_RATE, &(gui_update_rate));
+    set_gsettings_when_changed      (options.gcmd_settings->general, GCMD_SETTINGS_INCREMENTAL_LISTING, &(incremental_listing));
+    set_gsettings_when_changed      (options.gcmd_settings->general, GCMD_SETTINGS_SEARCH_THREADS, &(search_threads));
+    set_gsettings_when_changed      (options.gcmd_settings->general, GCMD_SETTINGS_BACKGROUND_DELETE, &(background_delete));
     set_gsettings_when_changed      (options.gcmd_settings->general, GCMD_SETTINGS_MULTIPLE_INSTANCES, &(options.allow_multiple_instances));
     set_gsettings_enum_when_changed (options.gcmd_settings->general, GCMD_SETTINGS_QUICK_SEARCH_SHORTCUT, options.quick_search);
 
@@ -81,6 +81,10 @@ GcmdSettings *gcmd_settings_new (void);
 #define GCMD_SETTINGS_SHOW_TOOLBAR                    "show-toolbar"
 #define GCMD_SETTINGS_SHOW_BUTTONBAR                  "show-buttonbar"
 #define GCMD_SETTINGS_GUI_UPDATE_RATE                 "gui-update-rate"
+#define GCMD_SETTINGS_INCREMENTAL_LISTING             "incremental-listing"
+#define GCMD_SETTINGS_SEARCH_THREADS                  "search-threads"
+#define GCMD_SETTINGS_SEARCH_INDEX_DIRS               "search-index-dirs"
+#define GCMD_SETTINGS_BACKGROUND_DELETE               "background-delete"
 #define GCMD_SETTINGS_SYMLINK_PREFIX                  "symlink-string"
 #define GCMD_SETTINGS_MAIN_WIN_POS_X                  "main-win-pos-x"
 #define GCMD_SETTINGS_MAIN_WIN_POS_Y                  "main-win-pos-y"
@@ -618,6 +622,10 @@ struct GnomeCmdData
     guint                        dev_icon_size;
     guint                        fs_col_width[GnomeCmdFileList::NUM_COLUMNS];
     guint                        gui_update_rate;
+    gboolean                     incremental_listing;
+    guint                        search_threads;
+    GList                       *search_index_dirs;
+    gboolean                     background_delete;
 
     GList                       *cmdline_history;
     gint                         cmdline_history_length;
@@ -30,6 +30,7 @@
 #include "gnome-cmd-data.h"
 #include "gnome-cmd-con.h"
 #include "gnome-cmd-file-collection.h"
+#include "gnome-cmd-search-index.h"
 #include "dirlist.h"
 #include "utils.h"
 
@@ -50,6 +51,7 @@ enum
     FILE_CHANGED,
     FILE_RENAMED,
     LIST_OK,
+    LIST_PARTIAL,
     LIST_FAILED,
     LAST_SIGNAL
 };
@@ -209,6 +211,16 @@ static void gnome_cmd_dir_class_init (GnomeCmdDirClass *klass)
             G_TYPE_NONE,
             1, G_TYPE_POINTER);
 
+    signals[LIST_PARTIAL] =
+        g_signal_new ("list-partial",
+            G_TYPE_FROM_CLASS (klass),
+            G_SIGNAL_RUN_LAST,
+            G_STRUCT_OFFSET (GnomeCmdDirClass, list_partial),
+            NULL, NULL,
+            g_cclosure_marshal_VOID__POINTER,
+            G_TYPE_NONE,
+            1, G_TYPE_POINTER);
+
     signals[LIST_FAILED] =
         g_signal_new ("list-failed",
             G_TYPE_FROM_CLASS (klass),
@@ -225,6 +237,7 @@ static void gnome_cmd_dir_class_init (GnomeCmdDirClass *klass)
     klass->file_changed = NULL;
     klass->file_renamed = NULL;
     klass->list_ok = NULL;
+    klass->list_partial = NULL;
     klass->list_failed = NULL;
 }
 
@@ -431,11 +444,35 @@ static GList *create_file_list (GnomeCmdDir *dir, GList *info_list)
                                                                             gnome_cmd_file_new (info, dir);
 
             gnome_cmd_file_ref (f);
-            file_list = g_list_append (file_list, f);
+            file_list = g_list_prepend (file_list, f);
         }
     }
 
-    return file_list;
+    return g_list_reverse (file_list);
+}
+
+
+// A batch of files has been listed. Turn it into GnomeCmdFile objects right away, so the
+// listed part of the directory can be shown before the whole directory has been read.
+static void on_list_partial (GnomeCmdDir *dir, GList *infolist)
+{
+    if (dir->state != GnomeCmdDir::STATE_LISTING)
+    {
+        g_list_foreach (infolist, (GFunc) gnome_vfs_file_info_unref, NULL);
+        g_list_free (infolist);
+        return;
+    }
+
+    GList *files = create_file_list (dir, infolist);
+    g_list_free (infolist);
+
+    dir->priv->file_collection->add(files);
+    dir->priv->files = dir->priv->file_collection->get_list();
+
+    DEBUG('l', "Emitting 'list-partial' signal\n");
+    g_signal_emit (dir, signals[LIST_PARTIAL], 0, files);
+
+    g_list_free (files);
 }
 
 
@@ -445,12 +482,17 @@ static void on_list_done (GnomeCmdDir *dir, GList *infolist, GnomeVFSResult resu
     {
         DEBUG('l', "File listing succeded\n");
 
-        if (!dir->priv->file_collection->empty())
-            dir->priv->file_collection->clear();
+        if (dir->partial_func)
+            dir->priv->files = dir->priv->file_collection->get_list();   // all batches have already been added by on_list_partial()
+        else
+        {
+            if (!dir->priv->file_collection->empty())
+                dir->priv->file_collection->clear();
 
-        dir->priv->files = create_file_list (dir, infolist);
-        dir->priv->file_collection->add(dir->priv->files);
-        g_list_free (infolist);
+            dir->priv->files = create_file_list (dir, infolist);
+            dir->priv->file_collection->add(dir->priv->files);
+            g_list_free (infolist);
+        }
 
         if (dir->dialog)
         {
@@ -524,7 +566,7 @@ static void create_list_progress_dialog (GnomeCmdDir *dir)
 }
 
 
-void gnome_cmd_dir_relist_files (GnomeCmdDir *dir, gboolean visprog)
+void gnome_cmd_dir_relist_files (GnomeCmdDir *dir, gboolean visprog, gboolean incremental)
 {
     g_return_if_fail (GNOME_CMD_IS_DIR (dir));
 
@@ -532,6 +574,14 @@ void gnome_cmd_dir_relist_files (GnomeCmdDir *dir, gboolean visprog)
     dir->priv->lock = TRUE;
 
     dir->done_func = (DirListDoneFunc) on_list_done;
+    dir->partial_func = incremental ? (DirListPartialFunc) on_list_partial : NULL;
+
+    if (dir->partial_func)
+    {
+        // the collection is refilled batch by batch while listing
+        dir->priv->file_collection->clear();
+        dir->priv->files = NULL;
+    }
 
     if (visprog)
         create_list_progress_dialog (dir);
@@ -540,7 +590,7 @@ void gnome_cmd_dir_relist_files (GnomeCmdDir *dir, gboolean visprog)
 }
 
 
-void gnome_cmd_dir_list_files (GnomeCmdDir *dir, gboolean visprog)
+void gnome_cmd_dir_list_files (GnomeCmdDir *dir, gboolean visprog, gboolean incremental)
 {
     g_return_if_fail (GNOME_CMD_IS_DIR (dir));
 
@@ -550,7 +600,7 @@ void gnome_cmd_dir_list_files (GnomeCmdDir *dir, gboolean visprog)
                dir,
                GNOME_CMD_FILE (dir)->get_path(),
                visprog);
-        gnome_cmd_dir_relist_files (dir, visprog);
+        gnome_cmd_dir_relist_files (dir, visprog, incremental);
     }
     else
         g_signal_emit (dir, signals[LIST_OK], 0, dir->priv->files);
@@ -696,6 +746,8 @@ void gnome_cmd_dir_file_created (GnomeCmdDir *dir, const gchar *uri_str)
     g_return_if_fail (GNOME_CMD_IS_DIR (dir));
     g_return_if_fail (uri_str != NULL);
 
+    gcmd_search_index_file_created (uri_str);
+
     if (file_already_exists (dir, uri_str))
         return;
 
@@ -727,6 +779,8 @@ void gnome_cmd_dir_file_deleted (GnomeCmdDir *dir, const gchar *uri_str)
     g_return_if_fail (GNOME_CMD_IS_DIR (dir));
     g_return_if_fail (uri_str != NULL);
 
+    gcmd_search_index_file_deleted (uri_str);
+
     GnomeCmdFile *f = dir->priv->file_collection->find(uri_str);
 
     if (!GNOME_CMD_IS_FILE (f))
@@ -760,6 +814,7 @@ void gnome_cmd_dir_file_changed (GnomeCmdDir *dir, const gchar *uri_str)
 
     f->update_info(info);
     f->invalidate_metadata();
+    forget_tree_size (uri_str);
     g_signal_emit (dir, signals[FILE_CHANGED], 0, f);
 }
 
@@ -773,6 +828,10 @@ void gnome_cmd_dir_file_renamed (GnomeCmdDir *dir, GnomeCmdFile *f, const gchar
     if (GNOME_CMD_IS_DIR (f))
         gnome_cmd_con_remove_from_cache (dir->priv->con, old_uri_str);
 
+    gchar *new_uri_str = f->get_uri_str();
+    gcmd_search_index_file_renamed (old_uri_str, new_uri_str);
+    g_free (new_uri_str);
+
     dir->priv->needs_mtime_update = TRUE;
 
     dir->priv->file_collection->remove(old_uri_str);
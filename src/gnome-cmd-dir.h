@@ -37,6 +37,7 @@ struct GnomeCmdDir;
 struct GnomeCmdDirPrivate;
 
 typedef void (* DirListDoneFunc) (GnomeCmdDir *dir, GList *files, GnomeVFSResult result);
+typedef void (* DirListPartialFunc) (GnomeCmdDir *dir, GList *infolist);
 
 #include <string>
 
@@ -66,6 +67,7 @@ struct GnomeCmdDir
     State state;
 
     DirListDoneFunc done_func;
+    DirListPartialFunc partial_func;    // if set, every listed batch is handed over at once instead of collecting them in infolist
 
     GtkWidget *dialog;
     GtkWidget *label;
@@ -81,6 +83,7 @@ struct GnomeCmdDirClass
     void (* file_changed)       (GnomeCmdDir *dir, GnomeCmdFile *file);
     void (* file_renamed)       (GnomeCmdDir *dir, GnomeCmdFile *file);
     void (* list_ok)            (GnomeCmdDir *dir, GList *files);
+    void (* list_partial)       (GnomeCmdDir *dir, GList *files);
     void (* list_failed)        (GnomeCmdDir *dir, GnomeVFSResult result);
 };
 
@@ -125,8 +128,9 @@ inline void gnome_cmd_dir_unref (GnomeCmdDir *dir)
 }
 
 GList *gnome_cmd_dir_get_files (GnomeCmdDir *dir);
-void gnome_cmd_dir_relist_files (GnomeCmdDir *dir, gboolean visprog);
-void gnome_cmd_dir_list_files (GnomeCmdDir *dir, gboolean visprog);
+// incremental listings are asynchronous and hand the files over in 'list-partial' signals, they are for the file panes only
+void gnome_cmd_dir_relist_files (GnomeCmdDir *dir, gboolean visprog, gboolean incremental=FALSE);
+void gnome_cmd_dir_list_files (GnomeCmdDir *dir, gboolean visprog, gboolean incremental=FALSE);
 
 GnomeCmdPath *gnome_cmd_dir_get_path (GnomeCmdDir *dir);
 void gnome_cmd_dir_set_path (GnomeCmdDir *dir, GnomeCmdPath *path);
@@ -24,53 +24,21 @@
 
 
 #include "gnome-cmd-file.h"
+#include "gnome-cmd-table.h"
 
 
-class GnomeCmdFileCollection
+/**
+ * The files of a directory or a file list, found by their URI.
+ */
+class GnomeCmdFileCollection: public GnomeCmd::Table<GnomeCmdFile>
 {
-    GHashTable *map;
-    GList *list;
+    static gchar *get_uri_str(GnomeCmdFile *f)      {  return f->get_uri_str();  }
+    static void ref(GnomeCmdFile *f)                {  f->ref();                 }
+    static void unref(GnomeCmdFile *f)              {  gnome_cmd_file_unref (f);  }
 
   public:
 
-    GnomeCmdFileCollection();
-    ~GnomeCmdFileCollection();
-
-    guint size()        {  return g_list_length (list);  }
-    gboolean empty()    {  return list==NULL;            }
-    void clear();
-
-    void add(GnomeCmdFile *f);
-    void add(GList *files);
-    gboolean remove(GnomeCmdFile *f);
-    gboolean remove(const gchar *uri_str);
-
-    GList *get_list()   {  return list;  }
-
-    GnomeCmdFile *find(const gchar *uri_str);
-
-    GList *sort(GCompareDataFunc compare_func, gpointer user_data);
+    GnomeCmdFileCollection(): GnomeCmd::Table<GnomeCmdFile>(get_uri_str, ref, unref)     {}
 };
 
-
-inline GnomeCmdFileCollection::GnomeCmdFileCollection()
-{
-    map = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) gnome_cmd_file_unref);
-    list = NULL;
-}
-
-
-inline GnomeCmdFileCollection::~GnomeCmdFileCollection()
-{
-    g_hash_table_destroy (map);
-    g_list_free (list);
-}
-
-
-inline void GnomeCmdFileCollection::add(GList *files)
-{
-    for (; files; files = files->next)
-        add(GNOME_CMD_FILE (files->data));
-}
-
 #endif // __GNOME_CMD_FILE_COLLECTION_H__
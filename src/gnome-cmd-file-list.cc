@@ -21,6 +21,7 @@
 
 #include <config.h>
 #include <stdio.h>
+#include <algorithm>
 #include <glib-object.h>
 #include <libgnomeui/gnome-popup-menu.h>
 
@@ -145,6 +146,29 @@ struct GnomeCmdFileList::Private
     gint cur_file;
     GnomeCmdFileCollection visible_files;
     GnomeCmd::Collection<GnomeCmdFile *> selected_files;      // contains GnomeCmdFile pointers, no refing
+    std::vector<GnomeCmdFile *> rows;                         // shown files in the order of the clist rows, no refing
+
+    std::vector<GnomeCmdFile *> created_files;                // files created in cwd waiting to be inserted, refed
+    guint created_files_timeout;
+
+    struct TreeSizeJob
+    {
+        GnomeCmdFile *f;                                      // refed
+        GnomeVFSURI *uri;
+        GnomeVFSFileSize size;
+        gint done;                                            // set by tree_size_thread
+        gboolean shown;
+    };
+
+    std::vector<TreeSizeJob *> tree_size_jobs;                // dirs whose tree sizes are calculated in the background
+    GThread *tree_size_thread;
+    guint tree_size_timeout;
+    gboolean tree_size_stop;
+
+    GnomeCmdDir *partial_dir;                                 // dir which is shown incrementally while being listed
+    GList *partial_files;                                     // listed files of partial_dir waiting to be merged into the list
+    gint partial_files_cnt;
+    gint partial_shown_cnt;
 
     gchar *base_dir;
 
@@ -175,6 +199,13 @@ struct GnomeCmdFileList::Private
     explicit Private(GnomeCmdFileList *fl);
     ~Private();
 
+    gint find_row(GnomeCmdFileList *fl, GnomeCmdFile *f, gboolean after_equal);
+    void drop_created_files();
+    void stop_tree_sizes();
+
+    static gpointer calc_tree_sizes(Private *priv);
+    static gboolean show_calculated_tree_sizes(GnomeCmdFileList *fl);
+
     static gchar *translate_menu(const gchar *path, gpointer);
 
     static void on_dnd_popup_menu(GnomeCmdFileList *fl, GnomeVFSXferOptions xferOptions, GtkWidget *widget);
@@ -188,6 +219,17 @@ GnomeCmdFileList::Private::Private(GnomeCmdFileList *fl)
 
     base_dir = NULL;
 
+    partial_dir = NULL;
+    partial_files = NULL;
+    partial_files_cnt = 0;
+    partial_shown_cnt = 0;
+
+    created_files_timeout = 0;
+
+    tree_size_thread = NULL;
+    tree_size_timeout = 0;
+    tree_size_stop = FALSE;
+
     quicksearch_popup = NULL;
     selpat_dialog = NULL;
 
@@ -228,10 +270,123 @@ GnomeCmdFileList::Private::Private(GnomeCmdFileList *fl)
 
 GnomeCmdFileList::Private::~Private()
 {
+    drop_created_files();
+    stop_tree_sizes();
+    g_list_free (partial_files);
     g_object_unref (ifac);
 }
 
 
+// Binary search in the sorted rows: returns the first row which doesn't sort before f,
+// or, if after_equal is TRUE, the first row which sorts after f
+gint GnomeCmdFileList::Private::find_row(GnomeCmdFileList *fl, GnomeCmdFile *f, gboolean after_equal)
+{
+    gint lo = 0;
+    gint hi = rows.size();
+
+    while (lo < hi)
+    {
+        gint mid = lo + (hi-lo)/2;
+        gint cmp = sort_func (rows[mid], f, fl);
+
+        if (cmp < 0 || (after_equal && cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+
+void GnomeCmdFileList::Private::drop_created_files()
+{
+    if (created_files_timeout)
+        g_source_remove (created_files_timeout);
+    created_files_timeout = 0;
+
+    for (std::vector<GnomeCmdFile *>::iterator i=created_files.begin(); i!=created_files.end(); ++i)
+        (*i)->unref();
+    created_files.clear();
+}
+
+
+void GnomeCmdFileList::Private::stop_tree_sizes()
+{
+    tree_size_stop = TRUE;
+
+    if (tree_size_thread)
+        g_thread_join (tree_size_thread);
+    tree_size_thread = NULL;
+
+    if (tree_size_timeout)
+        g_source_remove (tree_size_timeout);
+    tree_size_timeout = 0;
+
+    for (std::vector<TreeSizeJob *>::iterator i=tree_size_jobs.begin(); i!=tree_size_jobs.end(); ++i)
+    {
+        (*i)->f->unref();
+        gnome_vfs_uri_unref ((*i)->uri);
+        g_free (*i);
+    }
+    tree_size_jobs.clear();
+
+    tree_size_stop = FALSE;
+}
+
+
+gpointer GnomeCmdFileList::Private::calc_tree_sizes(Private *priv)
+{
+    for (std::vector<TreeSizeJob *>::iterator i=priv->tree_size_jobs.begin(); i!=priv->tree_size_jobs.end() && !priv->tree_size_stop; ++i)
+    {
+        (*i)->size = calc_tree_size ((*i)->uri, NULL, &priv->tree_size_stop);
+        g_atomic_int_set (&(*i)->done, TRUE);
+    }
+
+    return NULL;
+}
+
+
+// Shows the tree sizes calculated since the last call, and finishes when all of them are known
+gboolean GnomeCmdFileList::Private::show_calculated_tree_sizes(GnomeCmdFileList *fl)
+{
+    Private *priv = fl->priv;
+    gboolean changed = FALSE;
+    gboolean all_shown = TRUE;
+
+    for (std::vector<TreeSizeJob *>::iterator i=priv->tree_size_jobs.begin(); i!=priv->tree_size_jobs.end(); ++i)
+    {
+        TreeSizeJob *job = *i;
+
+        if (job->shown)
+            continue;
+
+        if (!g_atomic_int_get (&job->done))
+        {
+            all_shown = FALSE;
+            continue;
+        }
+
+        job->f->set_tree_size(job->size);
+        fl->show_dir_tree_size(job->f);
+        job->shown = TRUE;
+        changed = TRUE;
+    }
+
+    if (changed)
+        g_signal_emit (fl, signals[FILES_CHANGED], 0);
+
+    if (!all_shown)
+        return TRUE;
+
+    // Returning FALSE here stops the timeout callbacks
+    priv->tree_size_timeout = 0;
+    priv->stop_tree_sizes();
+
+    return FALSE;
+}
+
+
 gchar *GnomeCmdFileList::Private::translate_menu(const gchar *path, gpointer unused)
 {
     return _(path);
@@ -1073,6 +1228,240 @@ static gint sort_by_group (GnomeCmdFile *f1, GnomeCmdFile *f2, GnomeCmdFileList
 }
 
 
+/******************************************************
+ * Sorting with precomputed keys
+ *
+ * The sort_by_* functions above look up or compute everything they compare
+ * on each call (sort_by_dir even allocates the dir names), which adds up when
+ * a few hundred thousand files are sorted. For a full sort the keys are
+ * collected once, and big lists are sorted in chunks by several threads,
+ * which is safe as the keys don't touch any GObject. The order is the same
+ * as with the sort_by_* functions.
+ **/
+
+#define PARALLEL_SORT_MIN_FILES     20000
+
+struct FileSortKey
+{
+    GnomeCmdFile *f;
+    gboolean is_dotdot;
+    GnomeVFSFileType type;
+    const gchar *name;          // collation key
+    const gchar *ext;           // only for COLUMN_EXT
+    gchar *dirname;             // only for COLUMN_DIR
+    GnomeVFSFileSize size;      // only for COLUMN_SIZE
+    gint num;                   // mtime, permissions, uid or gid, depending on the column
+};
+
+
+struct FileSortKeyCompare
+{
+    GnomeCmdFileList::ColumnID col;
+    gboolean raising;
+    gboolean file_raising;
+
+    explicit FileSortKeyCompare(GnomeCmdFileList *fl);
+
+    gint compare(const FileSortKey &k1, const FileSortKey &k2) const;
+
+    bool operator () (const FileSortKey &k1, const FileSortKey &k2) const       {  return compare (k1, k2) < 0;  }
+};
+
+
+FileSortKeyCompare::FileSortKeyCompare(GnomeCmdFileList *fl)
+{
+    col = (GnomeCmdFileList::ColumnID) fl->priv->current_col;
+    raising = fl->priv->sort_raising[fl->priv->current_col];
+    file_raising = fl->priv->sort_raising[1];
+}
+
+
+gint FileSortKeyCompare::compare(const FileSortKey &k1, const FileSortKey &k2) const
+{
+    if (k1.is_dotdot)
+        return -1;
+
+    if (k2.is_dotdot)
+        return 1;
+
+    gint ret = my_intcmp (k1.type, k2.type, TRUE);
+
+    if (ret)
+        return ret;
+
+    switch (col)
+    {
+        case GnomeCmdFileList::COLUMN_EXT:
+            if (!k1.ext && !k2.ext)
+                return my_strcmp (k1.name, k2.name, file_raising);
+            if (!k1.ext)
+                return raising?1:-1;
+            if (!k2.ext)
+                return raising?-1:1;
+            ret = my_strcmp (k1.ext, k2.ext, raising);
+            return ret ? ret : my_strcmp (k1.name, k2.name, file_raising);
+
+        case GnomeCmdFileList::COLUMN_DIR:
+            ret = my_strcmp (k1.dirname, k2.dirname, raising);
+            return ret ? ret : my_strcmp (k1.name, k2.name, raising);
+
+        case GnomeCmdFileList::COLUMN_SIZE:
+            ret = my_filesizecmp (k1.size, k2.size, raising);
+            return ret ? ret : my_strcmp (k1.name, k2.name, file_raising);
+
+        case GnomeCmdFileList::COLUMN_DATE:
+        case GnomeCmdFileList::COLUMN_PERM:
+        case GnomeCmdFileList::COLUMN_OWNER:
+        case GnomeCmdFileList::COLUMN_GROUP:
+            ret = my_intcmp (k1.num, k2.num, raising);
+            return ret ? ret : my_strcmp (k1.name, k2.name, file_raising);
+
+        default:
+            return my_strcmp (k1.name, k2.name, raising);
+    }
+}
+
+
+static void make_sort_key (FileSortKey &key, GnomeCmdFile *f, GnomeCmdFileList::ColumnID col)
+{
+    key.f = f;
+    key.is_dotdot = f->is_dotdot;
+    key.type = f->info->type;
+    key.name = f->get_collation_fname();
+    key.ext = NULL;
+    key.dirname = NULL;
+    key.size = 0;
+    key.num = 0;
+
+    switch (col)
+    {
+        case GnomeCmdFileList::COLUMN_EXT:      key.ext = f->get_extension();           break;
+        case GnomeCmdFileList::COLUMN_DIR:      key.dirname = f->is_dotdot ? NULL : f->get_dirname();   break;
+        case GnomeCmdFileList::COLUMN_SIZE:     key.size = f->info->size;               break;
+        case GnomeCmdFileList::COLUMN_DATE:     key.num = f->info->mtime;               break;
+        case GnomeCmdFileList::COLUMN_PERM:     key.num = f->info->permissions;         break;
+        case GnomeCmdFileList::COLUMN_OWNER:    key.num = f->info->uid;                 break;
+        case GnomeCmdFileList::COLUMN_GROUP:    key.num = f->info->gid;                 break;
+        default:                                                                        break;
+    }
+}
+
+
+struct FileSortChunk
+{
+    vector<FileSortKey>::iterator begin, middle, end;
+    const FileSortKeyCompare *cmp;
+};
+
+
+static gpointer sort_chunk (FileSortChunk *chunk)
+{
+    stable_sort (chunk->begin, chunk->end, *chunk->cmp);
+    return NULL;
+}
+
+
+static gpointer merge_chunks (FileSortChunk *chunk)
+{
+    inplace_merge (chunk->begin, chunk->middle, chunk->end, *chunk->cmp);
+    return NULL;
+}
+
+
+// Runs func for every chunk, each but the first one in its own thread
+static void run_sort_chunks (vector<FileSortChunk> &chunks, GThreadFunc func)
+{
+    vector<GThread *> threads;
+
+    for (vector<FileSortChunk>::iterator i=chunks.begin()+1; i<chunks.end(); ++i)
+        threads.push_back(g_thread_new (NULL, func, &*i));
+
+    func (&chunks[0]);
+
+    for (vector<GThread *>::iterator i=threads.begin(); i!=threads.end(); ++i)
+        g_thread_join (*i);
+}
+
+
+static void parallel_stable_sort (vector<FileSortKey> &keys, const FileSortKeyCompare &cmp)
+{
+    guint n_chunks = keys.size() < PARALLEL_SORT_MIN_FILES ? 1 : MIN (g_get_num_processors (), keys.size() / (PARALLEL_SORT_MIN_FILES/2));
+
+    if (n_chunks < 2)
+    {
+        stable_sort (keys.begin(), keys.end(), cmp);
+        return;
+    }
+
+    // split the keys into chunks which are sorted in parallel...
+    vector<vector<FileSortKey>::iterator> bounds;
+
+    for (guint i=0; i<n_chunks; ++i)
+        bounds.push_back(keys.begin() + keys.size() * i / n_chunks);
+    bounds.push_back(keys.end());
+
+    vector<FileSortChunk> chunks(n_chunks);
+
+    for (guint i=0; i<n_chunks; ++i)
+    {
+        chunks[i].begin = chunks[i].middle = bounds[i];
+        chunks[i].end = bounds[i+1];
+        chunks[i].cmp = &cmp;
+    }
+
+    run_sort_chunks (chunks, (GThreadFunc) sort_chunk);
+
+    // ...and merge neighbouring chunks, again in parallel, until a single one is left
+    while (bounds.size() > 2)
+    {
+        vector<vector<FileSortKey>::iterator> merged_bounds;
+
+        chunks.clear();
+
+        for (guint i=0; i+2<bounds.size(); i+=2)
+        {
+            FileSortChunk chunk;
+            chunk.begin = bounds[i];
+            chunk.middle = bounds[i+1];
+            chunk.end = bounds[i+2];
+            chunk.cmp = &cmp;
+            chunks.push_back(chunk);
+            merged_bounds.push_back(bounds[i]);
+        }
+
+        if (bounds.size() % 2 == 0)             // odd number of chunks - the last one is merged in the next round
+            merged_bounds.push_back(bounds[bounds.size()-2]);
+        merged_bounds.push_back(keys.end());
+
+        run_sort_chunks (chunks, (GThreadFunc) merge_chunks);
+
+        bounds.swap(merged_bounds);
+    }
+}
+
+
+// Sorts files in the same order as fl->priv->sort_func would do
+static void sort_files (GnomeCmdFileList *fl, vector<GnomeCmdFile *> &files)
+{
+    if (files.size() < 2)
+        return;
+
+    GnomeCmdFileList::ColumnID col = (GnomeCmdFileList::ColumnID) fl->priv->current_col;
+    vector<FileSortKey> keys(files.size());
+
+    for (guint i=0; i<files.size(); ++i)
+        make_sort_key (keys[i], files[i], col);
+
+    parallel_stable_sort (keys, FileSortKeyCompare(fl));
+
+    for (guint i=0; i<files.size(); ++i)
+    {
+        files[i] = keys[i].f;
+        g_free (keys[i].dirname);
+    }
+}
+
+
 /*******************************
  * Callbacks
  *******************************/
@@ -1329,12 +1718,57 @@ static void on_realize (GnomeCmdFileList *fl, gpointer user_data)
 }
 
 
+// Inserts all files created since the last GUI update at once
+static gboolean insert_created_files (GnomeCmdFileList *fl)
+{
+    GnomeCmdFileList::Private *priv = fl->priv;
+
+    vector<GnomeCmdFile *> files;
+    files.swap(priv->created_files);
+    priv->created_files_timeout = 0;
+
+    gboolean changed = FALSE;
+
+    if (files.size() * 8 <= priv->rows.size())
+    {
+        // a few files - insert each one at its place
+        for (vector<GnomeCmdFile *>::iterator i=files.begin(); i!=files.end(); ++i)
+            changed |= fl->insert_file(*i);
+    }
+    else
+    {
+        // a burst of files - add them all and rebuild the rows only once
+        for (vector<GnomeCmdFile *>::iterator i=files.begin(); i!=files.end(); ++i)
+            if (fl->file_is_wanted(*i) && !fl->has_file(*i))
+            {
+                priv->visible_files.add(*i);
+                changed = TRUE;
+            }
+
+        if (changed)
+            fl->sort();
+    }
+
+    for (vector<GnomeCmdFile *>::iterator i=files.begin(); i!=files.end(); ++i)
+        (*i)->unref();
+
+    if (changed)
+        g_signal_emit (fl, signals[FILES_CHANGED], 0);
+
+    return FALSE;
+}
+
+
 static void on_dir_file_created (GnomeCmdDir *dir, GnomeCmdFile *f, GnomeCmdFileList *fl)
 {
     g_return_if_fail (GNOME_CMD_IS_FILE_LIST (fl));
 
-    if (fl->insert_file(f))
-        g_signal_emit (fl, signals[FILES_CHANGED], 0);
+    // monitor events tend to come in bursts, so collect them and insert them with the next GUI update
+    f->ref();
+    fl->priv->created_files.push_back(f);
+
+    if (!fl->priv->created_files_timeout)
+        fl->priv->created_files_timeout = g_timeout_add (gnome_cmd_data.gui_update_rate, (GSourceFunc) insert_created_files, fl);
 }
 
 
@@ -1342,6 +1776,16 @@ static void on_dir_file_deleted (GnomeCmdDir *dir, GnomeCmdFile *f, GnomeCmdFile
 {
     g_return_if_fail (GNOME_CMD_IS_FILE_LIST (fl));
 
+    vector<GnomeCmdFile *> &created = fl->priv->created_files;
+    vector<GnomeCmdFile *>::iterator i = find (created.begin(), created.end(), f);
+
+    if (i != created.end())             // f has not been shown yet
+    {
+        created.erase(i);
+        f->unref();
+        return;
+    }
+
     if (fl->cwd == dir)
         if (fl->remove_file(f))
             g_signal_emit (fl, signals[FILES_CHANGED], 0);
@@ -1372,11 +1816,21 @@ static void on_dir_file_renamed (GnomeCmdDir *dir, GnomeCmdFile *f, GnomeCmdFile
         GnomeCmdFileList::ColumnID sort_col = fl->get_sort_column();
 
         if (sort_col==GnomeCmdFileList::COLUMN_NAME || sort_col==GnomeCmdFileList::COLUMN_EXT)
-            fl->sort();
+            fl->resort_file(f);
     }
 }
 
 
+static void on_dir_list_partial (GnomeCmdDir *dir, GList *files, GnomeCmdFileList *fl)
+{
+    g_return_if_fail (GNOME_CMD_IS_DIR (dir));
+    g_return_if_fail (GNOME_CMD_IS_FILE_LIST (fl));
+
+    if (fl->cwd == dir)
+        fl->show_partial_files(dir, files);
+}
+
+
 static void on_dir_list_ok (GnomeCmdDir *dir, GList *files, GnomeCmdFileList *fl)
 {
     DEBUG('l', "on_dir_list_ok\n");
@@ -1683,6 +2137,8 @@ inline void add_file_to_clist (GnomeCmdFileList *fl, GnomeCmdFile *f, gint in_ro
 
     gint row = in_row == -1 ? gtk_clist_append (clist, data.text) : gtk_clist_insert (clist, in_row, data.text);
 
+    fl->priv->rows.insert(fl->priv->rows.begin() + row, f);
+
     // Setup row data and color
     if (!gnome_cmd_data.options.use_ls_colors)
         gtk_clist_set_row_style (clist, row, (row % 2) ? alt_list_style : list_style);
@@ -1741,27 +2197,145 @@ gboolean GnomeCmdFileList::insert_file(GnomeCmdFile *f)
     if (!file_is_wanted(f))
         return FALSE;
 
-    gint num_files = size();
+    gint row = priv->find_row(this, f, TRUE);
+
+    if (row == (gint) priv->rows.size())
+    {
+        // Insert the file at the end of the list
+        append_file(f);
+        return TRUE;
+    }
+
+    priv->visible_files.add(f);
+    add_file_to_clist (this, f, row);
+
+    if (row<=priv->cur_file)
+        priv->cur_file++;
+
+    return TRUE;
+}
+
+
+void GnomeCmdFileList::resort_file(GnomeCmdFile *f)
+{
+    gint row = get_row_from_file(f);
+
+    if (row == -1)
+        return;
+
+    gboolean focused = row == priv->cur_file;
+
+    gtk_clist_freeze (*this);
+
+    gtk_clist_remove (*this, row);
+    priv->rows.erase(priv->rows.begin() + row);
+
+    if (row < priv->cur_file)
+        priv->cur_file--;
+
+    gint new_row = priv->find_row(this, f, TRUE);
+    add_file_to_clist (this, f, new_row);
+
+    if (priv->selected_files.contain(f))
+        select_file(f, new_row);
+
+    if (focused)
+        focus_file_at_row (this, new_row);
+    else
+        if (new_row <= priv->cur_file)
+            priv->cur_file++;
+
+    gtk_clist_thaw (*this);
+}
+
 
-    for (gint i=0; i<num_files; i++)
+// Merges two lists which are both sorted with sort_func into a newly allocated one
+static GList *merge_sorted_files (GList *l1, GList *l2, GCompareDataFunc sort_func, gpointer user_data)
+{
+    GList *merged = NULL;
+
+    while (l1 && l2)
+        if (sort_func (l1->data, l2->data, user_data) <= 0)
+        {
+            merged = g_list_prepend (merged, l1->data);
+            l1 = l1->next;
+        }
+        else
+        {
+            merged = g_list_prepend (merged, l2->data);
+            l2 = l2->next;
+        }
+
+    for (; l1; l1=l1->next)
+        merged = g_list_prepend (merged, l1->data);
+    for (; l2; l2=l2->next)
+        merged = g_list_prepend (merged, l2->data);
+
+    return g_list_reverse (merged);
+}
+
+
+void GnomeCmdFileList::show_partial_files(GnomeCmdDir *dir, GList *files)
+{
+    if (priv->partial_dir != dir)
     {
-        GnomeCmdFile *f2 = get_file_at_row(i);
-        if (priv->sort_func (f2, f, this) == 1)
+        // first batch of a new listing - drop the rows shown so far
+        remove_all_files();
+
+        g_list_free (priv->partial_files);
+        priv->partial_files = NULL;
+        priv->partial_files_cnt = 0;
+        priv->partial_shown_cnt = 0;
+        priv->partial_dir = dir;
+
+        // Create a parent dir file (..) if appropriate
+        gchar *path = GNOME_CMD_FILE (dir)->get_path();
+        if (path && strcmp (path, G_DIR_SEPARATOR_S) != 0)
         {
-            priv->visible_files.add(f);
-            add_file_to_clist (this, f, i);
+            priv->partial_files = g_list_prepend (priv->partial_files, gnome_cmd_dir_new_parent_dir_file (dir));
+            priv->partial_files_cnt++;
+        }
+        g_free (path);
+    }
 
-            if (i<=priv->cur_file)
-                priv->cur_file++;
+    for (GList *i = files; i; i = i->next)
+    {
+        GnomeCmdFile *f = GNOME_CMD_FILE (i->data);
 
-            return TRUE;
+        if (file_is_wanted (f))
+        {
+            priv->partial_files = g_list_prepend (priv->partial_files, f);
+            priv->partial_files_cnt++;
         }
     }
 
-    // Insert the file at the end of the list
-    append_file(f);
+    // Merge the pending files only when there are at least as many of them as shown rows.
+    // The first batch is therefore shown immediately, while every row is rebuilt only
+    // a logarithmic number of times in total, no matter how big the directory is.
+    if (!priv->partial_files || priv->partial_files_cnt < priv->partial_shown_cnt)
+        return;
 
-    return TRUE;
+    GList *pending = g_list_sort_with_data (priv->partial_files, priv->sort_func, this);
+    GList *shown = g_list_copy (get_visible_files());
+    GList *merged = merge_sorted_files (shown, pending, priv->sort_func, this);
+
+    g_list_free (shown);
+    g_list_free (pending);
+    priv->partial_files = NULL;
+    priv->partial_shown_cnt += priv->partial_files_cnt;
+    priv->partial_files_cnt = 0;
+
+    // ref the files while the list is rebuilt, otherwise the ".." file would be destroyed by clear()
+    gnome_cmd_file_list_ref (merged);
+
+    gtk_clist_freeze (*this);
+    clear();
+    for (GList *i = merged; i; i = i->next)
+        append_file(GNOME_CMD_FILE (i->data));
+    gtk_clist_thaw (*this);
+
+    gnome_cmd_file_list_unref (merged);
+    g_list_free (merged);
 }
 
 
@@ -1769,35 +2343,44 @@ void GnomeCmdFileList::show_files(GnomeCmdDir *dir)
 {
     remove_all_files();
 
-    GList *files = NULL;
+    // the complete listing replaces the incrementally shown one
+    g_list_free (priv->partial_files);
+    priv->partial_files = NULL;
+    priv->partial_files_cnt = 0;
+    priv->partial_shown_cnt = 0;
+    priv->partial_dir = NULL;
+
+    vector<GnomeCmdFile *> files;
+    GList *dir_files = gnome_cmd_dir_get_files (dir);
+
+    files.reserve(g_list_length (dir_files) + 1);
 
     // select the files to show
-    for (GList *i = gnome_cmd_dir_get_files (dir); i; i = i->next)
+    for (GList *i = dir_files; i; i = i->next)
     {
         GnomeCmdFile *f = GNOME_CMD_FILE (i->data);
 
         if (file_is_wanted (f))
-            files = g_list_append (files, f);
+            files.push_back(f);
     }
 
     // Create a parent dir file (..) if appropriate
     gchar *path = GNOME_CMD_FILE (dir)->get_path();
     if (path && strcmp (path, G_DIR_SEPARATOR_S) != 0)
-        files = g_list_append (files, gnome_cmd_dir_new_parent_dir_file (dir));
+        files.push_back(gnome_cmd_dir_new_parent_dir_file (dir));
     g_free (path);
 
-    if (!files)
+    if (files.empty())
         return;
 
-    files = g_list_sort_with_data (files, (GCompareDataFunc) priv->sort_func, this);
+    sort_files (this, files);
+
+    priv->visible_files.reserve(files.size());
 
     gtk_clist_freeze (*this);
-    for (GList *i = files; i; i = i->next)
-        append_file(GNOME_CMD_FILE (i->data));
+    for (vector<GnomeCmdFile *>::const_iterator i = files.begin(); i != files.end(); ++i)
+        append_file(*i);
     gtk_clist_thaw (*this);
-
-    if (files)
-        g_list_free (files);
 }
 
 
@@ -1841,14 +2424,34 @@ void GnomeCmdFileList::show_dir_tree_size(GnomeCmdFile *f)
 }
 
 
+/**
+ * Calculates the tree sizes of all visible directories in a background
+ * thread, and shows each of them as soon as it is known.
+ */
 void GnomeCmdFileList::show_visible_tree_sizes()
 {
+    priv->stop_tree_sizes();
     invalidate_tree_size();
 
     for (GList *files = get_visible_files(); files; files = files->next)
-        show_dir_tree_size((GnomeCmdFile *) files->data);
+    {
+        GnomeCmdFile *f = (GnomeCmdFile *) files->data;
 
-    g_signal_emit (this, signals[FILES_CHANGED], 0);
+        if (f->info->type != GNOME_VFS_FILE_TYPE_DIRECTORY || f->is_dotdot)
+            continue;
+
+        Private::TreeSizeJob *job = g_new0 (Private::TreeSizeJob, 1);
+
+        job->f = f->ref();
+        job->uri = f->get_uri();
+        priv->tree_size_jobs.push_back(job);
+    }
+
+    if (priv->tree_size_jobs.empty())
+        return;
+
+    priv->tree_size_thread = g_thread_new ("tree-size", (GThreadFunc) Private::calc_tree_sizes, priv);
+    priv->tree_size_timeout = g_timeout_add (gnome_cmd_data.gui_update_rate, (GSourceFunc) Private::show_calculated_tree_sizes, this);
 }
 
 
@@ -1862,6 +2465,7 @@ gboolean GnomeCmdFileList::remove_file(GnomeCmdFile *f)
         return FALSE;
 
     gtk_clist_remove (*this, row);
+    priv->rows.erase(priv->rows.begin() + row);
 
     priv->selected_files.remove(f);
     priv->visible_files.remove(f);
@@ -1883,7 +2487,10 @@ gboolean GnomeCmdFileList::remove_file(const gchar *uri_str)
 
 void GnomeCmdFileList::clear()
 {
+    priv->drop_created_files();
+    priv->stop_tree_sizes();
     gtk_clist_clear (*this);
+    priv->rows.clear();
     priv->visible_files.clear();
     priv->selected_files.clear();
 }
@@ -1894,7 +2501,8 @@ void GnomeCmdFileList::reload()
     g_return_if_fail (GNOME_CMD_IS_DIR (cwd));
 
     unselect_all();
-    gnome_cmd_dir_relist_files (cwd, gnome_cmd_con_needs_list_visprog (con));
+    priv->partial_dir = NULL;
+    gnome_cmd_dir_relist_files (cwd, gnome_cmd_con_needs_list_visprog (con), gnome_cmd_data.incremental_listing);
 }
 
 
@@ -1915,6 +2523,48 @@ GnomeCmd::Collection<GnomeCmdFile *> &GnomeCmdFileList::get_marked_files()
 }
 
 
+GnomeCmdFile *GnomeCmdFileList::get_file_at_row(gint row)
+{
+    return row>=0 && row<(gint) priv->rows.size() ? priv->rows[row] : NULL;
+}
+
+
+gint GnomeCmdFileList::get_row_from_file(GnomeCmdFile *f)
+{
+    // look for f where it belongs in the sorted rows first...
+    for (gint row=priv->find_row(this, f, FALSE), n=priv->rows.size(); row<n; ++row)
+    {
+        if (priv->rows[row] == f)
+            return row;
+        if (priv->sort_func (priv->rows[row], f, this) != 0)
+            break;
+    }
+
+    // ...and fall back to scanning all of them, as f may have changed since it has been sorted in
+    vector<GnomeCmdFile *>::iterator i = find (priv->rows.begin(), priv->rows.end(), f);
+
+    return i==priv->rows.end() ? -1 : i - priv->rows.begin();
+}
+
+
+gboolean GnomeCmdFileList::has_file(const GnomeCmdFile *f)
+{
+    return priv->visible_files.contain(const_cast<GnomeCmdFile *> (f));
+}
+
+
+int GnomeCmdFileList::size()
+{
+    return priv->visible_files.size();
+}
+
+
+bool GnomeCmdFileList::empty()
+{
+    return priv->visible_files.empty();
+}
+
+
 GList *GnomeCmdFileList::get_visible_files()
 {
     return priv->visible_files.get_list();
@@ -2082,10 +2732,16 @@ void GnomeCmdFileList::sort()
 
     gtk_clist_freeze (*this);
     gtk_clist_clear (*this);
+    priv->rows.clear();
 
     // resort the files and readd them to the list
-    for (GList *list = priv->visible_files.sort(priv->sort_func, this); list; list = list->next)
-        add_file_to_clist (this, GNOME_CMD_FILE (list->data), -1);
+    vector<GnomeCmdFile *> files(priv->visible_files.begin(), priv->visible_files.end());
+
+    sort_files (this, files);
+    priv->visible_files.reorder(files);
+
+    for (vector<GnomeCmdFile *>::const_iterator i=files.begin(); i!=files.end(); ++i)
+        add_file_to_clist (this, *i, -1);
 
     // refocus the previously selected file if this file list has the focus
     if (selfile && GTK_WIDGET_HAS_FOCUS (this))
@@ -2570,13 +3226,16 @@ void GnomeCmdFileList::set_directory(GnomeCmdDir *dir)
     }
 
     cwd = dir;
+    priv->partial_dir = NULL;
+
+    g_signal_connect (dir, "list-partial", G_CALLBACK (on_dir_list_partial), this);
 
     switch (dir->state)
     {
         case GnomeCmdDir::STATE_EMPTY:
             g_signal_connect (dir, "list-ok", G_CALLBACK (on_dir_list_ok), this);
             g_signal_connect (dir, "list-failed", G_CALLBACK (on_dir_list_failed), this);
-            gnome_cmd_dir_list_files (dir, gnome_cmd_con_needs_list_visprog (con));
+            gnome_cmd_dir_list_files (dir, gnome_cmd_con_needs_list_visprog (con), gnome_cmd_data.incremental_listing);
             break;
 
         case GnomeCmdDir::STATE_LISTING:
@@ -2591,7 +3250,7 @@ void GnomeCmdFileList::set_directory(GnomeCmdDir *dir)
 
             // check if the dir has up-to-date file list; if not and it's a local dir - relist it
             if (gnome_cmd_dir_is_local (dir) && !gnome_cmd_dir_is_monitored (dir) && gnome_cmd_dir_update_mtime (dir))
-                gnome_cmd_dir_relist_files (dir, gnome_cmd_con_needs_list_visprog (con));
+                gnome_cmd_dir_relist_files (dir, gnome_cmd_con_needs_list_visprog (con), gnome_cmd_data.incremental_listing);
             else
                 on_dir_list_ok (dir, NULL, this);
             break;
@@ -108,14 +108,15 @@ struct GnomeCmdFileList
     GnomeCmdFileList(ColumnID sort_col, GtkSortType sort_order);
     ~GnomeCmdFileList();
 
-    int size()                          {  return g_list_length (get_visible_files());  }
-    bool empty()                        {  return get_visible_files()==NULL;            }    // FIXME should be: size()==0
+    int size();
+    bool empty();
     void clear();
 
     void reload();
 
     void append_file(GnomeCmdFile *f);
     gboolean insert_file(GnomeCmdFile *f);      // Returns TRUE if file added to shown file list, FALSE otherwise
+    void resort_file(GnomeCmdFile *f);          // Moves a shown file to its place after its sort key has changed
     gboolean remove_file(GnomeCmdFile *f);
     gboolean remove_file(const gchar *uri_str);
     void remove_files(GList *files);
@@ -141,8 +142,8 @@ struct GnomeCmdFileList
     void restore_selection();
 
     void select_row(gint row);
-    GnomeCmdFile *get_file_at_row(gint row)            {  return static_cast<GnomeCmdFile *>(gtk_clist_get_row_data (*this, row));  }
-    gint get_row_from_file(GnomeCmdFile *f)            {  return gtk_clist_find_row_from_data (*this, f);               }
+    GnomeCmdFile *get_file_at_row(gint row);
+    gint get_row_from_file(GnomeCmdFile *f);
     void focus_file(const gchar *focus_file, gboolean scroll_to_file=TRUE);
 
     void sort();
@@ -191,6 +192,7 @@ struct GnomeCmdFileList
 
     void update_file(GnomeCmdFile *f);
     void show_files(GnomeCmdDir *dir);
+    void show_partial_files(GnomeCmdDir *dir, GList *files);
     void show_dir_tree_size(GnomeCmdFile *f);
     void show_visible_tree_sizes();
 
@@ -240,11 +242,6 @@ inline void GnomeCmdFileList::remove_files (GList *files)
 	    remove_file(static_cast<GnomeCmdFile *>(files->data));
 }
 
-inline gboolean GnomeCmdFileList::has_file(const GnomeCmdFile *f)
-{
-    return g_list_index (get_visible_files(), f) != -1;
-}
-
 inline GnomeCmdFile *GnomeCmdFileList::get_selected_file()
 {
     GnomeCmdFile *f = get_focused_file();
@@ -314,13 +314,25 @@ GnomeVFSResult GnomeCmdFile::rename(const gchar *new_name)
     GnomeVFSResult result = gnome_vfs_set_file_info_uri (uri, new_info, GNOME_VFS_SET_FILE_INFO_NAME);
     gnome_vfs_uri_unref (uri);
 
-    if (result==GNOME_VFS_OK)       //  re-read GnomeVFSFileInfo for the new MIME type
-    {
-        const GnomeVFSFileInfoOptions infoOpts = (GnomeVFSFileInfoOptions) (GNOME_VFS_FILE_INFO_FOLLOW_LINKS|GNOME_VFS_FILE_INFO_GET_MIME_TYPE);
-        uri = get_uri(new_name);
-        result = gnome_vfs_get_file_info_uri (uri, new_info, infoOpts);
-        gnome_vfs_uri_unref (uri);
-    }
+    new_info->name = NULL;
+    gnome_vfs_file_info_unref (new_info);
+
+    return result==GNOME_VFS_OK ? renamed(new_name) : result;
+}
+
+
+GnomeVFSResult GnomeCmdFile::renamed(const gchar *new_name)
+{
+    g_return_val_if_fail (info, GNOME_VFS_ERROR_CORRUPTED_DATA);
+
+    GnomeVFSFileInfo *new_info = gnome_vfs_file_info_new ();
+    g_return_val_if_fail (new_info, GNOME_VFS_ERROR_CORRUPTED_DATA);
+
+    //  re-read GnomeVFSFileInfo for the new MIME type
+    const GnomeVFSFileInfoOptions infoOpts = (GnomeVFSFileInfoOptions) (GNOME_VFS_FILE_INFO_FOLLOW_LINKS|GNOME_VFS_FILE_INFO_GET_MIME_TYPE);
+    GnomeVFSURI *uri = get_uri(new_name);
+    GnomeVFSResult result = gnome_vfs_get_file_info_uri (uri, new_info, infoOpts);
+    gnome_vfs_uri_unref (uri);
 
     if (result==GNOME_VFS_OK && has_parent_dir (this))
     {
@@ -330,8 +342,12 @@ GnomeVFSResult GnomeCmdFile::rename(const gchar *new_name)
         gnome_cmd_dir_file_renamed (::get_parent_dir (this), this, old_uri_str);
         if (GNOME_CMD_IS_DIR (this))
             gnome_cmd_dir_update_path (GNOME_CMD_DIR (this));
+
+        g_free (old_uri_str);
     }
 
+    gnome_vfs_file_info_unref (new_info);
+
     return result;
 }
 
@@ -909,6 +925,12 @@ void GnomeCmdFile::invalidate_tree_size()
 }
 
 
+void GnomeCmdFile::set_tree_size(GnomeVFSFileSize size)
+{
+    priv->tree_size = size;
+}
+
+
 gboolean GnomeCmdFile::has_tree_size()
 {
     return priv->tree_size != -1;
@@ -92,6 +92,7 @@ struct GnomeCmdFile
     GnomeVFSResult chmod(GnomeVFSFilePermissions perm);
     GnomeVFSResult chown(uid_t uid, gid_t gid);
     GnomeVFSResult rename(const gchar *new_name);
+    GnomeVFSResult renamed(const gchar *new_name);          // updates the file after it has been renamed without gnome-vfs
 
     void update_info(GnomeVFSFileInfo *info);
     gboolean is_local();
@@ -102,6 +103,7 @@ struct GnomeCmdFile
     gboolean needs_update();
 
     void invalidate_tree_size();
+    void set_tree_size(GnomeVFSFileSize size);
     gboolean has_tree_size();
 
     GnomeVFSMimeApplication *get_default_application();
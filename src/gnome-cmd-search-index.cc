@@ -0,0 +1,177 @@
+/**
+ * @file gnome-cmd-search-index.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <vector>
+
+#include "gnome-cmd-includes.h"
+#include "gnome-cmd-data.h"
+#include "gnome-cmd-search-index.h"
+#include "search-engine.h"
+#include "utils.h"
+
+using namespace std;
+
+
+static vector<SearchIndex *> indexes;           // one for every directory of gnome_cmd_data.search_index_dirs
+
+static GThread *refresh_thread = NULL;
+static gint refreshing = FALSE;
+static gboolean stop_refresh = FALSE;
+
+
+static gchar *get_index_file (SearchIndex *index)
+{
+    gchar *checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, index->get_root(), -1);
+    gchar *fname = g_strconcat ("search-index-", checksum, ".db", NULL);
+    gchar *path = config_dir ? g_build_filename (config_dir, fname, NULL) : g_build_filename (g_get_home_dir (), "." PACKAGE, fname, NULL);
+
+    g_free (fname);
+    g_free (checksum);
+
+    return path;
+}
+
+
+static gpointer refresh_indexes (gpointer first_run)
+{
+    for (vector<SearchIndex *>::iterator i=indexes.begin(); i!=indexes.end() && !stop_refresh; ++i)
+    {
+        gchar *index_file = get_index_file (*i);
+
+        // a missing or outdated index file is simply built again by the refresh
+        if (first_run && !(*i)->load(index_file))
+            DEBUG ('g', "building the search index of %s\n", (*i)->get_root());
+
+        (*i)->refresh(&stop_refresh);
+
+        if ((*i)->is_dirty() && !(*i)->save(index_file))
+            g_warning ("Failed to save the search index of %s to %s", (*i)->get_root(), index_file);
+
+        g_free (index_file);
+    }
+
+    g_atomic_int_set (&refreshing, FALSE);
+
+    return NULL;
+}
+
+
+static void start_refresh (gboolean first_run)
+{
+    if (indexes.empty() || !g_atomic_int_compare_and_exchange (&refreshing, FALSE, TRUE))
+        return;
+
+    if (refresh_thread)
+        g_thread_join (refresh_thread);
+
+    refresh_thread = g_thread_new ("search-index", refresh_indexes, GINT_TO_POINTER (first_run));
+}
+
+
+void gcmd_search_index_init ()
+{
+    for (GList *i = gnome_cmd_data.search_index_dirs; i; i = i->next)
+    {
+        const gchar *dir = (const gchar *) i->data;
+
+        if (g_path_is_absolute (dir))
+            indexes.push_back(new SearchIndex(dir));
+        else
+            g_warning ("Ignoring the search index of %s, it's not an absolute path", dir);
+    }
+
+    // the index files are loaded in the background too, until then the searches walk the directories
+    start_refresh (TRUE);
+}
+
+
+void gcmd_search_index_shutdown ()
+{
+    stop_refresh = TRUE;
+
+    if (refresh_thread)
+        g_thread_join (refresh_thread);
+    refresh_thread = NULL;
+
+    for (vector<SearchIndex *>::iterator i=indexes.begin(); i!=indexes.end(); ++i)
+        delete *i;
+    indexes.clear();
+}
+
+
+void gcmd_search_index_refresh ()
+{
+    start_refresh (FALSE);
+}
+
+
+SearchIndex *gcmd_search_index_find (const gchar *path)
+{
+    SearchIndex *found = NULL;
+
+    // prefer the index with the deepest root
+    for (vector<SearchIndex *>::iterator i=indexes.begin(); i!=indexes.end(); ++i)
+        if ((*i)->covers(path) && (!found || strlen ((*i)->get_root()) > strlen (found->get_root())))
+            found = *i;
+
+    return found;
+}
+
+
+void gcmd_search_index_file_created (const gchar *uri_str)
+{
+    if (indexes.empty())
+        return;
+
+    gchar *path = gnome_vfs_get_local_path_from_uri (uri_str);
+
+    if (!path)
+        return;
+
+    for (vector<SearchIndex *>::iterator i=indexes.begin(); i!=indexes.end(); ++i)
+        (*i)->add(path);
+
+    g_free (path);
+}
+
+
+void gcmd_search_index_file_deleted (const gchar *uri_str)
+{
+    if (indexes.empty())
+        return;
+
+    gchar *path = gnome_vfs_get_local_path_from_uri (uri_str);
+
+    if (!path)
+        return;
+
+    for (vector<SearchIndex *>::iterator i=indexes.begin(); i!=indexes.end(); ++i)
+        (*i)->remove(path);
+
+    g_free (path);
+}
+
+
+void gcmd_search_index_file_renamed (const gchar *old_uri_str, const gchar *new_uri_str)
+{
+    gcmd_search_index_file_deleted (old_uri_str);
+    gcmd_search_index_file_created (new_uri_str);
+}
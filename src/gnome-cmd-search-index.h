@@ -0,0 +1,41 @@
+/**
+ * @file gnome-cmd-search-index.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GNOME_CMD_SEARCH_INDEX_H__
+#define __GNOME_CMD_SEARCH_INDEX_H__
+
+#include <glib.h>
+
+class SearchIndex;
+
+void gcmd_search_index_init ();
+void gcmd_search_index_shutdown ();
+
+// refreshes all indexes in the background, unless a refresh is running already
+void gcmd_search_index_refresh ();
+
+// returns the index covering the local directory path, or NULL
+SearchIndex *gcmd_search_index_find (const gchar *path);
+
+// changes reported by the directory monitors
+void gcmd_search_index_file_created (const gchar *uri_str);
+void gcmd_search_index_file_deleted (const gchar *uri_str);
+void gcmd_search_index_file_renamed (const gchar *old_uri_str, const gchar *new_uri_str);
+
+#endif // __GNOME_CMD_SEARCH_INDEX_H__
@@ -0,0 +1,307 @@
+/**
+ * @file gnome-cmd-table.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GNOME_CMD_TABLE_H__
+#define __GNOME_CMD_TABLE_H__
+
+#include <glib.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace GnomeCmd
+{
+    /**
+     * Referenced items in a contiguous table, found by their key or by
+     * themselves. Adding, removing and finding an item is O(1): a removed
+     * item leaves a hole, and the holes are squeezed out when they are
+     * half of the table or when the table is walked. The GList returned by
+     * get_list() is kept in the same order for the code that still expects
+     * a GList; its nodes stay valid until their item is removed.
+     */
+    template <typename T>
+    class Table
+    {
+      public:
+
+        typedef gchar *(* KeyFunc) (T *item);           // returns a new string
+        typedef void (* RefFunc) (T *item);
+        typedef typename std::vector<T *>::const_iterator const_iterator;
+
+        Table(KeyFunc key, RefFunc ref, RefFunc unref);
+        ~Table();
+
+        guint size() const          {  return table.size() - holes;  }
+        gboolean empty() const      {  return size() == 0;           }
+        void clear();
+        void reserve(guint n)       {  table.reserve(n);             }
+
+        void add(T *item);
+        void add(GList *items);
+        gboolean remove(T *item);
+        gboolean remove(const gchar *key);
+
+        const_iterator begin()              {  compact();  return table.begin();  }
+        const_iterator end()                {  compact();  return table.end();    }
+        T *operator [] (guint n)            {  compact();  return table[n];       }
+
+        GList *get_list()   {  return list;  }
+
+        T *find(const gchar *key);
+        gboolean contain(T *item)           {  return g_hash_table_lookup (by_item, item) != NULL;  }
+
+        GList *sort(GCompareDataFunc compare_func, gpointer user_data);
+        void reorder(const std::vector<T *> &items);    // items must hold the same items in the new order
+
+      private:
+
+        struct Slot
+        {
+            T *item;
+            gchar *key;
+            guint index;                                // in table
+            GList *link;                                // in list
+        };
+
+        struct Compare
+        {
+            GCompareDataFunc compare_func;
+            gpointer user_data;
+
+            Compare(GCompareDataFunc func, gpointer data): compare_func(func), user_data(data)     {}
+
+            bool operator () (T *a, T *b) const     {  return compare_func (a, b, user_data) < 0;  }
+        };
+
+        KeyFunc key_func;
+        RefFunc ref_func;
+        RefFunc unref_func;
+
+        GHashTable *by_key;
+        GHashTable *by_item;
+        std::vector<T *> table;                         // NULL where an item has been removed
+        guint holes;
+        GList *list;
+        GList *tail;
+
+        void erase(Slot *slot);
+        void compact();
+    };
+
+
+    template <typename T>
+    inline Table<T>::Table(KeyFunc key, RefFunc ref, RefFunc unref): key_func(key), ref_func(ref), unref_func(unref)
+    {
+        by_key = g_hash_table_new (g_str_hash, g_str_equal);
+        by_item = g_hash_table_new (g_direct_hash, g_direct_equal);
+        holes = 0;
+        list = tail = NULL;
+    }
+
+
+    template <typename T>
+    inline Table<T>::~Table()
+    {
+        clear();
+        g_hash_table_destroy (by_key);
+        g_hash_table_destroy (by_item);
+    }
+
+
+    template <typename T>
+    inline void Table<T>::clear()
+    {
+        for (GList *i = list; i; i = i->next)
+        {
+            Slot *slot = (Slot *) g_hash_table_lookup (by_item, i->data);
+
+            unref_func (slot->item);
+            g_free (slot->key);
+            g_slice_free (Slot, slot);
+        }
+
+        g_hash_table_remove_all (by_key);
+        g_hash_table_remove_all (by_item);
+        table.clear();
+        holes = 0;
+        g_list_free (list);
+        list = tail = NULL;
+    }
+
+
+    template <typename T>
+    inline void Table<T>::add(T *item)
+    {
+        g_return_if_fail (item != NULL);
+
+        Slot *slot = g_slice_new (Slot);
+
+        slot->item = item;
+        slot->key = key_func (item);
+
+        // re-adding an item moves it to the end, an item with the same key is replaced
+        ref_func (item);
+        remove(item);
+        remove(slot->key);
+
+        slot->index = table.size();
+        table.push_back(item);
+
+        // append to the remembered tail instead of walking the whole list
+        tail = g_list_append (tail, item);
+        if (!list)
+            list = tail;
+        else
+            tail = tail->next;
+        slot->link = tail;
+
+        g_hash_table_insert (by_key, slot->key, slot);
+        g_hash_table_insert (by_item, item, slot);
+    }
+
+
+    template <typename T>
+    inline void Table<T>::add(GList *items)
+    {
+        for (; items; items = items->next)
+            add((T *) items->data);
+    }
+
+
+    template <typename T>
+    inline void Table<T>::erase(Slot *slot)
+    {
+        table[slot->index] = NULL;
+        ++holes;
+
+        if (slot->link == tail)
+            tail = tail->prev;
+        list = g_list_delete_link (list, slot->link);
+
+        g_hash_table_remove (by_key, slot->key);
+        g_hash_table_remove (by_item, slot->item);
+
+        unref_func (slot->item);
+        g_free (slot->key);
+        g_slice_free (Slot, slot);
+
+        if (holes > table.size()/2)
+            compact();
+    }
+
+
+    template <typename T>
+    inline gboolean Table<T>::remove(T *item)
+    {
+        Slot *slot = (Slot *) g_hash_table_lookup (by_item, item);
+
+        if (!slot)
+            return FALSE;
+
+        erase(slot);
+
+        return TRUE;
+    }
+
+
+    template <typename T>
+    inline gboolean Table<T>::remove(const gchar *key)
+    {
+        g_return_val_if_fail (key != NULL, FALSE);
+
+        Slot *slot = (Slot *) g_hash_table_lookup (by_key, key);
+
+        if (!slot)
+            return FALSE;
+
+        erase(slot);
+
+        return TRUE;
+    }
+
+
+    template <typename T>
+    inline T *Table<T>::find(const gchar *key)
+    {
+        g_return_val_if_fail (key != NULL, NULL);
+
+        Slot *slot = (Slot *) g_hash_table_lookup (by_key, key);
+
+        return slot ? slot->item : NULL;
+    }
+
+
+    template <typename T>
+    inline void Table<T>::compact()
+    {
+        if (!holes)
+            return;
+
+        guint n = 0;
+
+        for (typename std::vector<T *>::const_iterator i=table.begin(); i!=table.end(); ++i)
+            if (*i)
+            {
+                ((Slot *) g_hash_table_lookup (by_item, *i))->index = n;
+                table[n++] = *i;
+            }
+
+        table.resize(n);
+        holes = 0;
+    }
+
+
+    // stable, like g_list_sort_with_data()
+    template <typename T>
+    inline GList *Table<T>::sort(GCompareDataFunc compare_func, gpointer user_data)
+    {
+        compact();
+        std::stable_sort (table.begin(), table.end(), Compare(compare_func, user_data));
+        reorder(table);
+
+        return list;
+    }
+
+
+    template <typename T>
+    inline void Table<T>::reorder(const std::vector<T *> &items)
+    {
+        g_return_if_fail (items.size() == size());
+
+        if (&items != &table)
+            table = items;
+
+        holes = 0;
+
+        // refill the existing nodes, so the GList view keeps its links
+        GList *i = list;
+        guint n = 0;
+
+        for (typename std::vector<T *>::const_iterator item = table.begin(); item != table.end(); ++item, i = i->next, ++n)
+        {
+            Slot *slot = (Slot *) g_hash_table_lookup (by_item, *item);
+
+            i->data = *item;
+            slot->index = n;
+            slot->link = i;
+        }
+    }
+}
+
+#endif // __GNOME_CMD_TABLE_H__
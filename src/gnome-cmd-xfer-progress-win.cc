@@ -103,6 +103,9 @@ static void init (GnomeCmdXferProgressWin *win)
     win->fileprog = create_progress_bar (w);
     gtk_container_add (GTK_CONTAINER (vbox), win->fileprog);
 
+    win->rate_label = create_label (w, "");
+    gtk_container_add (GTK_CONTAINER (vbox), win->rate_label);
+
     bbox = create_hbuttonbox (w);
     gtk_container_add (GTK_CONTAINER (vbox), bbox);
 
@@ -187,6 +190,30 @@ void gnome_cmd_xfer_progress_win_set_total_progress (GnomeCmdXferProgressWin *wi
 }
 
 
+/**
+ * Shows the speed of the transfer and the time left, @a secs_left is -1
+ * while it isn't known.
+ */
+void gnome_cmd_xfer_progress_win_set_rate (GnomeCmdXferProgressWin *win, gdouble bytes_per_sec, gdouble files_per_sec, gint64 secs_left)
+{
+    gchar *rate_str = g_strstrip (g_strdup (size2string ((GnomeVFSFileSize) bytes_per_sec, GNOME_CMD_SIZE_DISP_MODE_POWERED)));
+    gchar *text;
+
+    if (secs_left<0)
+        text = g_strdup_printf (_("%s/s, %.1f files/s"), rate_str, files_per_sec);
+    else
+        if (secs_left<3600)
+            text = g_strdup_printf (_("%s/s, %.1f files/s, %d:%02d left"), rate_str, files_per_sec, (gint) secs_left/60, (gint) secs_left%60);
+        else
+            text = g_strdup_printf (_("%s/s, %.1f files/s, %d:%02d:%02d left"), rate_str, files_per_sec, (gint) (secs_left/3600), (gint) secs_left/60%60, (gint) secs_left%60);
+
+    gtk_label_set_text (GTK_LABEL (win->rate_label), text);
+
+    g_free (text);
+    g_free (rate_str);
+}
+
+
 void gnome_cmd_xfer_progress_win_set_msg (GnomeCmdXferProgressWin *win, const gchar *string)
 {
     gtk_label_set_text (GTK_LABEL (win->msg_label), string);
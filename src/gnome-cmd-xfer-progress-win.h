@@ -38,6 +38,7 @@ struct GnomeCmdXferProgressWin
     GtkWidget *fileprog;
     GtkWidget *msg_label;
     GtkWidget *fileprog_label;
+    GtkWidget *rate_label;
 
     gboolean cancel_pressed;
 };
@@ -59,6 +60,8 @@ void gnome_cmd_xfer_progress_win_set_total_progress (GnomeCmdXferProgressWin *wi
                                                      GnomeVFSFileSize bytes_copied,
                                                      GnomeVFSFileSize bytes_total);
 
+void gnome_cmd_xfer_progress_win_set_rate (GnomeCmdXferProgressWin *win, gdouble bytes_per_sec, gdouble files_per_sec, gint64 secs_left);
+
 void gnome_cmd_xfer_progress_win_set_msg (GnomeCmdXferProgressWin *win, const gchar *string);
 
 void gnome_cmd_xfer_progress_win_set_action (GnomeCmdXferProgressWin *win, const gchar *string);
@@ -20,7 +20,10 @@
  */
 
 #include <config.h>
+#include <errno.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
 
 #include "gnome-cmd-includes.h"
 #include "gnome-cmd-xfer.h"
@@ -30,7 +33,10 @@
 #include "gnome-cmd-xfer-progress-win.h"
 #include "gnome-cmd-main-win.h"
 #include "gnome-cmd-data.h"
+#include "local-xfer.h"
 #include "utils.h"
+#include "xfer-queue.h"
+#include "xfer-rate.h"
 
 using namespace std;
 
@@ -41,8 +47,29 @@ using namespace std;
 struct XferData
 {
     GnomeVFSXferOptions xferOptions;
+    GnomeVFSXferErrorMode xferErrorMode;
+    GnomeVFSXferOverwriteMode xferOverwriteMode;
     GnomeVFSAsyncHandle *handle;
 
+    gchar *description;                         // shown in the queue window
+    const gchar *title;                         // of the progress window, until the transfer shows its progress
+
+    // Local to local transfers are done by local_xfer in local_thread instead of gnome-vfs.
+    // Its questions are asked by the main thread, query_cond tells local_thread the answer.
+    LocalXfer *local_xfer;
+    GThread *local_thread;
+    gboolean local_stopped;                     // run() returned FALSE, the journal is kept for resuming
+    GMutex query_mutex;
+    GCond query_cond;
+
+    // Transfers by gnome-vfs learn their totals only bit by bit, so prescan_thread
+    // computes them in parallel, with the shared tree walk of calc_tree_size()
+    GThread *prescan_thread;
+    GMutex prescan_mutex;
+    TreeSize prescan_base;                      // of the sources done
+    TreeSize prescan_total;                     // so far, protected by prescan_mutex
+    gboolean prescan_stop;
+
     // Source and target uri's. The first src_uri should be transfered to the first dest_uri and so on...
     GList *src_uri_list;
     GList *dest_uri_list;
@@ -68,6 +95,8 @@ struct XferData
     GnomeVFSFileSize bytes_total;
     GnomeVFSFileSize total_bytes_copied;
 
+    XferRate *rate;
+
     GFunc on_completed_func;
     gpointer on_completed_data;
 
@@ -92,6 +121,12 @@ inline void free_xfer_data (XferData *data)
     }
 
     g_list_free (data->dest_uri_list);
+    g_free (data->description);
+    delete data->local_xfer;
+    delete data->rate;
+    g_mutex_clear (&data->prescan_mutex);
+    g_mutex_clear (&data->query_mutex);
+    g_cond_clear (&data->query_cond);
     g_free (data);
 }
 
@@ -104,6 +139,10 @@ create_xfer_data (GnomeVFSXferOptions xferOptions, GList *src_uri_list, GList *d
     XferData *data = g_new0 (XferData, 1);
 
     data->xferOptions = xferOptions;
+    data->xferErrorMode = GNOME_VFS_XFER_ERROR_MODE_QUERY;
+    data->xferOverwriteMode = GNOME_VFS_XFER_OVERWRITE_MODE_QUERY;
+    data->description = NULL;
+    data->title = NULL;
     data->src_uri_list = src_uri_list;
     data->dest_uri_list = dest_uri_list;
     data->to_dir = to_dir;
@@ -123,21 +162,61 @@ create_xfer_data (GnomeVFSXferOptions xferOptions, GList *src_uri_list, GList *d
     data->on_completed_data = on_completed_data;
     data->done = FALSE;
     data->aborted = FALSE;
+    data->local_xfer = NULL;
+    data->local_thread = NULL;
+    data->local_stopped = FALSE;
+    g_mutex_init (&data->query_mutex);
+    g_cond_init (&data->query_cond);
+    data->prescan_thread = NULL;
+    g_mutex_init (&data->prescan_mutex);
+    data->prescan_stop = FALSE;
+    data->rate = new XferRate;
 
-    // If this is a move-operation, determine totals
-    // The async_xfer_callback-results for file and byte totals are not reliable
-    if (xferOptions == GNOME_VFS_XFER_REMOVESOURCE) {
-        GList *uris;
-        data->bytes_total = 0;
-        data->files_total = 0;
-        for (uris = data->src_uri_list; uris != NULL; uris = uris->next) {
-            GnomeVFSURI *uri;
-            uri = (GnomeVFSURI*)uris->data;
-            data->bytes_total += calc_tree_size(uri,&(data->files_total));
-        }
+    return data;
+}
+
+
+static void update_queue_row (XferData *data);
+static void dequeue_xfer (XferData *data);
+static void offer_resume (LocalXfer *local_xfer, const gchar *question);
+
+
+static void prescan_progress (const TreeSize &done, XferData *data)
+{
+    g_mutex_lock (&data->prescan_mutex);
+    data->prescan_total.size = data->prescan_base.size + done.size;
+    data->prescan_total.count = data->prescan_base.count + done.count;
+    g_mutex_unlock (&data->prescan_mutex);
+}
+
+
+static gpointer prescan_func (XferData *data)
+{
+    for (GList *i = data->src_uri_list; i && !data->prescan_stop; i = i->next)
+    {
+        gulong count = 0;
+        GnomeVFSFileSize size = calc_tree_size ((GnomeVFSURI *) i->data, &count, &data->prescan_stop, (TreeSizeService::ProgressFunc) prescan_progress, data);
+
+        data->prescan_base.size += size;
+        data->prescan_base.count += count;
+
+        g_mutex_lock (&data->prescan_mutex);
+        data->prescan_total = data->prescan_base;
+        g_mutex_unlock (&data->prescan_mutex);
     }
 
-    return data;
+    return NULL;
+}
+
+
+inline void stop_prescan (XferData *data)
+{
+    if (!data->prescan_thread)
+        return;
+
+    data->prescan_stop = TRUE;
+    g_thread_join (data->prescan_thread);
+    data->prescan_thread = NULL;
 }
 
 
@@ -154,6 +233,60 @@ inline gchar *file_details(const gchar *text_uri)
 }
 
 
+// returns a GnomeVFSXferOverwriteAction
+static gint query_overwrite (XferData *data, const gchar *source_name, const gchar *target_name)
+{
+    gchar *s = NULL;
+    // Check if the src uri is from local ('file:///...'). If not, just use the base name.
+    if ( !(s = gnome_vfs_get_local_path_from_uri (source_name) )) s = str_uri_basename (source_name);
+    gchar *t = !data->to_dir || gnome_cmd_dir_is_local (data->to_dir) ? gnome_vfs_get_local_path_from_uri (target_name) : str_uri_basename (target_name);
+
+    gchar *source_filename = get_utf8 (s);
+    gchar *target_filename = get_utf8 (t);
+
+    g_free (s);
+    g_free (t);
+
+    gchar *source_details = file_details (source_name);
+    gchar *target_details = file_details (target_name);
+
+    gchar *text = g_strdup_printf (_("Overwrite file:\n\n<b>%s</b>\n<span color='dimgray' size='smaller'>%s</span>\n\nWith:\n\n<b>%s</b>\n<span color='dimgray' size='smaller'>%s</span>"), target_filename, target_details, source_filename, source_details);
+
+    g_free (source_filename);
+    g_free (target_filename);
+    g_free (source_details);
+    g_free (target_details);
+
+    gdk_threads_enter ();
+
+    gint ret = run_simple_dialog (*main_win, FALSE, GTK_MESSAGE_QUESTION, text, " ",
+                     1, _("Abort"), _("Replace"), _("Replace All"), _("Skip"), _("Skip All"), NULL);
+    g_free(text);
+
+    gdk_threads_leave ();
+    return ret==-1 ? 0 : ret;
+}
+
+
+// returns a GnomeVFSXferErrorAction
+static gint query_error (XferData *data, const gchar *target_name, const gchar *error)
+{
+    gchar *t = !data->to_dir || gnome_cmd_dir_is_local (data->to_dir) ? gnome_vfs_get_local_path_from_uri (target_name) :
+                                                                        str_uri_basename (target_name);
+    gchar *fn = get_utf8 (t);
+    gchar *msg = g_strdup_printf (_("Error while copying to %s\n\n%s"), fn, error);
+
+    gdk_threads_enter ();
+    gint ret = run_simple_dialog (*main_win, FALSE, GTK_MESSAGE_ERROR, msg, _("Transfer problem"),
+                                  -1, _("Abort"), _("Retry"), _("Skip"), NULL);
+    g_free (msg);
+    g_free (fn);
+    g_free (t);
+    gdk_threads_leave ();
+    return ret==-1 ? 0 : ret;
+}
+
+
 static gint async_xfer_callback (GnomeVFSAsyncHandle *handle, GnomeVFSXferProgressInfo *info, XferData *data)
 {
     data->cur_phase = info->phase;
@@ -182,56 +315,19 @@ static gint async_xfer_callback (GnomeVFSAsyncHandle *handle, GnomeVFSXferProgre
 
     if (info->status == GNOME_VFS_XFER_PROGRESS_STATUS_OVERWRITE)
     {
-    gchar *s = NULL;
-    // Check if the src uri is from local ('file:///...'). If not, just use the base name.
-    if ( !(s = gnome_vfs_get_local_path_from_uri (info->source_name) )) s = str_uri_basename (info->source_name);
-        gchar *t = gnome_cmd_dir_is_local (data->to_dir) ? gnome_vfs_get_local_path_from_uri (info->target_name) : str_uri_basename (info->target_name);
-
-        gchar *source_filename = get_utf8 (s);
-        gchar *target_filename = get_utf8 (t);
-
-        g_free (s);
-        g_free (t);
-
-        gchar *source_details = file_details (info->source_name);
-        gchar *target_details = file_details (info->target_name);
-
-        gchar *text = g_strdup_printf (_("Overwrite file:\n\n<b>%s</b>\n<span color='dimgray' size='smaller'>%s</span>\n\nWith:\n\n<b>%s</b>\n<span color='dimgray' size='smaller'>%s</span>"), target_filename, target_details, source_filename, source_details);
-
-        g_free (source_filename);
-        g_free (target_filename);
-        g_free (source_details);
-        g_free (target_details);
-
-        gdk_threads_enter ();
-
-        gint ret = run_simple_dialog (*main_win, FALSE, GTK_MESSAGE_QUESTION, text, " ",
-                         1, _("Abort"), _("Replace"), _("Replace All"), _("Skip"), _("Skip All"), NULL);
-        g_free(text);
+        gint ret = query_overwrite (data, info->source_name, info->target_name);
 
         data->prev_status = GNOME_VFS_XFER_PROGRESS_STATUS_OVERWRITE;
-        gdk_threads_leave ();
-        return ret==-1 ? 0 : ret;
+        return ret;
     }
 
     if (info->status == GNOME_VFS_XFER_PROGRESS_STATUS_VFSERROR
         && data->prev_status != GNOME_VFS_XFER_PROGRESS_STATUS_OVERWRITE)
     {
-        const gchar *error = gnome_vfs_result_to_string (info->vfs_status);
-        gchar *t = gnome_cmd_dir_is_local (data->to_dir) ? gnome_vfs_get_local_path_from_uri (info->target_name) :
-                                                           str_uri_basename (info->target_name);
-        gchar *fn = get_utf8 (t);
-        gchar *msg = g_strdup_printf (_("Error while copying to %s\n\n%s"), fn, error);
-
-        gdk_threads_enter ();
-        gint ret = run_simple_dialog (*main_win, FALSE, GTK_MESSAGE_ERROR, msg, _("Transfer problem"),
-                                      -1, _("Abort"), _("Retry"), _("Skip"), NULL);
-        g_free (msg);
-        g_free (fn);
-        g_free (t);
+        gint ret = query_error (data, info->target_name, gnome_vfs_result_to_string (info->vfs_status));
+
         data->prev_status = GNOME_VFS_XFER_PROGRESS_STATUS_VFSERROR;
-        gdk_threads_leave ();
-        return ret==-1 ? 0 : ret;
+        return ret;
     }
 
     if (info->phase == GNOME_VFS_XFER_PHASE_COMPLETED)
@@ -246,19 +342,175 @@ static gint async_xfer_callback (GnomeVFSAsyncHandle *handle, GnomeVFSXferProgre
 }
 
 
+// a question of the local transfer, which waits while the main thread asks it
+struct LocalXferQuery
+{
+    XferData *data;
+    gboolean overwrite;                         // otherwise an error
+    const gchar *source_name;
+    const gchar *target_name;
+    const gchar *error;
+    gint answer;                                // -1 until it is known
+};
+
+
+static gboolean ask_local_xfer_query (LocalXferQuery *query)
+{
+    XferData *data = query->data;
+
+    gint answer = data->aborted ? 0 :
+                  query->overwrite ? query_overwrite (data, query->source_name, query->target_name) :
+                                     query_error (data, query->target_name, query->error);
+
+    g_mutex_lock (&data->query_mutex);
+    query->answer = answer;
+    g_cond_signal (&data->query_cond);
+    g_mutex_unlock (&data->query_mutex);
+
+    return FALSE;
+}
+
+
+// the dialogs must not be run by the threads of the local transfer, so they are handed to the main loop
+static gint ask_main_thread (XferData *data, gboolean overwrite, const gchar *source_name, const gchar *target_name, const gchar *error)
+{
+    LocalXferQuery query = {data, overwrite, source_name, target_name, error, -1};
+
+    g_mutex_lock (&data->query_mutex);
+
+    g_idle_add ((GSourceFunc) ask_local_xfer_query, &query);
+
+    while (query.answer == -1)
+        g_cond_wait (&data->query_cond, &data->query_mutex);
+
+    g_mutex_unlock (&data->query_mutex);
+
+    return query.answer;
+}
+
+
+static LocalXfer::OverwriteAnswer local_xfer_overwrite (const gchar *src, const gchar *dest, XferData *data)
+{
+    gchar *source_name = gnome_vfs_get_uri_from_local_path (src);
+    gchar *target_name = gnome_vfs_get_uri_from_local_path (dest);
+
+    gint ret = data->aborted ? 0 : ask_main_thread (data, TRUE, source_name, target_name, NULL);
+
+    g_free (source_name);
+    g_free (target_name);
+
+    return (LocalXfer::OverwriteAnswer) ret;
+}
+
+
+static LocalXfer::ErrorAnswer local_xfer_error (const gchar *src, const gchar *dest, int error, XferData *data)
+{
+    gchar *target_name = gnome_vfs_get_uri_from_local_path (dest);
+
+    gint ret = data->aborted ? 0 : ask_main_thread (data, FALSE, NULL, target_name, g_strerror (error));
+
+    g_free (target_name);
+
+    return (LocalXfer::ErrorAnswer) ret;
+}
+
+
+static gpointer local_xfer_func (XferData *data)
+{
+    // a stopped transfer keeps its journal and partial copies until offer_stopped_xfer() asks what to do with them
+    data->local_stopped = !data->local_xfer->run(&data->aborted, (LocalXfer::OverwriteFunc) local_xfer_overwrite, (LocalXfer::ErrorFunc) local_xfer_error, data);
+    data->done = TRUE;
+
+    return NULL;
+}
+
+
+// a transfer cancelled or aborted on an error may be resumed now, at the next start or be discarded
+static void offer_stopped_xfer (XferData *data)
+{
+    if (!data->local_xfer || !data->local_stopped)
+        return;
+
+    const string &journal = data->local_xfer->get_journal();
+    LocalXfer *local_xfer = journal.empty() ? NULL : LocalXfer::load_journal(journal.c_str());
+
+    // nothing to resume from
+    if (!local_xfer)
+    {
+        data->local_xfer->discard();
+        return;
+    }
+
+    offer_resume (local_xfer, _("A transfer was stopped:\n\n%s\n\nResume it now?"));
+}
+
+
+// feeds the progress of the local transfer to the fields async_xfer_callback() fills for gnome-vfs
+static void update_local_xfer_progress (XferData *data)
+{
+    LocalXfer::Progress progress;
+
+    data->local_xfer->get_progress(progress);
+
+    data->cur_phase = GNOME_VFS_XFER_PHASE_COPYING;
+    data->files_total = progress.files_total;
+    data->cur_file = MIN (progress.files_done + 1, progress.files_total);
+    data->bytes_total = progress.bytes_total;
+    data->total_bytes_copied = progress.bytes_done;
+    data->file_size = progress.file_size;
+    data->bytes_copied = progress.file_bytes_done;
+
+    if (!progress.current_file.empty())
+    {
+        g_free (data->cur_file_name);
+        data->cur_file_name = gnome_vfs_get_uri_from_local_path (progress.current_file.c_str());
+    }
+}
+
+
 static gboolean update_xfer_gui_func (XferData *data)
 {
     if (data->win && data->win->cancel_pressed)
     {
         data->aborted = TRUE;
+        stop_prescan (data);
+
+        // the local transfer stops after the chunk it is copying, or may be waiting for a question
+        // this thread has to ask, so it is joined by a later call once it is done
+        if (data->local_thread)
+        {
+            if (!data->done)
+                return TRUE;
+
+            g_thread_join (data->local_thread);
+            data->local_thread = NULL;
+        }
 
         if (data->on_completed_func)
             data->on_completed_func (data->on_completed_data, NULL);
 
+        dequeue_xfer (data);
+
         gtk_widget_destroy (GTK_WIDGET (data->win));
+
+        offer_stopped_xfer (data);
         return FALSE;
     }
 
+    if (data->local_xfer)
+        update_local_xfer_progress (data);
+
+    update_queue_row (data);
+
+    if (data->prescan_thread)
+    {
+        // only update totals if larger than current value, as in async_xfer_callback()
+        g_mutex_lock (&data->prescan_mutex);
+        if (data->files_total < data->prescan_total.count) data->files_total = data->prescan_total.count;
+        if (data->bytes_total < data->prescan_total.size) data->bytes_total = data->prescan_total.size;
+        g_mutex_unlock (&data->prescan_mutex);
+    }
+
     if (data->cur_phase == GNOME_VFS_XFER_PHASE_COPYING)
     {
         if (data->prev_phase != GNOME_VFS_XFER_PHASE_COPYING)
@@ -295,10 +547,27 @@ static gboolean update_xfer_gui_func (XferData *data)
                     gtk_main_iteration_do (FALSE);
             }
         }
+
+        gulong files_done = data->cur_file>0 ? data->cur_file-1 : 0;
+
+        data->rate->update(g_get_monotonic_time () / (gdouble) G_USEC_PER_SEC, data->total_bytes_copied, files_done);
+
+        if (data->rate->is_known())
+            gnome_cmd_xfer_progress_win_set_rate (data->win, data->rate->get_bytes_per_sec(), data->rate->get_files_per_sec(),
+                                                  data->rate->get_eta(data->bytes_total>data->total_bytes_copied ? data->bytes_total-data->total_bytes_copied : 0,
+                                                                      data->files_total>files_done ? data->files_total-files_done : 0));
     }
 
     if (data->done)
     {
+        stop_prescan (data);
+
+        if (data->local_thread)
+        {
+            g_thread_join (data->local_thread);
+            data->local_thread = NULL;
+        }
+
         // Remove files from the source file list when a move operation has finished
         if (data->xferOptions & GNOME_VFS_XFER_REMOVESOURCE)
             if (data->src_fl && data->src_files)
@@ -340,6 +609,8 @@ static gboolean update_xfer_gui_func (XferData *data)
             data->win = NULL;
         }
 
+        dequeue_xfer (data);
+        offer_stopped_xfer (data);
         free_xfer_data (data);
 
         return FALSE;
@@ -400,6 +671,464 @@ inline gboolean file_is_already_in_dir (GnomeVFSURI *uri, GnomeCmdDir *dir)
 }
 
 
+inline gchar *get_local_path (GnomeVFSURI *uri)
+{
+    gchar *uri_str = gnome_vfs_uri_to_string (uri, GNOME_VFS_URI_HIDE_NONE);
+    gchar *path = gnome_vfs_get_local_path_from_uri (uri_str);
+
+    g_free (uri_str);
+
+    return path;
+}
+
+
+inline gchar *get_journal_dir ()
+{
+    return config_dir ? g_build_filename (config_dir, "xfer-journals", NULL) : g_build_filename (g_get_home_dir (), "." PACKAGE, "xfer-journals", NULL);
+}
+
+
+// returns NULL unless all files are local and the options are the ones LocalXfer knows
+static LocalXfer *create_local_xfer (XferData *data, GnomeVFSXferOverwriteMode xferOverwriteMode)
+{
+    const guint supported = GNOME_VFS_XFER_RECURSIVE | GNOME_VFS_XFER_FOLLOW_LINKS | GNOME_VFS_XFER_REMOVESOURCE;
+
+    if ((data->xferOptions & ~supported) || !(data->xferOptions & (GNOME_VFS_XFER_RECURSIVE | GNOME_VFS_XFER_REMOVESOURCE)))
+        return NULL;
+
+    LocalXfer::OverwriteMode mode;
+
+    switch (xferOverwriteMode)
+    {
+        case GNOME_VFS_XFER_OVERWRITE_MODE_QUERY:   mode = LocalXfer::OVERWRITE_QUERY;   break;
+        case GNOME_VFS_XFER_OVERWRITE_MODE_REPLACE: mode = LocalXfer::OVERWRITE_REPLACE; break;
+        case GNOME_VFS_XFER_OVERWRITE_MODE_SKIP:    mode = LocalXfer::OVERWRITE_SKIP;    break;
+        default:                                    mode = LocalXfer::OVERWRITE_ABORT;   break;
+    }
+
+    LocalXfer *local_xfer = new LocalXfer((data->xferOptions & GNOME_VFS_XFER_REMOVESOURCE) != 0,
+                                          (data->xferOptions & GNOME_VFS_XFER_FOLLOW_LINKS) != 0,
+                                          mode);
+
+    for (GList *src = data->src_uri_list, *dest = data->dest_uri_list; src && dest; src = src->next, dest = dest->next)
+    {
+        gchar *src_path = get_local_path ((GnomeVFSURI *) src->data);
+        gchar *dest_path = get_local_path ((GnomeVFSURI *) dest->data);
+        gboolean local = src_path && dest_path;
+
+        if (local)
+            local_xfer->add(src_path, dest_path);
+
+        g_free (src_path);
+        g_free (dest_path);
+
+        if (!local)
+        {
+            delete local_xfer;
+            return NULL;
+        }
+    }
+
+    static guint journals = 0;
+    gchar *dir = get_journal_dir ();
+
+    if (g_mkdir_with_parents (dir, 0700)==0)
+    {
+        gchar *fname = g_strdup_printf ("%ld-%d-%u.journal", (long) time (NULL), (int) getpid (), journals++);
+        gchar *path = g_build_filename (dir, fname, NULL);
+
+        local_xfer->set_journal(path);
+
+        g_free (path);
+        g_free (fname);
+    }
+
+    g_free (dir);
+
+    return local_xfer;
+}
+
+
+/***********************************
+ * The queue of transfers
+ ***********************************/
+
+// the transfers wait here for their devices, see XferQueue
+static XferQueue xfer_queue;
+
+enum
+{
+    COL_XFER,
+    COL_DESCRIPTION,
+    COL_STATE,
+    COL_PROGRESS,
+    NUM_QUEUE_COLUMNS
+};
+
+static GtkWidget *queue_win = NULL;
+static GtkWidget *queue_view = NULL;
+static GtkListStore *queue_store = NULL;
+
+
+static void start_xfer (XferData *data)
+{
+    data->win = GNOME_CMD_XFER_PROGRESS_WIN (gnome_cmd_xfer_progress_win_new (g_list_length (data->src_uri_list)));
+    gtk_widget_ref (GTK_WIDGET (data->win));
+    gtk_window_set_title (GTK_WINDOW (data->win), data->title);
+    gtk_widget_show (GTK_WIDGET (data->win));
+
+    if (data->local_xfer)
+        data->local_thread = g_thread_new (NULL, (GThreadFunc) local_xfer_func, data);
+    else
+    {
+        data->prescan_thread = g_thread_new (NULL, (GThreadFunc) prescan_func, data);
+
+        gnome_vfs_async_xfer (&data->handle, data->src_uri_list, data->dest_uri_list,
+                              data->xferOptions, data->xferErrorMode, data->xferOverwriteMode,
+                              XFER_PRIORITY,
+                              (GnomeVFSAsyncXferProgressCallback) async_xfer_callback, data,
+                              NULL, NULL);
+    }
+
+    g_timeout_add (gnome_cmd_data.gui_update_rate, (GSourceFunc) update_xfer_gui_func, data);
+}
+
+
+static XferData *get_selected_xfer ()
+{
+    GtkTreeIter iter;
+    XferData *data = NULL;
+
+    if (queue_view && gtk_tree_selection_get_selected (gtk_tree_view_get_selection (GTK_TREE_VIEW (queue_view)), NULL, &iter))
+        gtk_tree_model_get (GTK_TREE_MODEL (queue_store), &iter, COL_XFER, &data, -1);
+
+    return data;
+}
+
+
+static void update_queue_buttons ()
+{
+    XferData *data = get_selected_xfer ();
+    gint n = data ? xfer_queue.find(data) : -1;
+    gboolean running = data && xfer_queue.is_running(data);
+    gboolean paused = data && xfer_queue.is_paused(data);
+
+    // gnome-vfs can't hold a running transfer
+    gtk_widget_set_sensitive ((GtkWidget *) g_object_get_data (G_OBJECT (queue_win), "up-button"), n>0);
+    gtk_widget_set_sensitive ((GtkWidget *) g_object_get_data (G_OBJECT (queue_win), "down-button"), n>=0 && n+1<(gint) xfer_queue.size());
+    gtk_widget_set_sensitive ((GtkWidget *) g_object_get_data (G_OBJECT (queue_win), "pause-button"), data && !paused && (!running || data->local_xfer));
+    gtk_widget_set_sensitive ((GtkWidget *) g_object_get_data (G_OBJECT (queue_win), "resume-button"), paused);
+    gtk_widget_set_sensitive ((GtkWidget *) g_object_get_data (G_OBJECT (queue_win), "cancel-button"), data!=NULL);
+}
+
+
+static void set_queue_row (GtkTreeIter *iter, XferData *data)
+{
+    const gchar *state;
+
+    if (xfer_queue.is_running(data))
+        state = xfer_queue.is_paused(data) ? _("paused") : _("running");
+    else
+        state = xfer_queue.is_paused(data) ? _("held") : _("waiting");
+
+    gint progress = data->bytes_total>0 ? (gint) MIN (data->total_bytes_copied * 100 / data->bytes_total, 100) : 0;
+
+    gtk_list_store_set (queue_store, iter,
+                        COL_STATE, state,
+                        COL_PROGRESS, progress,
+                        -1);
+}
+
+
+static void fill_queue_win ()
+{
+    XferData *selected = get_selected_xfer ();
+
+    gtk_list_store_clear (queue_store);
+
+    for (guint n=0; n<xfer_queue.size(); ++n)
+    {
+        XferData *data = (XferData *) xfer_queue.get(n);
+        GtkTreeIter iter;
+
+        gtk_list_store_append (queue_store, &iter);
+        gtk_list_store_set (queue_store, &iter,
+                            COL_XFER, data,
+                            COL_DESCRIPTION, data->description,
+                            -1);
+        set_queue_row (&iter, data);
+
+        if (data==selected)
+            gtk_tree_selection_select_iter (gtk_tree_view_get_selection (GTK_TREE_VIEW (queue_view)), &iter);
+    }
+
+    update_queue_buttons ();
+}
+
+
+static void update_queue_row (XferData *data)
+{
+    if (!queue_win)
+        return;
+
+    GtkTreeIter iter;
+
+    for (gboolean valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (queue_store), &iter); valid; valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (queue_store), &iter))
+    {
+        XferData *row_data;
+
+        gtk_tree_model_get (GTK_TREE_MODEL (queue_store), &iter, COL_XFER, &row_data, -1);
+
+        if (row_data==data)
+        {
+            set_queue_row (&iter, data);
+            break;
+        }
+    }
+}
+
+
+static void schedule_xfers ()
+{
+    XferData *data;
+
+    while ((data = (XferData *) xfer_queue.next()))
+        start_xfer (data);
+
+    if (queue_win)
+        fill_queue_win ();
+}
+
+
+static void dequeue_xfer (XferData *data)
+{
+    xfer_queue.remove(data);
+
+    if (!xfer_queue.size() && queue_win)
+    {
+        gtk_widget_destroy (queue_win);
+        queue_win = NULL;
+        queue_view = NULL;
+        queue_store = NULL;
+    }
+
+    schedule_xfers ();
+}
+
+
+static void set_xfer_paused (XferData *data, gboolean paused)
+{
+    xfer_queue.set_paused(data, paused);
+
+    if (xfer_queue.is_running(data))
+    {
+        data->local_xfer->set_paused(paused);
+        gnome_cmd_xfer_progress_win_set_action (data->win, paused ? _("paused") : _("copying..."));
+    }
+
+    schedule_xfers ();
+}
+
+
+static void on_queue_selection_changed (GtkTreeSelection *selection, gpointer unused)
+{
+    update_queue_buttons ();
+}
+
+
+static void on_queue_up (GtkButton *button, gpointer unused)
+{
+    XferData *data = get_selected_xfer ();
+
+    xfer_queue.move(data, xfer_queue.find(data)-1);
+    fill_queue_win ();
+}
+
+
+static void on_queue_down (GtkButton *button, gpointer unused)
+{
+    XferData *data = get_selected_xfer ();
+
+    xfer_queue.move(data, xfer_queue.find(data)+1);
+    fill_queue_win ();
+}
+
+
+static void on_queue_pause (GtkButton *button, gpointer unused)
+{
+    set_xfer_paused (get_selected_xfer (), TRUE);
+}
+
+
+static void on_queue_resume (GtkButton *button, gpointer unused)
+{
+    set_xfer_paused (get_selected_xfer (), FALSE);
+}
+
+
+static void on_queue_cancel (GtkButton *button, gpointer unused)
+{
+    XferData *data = get_selected_xfer ();
+
+    // a running transfer is cancelled like from its progress window
+    if (xfer_queue.is_running(data))
+    {
+        data->win->cancel_pressed = TRUE;
+        return;
+    }
+
+    dequeue_xfer (data);
+
+    if (data->to_dir)
+        gnome_cmd_dir_unref (data->to_dir);
+
+    free_xfer_data (data);
+}
+
+
+static GtkWidget *create_queue_button (GtkWidget *vbox, const gchar *name, const gchar *label, const gchar *stock_id, GCallback callback)
+{
+    GtkWidget *button = gtk_button_new_with_mnemonic (label);
+
+    gtk_button_set_image (GTK_BUTTON (button), gtk_image_new_from_stock (stock_id, GTK_ICON_SIZE_BUTTON));
+    g_signal_connect (button, "clicked", callback, NULL);
+    gtk_box_pack_start (GTK_BOX (vbox), button, FALSE, FALSE, 0);
+    g_object_set_data (G_OBJECT (queue_win), name, button);
+
+    return button;
+}
+
+
+/**
+ * Shows the transfers of the queue, with the ones waiting for their
+ * devices. Closing the window only hides it, it is destroyed when the
+ * queue is empty.
+ */
+static void show_queue_win ()
+{
+    if (queue_win)
+    {
+        fill_queue_win ();
+        gtk_window_present (GTK_WINDOW (queue_win));
+        return;
+    }
+
+    queue_win = gtk_dialog_new_with_buttons (_("Transfer Queue"), *main_win,
+                                             GTK_DIALOG_DESTROY_WITH_PARENT,
+                                             GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                                             NULL);
+
+    gtk_window_set_position (GTK_WINDOW (queue_win), GTK_WIN_POS_CENTER);
+    gtk_dialog_set_has_separator (GTK_DIALOG (queue_win), FALSE);
+    gtk_container_set_border_width (GTK_CONTAINER (queue_win), 5);
+    gtk_window_set_resizable (GTK_WINDOW (queue_win), TRUE);
+
+    GtkWidget *hbox = gtk_hbox_new (FALSE, 12);
+    gtk_container_set_border_width (GTK_CONTAINER (hbox), 12);
+#if GTK_CHECK_VERSION (2, 14, 0)
+    gtk_container_add (GTK_CONTAINER (gtk_dialog_get_content_area (GTK_DIALOG (queue_win))), hbox);
+#else
+    gtk_container_add (GTK_CONTAINER (GTK_DIALOG (queue_win)->vbox), hbox);
+#endif
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new (NULL, NULL);
+    gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scrolled_window), GTK_SHADOW_IN);
+    gtk_box_pack_start (GTK_BOX (hbox), scrolled_window, TRUE, TRUE, 0);
+
+    queue_store = gtk_list_store_new (NUM_QUEUE_COLUMNS, G_TYPE_POINTER, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT);
+    queue_view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (queue_store));
+    g_object_unref (queue_store);          // destroyed with the view
+
+    gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (queue_view), -1, _("Transfer"), gtk_cell_renderer_text_new (), "text", COL_DESCRIPTION, NULL);
+    gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (queue_view), -1, _("State"), gtk_cell_renderer_text_new (), "text", COL_STATE, NULL);
+    gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (queue_view), -1, _("Progress"), gtk_cell_renderer_progress_new (), "value", COL_PROGRESS, NULL);
+
+    gtk_widget_set_size_request (queue_view, 450, 200);
+    g_signal_connect (gtk_tree_view_get_selection (GTK_TREE_VIEW (queue_view)), "changed", G_CALLBACK (on_queue_selection_changed), NULL);
+    gtk_container_add (GTK_CONTAINER (scrolled_window), queue_view);
+
+    GtkWidget *vbox = gtk_vbox_new (FALSE, 12);
+    gtk_box_pack_start (GTK_BOX (hbox), vbox, FALSE, FALSE, 0);
+
+    create_queue_button (vbox, "up-button", _("_Up"), GTK_STOCK_GO_UP, G_CALLBACK (on_queue_up));
+    create_queue_button (vbox, "down-button", _("_Down"), GTK_STOCK_GO_DOWN, G_CALLBACK (on_queue_down));
+    create_queue_button (vbox, "pause-button", _("_Pause"), GTK_STOCK_MEDIA_PAUSE, G_CALLBACK (on_queue_pause));
+    create_queue_button (vbox, "resume-button", _("_Resume"), GTK_STOCK_MEDIA_PLAY, G_CALLBACK (on_queue_resume));
+    create_queue_button (vbox, "cancel-button", _("_Cancel"), GTK_STOCK_CANCEL, G_CALLBACK (on_queue_cancel));
+
+    g_signal_connect (queue_win, "response", G_CALLBACK (gtk_widget_hide), NULL);
+    g_signal_connect (queue_win, "delete-event", G_CALLBACK (gtk_widget_hide_on_delete), NULL);
+
+    fill_queue_win ();
+
+    gtk_widget_show_all (queue_win);
+}
+
+
+static gchar *describe_xfer (XferData *data)
+{
+    guint n = g_list_length (data->src_uri_list);
+    gchar *src = n==1 ? gnome_vfs_uri_extract_short_name ((GnomeVFSURI *) data->src_uri_list->data) : g_strdup_printf (ngettext("%u file", "%u files", n), n);
+    gchar *dest = data->dest_uri_list ? gnome_vfs_uri_extract_dirname ((GnomeVFSURI *) data->dest_uri_list->data) : g_strdup ("");
+    gchar *description = g_strdup_printf (data->xferOptions & GNOME_VFS_XFER_REMOVESOURCE ? _("Move %s to %s") : _("Copy %s to %s"), src, dest);
+
+    g_free (src);
+    g_free (dest);
+
+    return description;
+}
+
+
+/**
+ * Queues a transfer behind the ones using the same devices: the devices
+ * of the sources and the one of the target directory. Remote files are
+ * on a device of their host.
+ */
+static void enqueue_xfer (XferData *data)
+{
+    vector<string> devices;
+    GList *uris = g_list_copy (data->src_uri_list);
+    GnomeVFSURI *dest_dir_uri = data->dest_uri_list ? gnome_vfs_uri_get_parent ((GnomeVFSURI *) data->dest_uri_list->data) : NULL;
+
+    if (dest_dir_uri)
+        uris = g_list_append (uris, dest_dir_uri);
+
+    for (GList *i = uris; i; i = i->next)
+    {
+        GnomeVFSURI *uri = (GnomeVFSURI *) i->data;
+        gchar *path = get_local_path (uri);
+        struct stat st;
+
+        if (!path)
+        {
+            const gchar *host = gnome_vfs_uri_get_host_name (uri);
+            devices.push_back(string(gnome_vfs_uri_get_scheme (uri)) + "://" + (host ? host : ""));
+        }
+        else
+            if (stat (path, &st)==0)
+                devices.push_back(XferQueue::local_device(st.st_dev));
+
+        g_free (path);
+    }
+
+    g_list_free (uris);
+
+    if (dest_dir_uri)
+        gnome_vfs_uri_unref (dest_dir_uri);
+
+    if (!data->description)
+        data->description = describe_xfer (data);
+
+    xfer_queue.add(data, devices);
+
+    schedule_xfers ();
+
+    if (!xfer_queue.is_running(data))
+        show_queue_win ();
+}
+
+
 void
 gnome_cmd_xfer_uris_start (GList *src_uri_list,
                            GnomeCmdDir *to_dir,
@@ -461,19 +1190,11 @@ gnome_cmd_xfer_uris_start (GList *src_uri_list,
 
     g_free (dest_fn);
 
-    data->win = GNOME_CMD_XFER_PROGRESS_WIN (gnome_cmd_xfer_progress_win_new (num_files));
-    gtk_widget_ref (GTK_WIDGET (data->win));
-    gtk_window_set_title (GTK_WINDOW (data->win), _("preparing..."));
-    gtk_widget_show (GTK_WIDGET (data->win));
-
-    //  start the transfer
-    gnome_vfs_async_xfer (&data->handle, data->src_uri_list, data->dest_uri_list,
-                          xferOptions, GNOME_VFS_XFER_ERROR_MODE_QUERY, xferOverwriteMode,
-                          XFER_PRIORITY,
-                          (GnomeVFSAsyncXferProgressCallback) async_xfer_callback, data,
-                          NULL, NULL);
+    data->xferOverwriteMode = xferOverwriteMode;
+    data->title = _("preparing...");
+    data->local_xfer = create_local_xfer (data, xferOverwriteMode);
 
-    g_timeout_add (gnome_cmd_data.gui_update_rate, (GSourceFunc) update_xfer_gui_func, data);
+    enqueue_xfer (data);
 }
 
 
@@ -541,17 +1262,116 @@ gnome_cmd_xfer_tmp_download_multiple (GList *src_uri_list,
                              NULL, NULL, NULL,
                              (GFunc) on_completed_func, on_completed_data);
 
-    data->win = GNOME_CMD_XFER_PROGRESS_WIN (gnome_cmd_xfer_progress_win_new (g_list_length (src_uri_list)));
-    gtk_window_set_title (GTK_WINDOW (data->win), _("downloading to /tmp"));
-    gtk_widget_show (GTK_WIDGET (data->win));
+    data->xferErrorMode = GNOME_VFS_XFER_ERROR_MODE_ABORT;
+    data->xferOverwriteMode = xferOverwriteMode;
+    data->title = _("downloading to /tmp");
 
-    //  start the transfer
-    GnomeVFSResult result;
-    result = gnome_vfs_async_xfer (&data->handle, data->src_uri_list, data->dest_uri_list,
-                                   xferOptions, GNOME_VFS_XFER_ERROR_MODE_ABORT, xferOverwriteMode,
-                                   XFER_PRIORITY,
-                                   (GnomeVFSAsyncXferProgressCallback) async_xfer_callback, data,
-                                   NULL, NULL);
+    enqueue_xfer (data);
+}
 
-    g_timeout_add (gnome_cmd_data.gui_update_rate, (GSourceFunc) update_xfer_gui_func, data);
+
+static void unref_uris (GList *uris, gpointer unused)
+{
+    gnome_vfs_uri_list_unref (uris);
+}
+
+
+// asks whether to resume the transfer loaded from its journal now, later or never, question has a %s for its description
+static void offer_resume (LocalXfer *local_xfer, const gchar *question)
+{
+    GList *src_uri_list = NULL;
+    GList *dest_uri_list = NULL;
+
+    for (vector<pair<string,string> >::const_iterator i=local_xfer->get_items().begin(); i!=local_xfer->get_items().end(); ++i)
+    {
+        gchar *src = gnome_vfs_get_uri_from_local_path (i->first.c_str());
+        gchar *dest = gnome_vfs_get_uri_from_local_path (i->second.c_str());
+
+        src_uri_list = g_list_append (src_uri_list, gnome_vfs_uri_new (src));
+        dest_uri_list = g_list_append (dest_uri_list, gnome_vfs_uri_new (dest));
+
+        g_free (src);
+        g_free (dest);
+    }
+
+    guint options = GNOME_VFS_XFER_RECURSIVE;
+
+    if (local_xfer->is_move())
+        options |= GNOME_VFS_XFER_REMOVESOURCE;
+    if (local_xfer->is_following_links())
+        options |= GNOME_VFS_XFER_FOLLOW_LINKS;
+
+    XferData *data = create_xfer_data ((GnomeVFSXferOptions) options, src_uri_list, dest_uri_list,
+                                       NULL, NULL, NULL,
+                                       (GFunc) unref_uris, src_uri_list);
+
+    data->title = _("resuming...");
+    data->local_xfer = local_xfer;
+    data->description = describe_xfer (data);
+
+    gchar *msg = g_strdup_printf (question, data->description);
+
+    switch (run_simple_dialog (*main_win, FALSE, GTK_MESSAGE_QUESTION, msg, _("Resume Transfer"),
+                               -1, _("Discard"), _("Later"), _("Resume"), NULL))
+    {
+        case 0:
+            local_xfer->discard();
+            free_xfer_data (data);
+            break;
+
+        case 2:
+            enqueue_xfer (data);
+            break;
+
+        default:
+            free_xfer_data (data);
+            break;
+    }
+
+    g_free (msg);
+}
+
+
+// offers the transfers left behind in their journals by a crash or by quitting while they ran
+static gboolean resume_xfers (gpointer unused)
+{
+    gchar *journal_dir = get_journal_dir ();
+    GDir *dir = g_dir_open (journal_dir, 0, NULL);
+    const gchar *fname;
+
+    while (dir && (fname = g_dir_read_name (dir)))
+    {
+        if (!g_str_has_suffix (fname, ".journal"))
+            continue;
+
+        gchar *path = g_build_filename (journal_dir, fname, NULL);
+        int error = 0;
+        LocalXfer *local_xfer = LocalXfer::load_journal(path, &error);
+
+        if (!local_xfer)
+        {
+            if (error!=EBUSY)
+                g_unlink (path);
+
+            g_free (path);
+            continue;
+        }
+
+        offer_resume (local_xfer, _("A transfer was interrupted:\n\n%s\n\nResume it now?"));
+
+        g_free (path);
+    }
+
+    if (dir)
+        g_dir_close (dir);
+
+    g_free (journal_dir);
+
+    return FALSE;
+}
+
+
+void gnome_cmd_xfer_init ()
+{
+    g_timeout_add (1, resume_xfers, NULL);
 }
@@ -63,4 +63,6 @@ gnome_cmd_xfer_tmp_download_multiple (GList *src_uri_list,
                                       GtkSignalFunc on_completed_func,
                                       gpointer on_completed_data);
 
+void gnome_cmd_xfer_init ();
+
 #endif // __GNOME_CMD_XFER_H__
@@ -43,6 +43,24 @@ typedef offset_type (*align_offset_to_line_start_proc)(GVDataPresentation *dp, o
 typedef offset_type (*scroll_lines_proc)(GVDataPresentation *dp, offset_type current_offset, int delta);
 typedef offset_type (*get_end_of_line_offset_proc)(GVDataPresentation *dp, offset_type start_of_line);
 
+/*
+  The line index holds one entry for every LINE_INDEX_BLOCK bytes of the file.
+  It is built from the start of the file in the idle time of the main loop,
+  LINE_INDEX_STEP bytes at a time, and lets the text presentations find line
+  starts near any offset without scanning back to the previous CR/LF.
+*/
+#define LINE_INDEX_BLOCK (64 * 1024)
+#define LINE_INDEX_STEP (256 * 1024)
+
+// characters decoded at once when scanning the file for line ends
+#define DECODE_CHUNK 256
+
+struct GVLineIndexEntry
+{
+    offset_type last_crlf;      // offset of the last CR/LF before the start of the block, 0 if there is none
+    offset_type wrap_start;     // start of the (wrapped) line the start of the block belongs to
+};
+
 struct GVDataPresentation
 {
     GVInputModesData *imd;
@@ -56,6 +74,23 @@ struct GVDataPresentation
     align_offset_to_line_start_proc align_offset_to_line_start;
     scroll_lines_proc               scroll_lines;
     get_end_of_line_offset_proc     get_end_of_line_offset;
+
+    GArray *index;              // of GVLineIndexEntry
+
+    // the settings the index has been built for, the wrap limit and tab size only matter in PRSNT_WRAP
+    gboolean index_valid;
+    gboolean index_utf8;
+    PRESENTATION index_mode;
+    guint index_wrap_limit;
+    guint index_tab_size;
+
+    // the state of the scan building the index
+    offset_type index_pos;
+    offset_type index_line_start;
+    offset_type index_text_line_start;
+    guint index_char_count;
+    offset_type index_last_crlf;
+    guint index_idle_id;
 };
 
 static offset_type nowrap_align_offset(GVDataPresentation *dp, offset_type offset);
@@ -70,6 +105,9 @@ static offset_type binfixed_align_offset(GVDataPresentation *dp, offset_type off
 static offset_type binfixed_scroll_lines(GVDataPresentation *dp, offset_type current_offset, int delta);
 static offset_type binfixed_get_eol(GVDataPresentation *dp, offset_type start_of_line);
 
+static gboolean line_index_build(GVDataPresentation *dp);
+static const GVLineIndexEntry *line_index_get(GVDataPresentation *dp, guint *n_entries);
+
 
 /*********************************************************
    Data presentation public functions
@@ -89,6 +127,7 @@ void gv_init_data_presentation(GVDataPresentation *dp, GVInputModesData *imd, of
     dp->imd = imd;
     dp->max_offset = max_offset;
     dp->tab_size = 8;
+    dp->index = g_array_new (FALSE, FALSE, sizeof(GVLineIndexEntry));
 
     gv_set_data_presentation_mode(dp, PRSNT_NO_WRAP);
 }
@@ -96,6 +135,55 @@ void gv_init_data_presentation(GVDataPresentation *dp, GVInputModesData *imd, of
 
 void gv_free_data_presentation(GVDataPresentation *dp)
 {
+    g_return_if_fail (dp!=NULL);
+
+    if (dp->index_idle_id)
+        g_source_remove (dp->index_idle_id);
+    dp->index_idle_id = 0;
+
+    if (dp->index)
+        g_array_free (dp->index, TRUE);
+    dp->index = NULL;
+}
+
+
+void gv_set_max_offset(GVDataPresentation *dp, offset_type max_offset)
+{
+    g_return_if_fail (dp!=NULL);
+
+    dp->max_offset = max_offset;
+
+    if (!dp->index || !dp->index_valid || dp->index_mode==PRSNT_BIN_FIXED)
+        return;
+
+    /* The end of the last text line has not been seen yet, and a character
+       cut by the old end of the file may be complete now, so the scan
+       continues from the start of that line */
+    guint n = dp->index_text_line_start / LINE_INDEX_BLOCK + 1;
+
+    if (dp->index->len > n)
+        g_array_set_size (dp->index, n);
+
+    dp->index_pos = dp->index_text_line_start;
+    dp->index_line_start = dp->index_text_line_start;
+    dp->index_char_count = 0;
+
+    if (!dp->index_idle_id)
+        dp->index_idle_id = g_idle_add ((GSourceFunc) line_index_build, dp);
+}
+
+
+void gv_reset_data_presentation(GVDataPresentation *dp, offset_type max_offset)
+{
+    g_return_if_fail (dp!=NULL);
+
+    dp->max_offset = max_offset;
+
+    // the index is started over as soon as it is needed again
+    if (dp->index_idle_id)
+        g_source_remove (dp->index_idle_id);
+    dp->index_idle_id = 0;
+    dp->index_valid = FALSE;
 }
 
 
@@ -179,6 +267,137 @@ offset_type gv_get_end_of_line_offset(GVDataPresentation *dp, offset_type start_
 }
 
 
+/***********************************************************************
+  Line index
+***********************************************************************/
+static void line_index_reset(GVDataPresentation *dp)
+{
+    g_array_set_size (dp->index, 0);
+
+    dp->index_valid = TRUE;
+    dp->index_utf8 = strcmp(gv_get_input_mode(dp->imd), "UTF8")==0;
+    dp->index_mode = dp->presentation_mode;
+    dp->index_wrap_limit = dp->presentation_mode==PRSNT_WRAP ? dp->wrap_limit : 0;
+    dp->index_tab_size = dp->presentation_mode==PRSNT_WRAP ? dp->tab_size : 0;
+
+    dp->index_pos = 0;
+    dp->index_line_start = 0;
+    dp->index_text_line_start = 0;
+    dp->index_char_count = 0;
+    dp->index_last_crlf = 0;
+
+    // binary presentations don't need an index
+    if (dp->presentation_mode==PRSNT_BIN_FIXED)
+    {
+        if (dp->index_idle_id)
+            g_source_remove (dp->index_idle_id);
+        dp->index_idle_id = 0;
+    }
+    else
+        if (!dp->index_idle_id)
+            dp->index_idle_id = g_idle_add ((GSourceFunc) line_index_build, dp);
+}
+
+
+/*
+ indexes the next LINE_INDEX_STEP bytes of the file,
+ the same way wrap_get_eol and nowrap_get_eol split it into lines
+*/
+static gboolean line_index_build(GVDataPresentation *dp)
+{
+    offset_type pos = dp->index_pos;
+    offset_type limit = pos + LINE_INDEX_STEP;
+    gboolean wrap = dp->index_mode==PRSNT_WRAP;
+
+    char_type chars[DECODE_CHUNK];
+    offset_type offsets[DECODE_CHUNK+1];
+    int count = 0;
+    int i = 0;
+
+    while (pos<limit)
+    {
+        if (i==count)
+        {
+            count = gv_input_mode_decode(dp->imd, pos, chars, offsets, DECODE_CHUNK);
+            i = 0;
+
+            if (count==0)
+            {
+                dp->index_pos = pos;
+                dp->index_idle_id = 0;
+                return FALSE;
+            }
+        }
+
+        char_type value = chars[i];
+        offset_type next = offsets[++i];
+
+        // blocks starting at or inside this character
+        while ((offset_type) dp->index->len * LINE_INDEX_BLOCK < next)
+        {
+            GVLineIndexEntry entry;
+
+            entry.last_crlf = dp->index_last_crlf;
+            entry.wrap_start = dp->index_line_start;
+            g_array_append_val (dp->index, entry);
+        }
+
+        gboolean eol = FALSE;
+
+        if (value=='\n' || value=='\r')
+        {
+            dp->index_last_crlf = pos;
+            dp->index_text_line_start = next;
+            eol = TRUE;
+        }
+        else
+        {
+            dp->index_char_count += value=='\t' ? dp->index_tab_size : 1;
+            eol = wrap && dp->index_char_count >= dp->index_wrap_limit;
+        }
+
+        if (eol)
+        {
+            dp->index_line_start = next;
+            dp->index_char_count = 0;
+        }
+
+        pos = next;
+    }
+
+    dp->index_pos = pos;
+
+    return TRUE;
+}
+
+
+/*
+ returns the entries indexed so far, or NULL if there are none.
+ starts over if the index was built for other settings.
+*/
+static const GVLineIndexEntry *line_index_get(GVDataPresentation *dp, guint *n_entries)
+{
+    *n_entries = 0;
+
+    if (!dp->index || dp->presentation_mode==PRSNT_BIN_FIXED)
+        return NULL;
+
+    gboolean wrap = dp->presentation_mode==PRSNT_WRAP;
+
+    if (!dp->index_valid || dp->index_mode!=dp->presentation_mode ||
+        dp->index_utf8!=(strcmp(gv_get_input_mode(dp->imd), "UTF8")==0) ||
+        (wrap && (dp->index_wrap_limit!=dp->wrap_limit || dp->index_tab_size!=dp->tab_size)))
+    {
+        line_index_reset(dp);
+        return NULL;
+    }
+
+    *n_entries = dp->index->len;
+
+    return dp->index->len ? (const GVLineIndexEntry *) dp->index->data : NULL;
+}
+
+
 /***********************************************************************
   Data presentation specific implementations
 ***********************************************************************/
@@ -189,12 +408,20 @@ offset_type gv_get_end_of_line_offset(GVDataPresentation *dp, offset_type start_
 static offset_type find_previous_crlf(GVDataPresentation *dp, offset_type start)
 {
     offset_type offset = start;
+    guint n_entries;
+    const GVLineIndexEntry *entries = line_index_get(dp, &n_entries);
 
     while (TRUE)
     {
         if (offset<=0)
             return 0;
 
+        // there is no CR/LF between the next block start and 'start', the index knows the one before
+        offset_type block = (offset + LINE_INDEX_BLOCK - 1) / LINE_INDEX_BLOCK;
+
+        if (block < n_entries && block * LINE_INDEX_BLOCK <= start)
+            return entries[block].last_crlf;
+
         offset = gv_input_get_previous_char_offset(dp->imd, offset);
         char_type value = gv_input_mode_get_utf8_char(dp->imd, offset);
 
@@ -212,15 +439,15 @@ static offset_type find_previous_crlf(GVDataPresentation *dp, offset_type start)
 
 static offset_type nowrap_align_offset(GVDataPresentation *dp, offset_type offset)
 {
-    while (offset>0)
-    {
-        char_type value = gv_input_mode_get_utf8_char(dp->imd, offset);
-        if (value==INVALID_CHAR)
-            return 0;
-        if (value=='\r' || value=='\n')
-            break;
-        offset = gv_input_get_previous_char_offset(dp->imd, offset);
-    }
+    if (offset==0)
+        return 0;
+
+    char_type value = gv_input_mode_get_utf8_char(dp->imd, offset);
+    if (value==INVALID_CHAR)
+        return 0;
+    if (value!='\r' && value!='\n')
+        offset = find_previous_crlf(dp, offset);
+
     if (offset>0)
         return gv_input_get_next_char_offset(dp->imd, offset);
     return 0;
@@ -268,18 +495,48 @@ static offset_type nowrap_scroll_lines(GVDataPresentation *dp, offset_type curre
 static offset_type nowrap_get_eol(GVDataPresentation *dp, offset_type start_of_line)
 {
     offset_type offset = start_of_line;
+    guint n_entries;
+    const GVLineIndexEntry *entries = line_index_get(dp, &n_entries);
 
-    while (TRUE)
+    char_type first = gv_input_mode_get_utf8_char(dp->imd, offset);
+
+    if (n_entries>1 && first!='\n' && first!='\r')
     {
-        char_type value = gv_input_mode_get_utf8_char(dp->imd, offset);
+        // skip the blocks without a CR/LF: find the first block ending after a CR/LF past 'start_of_line'
+        guint lo = 1;
+        guint hi = n_entries;
 
-        if (value==INVALID_CHAR)
-            break;
+        while (lo<hi)
+        {
+            guint mid = lo + (hi-lo)/2;
 
-        offset = gv_input_get_next_char_offset(dp->imd, offset);
+            if (entries[mid].last_crlf > start_of_line)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+
+        offset_type block_start = (offset_type) (lo-1) * LINE_INDEX_BLOCK;
+
+        if (block_start > offset)
+            offset = block_start;
+    }
+
+    char_type chars[DECODE_CHUNK];
+    offset_type offsets[DECODE_CHUNK+1];
+
+    while (TRUE)
+    {
+        int count = gv_input_mode_decode(dp->imd, offset, chars, offsets, DECODE_CHUNK);
 
         // break upon end of line
-        if (value=='\n' || value=='\r')
+        for (int i=0; i<count; i++)
+            if (chars[i]=='\n' || chars[i]=='\r')
+                return offsets[i+1];
+
+        offset = offsets[count];
+
+        if (count<DECODE_CHUNK)
             break;
     }
 
@@ -304,7 +561,14 @@ static offset_type find_previous_wrapped_text_line(GVDataPresentation *dp, offse
         offset = gv_input_get_next_char_offset(dp->imd, offset);
 
     /* Step 2
+        continue from the wrapped line the index knows closest before 'start'
     */
+    guint n_entries;
+    const GVLineIndexEntry *entries = line_index_get(dp, &n_entries);
+    offset_type block = start>0 ? (start-1) / LINE_INDEX_BLOCK : 0;
+
+    if (start>0 && block < n_entries && entries[block].wrap_start > offset && entries[block].wrap_start < start)
+        offset = entries[block].wrap_start;
 
     while (TRUE)
     {
@@ -327,6 +591,12 @@ static offset_type find_previous_wrapped_text_line(GVDataPresentation *dp, offse
 static offset_type wrap_align_offset(GVDataPresentation *dp, offset_type offset)
 {
     offset_type line_start = nowrap_align_offset(dp, offset);
+    guint n_entries;
+    const GVLineIndexEntry *entries = line_index_get(dp, &n_entries);
+    offset_type block = offset / LINE_INDEX_BLOCK;
+
+    if (block < n_entries && entries[block].wrap_start > line_start && entries[block].wrap_start <= offset)
+        line_start = entries[block].wrap_start;
 
     for (offset_type temp=line_start; temp<=offset; temp=wrap_scroll_lines(dp, temp, 1))
         line_start = temp;
@@ -371,7 +641,6 @@ static offset_type wrap_scroll_lines(GVDataPresentation *dp, offset_type current
 static offset_type wrap_get_eol(GVDataPresentation *dp, offset_type start_of_line)
 {
     offset_type offset;
-    char_type value;
 
     /* A Single TAB character in the file,
        Translates to several displayable characters on the screen.
@@ -379,27 +648,37 @@ static offset_type wrap_get_eol(GVDataPresentation *dp, offset_type start_of_lin
        characters before wraping the line */
     guint char_count = 0;
 
+    // a line has no more than 'wrap_limit' characters, unless tabs are empty
+    int chunk = CLAMP(dp->wrap_limit, 1, DECODE_CHUNK);
+    char_type chars[DECODE_CHUNK];
+    offset_type offsets[DECODE_CHUNK+1];
+
     offset = start_of_line;
 
     while (TRUE)
     {
-        value = gv_input_mode_get_utf8_char(dp->imd, offset);
+        int count = gv_input_mode_decode(dp->imd, offset, chars, offsets, chunk);
 
-        if (value==INVALID_CHAR)
-            break;
+        for (int i=0; i<count; i++)
+        {
+            char_type value = chars[i];
 
-        offset = gv_input_get_next_char_offset(dp->imd, offset);
+            // break upon end of line
+            if (value=='\n' || value=='\r')
+                return offsets[i+1];
 
-        // break upon end of line
-        if (value=='\n' || value=='\r')
-            break;
+            if (value=='\t')
+                char_count += dp->tab_size;
+            else
+                char_count++;
 
-        if (value=='\t')
-            char_count += dp->tab_size;
-        else
-            char_count++;
+            if (char_count >= dp->wrap_limit)
+                return offsets[i+1];
+        }
+
+        offset = offsets[count];
 
-        if (char_count >= dp->wrap_limit)
+        if (count<chunk)
             break;
     }
 
@@ -40,6 +40,8 @@ GVDataPresentation *gv_data_presentation_new();
 
 void gv_init_data_presentation(GVDataPresentation *dp, GVInputModesData *imd, offset_type max_offset);
 void gv_free_data_presentation(GVDataPresentation *dp);
+void gv_set_max_offset(GVDataPresentation *dp, offset_type max_offset);         // data has been appended
+void gv_reset_data_presentation(GVDataPresentation *dp, offset_type max_offset);  // the data has been replaced
 
 void gv_set_data_presentation_mode(GVDataPresentation *dp, PRESENTATION present);
 PRESENTATION gv_get_data_presentation_mode(GVDataPresentation *dp);
@@ -50,9 +50,23 @@
 
 #define VIEW_PAGE_SIZE 8192
 
+#define VIEW_WINDOW_SIZE (1 << 20)              // a multiple of the page size of every platform
+#define VIEW_WINDOWS 16
+#define VIEW_MAX_MAPPING (256 << 20)            // bigger files are accessed through windows
+
 using namespace std;
 
 
+struct ViewerFileWindow
+{
+    offset_type start;          // a multiple of VIEW_WINDOW_SIZE
+    offset_type len;
+    unsigned char *data;        // NULL if the window is unused
+    int mapped;                 // Did we use mmap on the window?
+    guint64 last_used;
+};
+
+
 struct _ViewerFileOps
 {
     // File handling (based on 'Midnight Commander'-'s view.c)
@@ -73,6 +87,15 @@ struct _ViewerFileOps
     offset_type bottom_first;    // First byte shown when very last page is displayed
                     // For the case of WINCH we should reset it to -1
     offset_type bytes_read;     // How much of file is read
+
+    // Window cache for files which are too big to be mapped as a whole
+    int windowed;
+    offset_type max_mapping;
+    ViewerFileWindow windows[VIEW_WINDOWS];
+    ViewerFileWindow *cur_window;       // the window of the last access
+    guint64 window_uses;
+
+    int following;              // the file may be truncated under the view, so nothing of it is mapped
 };
 
 
@@ -81,6 +104,7 @@ ViewerFileOps *gv_fileops_new()
     ViewerFileOps *fops = g_new0 (ViewerFileOps, 1);
 
     fops->file = -1;
+    fops->max_mapping = VIEW_MAX_MAPPING;
     return fops;
 }
 
@@ -220,6 +244,120 @@ const char *gv_file_init_growing_view (ViewerFileOps *ops, const char *filename)
 }
 
 
+static void gv_file_release_window (ViewerFileWindow *w)
+{
+    if (!w->data)
+        return;
+
+#ifdef HAVE_MMAP
+    if (w->mapped)
+        munmap ((char *) w->data, w->len);
+    else
+#endif                // HAVE_MMAP
+        g_free (w->data);
+
+    w->data = NULL;
+    w->mapped = 0;
+}
+
+
+// return values: NULL for success, else points to error message
+const char *gv_file_init_windowed_view (ViewerFileOps *ops)
+{
+    for (int i = 0; i < VIEW_WINDOWS; i++)
+        gv_file_release_window (ops->windows + i);
+    ops->cur_window = NULL;
+
+    ops->windowed = 1;
+    ops->first = 0;
+    ops->bytes_read = ops->s.st_size;
+
+    return NULL;
+}
+
+
+void gv_file_set_max_mapping (ViewerFileOps *ops, offset_type max_mapping)
+{
+    g_return_if_fail (ops!=NULL);
+
+    ops->max_mapping = max_mapping;
+}
+
+
+/*
+    returns the window containing BYTE_INDEX, maps or reads it into the least recently
+    used window if necessary; NULL if BYTE_INDEX is beyond the end of the file or on failure
+*/
+static ViewerFileWindow *gv_file_get_window (ViewerFileOps *ops, offset_type byte_index)
+{
+    if (byte_index >= ops->last_byte)
+        return NULL;
+
+    offset_type start = byte_index - byte_index % VIEW_WINDOW_SIZE;
+    ViewerFileWindow *lru = ops->windows;
+
+    for (int i = 0; i < VIEW_WINDOWS; i++)
+    {
+        ViewerFileWindow *w = ops->windows + i;
+
+        if (w->data && w->start == start)
+        {
+            w->last_used = ++ops->window_uses;
+            return ops->cur_window = w;
+        }
+
+        if (!w->data)
+            lru = w;
+        else if (lru->data && w->last_used < lru->last_used)
+            lru = w;
+    }
+
+    gv_file_release_window (lru);
+
+    lru->start = start;
+    lru->len = MIN (VIEW_WINDOW_SIZE, ops->last_byte - start);
+
+#ifdef HAVE_MMAP
+    // touching a mapping beyond the end of a truncated file raises SIGBUS
+    void *p = ops->following ? MAP_FAILED : mmap (0, lru->len, PROT_READ, MAP_FILE | MAP_SHARED, ops->file, start);
+
+    if (p != MAP_FAILED)
+    {
+        lru->data = (unsigned char *) p;
+        lru->mapped = 1;
+    }
+    else
+#endif                // HAVE_MMAP
+    {
+        lru->data = (unsigned char *) g_try_malloc (lru->len);
+
+        for (offset_type done = 0; lru->data && done < lru->len;)
+        {
+            ssize_t n = pread (ops->file, lru->data + done, lru->len - done, start + done);
+
+            if (n == -1 && errno == EINTR)
+                continue;
+
+            if (n <= 0)
+            {
+                // the file has been truncated in the meantime
+                g_free (lru->data);
+                lru->data = NULL;
+            }
+            else
+                done += n;
+        }
+
+        if (!lru->data)
+            return ops->cur_window = NULL;
+    }
+
+    lru->last_used = ++ops->window_uses;
+
+    return ops->cur_window = lru;
+}
+
+
 /*
     returns  NULL on success
 */
@@ -235,6 +373,9 @@ const char *gv_file_load(ViewerFileOps *ops, int fd)
         gv_file_close (ops);
         return gv_file_init_growing_view (ops, ops->filename);
     }
+    if ((offset_type) ops->s.st_size > ops->max_mapping || ops->following)
+        return gv_file_init_windowed_view (ops);
+
 #ifdef HAVE_MMAP
     if ((size_t) ops->s.st_size == ops->s.st_size)
         ops->data = (unsigned char *) mmap (0, ops->s.st_size, PROT_READ, MAP_FILE | MAP_SHARED, ops->file, 0);
@@ -266,8 +407,8 @@ const char *gv_file_load(ViewerFileOps *ops, int fd)
         read (ops->file, (char *) ops->data, ops->s.st_size) != ops->s.st_size)
     {
         g_free (ops->data);
-        gv_file_close (ops);
-        return gv_file_init_growing_view (ops, ops->filename);
+        ops->data = NULL;
+        return gv_file_init_windowed_view (ops);
     }
 
     ops->first = 0;
@@ -317,21 +458,94 @@ int gv_file_get_byte (ViewerFileOps *ops, offset_type byte_index)
 
         return byte_index >= ops->bytes_read ? -1 : ops->block_ptr[page - 1][offset];
     }
-    else
-        return byte_index >= ops->last_byte ? -1 : ops->data[byte_index];
+
+    if (ops->windowed)
+    {
+        ViewerFileWindow *w = ops->cur_window;
+
+        // byte_index below the window wraps around to a big difference
+        if (!w || byte_index - w->start >= w->len)
+            if (!(w = gv_file_get_window (ops, byte_index)))
+                return -1;
+
+        return w->data[byte_index - w->start];
+    }
+
+    return byte_index >= ops->last_byte ? -1 : ops->data[byte_index];
 }
 
 
-// based on MC's view.c "free_file"
-void gv_file_free(ViewerFileOps *ops)
+/*
+    returns: the number of bytes copied, less than COUNT only at the end of the file or on failure
+*/
+offset_type gv_file_get_range (ViewerFileOps *ops, offset_type start, unsigned char *buf, offset_type count)
 {
-    g_return_if_fail (ops!=NULL);
+    g_return_val_if_fail (ops!=NULL, 0);
+    g_return_val_if_fail (buf!=NULL, 0);
+
+    if (ops->growing_buffer)
+    {
+        offset_type done;
+
+        for (done = 0; done < count; done++)
+        {
+            int value = gv_file_get_byte (ops, start + done);
+
+            if (value == -1)
+                break;
+
+            buf[done] = value;
+        }
+
+        return done;
+    }
+
+    if (start >= ops->last_byte)
+        return 0;
+
+    count = MIN (count, ops->last_byte - start);
 
+    if (!ops->windowed)
+    {
+        memcpy (buf, ops->data + start, count);
+        return count;
+    }
+
+    offset_type done = 0;
+
+    while (done < count)
+    {
+        ViewerFileWindow *w = gv_file_get_window (ops, start + done);
+
+        if (!w)
+            break;
+
+        offset_type offset = start + done - w->start;
+        offset_type n = MIN (count - done, w->len - offset);
+
+        memcpy (buf + done, w->data + offset, n);
+        done += n;
+    }
+
+    return done;
+}
+
+
+// releases the memory holding the data of the file, the file itself stays open
+static void gv_file_release_data (ViewerFileOps *ops)
+{
 #ifdef HAVE_MMAP
     if (ops->mmapping)
         munmap ((char *) ops->data, ops->s.st_size);
 #endif                // HAVE_MMAP
-    gv_file_close (ops);
+    if (!ops->mmapping && !ops->windowed)
+        g_free (ops->data);
+    ops->data = NULL;
+    ops->mmapping = 0;
+
+    for (int i = 0; i < VIEW_WINDOWS; i++)
+        gv_file_release_window (ops->windows + i);
+    ops->cur_window = NULL;
 
     // Block_ptr may be zero if the file was a file with 0 bytes
     if (ops->growing_buffer && ops->block_ptr)
@@ -340,4 +554,101 @@ void gv_file_free(ViewerFileOps *ops)
             g_free (ops->block_ptr[i]);
         g_free (ops->block_ptr);
     }
+    ops->block_ptr = NULL;
+    ops->blocks = 0;
+    ops->growing_buffer = 0;
+}
+
+
+GVFileChange gv_file_update (ViewerFileOps *ops)
+{
+    g_return_val_if_fail (ops!=NULL, GV_FILE_UNCHANGED);
+
+    if (ops->file == -1)
+        return GV_FILE_UNCHANGED;
+
+    struct stat s;
+    GVFileChange change;
+
+    // a file of the same name which is not the open one has taken its place, e.g. by log rotation
+    if (ops->filename && stat (ops->filename, &s) == 0 && S_ISREG (s.st_mode) &&
+        (s.st_ino != ops->s.st_ino || s.st_dev != ops->s.st_dev))
+    {
+        int fd = open (ops->filename, O_RDONLY);
+
+        if (fd != -1)
+        {
+            gv_file_release_data (ops);
+            close (ops->file);
+            ops->file = fd;
+            memset (&ops->s, 0, sizeof (ops->s));
+        }
+    }
+
+    if (fstat (ops->file, &s) == -1)
+        return GV_FILE_UNCHANGED;
+
+    if (ops->growing_buffer && s.st_size == 0)
+        return GV_FILE_UNCHANGED;           // one of those files without a size (/proc), read as it is
+
+    if (ops->growing_buffer || s.st_ino != ops->s.st_ino || s.st_dev != ops->s.st_dev || s.st_size < ops->s.st_size)
+    {
+        // replaced or truncated, nothing read so far is of use
+        gv_file_release_data (ops);
+        change = GV_FILE_REPLACED;
+    }
+    else
+        if (s.st_size > ops->s.st_size)
+        {
+            // a mapping of the whole file can't grow, the appended data is accessed through windows
+            if (!ops->windowed)
+                gv_file_release_data (ops);
+            else
+                for (int i = 0; i < VIEW_WINDOWS; i++)
+                    if (ops->windows[i].len < VIEW_WINDOW_SIZE)
+                    {
+                        gv_file_release_window (ops->windows + i);
+                        if (ops->cur_window == ops->windows + i)
+                            ops->cur_window = NULL;
+                    }
+            change = GV_FILE_GROWN;
+        }
+        else
+            return GV_FILE_UNCHANGED;
+
+    ops->s = s;
+    ops->windowed = 1;
+    ops->first = 0;
+    ops->bytes_read = s.st_size;
+    ops->last_byte = s.st_size;
+
+    return change;
+}
+
+
+void gv_file_set_following (ViewerFileOps *ops, gboolean following)
+{
+    g_return_if_fail (ops!=NULL);
+
+    ops->following = following;
+
+    if (!following || ops->growing_buffer || (!ops->mmapping && !ops->windowed))
+        return;
+
+    // the mappings made so far are replaced by windows read with pread
+    if (ops->mmapping)
+        gv_file_release_data (ops);
+
+    gv_file_init_windowed_view (ops);
+}
+
+
+// based on MC's view.c "free_file"
+void gv_file_free(ViewerFileOps *ops)
+{
+    g_return_if_fail (ops!=NULL);
+
+    gv_file_release_data (ops);
+
+    gv_file_close (ops);
 }
@@ -57,14 +57,53 @@ const char *gv_file_load (ViewerFileOps *ops, int fd);
 */
 const char *gv_file_init_growing_view (ViewerFileOps *ops, const char *filename);
 
+/*
+    return values: NULL for success, else points to error message
+*/
+const char *gv_file_init_windowed_view (ViewerFileOps *ops);
+
+/*
+    files bigger than MAX_MAPPING bytes are not mapped as a whole, but through a cache
+    of windows of fixed size, the least recently used of which is replaced;
+    has to be called before opening the file
+*/
+void gv_file_set_max_mapping (ViewerFileOps *ops, offset_type max_mapping);
+
 /*
     returns: -1 on failure
         0->255 value on success
 */
 int gv_file_get_byte (ViewerFileOps *ops, offset_type byte_index);
 
+/*
+    copies COUNT bytes starting at START into BUF
+
+    returns: the number of bytes copied, less than COUNT only at the end of the file or on failure
+*/
+offset_type gv_file_get_range (ViewerFileOps *ops, offset_type start, unsigned char *buf, offset_type count);
+
 offset_type gv_file_get_max_offset(ViewerFileOps *ops);
 
+enum GVFileChange
+{
+    GV_FILE_UNCHANGED,
+    GV_FILE_GROWN,          // data has been appended
+    GV_FILE_REPLACED        // the file has been truncated, or replaced by another one of the same name
+};
+
+/*
+    checks the file for changes since it was opened or last checked, and makes its
+    current contents accessible; appended data is accessed through the window cache,
+    a file replaced by another one of the same name (e.g. by log rotation) is opened again
+*/
+GVFileChange gv_file_update (ViewerFileOps *ops);
+
+/*
+    a followed file is read into the windows instead of being mapped, as touching a mapping
+    beyond the end of a file truncated since raises SIGBUS; the file may be open or not
+*/
+void gv_file_set_following (ViewerFileOps *ops, gboolean following);
+
 void gv_file_close (ViewerFileOps *ops);
 
 void gv_file_free (ViewerFileOps *ops);
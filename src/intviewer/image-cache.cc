@@ -0,0 +1,314 @@
+/**
+ * @file image-cache.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "image-cache.h"
+
+using namespace std;
+
+
+#define IMAGE_CACHE_MAX_BYTES       (384*1024*1024)     // the pixbufs of all images cached
+#define IMAGE_CACHE_READ_SIZE       (64*1024)           // bytes fed to the pixbuf loader at a time
+#define IMAGE_CACHE_THREADS         2
+
+
+struct ImageCacheEntry
+{
+    gchar *filename;
+    time_t mtime;
+    off_t size;
+
+    GdkPixbuf *pixbuf;
+    gint image_width;
+    gint image_height;
+    gsize bytes;
+};
+
+
+struct PrefetchTask
+{
+    gchar *filename;
+    gint generation;
+};
+
+
+G_LOCK_DEFINE_STATIC (image_cache);
+
+static GList *entries = NULL;                   // the most recently used first
+static gsize cached_bytes = 0;
+static GHashTable *pending = NULL;              // the prefetch tasks queued or running, by file name
+
+static GThreadPool *prefetch_pool = NULL;
+static gint prefetch_generation = 0;            // tasks of older calls are dropped
+
+
+void image_cache_limit_size (GdkPixbufLoader *loader, gint width, gint height)
+{
+    gdouble pixels = (gdouble) width * height;
+
+    if (pixels > IMAGE_CACHE_MAX_PIXELS)
+    {
+        gdouble f = sqrt (IMAGE_CACHE_MAX_PIXELS / pixels);
+
+        gdk_pixbuf_loader_set_size (loader, MAX ((gint) (width * f), 1), MAX ((gint) (height * f), 1));
+    }
+}
+
+
+gboolean image_cache_feed_loader (GdkPixbufLoader *loader, const gchar *filename, gint *cancel, GError **error)
+{
+    GError *err = NULL;
+    int fd = open (filename, O_RDONLY);
+
+    if (fd==-1)
+        g_set_error (&err, G_FILE_ERROR, g_file_error_from_errno (errno), "%s: %s", filename, g_strerror (errno));
+    else
+    {
+        guchar *buf = g_new (guchar, IMAGE_CACHE_READ_SIZE);
+        ssize_t n;
+
+        while (!(cancel && g_atomic_int_get (cancel)) && (n = read (fd, buf, IMAGE_CACHE_READ_SIZE)) > 0)
+            if (!gdk_pixbuf_loader_write (loader, buf, n, &err))
+                break;
+
+        g_free (buf);
+        close (fd);
+    }
+
+    // a cancelled loader is closed silently, it would only complain about the missing data
+    gboolean cancelled = cancel && g_atomic_int_get (cancel);
+
+    gdk_pixbuf_loader_close (loader, err || cancelled ? NULL : &err);
+
+    if (!err)
+        return !cancelled;
+
+    g_propagate_error (error, err);
+
+    return FALSE;
+}
+
+
+static void free_entry (ImageCacheEntry *e)
+{
+    g_free (e->filename);
+    g_object_unref (e->pixbuf);
+    g_free (e);
+}
+
+
+// the caller holds the lock
+static void remove_entry (GList *l)
+{
+    ImageCacheEntry *e = (ImageCacheEntry *) l->data;
+
+    cached_bytes -= e->bytes;
+    entries = g_list_delete_link (entries, l);
+    free_entry (e);
+}
+
+
+// the caller holds the lock
+static GList *find_entry (const gchar *filename)
+{
+    for (GList *l=entries; l; l=l->next)
+        if (strcmp (((ImageCacheEntry *) l->data)->filename, filename)==0)
+            return l;
+
+    return NULL;
+}
+
+
+GdkPixbuf *image_cache_lookup (const gchar *filename, gint *image_width, gint *image_height)
+{
+    g_return_val_if_fail (filename!=NULL, NULL);
+
+    struct stat st;
+
+    if (stat (filename, &st)!=0)
+        return NULL;
+
+    GdkPixbuf *pixbuf = NULL;
+
+    G_LOCK (image_cache);
+
+    GList *l = find_entry (filename);
+
+    if (l)
+    {
+        ImageCacheEntry *e = (ImageCacheEntry *) l->data;
+
+        if (e->mtime==st.st_mtime && e->size==st.st_size)
+        {
+            pixbuf = (GdkPixbuf *) g_object_ref (e->pixbuf);
+            *image_width = e->image_width;
+            *image_height = e->image_height;
+
+            // move it to the front
+            entries = g_list_remove_link (entries, l);
+            entries = g_list_concat (l, entries);
+        }
+        else
+            remove_entry (l);
+    }
+
+    G_UNLOCK (image_cache);
+
+    return pixbuf;
+}
+
+
+void image_cache_insert (const gchar *filename, GdkPixbuf *pixbuf, gint image_width, gint image_height)
+{
+    g_return_if_fail (filename!=NULL);
+    g_return_if_fail (GDK_IS_PIXBUF (pixbuf));
+
+    struct stat st;
+
+    if (stat (filename, &st)!=0)
+        return;
+
+    gsize bytes = (gsize) gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+
+    if (bytes > IMAGE_CACHE_MAX_BYTES)
+        return;
+
+    ImageCacheEntry *e = g_new0 (ImageCacheEntry, 1);
+
+    e->filename = g_strdup (filename);
+    e->mtime = st.st_mtime;
+    e->size = st.st_size;
+    e->pixbuf = (GdkPixbuf *) g_object_ref (pixbuf);
+    e->image_width = image_width;
+    e->image_height = image_height;
+    e->bytes = bytes;
+
+    G_LOCK (image_cache);
+
+    GList *l = find_entry (filename);
+
+    if (l)
+        remove_entry (l);
+
+    entries = g_list_prepend (entries, e);
+    cached_bytes += bytes;
+
+    // drop the least recently used images, but never the new one
+    while (cached_bytes > IMAGE_CACHE_MAX_BYTES && entries->next)
+        remove_entry (g_list_last (entries));
+
+    G_UNLOCK (image_cache);
+}
+
+
+static void prefetch_size_prepared (GdkPixbufLoader *loader, gint width, gint height, gint *size)
+{
+    size[0] = width;
+    size[1] = height;
+
+    image_cache_limit_size (loader, width, height);
+}
+
+
+static void prefetch_func (PrefetchTask *task, gpointer unused)
+{
+    G_LOCK (image_cache);
+    gboolean wanted = task->generation==prefetch_generation;
+    G_UNLOCK (image_cache);
+
+    gint width, height;
+    GdkPixbuf *cached = wanted ? image_cache_lookup (task->filename, &width, &height) : NULL;
+
+    // skip the files which are no neighbours any more, and those decoded already
+    if (cached)
+        g_object_unref (cached);
+    else if (wanted)
+    {
+        GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+        gint size[2] = {0, 0};
+
+        g_signal_connect (loader, "size-prepared", G_CALLBACK (prefetch_size_prepared), size);
+
+        if (image_cache_feed_loader (loader, task->filename, NULL, NULL))
+        {
+            GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+            if (pixbuf)
+                image_cache_insert (task->filename, pixbuf, size[0], size[1]);
+        }
+
+        g_object_unref (loader);
+    }
+
+    G_LOCK (image_cache);
+    g_hash_table_remove (pending, task->filename);
+    G_UNLOCK (image_cache);
+
+    g_free (task->filename);
+    g_free (task);
+}
+
+
+void image_cache_prefetch (GList *filenames)
+{
+    G_LOCK (image_cache);
+
+    if (!prefetch_pool)
+    {
+        pending = g_hash_table_new (g_str_hash, g_str_equal);
+        prefetch_pool = g_thread_pool_new ((GFunc) prefetch_func, NULL, IMAGE_CACHE_THREADS, FALSE, NULL);
+    }
+
+    ++prefetch_generation;
+
+    for (GList *i=filenames; i; i=i->next)
+    {
+        const gchar *filename = (const gchar *) i->data;
+        PrefetchTask *task = (PrefetchTask *) g_hash_table_lookup (pending, filename);
+
+        // still queued from an earlier call, it is wanted again
+        if (task)
+        {
+            task->generation = prefetch_generation;
+            continue;
+        }
+
+        task = g_new0 (PrefetchTask, 1);
+        task->filename = g_strdup (filename);
+        task->generation = prefetch_generation;
+
+        g_hash_table_insert (pending, task->filename, task);
+        g_thread_pool_push (prefetch_pool, task, NULL);
+    }
+
+    G_UNLOCK (image_cache);
+}
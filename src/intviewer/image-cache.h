@@ -0,0 +1,65 @@
+/**
+ * @file image-cache.h
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __LIBGVIEWER_IMAGE_CACHE_H__
+#define __LIBGVIEWER_IMAGE_CACHE_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+/*
+    A cache of decoded images, shared by all image renderers and bounded by the memory
+    of the pixbufs. The neighbours of the image shown are decoded into it in advance by
+    a few background threads, so stepping through a directory of photos doesn't wait
+    for the decoder.
+
+    All functions may be called from any thread.
+*/
+
+#define IMAGE_CACHE_MAX_PIXELS      (32*1024*1024)      // bigger images are decoded scaled down to this size
+
+/*
+    Lets loader decode an image of width x height scaled down to IMAGE_CACHE_MAX_PIXELS,
+    call it from the "size-prepared" handler
+*/
+void image_cache_limit_size (GdkPixbufLoader *loader, gint width, gint height);
+
+/*
+    Feeds the content of filename to loader in chunks and closes the loader.
+    Stops early if *cancel becomes non-zero. Returns FALSE on errors.
+*/
+gboolean image_cache_feed_loader (GdkPixbufLoader *loader, const gchar *filename, gint *cancel, GError **error);
+
+/*
+    Returns a new reference to the decoded image of filename and the size of the image file,
+    or NULL if it is not in the cache or the file has changed since it was decoded
+*/
+GdkPixbuf *image_cache_lookup (const gchar *filename, gint *image_width, gint *image_height);
+
+void image_cache_insert (const gchar *filename, GdkPixbuf *pixbuf, gint image_width, gint image_height);
+
+/*
+    Decodes the files in the list of filenames into the cache in the background. Files not
+    decoded yet from earlier calls are dropped, only the latest neighbours are of interest.
+*/
+void image_cache_prefetch (GList *filenames);
+
+#endif // __LIBGVIEWER_IMAGE_CACHE_H__
@@ -36,6 +36,7 @@
 #include <iostream>
 
 #include "image-render.h"
+#include "image-cache.h"
 #include "gnome-cmd-includes.h"
 #include "gnome-cmd-file.h"
 #include "utils.h"
@@ -46,6 +47,10 @@ using namespace std;
 #define IMAGE_RENDER_DEFAULT_WIDTH      100
 #define IMAGE_RENDER_DEFAULT_HEIGHT     200
 
+#define IMAGE_RENDER_MIP_LEVELS         8
+#define IMAGE_RENDER_MIP_MIN_SIZE       64                  // no mip level is made smaller than this
+#define IMAGE_RENDER_PROGRESS_INTERVAL  100                 // ms between redraws while the image is being decoded
+
 
 enum {
   IMAGE_STATUS_CHANGED,
@@ -79,14 +84,20 @@ struct ImageRender::Private
     gfloat old_v_adj_upper;
 
     gchar      *filename;
-    gboolean    scaled_pixbuf_loaded;
-    GdkPixbuf  *orig_pixbuf;
-    GdkPixbuf  *disp_pixbuf;
+    GdkPixbuf  *orig_pixbuf;                            // filled by the loader thread until orig_pixbuf_loaded is set
+    GdkPixbuf  *mip_levels[IMAGE_RENDER_MIP_LEVELS];    // orig_pixbuf halved once, twice, ...
+    gint        n_mip_levels;
+    gint        image_width;                            // the size of the image file, orig_pixbuf is smaller for huge images
+    gint        image_height;
     gboolean    best_fit;
     gdouble     scale_factor;
 
     GThread    *pixbuf_loading_thread;
     gint        orig_pixbuf_loaded;
+    gint        cancel_loading;
+    gint        loading_progress;                       // the number of rows of orig_pixbuf decoded so far
+    gint        drawn_progress;
+    guint       progress_timeout_id;
 };
 
 
@@ -113,11 +124,11 @@ static void image_render_v_adjustment_changed (GtkAdjustment *adjustment, gpoint
 static void image_render_v_adjustment_value_changed (GtkAdjustment *adjustment, gpointer data);
 
 void image_render_start_background_pixbuf_loading (ImageRender *w);
-void image_render_load_scaled_pixbuf (ImageRender *obj);
 void image_render_wait_for_loader_thread (ImageRender *obj);
 
 static void image_render_free_pixbuf (ImageRender *obj);
-static void image_render_prepare_disp_pixbuf (ImageRender *obj);
+static void image_render_build_mip_levels (ImageRender *obj);
+static gboolean image_render_get_display_size (ImageRender *obj, gint *width, gint *height);
 static void image_render_update_adjustments (ImageRender *obj);
 
 /*****************************************
@@ -188,7 +199,6 @@ static void image_render_init (ImageRender *w)
 
     w->priv->button = 0;
 
-    w->priv->scaled_pixbuf_loaded = FALSE;
     w->priv->filename = NULL;
 
     w->priv->h_adjustment = NULL;
@@ -204,7 +214,7 @@ static void image_render_init (ImageRender *w)
     w->priv->best_fit = FALSE;
     w->priv->scale_factor = 1.3;
     w->priv->orig_pixbuf = NULL;
-    w->priv->disp_pixbuf = NULL;
+    w->priv->n_mip_levels = 0;
 
     GTK_WIDGET_SET_FLAGS (GTK_WIDGET (w), GTK_CAN_FOCUS);
 }
@@ -290,11 +300,13 @@ void image_render_notify_status_changed (ImageRender *w)
     stat.best_fit = w->priv->best_fit;
     stat.scale_factor = w->priv->scale_factor;
 
-    if (w->priv->orig_pixbuf)
+    GdkPixbuf *pixbuf = (GdkPixbuf *) g_atomic_pointer_get ((gpointer *) &w->priv->orig_pixbuf);
+
+    if (pixbuf)
     {
-        stat.image_width = gdk_pixbuf_get_width (w->priv->orig_pixbuf);
-        stat.image_height = gdk_pixbuf_get_height (w->priv->orig_pixbuf);
-        stat.bits_per_sample = gdk_pixbuf_get_bits_per_sample(w->priv->orig_pixbuf);
+        stat.image_width = g_atomic_int_get (&w->priv->image_width);
+        stat.image_height = g_atomic_int_get (&w->priv->image_height);
+        stat.bits_per_sample = gdk_pixbuf_get_bits_per_sample(pixbuf);
     }
 
     g_signal_emit (w, image_render_signals[IMAGE_STATUS_CHANGED], 0, &stat);
@@ -341,9 +353,8 @@ static void image_render_realize (GtkWidget *widget)
     gdk_window_set_user_data (window, widget);
     gtk_style_set_background (widget->style, window, GTK_STATE_ACTIVE);
 
-    // image_render_prepare_disp_pixbuf (obj);
-    if (!obj->priv->scaled_pixbuf_loaded)
-        image_render_load_scaled_pixbuf (obj);
+    if (obj->priv->filename && g_atomic_int_get (&obj->priv->orig_pixbuf_loaded)==0)
+        image_render_start_background_pixbuf_loading (obj);
 }
 
 
@@ -382,8 +393,57 @@ static void image_render_size_allocate (GtkWidget *widget, GtkAllocation *alloca
 #else
         gdk_window_move_resize (widget->window, allocation->x, allocation->y, allocation->width, allocation->height);
 #endif
-        image_render_prepare_disp_pixbuf (IMAGE_RENDER (widget));
+        image_render_update_adjustments (IMAGE_RENDER (widget));
+    }
+}
+
+
+/* Draws the part of the image inside area of the window. The image is scaled from the smallest mip level
+   which still has the resolution of the display, and only the pixels inside area are scaled at all */
+static void image_render_draw_area (ImageRender *obj, GdkDrawable *drawable, gint x0, gint y0, gint disp_width, gint disp_height, GdkRectangle *area)
+{
+    GdkPixbuf *src = (GdkPixbuf *) g_atomic_pointer_get ((gpointer *) &obj->priv->orig_pixbuf);
+
+    if (g_atomic_int_get (&obj->priv->orig_pixbuf_loaded))
+        for (gint i=obj->priv->n_mip_levels-1; i>=0; --i)
+            if (gdk_pixbuf_get_width (obj->priv->mip_levels[i]) >= disp_width &&
+                gdk_pixbuf_get_height (obj->priv->mip_levels[i]) >= disp_height)
+            {
+                src = obj->priv->mip_levels[i];
+                break;
+            }
+
+    gdouble scale_x = (gdouble) disp_width / gdk_pixbuf_get_width (src);
+    gdouble scale_y = (gdouble) disp_height / gdk_pixbuf_get_height (src);
+
+    if (scale_x==1.0 && scale_y==1.0)
+    {
+        gdk_draw_pixbuf (drawable, NULL, src,
+                         area->x - x0, area->y - y0,
+                         area->x, area->y,
+                         area->width, area->height,
+                         GDK_RGB_DITHER_NONE, 0, 0);
+        return;
     }
+
+    GdkPixbuf *tile = gdk_pixbuf_new (GDK_COLORSPACE_RGB, gdk_pixbuf_get_has_alpha (src), 8, area->width, area->height);
+
+    if (!tile)
+        return;
+
+    gdk_pixbuf_scale (src, tile,
+                      0, 0, area->width, area->height,
+                      x0 - area->x, y0 - area->y,
+                      scale_x, scale_y,
+                      scale_x>1.0 || scale_y>1.0 ? GDK_INTERP_NEAREST : GDK_INTERP_BILINEAR);
+
+    gdk_draw_pixbuf (drawable, NULL, tile,
+                     0, 0,
+                     area->x, area->y,
+                     area->width, area->height,
+                     GDK_RGB_DITHER_NONE, 0, 0);
+
+    g_object_unref (tile);
 }
 
 
@@ -392,106 +452,48 @@ static gboolean image_render_expose (GtkWidget *widget, GdkEventExpose *event)
     g_return_val_if_fail (IS_IMAGE_RENDER (widget), FALSE);
     g_return_val_if_fail (event != NULL, FALSE);
 
-    if (event->count > 0)
-        return FALSE;
-
     ImageRender *w = IMAGE_RENDER (widget);
 
 #if GTK_CHECK_VERSION (2,14,0)
-    gdk_window_clear_area (gtk_widget_get_window (widget), 0, 0, widget->allocation.width, widget->allocation.height);
+    GdkWindow *window = gtk_widget_get_window (widget);
 #else
-    gdk_window_clear_area (widget->window, 0, 0, widget->allocation.width, widget->allocation.height);
+    GdkWindow *window = widget->window;
 #endif
 
-    if (!w->priv->disp_pixbuf)
-        return FALSE;
+    gdk_window_clear_area (window, event->area.x, event->area.y, event->area.width, event->area.height);
 
-    gint xc, yc;
+    if (w->priv->filename && g_atomic_int_get (&w->priv->orig_pixbuf_loaded)==0)
+        image_render_start_background_pixbuf_loading (w);
 
-    if (w->priv->best_fit ||
-        (gdk_pixbuf_get_width (w->priv->disp_pixbuf) < widget->allocation.width &&
-         gdk_pixbuf_get_height (w->priv->disp_pixbuf) < widget->allocation.height))
-    {
-        xc = widget->allocation.width / 2 - gdk_pixbuf_get_width (w->priv->disp_pixbuf)/2;
-        yc = widget->allocation.height / 2 - gdk_pixbuf_get_height (w->priv->disp_pixbuf)/2;
+    GdkPixbuf *pixbuf = (GdkPixbuf *) g_atomic_pointer_get ((gpointer *) &w->priv->orig_pixbuf);
+    gint disp_width, disp_height;
 
-#if GTK_CHECK_VERSION (2,14,0)
-        gdk_draw_pixbuf (gtk_widget_get_window (widget),
-#else
-        gdk_draw_pixbuf (widget->window,
-#endif
-                NULL,
-                w->priv->disp_pixbuf,
-                0, 0, // source X, Y
-                xc, yc, // Dest X, Y
-                -1, -1, // Source W, H
-                 GDK_RGB_DITHER_NONE, 0, 0);
-    }
-    else
-    {
-        gint src_x, src_y;
-        gint dst_x, dst_y;
-        gint width, height;
-
-        if (widget->allocation.width > gdk_pixbuf_get_width (w->priv->disp_pixbuf))
-        {
-            src_x = 0;
-            dst_x = widget->allocation.width / 2 - gdk_pixbuf_get_width (w->priv->disp_pixbuf)/2;
-            width = gdk_pixbuf_get_width (w->priv->disp_pixbuf);
-        }
-        else
-        {
-            src_x = (int) gtk_adjustment_get_value (w->priv->h_adjustment);
-            dst_x = 0;
-            width = MIN(widget->allocation.width, gdk_pixbuf_get_width (w->priv->disp_pixbuf));
-            if (src_x + width > gdk_pixbuf_get_width (w->priv->disp_pixbuf))
-                src_x = gdk_pixbuf_get_width (w->priv->disp_pixbuf) - width;
-        }
+    if (!pixbuf || !image_render_get_display_size (w, &disp_width, &disp_height))
+        return FALSE;
 
+    // the position of the image in the window: centered if it is smaller, else scrolled by the adjustments
+    gint x0, y0;
 
-        if ((int) gtk_adjustment_get_value (w->priv->h_adjustment) > gdk_pixbuf_get_height (w->priv->disp_pixbuf))
-        {
-            src_y = 0;
-            dst_y = widget->allocation.height / 2 - gdk_pixbuf_get_height (w->priv->disp_pixbuf)/2;
-            height = gdk_pixbuf_get_height (w->priv->disp_pixbuf);
-        }
-        else
-        {
-            src_y = (int) gtk_adjustment_get_value (w->priv->v_adjustment);
-            dst_y = 0;
-            height = MIN(widget->allocation.height, gdk_pixbuf_get_height (w->priv->disp_pixbuf));
+    if (disp_width <= widget->allocation.width)
+        x0 = (widget->allocation.width - disp_width) / 2;
+    else
+        x0 = w->priv->h_adjustment ? -CLAMP ((gint) gtk_adjustment_get_value (w->priv->h_adjustment), 0, disp_width - widget->allocation.width) : 0;
 
-            if (src_y + height > gdk_pixbuf_get_height (w->priv->disp_pixbuf))
-                src_y = gdk_pixbuf_get_height (w->priv->disp_pixbuf) - height;
-        }
+    if (disp_height <= widget->allocation.height)
+        y0 = (widget->allocation.height - disp_height) / 2;
+    else
+        y0 = w->priv->v_adjustment ? -CLAMP ((gint) gtk_adjustment_get_value (w->priv->v_adjustment), 0, disp_height - widget->allocation.height) : 0;
 
-#if 0
-        fprintf(stderr, "src(%d, %d), dst(%d, %d), size(%d, %d) origsize(%d, %d) alloc(%d, %d) ajd(%d, %d)\n",
-                src_x, src_y,
-                dst_x, dst_y,
-                width, height,
-                gdk_pixbuf_get_width (w->priv->disp_pixbuf),
-                gdk_pixbuf_get_height (w->priv->disp_pixbuf),
-                widget->allocation.width,
-                widget->allocation.height,
-                (int)w->priv->h_adjustment->value,
-                (int)w->priv->v_adjustment->value);
-#endif
-#if GTK_CHECK_VERSION (2,14,0)
-        gdk_draw_pixbuf(gtk_widget_get_window (widget),
-#else
-        gdk_draw_pixbuf(widget->window,
-#endif
-                        NULL,
-                        w->priv->disp_pixbuf,
-                        src_x, src_y,
-                        dst_x, dst_y,
-                        width, height,
-                        GDK_RGB_DITHER_NONE, 0, 0);
-    }
+    GdkRectangle image_area = {x0, y0, disp_width, disp_height};
+    GdkRectangle area;
 
+    // while the image is being decoded only the rows ready so far are shown
     if (g_atomic_int_get (&w->priv->orig_pixbuf_loaded)==0)
-        image_render_start_background_pixbuf_loading (w);
+        image_area.height = (gint) ((gint64) g_atomic_int_get (&w->priv->loading_progress) * disp_height / gdk_pixbuf_get_height (pixbuf));
+
+    if (gdk_rectangle_intersect (&event->area, &image_area, &area))
+        image_render_draw_area (w, window, x0, y0, disp_width, disp_height, &area);
+
     return FALSE;
 }
 
@@ -727,33 +729,127 @@ static void image_render_v_adjustment_value_changed (GtkAdjustment *adjustment,
 }
 
 
+static void image_render_free_mip_levels (ImageRender *obj)
+{
+    for (gint i=0; i<obj->priv->n_mip_levels; ++i)
+        g_object_unref (obj->priv->mip_levels[i]);
+
+    obj->priv->n_mip_levels = 0;
+}
+
+
 static void image_render_free_pixbuf (ImageRender *obj)
 {
     g_return_if_fail (IS_IMAGE_RENDER(obj));
 
+    g_atomic_int_set (&obj->priv->cancel_loading, 1);
     image_render_wait_for_loader_thread (obj);
 
+    if (obj->priv->progress_timeout_id)
+        g_source_remove (obj->priv->progress_timeout_id);
+    obj->priv->progress_timeout_id = 0;
+
     obj->priv->orig_pixbuf_loaded = 0;
-    obj->priv->scaled_pixbuf_loaded = FALSE;
+    obj->priv->cancel_loading = 0;
+    obj->priv->loading_progress = 0;
+    obj->priv->drawn_progress = 0;
+    obj->priv->image_width = 0;
+    obj->priv->image_height = 0;
+
+    image_render_free_mip_levels (obj);
 
     if (obj->priv->orig_pixbuf)
         g_object_unref (obj->priv->orig_pixbuf);
     obj->priv->orig_pixbuf = NULL;
 
-    if (obj->priv->disp_pixbuf)
-        g_object_unref (obj->priv->disp_pixbuf);
-    obj->priv->disp_pixbuf = NULL;
-
     g_free (obj->priv->filename);
     obj->priv->filename = NULL;
 }
 
 
+/* Called by the pixbuf loader as soon as the size of the image is known. Huge images are decoded
+   scaled down, they are shown scaled down anyway unless zoomed in */
+static void image_render_loader_size_prepared (GdkPixbufLoader *loader, gint width, gint height, ImageRender *obj)
+{
+    g_atomic_int_set (&obj->priv->image_width, width);
+    g_atomic_int_set (&obj->priv->image_height, height);
+
+    image_cache_limit_size (loader, width, height);
+}
+
+
+static void image_render_loader_area_prepared (GdkPixbufLoader *loader, ImageRender *obj)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+    if (pixbuf && !obj->priv->orig_pixbuf)
+        g_atomic_pointer_set ((gpointer *) &obj->priv->orig_pixbuf, g_object_ref (pixbuf));
+}
+
+
+static void image_render_loader_area_updated (GdkPixbufLoader *loader, gint x, gint y, gint width, gint height, ImageRender *obj)
+{
+    if (y + height > obj->priv->loading_progress)
+        g_atomic_int_set (&obj->priv->loading_progress, y + height);
+}
+
+
+/* Takes the image from the cache or decodes the file chunk by chunk, so the main
+   thread can show the rows decoded so far, and makes the mip levels once the whole
+   image is there */
 static gpointer image_render_pixbuf_loading_thread (ImageRender *obj)
 {
-    GError *err = NULL;
+    gint width, height;
+    GdkPixbuf *pixbuf = image_cache_lookup (obj->priv->filename, &width, &height);
+
+    if (pixbuf)
+    {
+        g_atomic_int_set (&obj->priv->image_width, width);
+        g_atomic_int_set (&obj->priv->image_height, height);
+        g_atomic_int_set (&obj->priv->loading_progress, gdk_pixbuf_get_height (pixbuf));
+        g_atomic_pointer_set ((gpointer *) &obj->priv->orig_pixbuf, pixbuf);
+    }
+    else
+    {
+        GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+        GError *err = NULL;
+
+        g_signal_connect (loader, "size-prepared", G_CALLBACK (image_render_loader_size_prepared), obj);
+        g_signal_connect (loader, "area-prepared", G_CALLBACK (image_render_loader_area_prepared), obj);
+        g_signal_connect (loader, "area-updated", G_CALLBACK (image_render_loader_area_updated), obj);
 
-    obj->priv->orig_pixbuf = gdk_pixbuf_new_from_file (obj->priv->filename, &err);
+        gboolean loaded = image_cache_feed_loader (loader, obj->priv->filename, &obj->priv->cancel_loading, &err);
+
+        if (err)
+        {
+            g_warning ("pixbuf loading failed: %s", err->message);
+            g_error_free (err);
+        }
+
+        pixbuf = obj->priv->orig_pixbuf;
+
+        if (loaded && pixbuf)
+            image_cache_insert (obj->priv->filename, pixbuf, obj->priv->image_width, obj->priv->image_height);
+
+        g_object_unref (loader);
+    }
+
+    if (pixbuf && !g_atomic_int_get (&obj->priv->cancel_loading))
+    {
+        gint height = gdk_pixbuf_get_height (pixbuf);
+
+        // clear what a broken file left undecoded, so the whole pixbuf can be shown
+        if (obj->priv->loading_progress < height)
+        {
+            GdkPixbuf *rest = gdk_pixbuf_new_subpixbuf (pixbuf, 0, obj->priv->loading_progress,
+                                                        gdk_pixbuf_get_width (pixbuf), height - obj->priv->loading_progress);
+            gdk_pixbuf_fill (rest, 0);
+            g_object_unref (rest);
+            g_atomic_int_set (&obj->priv->loading_progress, height);
+        }
+
+        image_render_build_mip_levels (obj);
+    }
 
     g_atomic_int_inc (&obj->priv->orig_pixbuf_loaded);
 
@@ -786,31 +882,28 @@ inline void image_render_wait_for_loader_thread (ImageRender *obj)
 }
 
 
-void image_render_load_scaled_pixbuf (ImageRender *obj)
+/* Shows the progress of the loader thread, until it is done */
+static gboolean image_render_loading_progress (ImageRender *obj)
 {
-    g_return_if_fail (IS_IMAGE_RENDER(obj));
-    g_return_if_fail (obj->priv->filename!=NULL);
-    g_return_if_fail (obj->priv->scaled_pixbuf_loaded==FALSE);
+    gboolean loaded = g_atomic_int_get (&obj->priv->orig_pixbuf_loaded)!=0;
+    gint progress = g_atomic_int_get (&obj->priv->loading_progress);
 
-    g_return_if_fail (GTK_WIDGET_REALIZED(GTK_WIDGET (obj)));
-
-    int width = GTK_WIDGET (obj)->allocation.width;
-    int height = GTK_WIDGET (obj)->allocation.height;
+    if (progress!=obj->priv->drawn_progress || loaded)
+    {
+        // the scrollbars only change when the image appears and when it is complete
+        if (obj->priv->drawn_progress==0 || loaded)
+            image_render_update_adjustments (obj);
 
-    GError *err = NULL;
+        obj->priv->drawn_progress = progress;
+        image_render_redraw (obj);
+    }
 
-    obj->priv->disp_pixbuf  = gdk_pixbuf_new_from_file_at_scale (obj->priv->filename, width, height, TRUE, &err);
+    if (!loaded)
+        return TRUE;
 
-    if (err)
-    {
-        g_warning ("pixbuf loading failed: %s", err->message);
-        g_error_free (err);
-        obj->priv->orig_pixbuf = NULL;
-        obj->priv->disp_pixbuf = NULL;
-        return;
-    }
+    obj->priv->progress_timeout_id = 0;
 
-    obj->priv->scaled_pixbuf_loaded = TRUE;
+    return FALSE;
 }
 
 
@@ -827,6 +920,10 @@ inline void image_render_start_background_pixbuf_loading (ImageRender *obj)
     // Start background loading
     g_object_ref (obj);
     obj->priv->pixbuf_loading_thread = g_thread_create((GThreadFunc) image_render_pixbuf_loading_thread, (gpointer) obj, FALSE, NULL);
+
+    obj->priv->progress_timeout_id = g_timeout_add_full (G_PRIORITY_DEFAULT, IMAGE_RENDER_PROGRESS_INTERVAL,
+                                                         (GSourceFunc) image_render_loading_progress,
+                                                         g_object_ref (obj), g_object_unref);
 }
 
 
@@ -839,73 +936,58 @@ void image_render_load_file (ImageRender *obj, const gchar *filename)
     g_return_if_fail (obj->priv->filename==NULL);
 
     obj->priv->filename = g_strdup (filename);
-    obj->priv->scaled_pixbuf_loaded = FALSE;
     obj->priv->orig_pixbuf_loaded = 0;
 }
 
 
-static void image_render_prepare_disp_pixbuf (ImageRender *obj)
+/* Halves orig_pixbuf again and again, so scaling the image down for the display
+   starts from a pixbuf of about the size shown instead of from the whole image */
+static void image_render_build_mip_levels (ImageRender *obj)
 {
-    g_return_if_fail (IS_IMAGE_RENDER(obj));
+    image_render_free_mip_levels (obj);
 
-    // this will be set only if the loader thread finished loading the big pixbuf
-    if (g_atomic_int_get (&obj->priv->orig_pixbuf_loaded)==0)
-        return;
+    GdkPixbuf *pixbuf = obj->priv->orig_pixbuf;
 
-    if (!GTK_WIDGET_REALIZED (GTK_WIDGET (obj)))
-        return;
+    while (pixbuf && obj->priv->n_mip_levels < IMAGE_RENDER_MIP_LEVELS && !g_atomic_int_get (&obj->priv->cancel_loading))
+    {
+        gint width = gdk_pixbuf_get_width (pixbuf) / 2;
+        gint height = gdk_pixbuf_get_height (pixbuf) / 2;
 
-    if (obj->priv->disp_pixbuf)
-        g_object_unref (obj->priv->disp_pixbuf);
-    obj->priv->disp_pixbuf = NULL;
+        if (width < IMAGE_RENDER_MIP_MIN_SIZE || height < IMAGE_RENDER_MIP_MIN_SIZE)
+            break;
 
-    if (gdk_pixbuf_get_height (obj->priv->orig_pixbuf)==0)
-        return;
+        pixbuf = gdk_pixbuf_scale_simple (pixbuf, width, height, GDK_INTERP_BILINEAR);
 
-    if (obj->priv->best_fit)
-    {
-        if (gdk_pixbuf_get_height (obj->priv->orig_pixbuf) < GTK_WIDGET (obj)->allocation.height &&
-            gdk_pixbuf_get_width (obj->priv->orig_pixbuf) < GTK_WIDGET (obj)->allocation.width)
-        {
-            // no need to scale down
+        if (pixbuf)
+            obj->priv->mip_levels[obj->priv->n_mip_levels++] = pixbuf;
+    }
+}
 
-            obj->priv->disp_pixbuf = obj->priv->orig_pixbuf;
-            g_object_ref (obj->priv->disp_pixbuf);
-            return;
-        }
 
-        int height = GTK_WIDGET (obj)->allocation.height;
-        int width = (((double) GTK_WIDGET (obj)->allocation.height) /
-                  gdk_pixbuf_get_height (obj->priv->orig_pixbuf))*
-                    gdk_pixbuf_get_width (obj->priv->orig_pixbuf);
+/* The size of the image on the screen */
+static gboolean image_render_get_display_size (ImageRender *obj, gint *width, gint *height)
+{
+    gint image_width = g_atomic_int_get (&obj->priv->image_width);
+    gint image_height = g_atomic_int_get (&obj->priv->image_height);
 
-        if (width >= GTK_WIDGET (obj)->allocation.width)
-        {
-            width = GTK_WIDGET (obj)->allocation.width;
-            height = (((double)GTK_WIDGET (obj)->allocation.width) /
-                  gdk_pixbuf_get_width (obj->priv->orig_pixbuf))*
-                    gdk_pixbuf_get_height (obj->priv->orig_pixbuf);
-        }
+    if (image_width<=0 || image_height<=0)
+        return FALSE;
 
-        if (width<=1 || height<=1)
-        {
-            obj->priv->disp_pixbuf = NULL;
-            return;
-        }
+    GtkAllocation *allocation = &GTK_WIDGET (obj)->allocation;
+    gdouble scale = obj->priv->scale_factor;
 
-        obj->priv->disp_pixbuf = gdk_pixbuf_scale_simple( obj->priv->orig_pixbuf, width, height, GDK_INTERP_NEAREST);
-    }
-    else
+    if (obj->priv->best_fit)
     {
-        // not "best_fit" = scaling mode
-        obj->priv->disp_pixbuf = gdk_pixbuf_scale_simple(
-                obj->priv->orig_pixbuf,
-                (int)(gdk_pixbuf_get_width (obj->priv->orig_pixbuf) * obj->priv->scale_factor),
-                (int)(gdk_pixbuf_get_height (obj->priv->orig_pixbuf) * obj->priv->scale_factor),
-                GDK_INTERP_NEAREST);
+        if (image_width < allocation->width && image_height < allocation->height)
+            scale = 1.0;        // no need to scale down
+        else
+            scale = MIN ((gdouble) allocation->width / image_width, (gdouble) allocation->height / image_height);
     }
 
-    image_render_update_adjustments (obj);
+    *width = MAX ((gint) (image_width * scale), 1);
+    *height = MAX ((gint) (image_height * scale), 1);
+
+    return TRUE;
 }
 
 
@@ -913,12 +995,14 @@ static void image_render_update_adjustments (ImageRender *obj)
 {
     g_return_if_fail (IS_IMAGE_RENDER(obj));
 
-    if (!obj->priv->disp_pixbuf)
+    gint disp_width, disp_height;
+
+    if (!image_render_get_display_size (obj, &disp_width, &disp_height))
         return;
 
     if (obj->priv->best_fit ||
-        (gdk_pixbuf_get_width (obj->priv->disp_pixbuf) < GTK_WIDGET (obj)->allocation.width  &&
-         gdk_pixbuf_get_height (obj->priv->disp_pixbuf) < GTK_WIDGET (obj)->allocation.height))
+        (disp_width < GTK_WIDGET (obj)->allocation.width  &&
+         disp_height < GTK_WIDGET (obj)->allocation.height))
     {
         if (obj->priv->h_adjustment)
         {
@@ -951,11 +1035,11 @@ static void image_render_update_adjustments (ImageRender *obj)
         {
 #if GTK_CHECK_VERSION (2,14,0)
             gtk_adjustment_set_lower (obj->priv->h_adjustment, 0);
-            gtk_adjustment_set_upper (obj->priv->h_adjustment, gdk_pixbuf_get_width (obj->priv->disp_pixbuf));
+            gtk_adjustment_set_upper (obj->priv->h_adjustment, disp_width);
             gtk_adjustment_set_page_size (obj->priv->h_adjustment, GTK_WIDGET (obj)->allocation.width);
 #else
             obj->priv->h_adjustment->lower = 0;
-            obj->priv->h_adjustment->upper = gdk_pixbuf_get_width (obj->priv->disp_pixbuf);
+            obj->priv->h_adjustment->upper = disp_width;
             obj->priv->h_adjustment->page_size = GTK_WIDGET (obj)->allocation.width;
 #endif
             gtk_adjustment_changed (obj->priv->h_adjustment);
@@ -964,11 +1048,11 @@ static void image_render_update_adjustments (ImageRender *obj)
         {
 #if GTK_CHECK_VERSION (2,14,0)
             gtk_adjustment_set_lower (obj->priv->v_adjustment, 0);
-            gtk_adjustment_set_upper (obj->priv->v_adjustment, gdk_pixbuf_get_height (obj->priv->disp_pixbuf));
+            gtk_adjustment_set_upper (obj->priv->v_adjustment, disp_height);
             gtk_adjustment_set_page_size (obj->priv->v_adjustment, GTK_WIDGET (obj)->allocation.height);
 #else
             obj->priv->v_adjustment->lower = 0;
-            obj->priv->v_adjustment->upper = gdk_pixbuf_get_height (obj->priv->disp_pixbuf);
+            obj->priv->v_adjustment->upper = disp_height;
             obj->priv->v_adjustment->page_size = GTK_WIDGET (obj)->allocation.height;
 #endif
             gtk_adjustment_changed (obj->priv->v_adjustment);
@@ -982,7 +1066,7 @@ void image_render_set_best_fit(ImageRender *obj, gboolean active)
     g_return_if_fail (IS_IMAGE_RENDER(obj));
 
     obj->priv->best_fit = active;
-    image_render_prepare_disp_pixbuf (obj);
+    image_render_update_adjustments (obj);
     image_render_redraw (obj);
 }
 
@@ -1000,7 +1084,7 @@ void image_render_set_scale_factor(ImageRender *obj, double scalefactor)
     g_return_if_fail (IS_IMAGE_RENDER(obj));
 
     obj->priv->scale_factor = scalefactor;
-    image_render_prepare_disp_pixbuf (obj);
+    image_render_update_adjustments (obj);
     image_render_redraw(obj);
 }
 
@@ -1018,7 +1102,12 @@ void image_render_operation(ImageRender *obj, ImageRender::DISPLAYMODE op)
     g_return_if_fail (IS_IMAGE_RENDER(obj));
     g_return_if_fail (obj->priv->orig_pixbuf);
 
+    // the loader thread still fills orig_pixbuf
+    if (g_atomic_int_get (&obj->priv->orig_pixbuf_loaded)==0)
+        return;
+
     GdkPixbuf *temp = NULL;
+    gboolean rotated = op==ImageRender::ROTATE_CLOCKWISE || op==ImageRender::ROTATE_COUNTERCLOCKWISE;
 
     switch (op)
     {
@@ -1045,5 +1134,15 @@ void image_render_operation(ImageRender *obj, ImageRender::DISPLAYMODE op)
 
     obj->priv->orig_pixbuf = temp;
 
-    image_render_prepare_disp_pixbuf (obj);
+    if (rotated)
+    {
+        gint width = obj->priv->image_width;
+
+        obj->priv->image_width = obj->priv->image_height;
+        obj->priv->image_height = width;
+    }
+
+    image_render_build_mip_levels (obj);
+    image_render_update_adjustments (obj);
+    image_render_redraw (obj);
 }
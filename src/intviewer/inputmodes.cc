@@ -34,11 +34,15 @@
 using namespace std;
 
 
+#define DECODE_BUFFER_SIZE 4096
+
+
 struct GVInputModesData
 {
     gchar *input_mode_name;
 
     get_byte_proc   get_byte;
+    get_range_proc  get_range;
     void            *get_byte_user_data;
 
     /*
@@ -47,6 +51,7 @@ struct GVInputModesData
     input_get_char_proc get_char;
     input_get_offset_proc get_next_offset;
     input_get_offset_proc get_prev_offset;
+    input_decode_proc decode;
 
     /*
         Input mode implementors:
@@ -66,11 +71,15 @@ struct GVInputModesData
 static offset_type inputmode_ascii_get_next_offset(GVInputModesData *imd, offset_type offset);
 static offset_type inputmode_ascii_get_previous_offset(GVInputModesData *imd, offset_type offset);
 static char_type inputmode_ascii_get_char(GVInputModesData *imd, offset_type offset);
+static int inputmode_ascii_decode(GVInputModesData *imd, const unsigned char *buf, int len, gboolean eof,
+                                  offset_type offset, char_type *chars, offset_type *offsets, int max_chars);
 static void inputmode_ascii_activate(GVInputModesData *imd, const gchar *encoding);
 
 static char_type inputmode_utf8_get_char(GVInputModesData *imd, offset_type offset);
 static offset_type inputmode_utf8_get_previous_offset(GVInputModesData *imd, offset_type offset);
 static offset_type inputmode_utf8_get_next_offset(GVInputModesData *imd, offset_type offset);
+static int inputmode_utf8_decode(GVInputModesData *imd, const unsigned char *buf, int len, gboolean eof,
+                                 offset_type offset, char_type *chars, offset_type *offsets, int max_chars);
 static void inputmode_utf8_activate(GVInputModesData *imd);
 
 GVInputModesData *gv_input_modes_new()
@@ -103,6 +112,14 @@ void gv_init_input_modes(GVInputModesData *imd, get_byte_proc proc, void *get_by
 }
 
 
+void gv_set_input_modes_range_proc(GVInputModesData *imd, get_range_proc proc)
+{
+    g_return_if_fail (imd!=NULL);
+
+    imd->get_range = proc;
+}
+
+
 void gv_free_input_modes(GVInputModesData *imd)
 {
     g_return_if_fail (imd!=NULL);
@@ -174,6 +191,36 @@ offset_type gv_input_get_previous_char_offset(GVInputModesData *imd, offset_type
 }
 
 
+int gv_input_mode_decode(GVInputModesData *imd, offset_type offset, char_type *chars, offset_type *offsets, int max_chars)
+{
+    g_return_val_if_fail (imd!=NULL, 0);
+    g_return_val_if_fail (imd->decode!=NULL, 0);
+
+    /* A character takes up to four bytes, and one more byte is needed
+       to know where it ends (UTF-8) or whether it is a CR/LF pair (ASCII) */
+    unsigned char buf[DECODE_BUFFER_SIZE];
+    int count = 0;
+
+    offsets[0] = offset;
+
+    while (count<max_chars)
+    {
+        offset_type wanted = MIN(sizeof(buf), (offset_type) (max_chars-count) * 4 + 1);
+        offset_type len = gv_input_mode_get_raw_range(imd, offsets[count], buf, wanted);
+        gboolean eof = len<wanted;
+
+        int n = imd->decode(imd, buf, len, eof, offsets[count], chars+count, offsets+count, max_chars-count);
+
+        count += n;
+
+        if (eof || n==0)
+            break;
+    }
+
+    return count;
+}
+
+
 static int gv_input_mode_get_byte(GVInputModesData *imd, offset_type offset)
 {
     g_return_val_if_fail (imd->get_byte!=NULL, INVALID_CHAR);
@@ -188,6 +235,29 @@ int gv_input_mode_get_raw_byte(GVInputModesData *imd, offset_type offset)
 }
 
 
+offset_type gv_input_mode_get_raw_range(GVInputModesData *imd, offset_type offset, unsigned char *buf, offset_type count)
+{
+    g_return_val_if_fail (imd!=NULL, 0);
+
+    if (imd->get_range)
+        return imd->get_range(imd->get_byte_user_data, offset, buf, count);
+
+    offset_type i;
+
+    for (i=0; i<count; i++)
+    {
+        int value = gv_input_mode_get_byte(imd, offset+i);
+
+        if (value<0)
+            break;
+
+        buf[i] = value;
+    }
+
+    return i;
+}
+
+
 /*****************************************************************************
   Specific Input mode related function
 ******************************************************************************/
@@ -208,6 +278,7 @@ static void inputmode_ascii_activate(GVInputModesData *imd, const gchar *encodin
     imd->get_char = inputmode_ascii_get_char;
     imd->get_next_offset = inputmode_ascii_get_next_offset;
     imd->get_prev_offset = inputmode_ascii_get_previous_offset;
+    imd->decode = inputmode_ascii_decode;
     g_free (imd->input_mode_name);
     imd->input_mode_name = g_strdup ("ASCII");
 
@@ -344,6 +415,37 @@ static offset_type inputmode_ascii_get_next_offset(GVInputModesData *imd, offset
 }
 
 
+static int inputmode_ascii_decode(GVInputModesData *imd, const unsigned char *buf, int len, gboolean eof,
+                                  offset_type offset, char_type *chars, offset_type *offsets, int max_chars)
+{
+    int i = 0;
+    int n = 0;
+
+    while (n<max_chars && i<len)
+    {
+        unsigned char value = buf[i];
+        int size = 1;
+
+        if (value=='\r')
+        {
+            // is this a CR/LF pair?
+            if (i+1>=len && !eof)
+                break;
+            if (i+1<len && buf[i+1]=='\n')
+                size = 2;
+        }
+
+        chars[n] = value=='\r' || value=='\n' || value=='\t' ? value : imd->ascii_charset_translation[value];
+        offsets[n++] = offset + i;
+        i += size;
+    }
+
+    offsets[n] = offset + i;
+
+    return n;
+}
+
+
 /************************* UTF-8 input mode functions **************************/
 
 static void inputmode_utf8_activate(GVInputModesData *imd)
@@ -353,6 +455,7 @@ static void inputmode_utf8_activate(GVInputModesData *imd)
     imd->get_char = inputmode_utf8_get_char;
     imd->get_prev_offset = inputmode_utf8_get_previous_offset;
     imd->get_next_offset = inputmode_utf8_get_next_offset;
+    imd->decode = inputmode_utf8_decode;
     g_free (imd->input_mode_name);
     imd->input_mode_name = g_strdup ("UTF8");
 }
@@ -488,3 +591,87 @@ static offset_type inputmode_utf8_get_next_offset(GVInputModesData *imd, offset_
 
     return offset+len;
 }
+
+
+/*
+  Works like "inputmode_utf8_get_char" and "inputmode_utf8_get_next_offset" on a buffer,
+  so a character cut by the end of the file is invalid too.
+  Runs of ASCII characters are taken over eight bytes at a time.
+*/
+static int inputmode_utf8_decode(GVInputModesData *imd, const unsigned char *buf, int len, gboolean eof,
+                                 offset_type offset, char_type *chars, offset_type *offsets, int max_chars)
+{
+    int i = 0;
+    int n = 0;
+
+    while (n<max_chars && i<len)
+    {
+        // the byte after a character has to be there for it to be valid
+        while (n+8<=max_chars && i+8<len)
+        {
+            guint64 block;
+
+            memcpy(&block, buf+i, sizeof(block));
+            if (block & G_GUINT64_CONSTANT(0x8080808080808080))
+                break;
+
+            for (int k=0; k<8; k++)
+            {
+                chars[n] = buf[i];
+                offsets[n++] = offset + i++;
+            }
+        }
+
+        if (n>=max_chars)
+            break;
+
+        unsigned char value = buf[i];
+        int size = 0;
+
+        if (UTF8_SINGLE_CHAR(value))
+            size = 1;
+        else
+            if (UTF8_HEADER_2BYTES(value))
+                size = 2;
+            else
+                if (UTF8_HEADER_3BYTES(value))
+                    size = 3;
+                else
+                    if (UTF8_HEADER_4BYTES(value))
+                        size = 4;
+
+        if (size>0 && i+size>=len)
+        {
+            if (!eof)
+                break;
+            size = 0;
+        }
+
+        for (int k=1; k<size; k++)
+            if (!UTF8_TRAILER_CHAR(buf[i+k]))
+            {
+                size = 0;
+                break;
+            }
+
+        if (size==0)
+        {
+            chars[n] = '.';
+            offsets[n++] = offset + i++;
+            continue;
+        }
+
+        char_type c = 0;
+
+        for (int k=size-1; k>=0; k--)
+            c = (c << 8) + buf[i+k];
+
+        chars[n] = c;
+        offsets[n++] = offset + i;
+        i += size;
+    }
+
+    offsets[n] = offset + i;
+
+    return n;
+}
@@ -32,6 +32,8 @@ struct GVInputModesData;
 /* input function types */
 typedef char_type (*input_get_char_proc)(GVInputModesData *imd, offset_type offset);
 typedef offset_type (*input_get_offset_proc)(GVInputModesData *imd, offset_type offset);
+typedef int (*input_decode_proc)(GVInputModesData *imd, const unsigned char *buf, int len, gboolean eof,
+                                 offset_type offset, char_type *chars, offset_type *offsets, int max_chars);
 
 
 /*
@@ -41,6 +43,12 @@ typedef offset_type (*input_get_offset_proc)(GVInputModesData *imd, offset_type
 */
 typedef int (*get_byte_proc)(void *user_data, offset_type offset);
 
+/*
+  Optionally used to retrive spans of bytes at once.
+  Should return the number of bytes copied to 'buf', less than 'count' only at EOF or on failure
+*/
+typedef offset_type (*get_range_proc)(void *user_data, offset_type start, unsigned char *buf, offset_type count);
+
 
 GVInputModesData *gv_input_modes_new();
 
@@ -53,6 +61,12 @@ GVInputModesData *gv_input_modes_new();
 */
 void gv_init_input_modes(GVInputModesData *imd, get_byte_proc proc, void *get_byte_user_data);
 
+/*
+  Sets the function to retrive spans of bytes, with the same user data as the 'get_byte_proc'.
+  Must be called after "gv_init_input_modes".
+*/
+void gv_set_input_modes_range_proc(GVInputModesData *imd, get_range_proc proc);
+
 /*
    Free any internal data used by the input mode translators
 */
@@ -89,6 +103,17 @@ void gv_set_input_mode(GVInputModesData *imd, const gchar *input_mode);
 */
 char_type gv_input_mode_get_utf8_char(GVInputModesData *imd, offset_type offset);
 
+/*
+    decodes up to 'max_chars' characters starting at 'offset', at once.
+
+    the characters are stored in 'chars', as "gv_input_mode_get_utf8_char" returns them,
+    and their offsets in 'offsets'. 'offsets[count]' is set to the offset after the last
+    character, so 'offsets' must have room for 'max_chars'+1 entries.
+
+    returns the number of characters decoded, less than 'max_chars' only at EOF.
+*/
+int gv_input_mode_decode(GVInputModesData *imd, offset_type offset, char_type *chars, offset_type *offsets, int max_chars);
+
 /*
     Special hack:
     Control Characters (\r \n \t) are NOT translated by 'gv_input_mode_get_utf8_char, ever.
@@ -109,6 +134,14 @@ void gv_input_mode_update_utf8_translation(GVInputModesData *imd, unsigned char
 */
 int gv_input_mode_get_raw_byte(GVInputModesData *imd, offset_type offset);
 
+/*
+    copies up to 'count' RAW Bytes starting at 'offset' to 'buf'.
+    Does no input mode translations.
+
+    returns the number of bytes copied, less than 'count' only at EOF or on failure.
+*/
+offset_type gv_input_mode_get_raw_range(GVInputModesData *imd, offset_type offset, unsigned char *buf, offset_type count);
+
 /*
     returns the BYTE offset of the next logical character.
 
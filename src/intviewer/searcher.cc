@@ -26,7 +26,9 @@
 #include <string.h>
 #include "libgviewer.h"
 #include "bm_chartype.h"
-#include "bm_byte.h"
+
+#define RAW_SEARCH_CHUNK (1 << 20)
+#define TEXT_SEARCH_CHUNK (64 * 1024)       // characters decoded at once by "search_text_forward"
 
 using namespace std;
 
@@ -62,8 +64,12 @@ struct GViewerSearcherPrivate
     GViewerBMChartypeData *ct_data;
     GViewerBMChartypeData *ct_reverse_data;
 
-    GViewerBMByteData *b_data;
-    GViewerBMByteData *b_reverse_data;
+    // the pattern as bytes, searched for in the raw file (always for hex searches)
+    guint8 *raw_pattern;
+    offset_type raw_pattern_len;
+    offset_type raw_pattern_chars;      // number of characters in the text pattern
+    offset_type raw_last_char_len;      // number of bytes of the last character of the text pattern
+    gboolean raw_case_sensitive;        // if not, raw_pattern is in upper case
 
     enum SearchMode searchmode;
 };
@@ -154,16 +160,7 @@ static void g_viewer_searcher_finalize(GObject *object)
             free_bm_chartype_data(cobj->priv->ct_reverse_data);
             cobj->priv->ct_reverse_data = NULL;
         }
-        if (cobj->priv->b_data!=NULL)
-        {
-            free_bm_byte_data(cobj->priv->b_data);
-            cobj->priv->b_data = NULL;
-        }
-        if (cobj->priv->b_reverse_data!=NULL)
-        {
-            free_bm_byte_data(cobj->priv->b_reverse_data);
-            cobj->priv->b_reverse_data = NULL;
-        }
+        g_free (cobj->priv->raw_pattern);
         g_free (cobj->priv);
         cobj->priv = NULL;
     }
@@ -258,6 +255,14 @@ void g_viewer_searcher_setup_new_text_search(GViewerSearcher *srchr,
     g_free (rev_text);
     g_return_if_fail (srchr->priv->ct_reverse_data!=NULL);
 
+    srchr->priv->raw_pattern_len = strlen(text);
+    srchr->priv->raw_pattern = (guint8 *) g_strdup (text);
+    srchr->priv->raw_pattern_chars = srchr->priv->ct_data->pattern_len;
+    srchr->priv->raw_last_char_len = text + srchr->priv->raw_pattern_len - g_utf8_prev_char(text + srchr->priv->raw_pattern_len);
+    srchr->priv->raw_case_sensitive = case_sensitive;
+    if (!case_sensitive)
+        mem_toupper(srchr->priv->raw_pattern, srchr->priv->raw_pattern_len);
+
     srchr->priv->searchmode = TEXT;
 }
 
@@ -289,13 +294,11 @@ void g_viewer_searcher_setup_new_hex_search(GViewerSearcher *srchr,
     else
         srchr->priv->update_interval = 10;
 
-    srchr->priv->b_data = create_bm_byte_data(buffer, buflen);
-    g_return_if_fail (srchr->priv->b_data!=NULL);
-
-    guint8 *rev_buffer = mem_reverse(buffer, buflen);
-    srchr->priv->b_reverse_data = create_bm_byte_data(rev_buffer, buflen);
-    g_free (rev_buffer);
-    g_return_if_fail (srchr->priv->b_reverse_data!=NULL);
+    srchr->priv->raw_pattern = (guint8 *) g_memdup (buffer, buflen);
+    srchr->priv->raw_pattern_len = buflen;
+    srchr->priv->raw_pattern_chars = buflen;
+    srchr->priv->raw_last_char_len = 1;
+    srchr->priv->raw_case_sensitive = TRUE;
 
     srchr->priv->searchmode = HEX;
 }
@@ -318,105 +321,135 @@ gboolean check_abort_request (GViewerSearcher *src)
 }
 
 
-gboolean search_hex_forward (GViewerSearcher *src)
+/*
+    Text can be searched for as bytes, if every byte of the pattern can only be
+    matched by the same byte in the file. Bytes which are not displayable, and
+    invalid UTF-8 characters are shown as '.', so these can't be in the pattern.
+    Case is ignored for english letters only (see "chartype_toupper"), which
+    can be done on the bytes of ASCII and UTF-8 text as well.
+*/
+static gboolean raw_text_search_possible (GViewerSearcher *src)
 {
-    offset_type m, n, j;
-    int i;
+    const char *mode = gv_get_input_mode(src->priv->imd);
+    gboolean utf8 = g_ascii_strcasecmp (mode, "UTF8")==0;
+
+    if (!utf8 && g_ascii_strcasecmp (mode, "ASCII")!=0)
+        return FALSE;
+
+    for (offset_type i=0; i<src->priv->raw_pattern_len; i++)
+    {
+        guint8 value = src->priv->raw_pattern[i];
+
+        if (value=='.' || (value<0x80 && !is_displayable(value)) || (value>=0x80 && !utf8))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+    Searches the bytes of the file chunk by chunk (see "mem_find"),
+    with the same results as the Boyer-Moore search on characters.
+*/
+static gboolean search_raw_forward (GViewerSearcher *src)
+{
+    GViewerSearcherPrivate *priv = src->priv;
+    offset_type m = priv->raw_pattern_len;
+    offset_type n = priv->max_offset;
+    offset_type pos = priv->start_offset;
     gboolean found = FALSE;
-    guint8 value;
-    GViewerBMByteData *data = src->priv->b_data;
 
-    m = data->pattern_len;
-    n = src->priv->max_offset;
-    j = src->priv->start_offset;
-    int update_counter = src->priv->update_interval;
+    guint8 *buf = g_new (guint8, RAW_SEARCH_CHUNK + m - 1);
 
-    while (j <= n - m)
+    while (pos + m <= n)
     {
-        for (i = m - 1; i >= 0; --i)
-        {
-            value = (guint8) gv_input_mode_get_raw_byte(src->priv->imd, i+j);
-            if (data->pattern[i] != value)
-                break;
-        }
+        offset_type len = gv_input_mode_get_raw_range(priv->imd, pos, buf, MIN(RAW_SEARCH_CHUNK + m - 1, n - pos));
 
-        if (i < 0)
+        if (len < m)
+            break;
+
+        if (!priv->raw_case_sensitive)
+            mem_toupper(buf, len);
+
+        gssize i = mem_find(buf, len, priv->raw_pattern, m);
+
+        if (i >= 0)
         {
-            src->priv->search_result = j;
-            j ++;
+            priv->search_result = pos + i;
             found = TRUE;
             break;
         }
 
-        j += MAX(data->good[i], data->bad[value] - m + 1 + i);
+        // the next chunk starts with the last m-1 bytes of this one
+        pos += len - m + 1;
 
-        if (--update_counter==0)
-        {
-            update_progress_indicator(src, j);
-            update_counter = src->priv->update_interval;
-        }
+        update_progress_indicator(src, pos);
 
         if (check_abort_request(src))
             break;
     }
 
-    // Store the current offset, we'll use it if the user chooses "find next"
+    g_free (buf);
+
+    // Store the next offset, we'll use it if the user chooses "find next"
     if (found)
-        src->priv->start_offset = j;
+        priv->start_offset = priv->searchmode==HEX ? priv->search_result + 1 : gv_input_get_next_char_offset(priv->imd, priv->search_result);
 
     return found;
 }
 
 
-gboolean search_hex_backward (GViewerSearcher *src)
+static gboolean search_raw_backward (GViewerSearcher *src)
 {
-    offset_type m, n, j;
-    int i;
+    GViewerSearcherPrivate *priv = src->priv;
+    offset_type m = priv->raw_pattern_len;
     gboolean found = FALSE;
-    int update_counter;
-    guint8 value;
-    GViewerBMByteData *data;
 
-    data = src->priv->b_reverse_data;
+    /* Like the Boyer-Moore search, find matches which end before the start offset,
+       and whose last character starts at least 'raw_pattern_chars' bytes into the file */
+    offset_type lo = priv->raw_pattern_chars + priv->raw_last_char_len > m ? priv->raw_pattern_chars + priv->raw_last_char_len - m : 0;
+    offset_type end = priv->start_offset;
 
-    m = data->pattern_len;
-    n = src->priv->max_offset;
-    j = src->priv->start_offset;
-    update_counter = src->priv->update_interval;
+    guint8 *buf = g_new (guint8, RAW_SEARCH_CHUNK + m - 1);
 
-    if (j>0)
-        j--;
-    while (j >= m)
+    while (end >= lo + m)
     {
-        for (i = m - 1; i >= 0; --i)
-        {
-            value = (guint8) gv_input_mode_get_raw_byte(src->priv->imd, j-i);
-            if (data->pattern[i] != value)
-                break;
-        }
+        offset_type start = end - lo > RAW_SEARCH_CHUNK + m - 1 ? end - (RAW_SEARCH_CHUNK + m - 1) : lo;
+        offset_type len = gv_input_mode_get_raw_range(priv->imd, start, buf, end - start);
 
-        if (i < 0)
+        if (len < end - start)
+            break;
+
+        if (!priv->raw_case_sensitive)
+            mem_toupper(buf, len);
+
+        gssize i = mem_find_last(buf, len, priv->raw_pattern, m);
+
+        if (i >= 0)
         {
-            src->priv->search_result = j;
+            end = start + i + m;
             found = TRUE;
             break;
         }
 
-        j -= MAX(data->good[i], data->bad[value] - m + 1 + i);
+        // the previous chunk ends with the first m-1 bytes of this one
+        end = start + m - 1;
 
-        if (--update_counter==0)
-        {
-            update_progress_indicator(src, j);
-            update_counter = src->priv->update_interval;
-        }
+        update_progress_indicator(src, end);
 
         if (check_abort_request(src))
             break;
     }
 
-    // Store the current offset, we'll use it if the user chooses "find next"
+    g_free (buf);
+
+    // Hex searches report the last byte of the match, text searches the offset after it
     if (found)
-        src->priv->start_offset = j;
+    {
+        priv->search_result = priv->searchmode==HEX ? end - 1 : end;
+        priv->start_offset = end - priv->raw_last_char_len;
+    }
 
     return found;
 }
@@ -424,60 +457,82 @@ gboolean search_hex_backward (GViewerSearcher *src)
 
 gboolean search_text_forward (GViewerSearcher *src)
 {
-    offset_type m, n, j;
-    int i;
+    int m, i;
     gboolean found = FALSE;
-    char_type value;
+    gboolean eof = FALSE;
+    char_type value = 0;
     GViewerBMChartypeData *data = src->priv->ct_data;
 
     m = data->pattern_len;
-    n = src->priv->max_offset;
-    j = src->priv->start_offset;
+    offset_type j = src->priv->start_offset;
+    int k = 0;      // index of the current position in the decoded characters, which start at 'j'
     int update_counter = src->priv->update_interval;
 
-    while (j <= n - m)
+    char_type *chars = g_new (char_type, TEXT_SEARCH_CHUNK);
+    offset_type *offsets = g_new (offset_type, TEXT_SEARCH_CHUNK + 1);
+
+    while (!found && !eof)
     {
-        offset_type t, delta;
+        int count = gv_input_mode_decode(src->priv->imd, j, chars, offsets, TEXT_SEARCH_CHUNK);
 
-        delta = m - 1;
-        t = j;
-        while (delta--)
-            t = gv_input_get_next_char_offset(src->priv->imd, t);
-        for (i = m - 1; i >= 0; --i)
+        eof = count<TEXT_SEARCH_CHUNK;
+
+        while (k + m <= count)
         {
-            value = gv_input_mode_get_utf8_char(src->priv->imd, t);
-            t = gv_input_get_previous_char_offset(src->priv->imd, t);
-            if (!bm_chartype_equal(data, i, value))
+            for (i = m - 1; i >= 0; --i)
+            {
+                value = chars[k + i];
+                if (!bm_chartype_equal(data, i, value))
+                    break;
+            }
+
+            // Found a match
+            if (i < 0)
+            {
+                src->priv->search_result = offsets[k];
+
+                // Advance the current offset, from which "find next" will begin
+                j = offsets[k + 1];
+
+                found = TRUE;
                 break;
-        }
+            }
 
-        // Found a match
-        if (i < 0)
-        {
-            src->priv->search_result = j;
+            // didn't find a match, calculate new index
+            k += bm_chartype_get_advancement(data, i, value);
 
-            // Advance the current offset, from which "find next" will begin
-            j = gv_input_get_next_char_offset(src->priv->imd, j);
+            if (--update_counter==0)
+            {
+                update_progress_indicator(src, offsets[MIN(k, count)]);
+                update_counter = src->priv->update_interval;
+            }
 
-            found = TRUE;
-            break;
+            if (check_abort_request(src))
+            {
+                eof = TRUE;
+                break;
+            }
         }
 
-        // didn't find a match, calculate new index
-        delta = bm_chartype_get_advancement(data, i, value);
-        while (delta--)
-            j = gv_input_get_next_char_offset(src->priv->imd, j);
-
-        if (--update_counter==0)
+        // continue with the characters from the current position on, which may be past the decoded ones
+        if (!found && !eof)
         {
-            update_progress_indicator(src, j);
-            update_counter = src->priv->update_interval;
+            if (k < count)
+            {
+                j = offsets[k];
+                k = 0;
+            }
+            else
+            {
+                j = offsets[count];
+                k -= count;
+            }
         }
-
-        if (check_abort_request(src))
-            break;
     }
 
+    g_free (offsets);
+    g_free (chars);
+
     // Store the current offset, we'll use it if the user chooses "find next"
     if (found)
         src->priv->start_offset = j;
@@ -564,10 +619,10 @@ gpointer search_func (gpointer user_data)
 
     gboolean found;
     
-    if (src->priv->searchmode==TEXT)
+    if (src->priv->searchmode==TEXT && !raw_text_search_possible(src))
         found = (src->priv->search_forward) ? search_text_forward(src) : search_text_backward(src);
     else
-        found = (src->priv->search_forward) ? search_hex_forward(src) : search_hex_backward(src);
+        found = (src->priv->search_forward) ? search_raw_forward(src) : search_raw_backward(src);
 
     src->priv->search_reached_end = !found;
 
@@ -47,6 +47,8 @@ using namespace std;
 
 #define HEXDUMP_FIXED_LIMIT              16
 #define MAX_CLIPBOARD_COPY_LENGTH  0xFFFFFF
+#define DISPLAY_DECODE_CHUNK      256
+#define FOLLOW_RATE_LIMIT         100   // milliseconds between two looks at a followed file
 
 #define NEED_PANGO_ESCAPING(x) ((x)=='<' || (x)=='>' || (x)=='&')
 
@@ -58,7 +60,7 @@ enum
 
 static guint text_render_signals[LAST_SIGNAL] = { 0 };
 
-typedef int (*display_line_proc)(TextRender *w, int y, int column, offset_type start_of_line, offset_type end_of_line);
+typedef int (*display_line_proc)(TextRender *w, offset_type start_of_line, offset_type end_of_line);
 typedef offset_type (*pixel_to_offset_proc) (TextRender *obj, int x, int y, gboolean start_marker);
 typedef void (*copy_to_clipboard_proc)(TextRender *obj, offset_type start_offset, offset_type end_offset);
 
@@ -70,6 +72,19 @@ struct TextRenderClass
     void (* text_status_changed) (TextRender *obj, TextRender::Status *status);
 };
 
+// A line laid out by the "display_line" function of the display mode, kept for the next exposes
+struct TextRenderLine
+{
+    offset_type start;
+    offset_type end;
+    offset_type marker_start;       // the part of the marker in the line
+    offset_type marker_end;
+    gboolean marker_on_hexdump;
+    guint last_used;                // the frame the line was last drawn in
+    PangoLayout *layout;            // NULL for an unused entry
+};
+
+
 // Class Private Data
 struct TextRender::Private
 {
@@ -91,6 +106,11 @@ struct TextRender::Private
     GVInputModesData *im;
     GVDataPresentation *dp;
 
+    gchar *filename;                // NULL if loaded from a file descriptor
+    gboolean follow_mode;
+    GFileMonitor *monitor;
+    guint follow_timeout_id;        // polls the file if it can't be monitored
+
     gchar *encoding;
     int tab_size;
     int fixed_limit;
@@ -111,9 +131,22 @@ struct TextRender::Private
     gint     lines_displayed;
     PangoFontMetrics *disp_font_metrics;
     PangoFontDescription *font_desc;
-    PangoLayout *layout;
     GdkGC    *gc;
 
+    // lines laid out for the previous frames, and the number of the current frame
+    TextRenderLine *lines;
+    guint       n_lines;
+    guint       frame;
+
+    // offsets of the lines shown in the window, followed by the end of the last one
+    offset_type *shown_lines;
+    gint        n_shown_lines;
+    gint        shown_lines_alloc;
+
+    GTimer     *frame_timer;
+    guint       frames;
+    gdouble     frame_time;         // milliseconds taken by the last expose
+
     unsigned char *utf8buf;
     int           utf8alloc;
     int           utf8buf_length;
@@ -133,6 +166,7 @@ G_DEFINE_TYPE (TextRender, text_render, GTK_TYPE_WIDGET)
 
 // Gtk class related static functions
 static void text_render_redraw(TextRender *w);
+static gint text_render_scroll_window(TextRender *w, offset_type old_offset);
 static void text_render_position_changed(TextRender *w);
 
 static void text_render_realize (GtkWidget *widget);
@@ -153,21 +187,25 @@ static gboolean text_render_key_pressed(GtkWidget *widget, GdkEventKey *event, g
 
 static void text_render_update_adjustments_limits(TextRender *w);
 static void text_render_free_data(TextRender *w);
+static void text_render_start_following(TextRender *w);
+static void text_render_stop_following(TextRender *w);
 static void text_render_setup_font(TextRender*w, const gchar *fontname, gint fontsize);
 static void text_render_free_font(TextRender*w);
 static void text_render_reserve_utf8buf(TextRender *w, int minlength);
+static void text_render_update_shown_lines(TextRender *w);
+static void text_render_discard_lines(TextRender *w);
 
 static void text_render_utf8_clear_buf(TextRender *w);
 static int text_render_utf8_printf (TextRender *w, const char *format, ...);
 static int text_render_utf8_print_char(TextRender *w, char_type value);
 
 static void text_mode_copy_to_clipboard(TextRender *obj, offset_type start_offset, offset_type end_offset);
-static int text_mode_display_line(TextRender *w, int y, int column, offset_type start_of_line, offset_type end_of_line);
+static int text_mode_display_line(TextRender *w, offset_type start_of_line, offset_type end_of_line);
 static offset_type text_mode_pixel_to_offset(TextRender *obj, int x, int y, gboolean start_marker);
 
-static int binary_mode_display_line(TextRender *w, int y, int column, offset_type start_of_line, offset_type end_of_line);
+static int binary_mode_display_line(TextRender *w, offset_type start_of_line, offset_type end_of_line);
 
-static int hex_mode_display_line(TextRender *w, int y, int column, offset_type start_of_line, offset_type end_of_line);
+static int hex_mode_display_line(TextRender *w, offset_type start_of_line, offset_type end_of_line);
 static void hex_mode_copy_to_clipboard(TextRender *obj, offset_type start_offset, offset_type end_offset);
 static offset_type hex_mode_pixel_to_offset(TextRender *obj, int x, int y, gboolean start_marker);
 
@@ -260,7 +298,7 @@ static void text_render_init (TextRender *w)
 
     g_signal_connect (w, "key-press-event", G_CALLBACK (text_render_key_pressed), NULL);
 
-    w->priv->layout = gtk_widget_create_pango_layout (GTK_WIDGET (w), NULL);
+    w->priv->frame_timer = g_timer_new ();
 
     GTK_WIDGET_SET_FLAGS(GTK_WIDGET (w), GTK_CAN_FOCUS);
 }
@@ -286,6 +324,10 @@ static void text_render_finalize (GObject *object)
 
         text_render_free_data(w);
 
+        g_free (w->priv->lines);
+        g_free (w->priv->shown_lines);
+        g_timer_destroy (w->priv->frame_timer);
+
         g_free (w->priv->utf8buf);
 
         g_free (w->priv);
@@ -342,6 +384,9 @@ void text_render_notify_status_changed(TextRender *w)
 
     stat.encoding = w->priv->encoding;
 
+    stat.frames = w->priv->frames;
+    stat.frame_time = w->priv->frame_time;
+
     g_signal_emit (w, text_render_signals[TEXT_STATUS_CHANGED], 0, &stat);
 }
 
@@ -377,6 +422,59 @@ static void text_render_redraw(TextRender *w)
 }
 
 
+/*
+  Brings the window from the lines starting at OLD_OFFSET to the lines starting at the
+  current offset. If some of the lines stay in the window, the window contents are
+  scrolled and only the lines scrolled in are exposed, otherwise the whole window is redrawn.
+  Returns the number of lines scrolled up (negative for down), 0 if the window is redrawn.
+*/
+static gint text_render_scroll_window(TextRender *w, offset_type old_offset)
+{
+    GtkWidget *widget = GTK_WIDGET (w);
+
+    if (!GTK_WIDGET_REALIZED (widget))
+        return 0;
+
+    offset_type *shown = w->priv->shown_lines;
+    gint n_shown = w->priv->n_shown_lines;
+    gint lines = 0;
+
+    if (w->priv->current_offset > old_offset && n_shown>0 && shown[0]==old_offset)
+    {
+        // scrolled forward: the new first line is one of the lines shown
+        for (gint i=1; i<n_shown && !lines; i++)
+            if (shown[i]==w->priv->current_offset)
+                lines = i;
+    }
+
+    if (w->priv->current_offset < old_offset && n_shown>0 && shown[0]==old_offset)
+    {
+        // scrolled back: the old first line is one of the lines from the current offset
+        offset_type ofs = w->priv->current_offset;
+
+        for (gint i=1; i<n_shown && !lines; i++)
+        {
+            ofs = gv_get_end_of_line_offset(w->priv->dp, ofs);
+            if (ofs==old_offset)
+                lines = -i;
+        }
+    }
+
+    if (lines==0)
+    {
+        text_render_redraw(w);
+        return 0;
+    }
+
+    // the window will show these lines as soon as the uncovered area is exposed
+    text_render_update_shown_lines(w);
+
+    gdk_window_scroll (widget->window, 0, -lines*w->priv->char_height);
+
+    return lines;
+}
+
+
 static gboolean text_render_key_pressed(GtkWidget *widget, GdkEventKey *event, gpointer data)
 {
     g_return_val_if_fail (IS_TEXT_RENDER (widget), FALSE);
@@ -385,6 +483,8 @@ static gboolean text_render_key_pressed(GtkWidget *widget, GdkEventKey *event, g
     if (!obj->priv->dp)
         return FALSE;
 
+    offset_type old_offset = obj->priv->current_offset;
+
     switch (event->keyval)
     {
     case GDK_Up:
@@ -434,7 +534,7 @@ static gboolean text_render_key_pressed(GtkWidget *widget, GdkEventKey *event, g
     }
 
     text_render_position_changed(obj);
-    text_render_redraw(obj);
+    text_render_scroll_window(obj, old_offset);
 
     return TRUE;
 }
@@ -507,51 +607,176 @@ static void text_render_size_allocate (GtkWidget *widget, GtkAllocation *allocat
 }
 
 
+/*
+  Fills W->PRIV->SHOWN_LINES with the offsets of the lines which fit in the window,
+  starting from the current offset
+*/
+static void text_render_update_shown_lines(TextRender *w)
+{
+    GtkWidget *widget = GTK_WIDGET (w);
+
+    w->priv->n_shown_lines = 0;
+
+    if (w->priv->dp==NULL || w->priv->char_height<=0)
+        return;
+
+    gint max_lines = (widget->allocation.height + w->priv->char_height - 1) / w->priv->char_height;
+
+    if (w->priv->shown_lines_alloc < max_lines+1)
+    {
+        w->priv->shown_lines_alloc = max_lines+1;
+        w->priv->shown_lines = g_renew (offset_type, w->priv->shown_lines, w->priv->shown_lines_alloc);
+    }
+
+    offset_type ofs = w->priv->current_offset;
+
+    while (w->priv->n_shown_lines < max_lines)
+    {
+        offset_type eol_offset = gv_get_end_of_line_offset(w->priv->dp, ofs);
+        if (eol_offset == ofs)
+            break;
+
+        w->priv->shown_lines[w->priv->n_shown_lines++] = ofs;
+        ofs = eol_offset;
+    }
+
+    w->priv->shown_lines[w->priv->n_shown_lines] = ofs;
+}
+
+
+// Text and binary lines are moved to the left by the current column, unless they are wrapped
+static int text_render_get_line_x(TextRender *w)
+{
+    if (w->priv->dispmode==TextRender::DISPLAYMODE_HEXDUMP)
+        return 0;
+
+    if (w->priv->dispmode==TextRender::DISPLAYMODE_TEXT && w->priv->wrapmode)
+        return 0;
+
+    return -(w->priv->char_width*w->priv->column);
+}
+
+
+/*
+  Forgets the lines laid out so far. Has to be called whenever the markup of a line
+  could change for reasons not kept in TextRenderLine: the file, the encoding, the
+  display mode, the tab size, the font or the offset format.
+*/
+static void text_render_discard_lines(TextRender *w)
+{
+    for (guint i=0; i<w->priv->n_lines; i++)
+    {
+        if (w->priv->lines[i].layout)
+            g_object_unref (w->priv->lines[i].layout);
+        w->priv->lines[i].layout = NULL;
+    }
+}
+
+
+/*
+  Returns the layout of the line from START to END, either one laid out for the
+  previous frames or a new one in place of the line not drawn for the longest time.
+  Returns NULL if the "display_line" function failed.
+*/
+static PangoLayout *text_render_get_line_layout(TextRender *w, offset_type start, offset_type end)
+{
+    offset_type marker_start = MIN(w->priv->marker_start, w->priv->marker_end);
+    offset_type marker_end = MAX(w->priv->marker_start, w->priv->marker_end);
+
+    marker_start = CLAMP(marker_start, start, end);
+    marker_end = CLAMP(marker_end, start, end);
+
+    if (marker_start==marker_end)
+        marker_start = marker_end = 0;
+
+    gboolean marker_on_hexdump = marker_start!=marker_end && w->priv->hexmode_marker_on_hexdump;
+
+    // keep twice the lines of the window, so that scrolling back and forth by a page takes no new layouts
+    guint n_lines = 2*(w->priv->n_shown_lines+1);
+
+    if (w->priv->n_lines < n_lines)
+    {
+        w->priv->lines = g_renew (TextRenderLine, w->priv->lines, n_lines);
+        memset(&w->priv->lines[w->priv->n_lines], 0, (n_lines-w->priv->n_lines)*sizeof(TextRenderLine));
+        w->priv->n_lines = n_lines;
+    }
+
+    TextRenderLine *oldest = NULL;
+
+    for (guint i=0; i<w->priv->n_lines; i++)
+    {
+        TextRenderLine *line = &w->priv->lines[i];
+
+        if (line->layout && line->start==start && line->end==end &&
+            line->marker_start==marker_start && line->marker_end==marker_end &&
+            line->marker_on_hexdump==marker_on_hexdump)
+        {
+            line->last_used = w->priv->frame;
+            return line->layout;
+        }
+
+        if (!oldest || !line->layout || (oldest->layout && line->last_used < oldest->last_used))
+            oldest = line;
+    }
+
+    if (w->priv->display_line(w, start, end)==-1)
+        return NULL;
+
+    if (!oldest->layout)
+        oldest->layout = gtk_widget_create_pango_layout (GTK_WIDGET (w), NULL);
+
+    pango_layout_set_markup (oldest->layout, (gchar *) w->priv->utf8buf, w->priv->utf8buf_length);
+
+    oldest->start = start;
+    oldest->end = end;
+    oldest->marker_start = marker_start;
+    oldest->marker_end = marker_end;
+    oldest->marker_on_hexdump = marker_on_hexdump;
+    oldest->last_used = w->priv->frame;
+
+    return oldest->layout;
+}
+
+
 static gboolean text_render_expose(GtkWidget *widget, GdkEventExpose *event)
 {
     g_return_val_if_fail (IS_TEXT_RENDER (widget), FALSE);
     g_return_val_if_fail (event != NULL, FALSE);
 
-    gint y, rc;
-    offset_type ofs;
-
-    if (event->count > 0)
-        return FALSE;
-
     TextRender *w = TEXT_RENDER (widget);
 
     g_return_val_if_fail (w->priv->display_line!=NULL, FALSE);
 
-    if (w->priv->dp==NULL)
+    if (w->priv->dp==NULL || w->priv->char_height<=0)
         return FALSE;
 
-    gdk_window_clear_area (widget->window, 0, 0, widget->allocation.width, widget->allocation.height);
+    g_timer_start (w->priv->frame_timer);
 
-    ofs = w->priv->current_offset;
-    y = 0;
+    gdk_window_clear_area (widget->window, event->area.x, event->area.y, event->area.width, event->area.height);
 
-    while (TRUE)
-    {
-        offset_type eol_offset;
+    text_render_update_shown_lines(w);
 
-        eol_offset = gv_get_end_of_line_offset(w->priv->dp, ofs);
-        if (eol_offset == ofs)
-            break;
+    w->priv->frame++;
 
-        rc = w->priv->display_line(w, y, w->priv->column, ofs, eol_offset);
+    // only the lines in the exposed area are drawn, the rest of the window is still up to date
+    gint x = text_render_get_line_x(w);
+    gint first = event->area.y / w->priv->char_height;
+    gint last = (event->area.y + event->area.height - 1) / w->priv->char_height;
 
-        if (rc==-1)
-            break;
-
-        ofs = eol_offset;
+    for (gint i=MAX(first,0); i<=last && i<w->priv->n_shown_lines; i++)
+    {
+        PangoLayout *layout = text_render_get_line_layout(w, w->priv->shown_lines[i], w->priv->shown_lines[i+1]);
 
-        y += w->priv->char_height;
-        if (y>=widget->allocation.height)
+        if (!layout)
             break;
 
+        gdk_draw_layout (widget->window, w->priv->gc, x, i*w->priv->char_height, layout);
     }
 
-    w->priv->last_displayed_offset = ofs;
+    w->priv->last_displayed_offset = w->priv->shown_lines[w->priv->n_shown_lines];
+
+    w->priv->frames++;
+    w->priv->frame_time = 1000.0 * g_timer_elapsed (w->priv->frame_timer, NULL);
 
     return FALSE;
 }
@@ -567,6 +792,8 @@ static gboolean text_render_scroll(GtkWidget *widget, GdkEventScroll *event)
     if (!w->priv->dp)
         return FALSE;
 
+    offset_type old_offset = w->priv->current_offset;
+
     // Mouse scroll wheel
     switch (event->direction)
     {
@@ -583,7 +810,7 @@ static gboolean text_render_scroll(GtkWidget *widget, GdkEventScroll *event)
     }
 
     text_render_position_changed (w);
-    text_render_redraw (w);
+    text_render_scroll_window (w, old_offset);
 
     return TRUE;
 }
@@ -774,9 +1001,11 @@ static void text_render_v_adjustment_update (TextRender *obj)
         gtk_signal_emit_by_name (GTK_OBJECT (obj->priv->v_adjustment), "value-changed");
     }
 
+    offset_type old_offset = obj->priv->current_offset;
+
     obj->priv->current_offset = (offset_type)new_value;
 
-    text_render_redraw(obj);
+    text_render_scroll_window(obj, old_offset);
 }
 
 
@@ -819,6 +1048,11 @@ static void text_render_free_data(TextRender *w)
 {
     g_return_if_fail (IS_TEXT_RENDER (w));
 
+    text_render_stop_following(w);
+
+    g_free (w->priv->filename);
+    w->priv->filename = NULL;
+
     if (w->priv->dp)
         gv_free_data_presentation(w->priv->dp);
     w->priv->dp = NULL;
@@ -831,6 +1065,8 @@ static void text_render_free_data(TextRender *w)
         gv_file_free(w->priv->fops);
     w->priv->fops = NULL;
     w->priv->current_offset = 0;
+
+    text_render_discard_lines(w);
 }
 
 
@@ -847,6 +1083,7 @@ static void text_render_internal_load(TextRender *w)
     // Setup the input mode translations
     w->priv->im = gv_input_modes_new();
     gv_init_input_modes(w->priv->im, (get_byte_proc)gv_file_get_byte, w->priv->fops);
+    gv_set_input_modes_range_proc(w->priv->im, (get_range_proc)gv_file_get_range);
     gv_set_input_mode(w->priv->im, w->priv->encoding);
 
     // Setup the data presentation mode
@@ -861,6 +1098,8 @@ static void text_render_internal_load(TextRender *w)
     text_render_set_display_mode (w, TextRender::DISPLAYMODE_TEXT);
 
     text_render_update_adjustments_limits(w);
+
+    text_render_start_following(w);
 }
 
 
@@ -894,10 +1133,176 @@ void text_render_load_file(TextRender *w, const gchar *filename)
         return;
     }
 
+    w->priv->filename = g_strdup (filename);
+
     text_render_internal_load(w);
 }
 
 
+/*
+  Takes over the changes of a followed file. The view keeps showing the end of the file
+  if it did so before, or if TO_END is set.
+*/
+static void text_render_follow_file(TextRender *w, gboolean to_end)
+{
+    if (!w->priv->fops || !w->priv->dp)
+        return;
+
+    offset_type old_offset = w->priv->current_offset;
+    offset_type old_size = gv_file_get_max_offset(w->priv->fops);
+
+    to_end = to_end || w->priv->last_displayed_offset>=old_size;
+
+    // the row of the last line of the file, which may get longer
+    gint last_row = -1;
+
+    if (w->priv->n_shown_lines>0 && w->priv->shown_lines[w->priv->n_shown_lines]==old_size)
+        last_row = w->priv->n_shown_lines-1;
+
+    GVFileChange change = gv_file_update(w->priv->fops);
+    offset_type size = gv_file_get_max_offset(w->priv->fops);
+
+    switch (change)
+    {
+        case GV_FILE_UNCHANGED:
+            if (!to_end || w->priv->last_displayed_offset>=size)
+                return;
+            break;
+
+        case GV_FILE_GROWN:
+            gv_set_max_offset(w->priv->dp, size);
+            break;
+
+        case GV_FILE_REPLACED:
+            gv_reset_data_presentation(w->priv->dp, size);
+            w->priv->max_column = 0;
+            w->priv->marker_start = 0;
+            w->priv->marker_end = 0;
+            break;
+    }
+
+    text_render_discard_lines(w);
+    text_render_update_adjustments_limits(w);
+
+    if (change==GV_FILE_REPLACED)
+        w->priv->current_offset = 0;
+
+    // show the last page of the file, as tail -f does
+    if (to_end && size>0)
+    {
+        offset_type offset = gv_align_offset_to_line_start(w->priv->dp, size-1);
+        w->priv->current_offset = gv_scroll_lines(w->priv->dp, offset, -(w->priv->lines_displayed-1));
+    }
+
+    text_render_position_changed(w);
+
+    if (!GTK_WIDGET_REALIZED (GTK_WIDGET (w)))
+        return;
+
+    if (change==GV_FILE_REPLACED)
+    {
+        text_render_redraw(w);
+        return;
+    }
+
+    gint scrolled = w->priv->current_offset!=old_offset ? text_render_scroll_window(w, old_offset) : 0;
+
+    // the lines from the old last line on are new
+    if (last_row>=0)
+    {
+        GdkRectangle rect;
+
+        rect.x = 0;
+        rect.y = MAX(last_row-scrolled, 0) * w->priv->char_height;
+        rect.width = GTK_WIDGET (w)->allocation.width;
+        rect.height = MAX(GTK_WIDGET (w)->allocation.height - rect.y, 0);
+
+        gdk_window_invalidate_rect (GTK_WIDGET (w)->window, &rect, FALSE);
+    }
+}
+
+
+static void text_render_file_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type, TextRender *w)
+{
+    text_render_follow_file(w, FALSE);
+}
+
+
+static gboolean text_render_follow_timeout(TextRender *w)
+{
+    text_render_follow_file(w, FALSE);
+
+    return TRUE;
+}
+
+
+static void text_render_start_following(TextRender *w)
+{
+    if (!w->priv->follow_mode || !w->priv->fops || w->priv->monitor || w->priv->follow_timeout_id)
+        return;
+
+    gv_file_set_following(w->priv->fops, TRUE);
+
+    // inotify on local files, polling if the file can't be monitored
+    if (w->priv->filename)
+    {
+        GFile *file = g_file_new_for_path (w->priv->filename);
+        w->priv->monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+        g_object_unref (file);
+    }
+
+    if (w->priv->monitor)
+    {
+        g_file_monitor_set_rate_limit (w->priv->monitor, FOLLOW_RATE_LIMIT);
+        g_signal_connect (w->priv->monitor, "changed", G_CALLBACK (text_render_file_changed), w);
+    }
+    else
+        w->priv->follow_timeout_id = g_timeout_add (FOLLOW_RATE_LIMIT, (GSourceFunc) text_render_follow_timeout, w);
+
+    text_render_follow_file(w, TRUE);
+}
+
+
+static void text_render_stop_following(TextRender *w)
+{
+    if (w->priv->fops)
+        gv_file_set_following(w->priv->fops, FALSE);
+
+    if (w->priv->monitor)
+    {
+        g_signal_handlers_disconnect_matched (w->priv->monitor, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, w);
+        g_file_monitor_cancel (w->priv->monitor);
+        g_object_unref (w->priv->monitor);
+    }
+    w->priv->monitor = NULL;
+
+    if (w->priv->follow_timeout_id)
+        g_source_remove (w->priv->follow_timeout_id);
+    w->priv->follow_timeout_id = 0;
+}
+
+
+void text_render_set_follow_mode(TextRender *w, gboolean ACTIVE)
+{
+    g_return_if_fail (IS_TEXT_RENDER (w));
+
+    w->priv->follow_mode = ACTIVE;
+
+    if (ACTIVE)
+        text_render_start_following(w);
+    else
+        text_render_stop_following(w);
+}
+
+
+gboolean text_render_get_follow_mode(TextRender *w)
+{
+    g_return_val_if_fail (IS_TEXT_RENDER (w), FALSE);
+
+    return w->priv->follow_mode;
+}
+
+
 static void text_render_update_adjustments_limits(TextRender *w)
 {
     g_return_if_fail (IS_TEXT_RENDER (w));
@@ -934,6 +1339,8 @@ static gboolean text_render_vscroll_change_value(GtkRange *range,
     if (!obj->priv->dp)
         return FALSE;
 
+    offset_type old_offset = obj->priv->current_offset;
+
     switch (scroll)
     {
         case GTK_SCROLL_STEP_BACKWARD:
@@ -964,7 +1371,7 @@ static gboolean text_render_vscroll_change_value(GtkRange *range,
     }
 
     text_render_position_changed(obj);
-    text_render_redraw(obj);
+    text_render_scroll_window(obj, old_offset);
 
     return TRUE;
 }
@@ -1098,6 +1505,8 @@ static void text_render_setup_font(TextRender*w, const gchar *fontname, gint fon
        PANGO_PIXELS(pango_font_metrics_get_ascent(w->priv->disp_font_metrics)) +
        PANGO_PIXELS(pango_font_metrics_get_descent(w->priv->disp_font_metrics));
 
+    text_render_discard_lines(w);
+
     g_free (fontlabel);
 }
 
@@ -1223,7 +1632,7 @@ void  text_render_set_display_mode (TextRender *w, TextRender::DISPLAYMODE mode)
         break;
     }
 
-    text_render_setup_font (w, w->priv->fixed_font_name, w->priv->font_size);
+    text_render_setup_font (w, w->priv->fixed_font_name, w->priv->font_size);   // discards the laid out lines too
     w->priv->dispmode = mode;
     w->priv->current_offset = gv_align_offset_to_line_start (w->priv->dp, w->priv->current_offset);
 
@@ -1279,6 +1688,7 @@ void text_render_set_tab_size(TextRender *w, int tab_size)
     w->priv->tab_size = tab_size;
     gv_set_tab_size(w->priv->dp, tab_size);
 
+    text_render_discard_lines(w);
     text_render_redraw(w);
 }
 
@@ -1368,8 +1778,10 @@ void text_render_ensure_offset_visible(TextRender *w, offset_type offset)
         offset = gv_align_offset_to_line_start(w->priv->dp, offset);
         offset = gv_scroll_lines (w->priv->dp, offset, -w->priv->lines_displayed/2);
 
+        offset_type old_offset = w->priv->current_offset;
+
         w->priv->current_offset = offset;
-        text_render_redraw(w);
+        text_render_scroll_window(w, old_offset);
         text_render_position_changed(w);
     }
 }
@@ -1404,6 +1816,7 @@ void text_render_set_encoding(TextRender *w, const char *encoding)
     w->priv->encoding = g_strdup (encoding);
     gv_set_input_mode(w->priv->im, encoding);
     text_render_filter_undisplayable_chars(w);
+    text_render_discard_lines(w);
     text_render_redraw(w);
 }
 
@@ -1421,6 +1834,7 @@ void text_render_set_hex_offset_display(TextRender *w, gboolean HEX_OFFSET)
     g_return_if_fail (IS_TEXT_RENDER (w));
 
     w->priv->hex_offset_display = HEX_OFFSET;
+    text_render_discard_lines(w);
     text_render_redraw(w);
 }
 
@@ -1591,12 +2005,14 @@ static void text_mode_copy_to_clipboard(TextRender *obj, offset_type start_offse
 }
 
 
-static int text_mode_display_line(TextRender *w, int y, int column, offset_type start_of_line, offset_type end_of_line)
+static int text_mode_display_line(TextRender *w, offset_type start_of_line, offset_type end_of_line)
 {
     g_return_val_if_fail (IS_TEXT_RENDER (w), -1);
 
     offset_type current;
     char_type value;
+    char_type chars[DISPLAY_DECODE_CHUNK];
+    offset_type offsets[DISPLAY_DECODE_CHUNK+1];
     int char_count = 0;
     offset_type marker_start;
     offset_type marker_end;
@@ -1615,42 +2031,44 @@ static int text_mode_display_line(TextRender *w, int y, int column, offset_type
 
     show_marker = marker_start!=marker_end;
 
-    if (w->priv->wrapmode)
-        column = 0;
-
     text_render_utf8_clear_buf(w);
 
     current = start_of_line;
     while (current < end_of_line)
     {
-        if (show_marker)
-            marker_shown = marker_helper(w, marker_shown, current, marker_start, marker_end);
-
-        // Read a UTF8 character from the input file. The "inputmode" module is responsible for converting the file into UTF8
-        value = gv_input_mode_get_utf8_char(w->priv->im, current);
-        if (value==INVALID_CHAR)
+        // Read UTF8 characters from the input file. The "inputmode" module is responsible for converting the file into UTF8
+        int count = gv_input_mode_decode(w->priv->im, current, chars, offsets, MIN(DISPLAY_DECODE_CHUNK, end_of_line-current));
+        if (count==0)
             break;
 
-        // move to the next character's offset
-        current = gv_input_get_next_char_offset(w->priv->im, current);
+        for (int k=0; k<count && offsets[k]<end_of_line; k++)
+        {
+            if (show_marker)
+                marker_shown = marker_helper(w, marker_shown, offsets[k], marker_start, marker_end);
 
-        if (value=='\r' || value=='\n')
-            continue;
+            value = chars[k];
 
-        if (value=='\t')
-        {
-            for (int i=0; i<w->priv->tab_size; i++)
-                text_render_utf8_print_char(w, ' ');
-            char_count += w->priv->tab_size;
-            continue;
-        }
+            if (value=='\r' || value=='\n')
+                continue;
 
-        if (NEED_PANGO_ESCAPING(value))
-            text_render_utf8_printf (w, escape_pango_char(value));
-        else
-            text_render_utf8_print_char(w, value);
+            if (value=='\t')
+            {
+                for (int i=0; i<w->priv->tab_size; i++)
+                    text_render_utf8_print_char(w, ' ');
+                char_count += w->priv->tab_size;
+                continue;
+            }
 
-        char_count++;
+            if (NEED_PANGO_ESCAPING(value))
+                text_render_utf8_printf (w, escape_pango_char(value));
+            else
+                text_render_utf8_print_char(w, value);
+
+            char_count++;
+        }
+
+        // move to the next character's offset
+        current = offsets[count];
     }
 
     if (char_count > w->priv->max_column)
@@ -1662,19 +2080,18 @@ static int text_mode_display_line(TextRender *w, int y, int column, offset_type
     if (show_marker)
         marker_closer(w, marker_shown);
 
-    pango_layout_set_markup (w->priv->layout, (gchar *) w->priv->utf8buf, w->priv->utf8buf_length);
-    gdk_draw_layout (GTK_WIDGET (w)->window, w->priv->gc, -(w->priv->char_width*column), y, w->priv->layout);
-
     return 0;
 }
 
 
-static int binary_mode_display_line(TextRender *w, int y, int column, offset_type start_of_line, offset_type end_of_line)
+static int binary_mode_display_line(TextRender *w, offset_type start_of_line, offset_type end_of_line)
 {
     g_return_val_if_fail (IS_TEXT_RENDER (w), -1);
 
     offset_type current;
     char_type value;
+    char_type chars[DISPLAY_DECODE_CHUNK];
+    offset_type offsets[DISPLAY_DECODE_CHUNK+1];
     offset_type marker_start;
     offset_type marker_end;
     gboolean show_marker;
@@ -1696,34 +2113,35 @@ static int binary_mode_display_line(TextRender *w, int y, int column, offset_typ
     current = start_of_line;
     while (current < end_of_line)
     {
-
-        if (show_marker)
-            marker_shown = marker_helper(w, marker_shown, current, marker_start, marker_end);
-
-        /* Read a UTF8 character from the input file.
+        /* Read UTF8 characters from the input file.
            The "inputmode" module is responsible for converting the file into UTF8 */
-        value = gv_input_mode_get_utf8_char(w->priv->im, current);
-        if (value==INVALID_CHAR)
+        int count = gv_input_mode_decode(w->priv->im, current, chars, offsets, MIN(DISPLAY_DECODE_CHUNK, end_of_line-current));
+        if (count==0)
             break;
 
-        // move to the next character's offset
-        current = gv_input_get_next_char_offset(w->priv->im, current);
+        for (int k=0; k<count && offsets[k]<end_of_line; k++)
+        {
+            if (show_marker)
+                marker_shown = marker_helper(w, marker_shown, offsets[k], marker_start, marker_end);
 
-        if (value=='\r' || value=='\n' || value=='\t')
-            value = gv_input_mode_byte_to_utf8(w->priv->im, (unsigned char)value);
+            value = chars[k];
 
-        if (NEED_PANGO_ESCAPING(value))
-            text_render_utf8_printf (w, escape_pango_char(value));
-        else
-            text_render_utf8_print_char(w, value);
+            if (value=='\r' || value=='\n' || value=='\t')
+                value = gv_input_mode_byte_to_utf8(w->priv->im, (unsigned char)value);
+
+            if (NEED_PANGO_ESCAPING(value))
+                text_render_utf8_printf (w, escape_pango_char(value));
+            else
+                text_render_utf8_print_char(w, value);
+        }
+
+        // move to the next character's offset
+        current = offsets[count];
     }
 
     if (show_marker)
         marker_closer(w, marker_shown);
 
-    pango_layout_set_markup (w->priv->layout, (gchar *) w->priv->utf8buf, w->priv->utf8buf_length);
-    gdk_draw_layout (GTK_WIDGET (w)->window, w->priv->gc, -(w->priv->char_width*column), y, w->priv->layout);
-
     return 0;
 }
 
@@ -1829,7 +2247,7 @@ static void hex_mode_copy_to_clipboard(TextRender *obj, offset_type start_offset
 }
 
 
-static int hex_mode_display_line(TextRender *w, int y, int column, offset_type start_of_line, offset_type end_of_line)
+static int hex_mode_display_line(TextRender *w, offset_type start_of_line, offset_type end_of_line)
 {
     g_return_val_if_fail (IS_TEXT_RENDER (w), -1);
 
@@ -1899,8 +2317,5 @@ static int hex_mode_display_line(TextRender *w, int y, int column, offset_type s
     if (show_marker)
         marker_closer(w, marker_shown);
 
-    pango_layout_set_markup (w->priv->layout, (gchar *) w->priv->utf8buf, w->priv->utf8buf_length);
-    gdk_draw_layout (GTK_WIDGET (w)->window, w->priv->gc, 0, y, w->priv->layout);
-
     return 0;
 }
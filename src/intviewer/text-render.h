@@ -51,6 +51,8 @@ struct TextRender
         int         column;
         const char *encoding;
         gboolean    wrap_mode;
+        guint       frames;         // exposes handled so far
+        gdouble     frame_time;     // milliseconds taken by the last one
     };
 
     enum DISPLAYMODE
@@ -91,6 +93,14 @@ int text_render_get_tab_size(TextRender *w);
 void text_render_set_wrap_mode(TextRender *w, gboolean ACTIVE);
 gboolean text_render_get_wrap_mode(TextRender *w);
 
+/*
+  Follows a file growing at its end, as tail -f does: appended data is shown as soon as
+  it is written, the view keeps showing the end of the file if it does so, and a file
+  truncated or replaced by log rotation is shown from the start again.
+*/
+void text_render_set_follow_mode(TextRender *w, gboolean ACTIVE);
+gboolean text_render_get_follow_mode(TextRender *w);
+
 void text_render_set_fixed_limit(TextRender *w, int fixed_limit);
 int text_render_get_fixed_limit(TextRender *w);
 
@@ -22,6 +22,8 @@
  *
  */
 
+#include <config.h>
+#include <string.h>
 #include <glib.h>
 
 #include "gvtypes.h"
@@ -98,6 +100,74 @@ char_type *convert_utf8_to_chartype_array (const gchar *utf8text, /*out*/ int &a
 }
 
 
+/*
+    memchr() finds the candidates for the first byte of the pattern, which uses
+    the vector instructions of the CPU; the rest of the pattern is compared with memcmp()
+*/
+gssize mem_find (const guint8 *buffer, gsize buflen, const guint8 *pattern, gsize patlen)
+{
+    g_return_val_if_fail (buffer!=NULL, -1);
+    g_return_val_if_fail (pattern!=NULL, -1);
+    g_return_val_if_fail (patlen>0, -1);
+
+    if (buflen<patlen)
+        return -1;
+
+    const guint8 *p = buffer;
+    const guint8 *end = buffer + buflen - patlen + 1;      // candidates for the first byte
+
+    while (p<end && (p = (const guint8 *) memchr (p, pattern[0], end-p)))
+    {
+        if (memcmp (p+1, pattern+1, patlen-1)==0)
+            return p - buffer;
+        p++;
+    }
+
+    return -1;
+}
+
+
+gssize mem_find_last (const guint8 *buffer, gsize buflen, const guint8 *pattern, gsize patlen)
+{
+    g_return_val_if_fail (buffer!=NULL, -1);
+    g_return_val_if_fail (pattern!=NULL, -1);
+    g_return_val_if_fail (patlen>0, -1);
+
+    if (buflen<patlen)
+        return -1;
+
+    gsize n = buflen - patlen + 1;      // candidates for the first byte
+
+    while (n>0)
+    {
+#ifdef HAVE_MEMRCHR
+        const guint8 *p = (const guint8 *) memrchr (buffer, pattern[0], n);
+
+        if (!p)
+            return -1;
+#else
+        const guint8 *p = buffer + n - 1;
+
+        while (*p!=pattern[0])
+            if (p--==buffer)
+                return -1;
+#endif
+        if (memcmp (p+1, pattern+1, patlen-1)==0)
+            return p - buffer;
+        n = p - buffer;
+    }
+
+    return -1;
+}
+
+
+void mem_toupper (guint8 *buffer, gsize buflen)
+{
+    for (gsize i=0; i<buflen; i++)
+        buffer[i] = buffer[i]>='a' && buffer[i]<='z' ? buffer[i] & ~0x20 : buffer[i];
+}
+
+
 guint8 *mem_reverse (const guint8 *buffer, guint buflen)
 {
     g_return_val_if_fail (buffer!=NULL, NULL);
@@ -32,6 +32,13 @@ char_type *convert_utf8_to_chartype_array(const gchar *utf8text, /*out*/ int &ar
 
 guint8 *mem_reverse(const guint8 *buffer, guint buflen);
 
+/* returns the offset of the first (last) occurrence of 'pattern' in 'buffer', or -1 */
+gssize mem_find(const guint8 *buffer, gsize buflen, const guint8 *pattern, gsize patlen);
+gssize mem_find_last(const guint8 *buffer, gsize buflen, const guint8 *pattern, gsize patlen);
+
+/* converts english letters (a-z) in 'buffer' to UPPER case, like "chartype_toupper" */
+void mem_toupper(guint8 *buffer, gsize buflen);
+
 /* returns NULL if 'text' is not a valid hex string (whitespaces are OK, and are ignored) */
 guint8 *text2hex (const gchar *text, /*out*/ guint &buflen);
 
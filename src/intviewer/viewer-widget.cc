@@ -336,10 +336,7 @@ void gviewer_auto_detect_display_mode(GViewer *obj)
     if (!fops)
         return;
 
-    int count = MIN(DETECTION_BUF_LEN, gv_file_get_max_offset(fops));
-
-    for (gint i=0; i<count; i++)
-        temp[i] = gv_file_get_byte(fops, i);
+    int count = gv_file_get_range(fops, 0, temp, DETECTION_BUF_LEN);
 
     obj->priv->dispmode = guess_display_mode(temp, count);
 }
@@ -497,6 +494,24 @@ gboolean gviewer_get_wrap_mode(GViewer *obj)
 }
 
 
+void gviewer_set_follow_mode(GViewer *obj, gboolean ACTIVE)
+{
+    g_return_if_fail (IS_GVIEWER (obj));
+    g_return_if_fail (obj->priv->textr);
+
+    text_render_set_follow_mode(obj->priv->textr, ACTIVE);
+}
+
+
+gboolean gviewer_get_follow_mode(GViewer *obj)
+{
+    g_return_val_if_fail (IS_GVIEWER (obj), FALSE);
+    g_return_val_if_fail (obj->priv->textr, FALSE);
+
+    return text_render_get_follow_mode(obj->priv->textr);
+}
+
+
 void gviewer_set_fixed_limit(GViewer *obj, int fixed_limit)
 {
     g_return_if_fail (IS_GVIEWER (obj));
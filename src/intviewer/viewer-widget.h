@@ -75,6 +75,9 @@ int         gviewer_get_tab_size(GViewer *obj);
 void        gviewer_set_wrap_mode(GViewer *obj, gboolean ACTIVE);
 gboolean    gviewer_get_wrap_mode(GViewer *obj);
 
+void        gviewer_set_follow_mode(GViewer *obj, gboolean ACTIVE);
+gboolean    gviewer_get_follow_mode(GViewer *obj);
+
 void        gviewer_set_fixed_limit(GViewer *obj, int fixed_limit);
 int         gviewer_get_fixed_limit(GViewer *obj);
 
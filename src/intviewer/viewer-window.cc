@@ -32,9 +32,12 @@
 
 #include "libgviewer.h"
 #include "search-dlg.h"
+#include "image-cache.h"
 
 #include "gnome-cmd-includes.h"
 #include "gnome-cmd-file.h"
+#include "gnome-cmd-file-list.h"
+#include "gnome-cmd-main-win.h"
 #include "gnome-cmd-treeview.h"
 #include "utils.h"
 #include "tags/gnome-cmd-tags.h"
@@ -104,6 +107,8 @@ static double image_scale_factors[] = {0.1, 0.2, 0.33, 0.5, 0.67, 1, 1.25, 1.50,
 
 const static int MAX_SCALE_FACTOR_INDEX = G_N_ELEMENTS(image_scale_factors);
 
+const static int PREFETCH_NEIGHBOURS = 2;       // images decoded in advance before and after the file shown
+
 struct GViewerWindowPrivate
 {
     // Gtk User Interface
@@ -150,6 +155,8 @@ inline void gviewer_window_hide_metadata(GViewerWindow *obj);
 
 // Event Handlers
 static void menu_file_close (GtkMenuItem *item, GViewerWindow *obj);
+static void menu_file_next (GtkMenuItem *item, GViewerWindow *obj);
+static void menu_file_prev (GtkMenuItem *item, GViewerWindow *obj);
 
 static void menu_view_exif_information(GtkMenuItem *item, GViewerWindow *obj);
 
@@ -159,6 +166,7 @@ static void menu_edit_find_next(GtkMenuItem *item, GViewerWindow *obj);
 static void menu_edit_find_prev(GtkMenuItem *item, GViewerWindow *obj);
 
 static void menu_view_wrap(GtkMenuItem *item, GViewerWindow *obj);
+static void menu_view_follow(GtkMenuItem *item, GViewerWindow *obj);
 static void menu_view_display_mode(GtkMenuItem *item, GViewerWindow *obj);
 static void menu_view_set_charset(GtkMenuItem *item, GViewerWindow *obj);
 static void menu_view_zoom_in(GtkMenuItem *item, GViewerWindow *obj);
@@ -177,6 +185,8 @@ static void menu_help_keyboard(GtkMenuItem *item, GViewerWindow *obj);
 
 static void set_zoom_best_fit(GViewerWindow *obj);
 
+static void gviewer_window_prefetch_neighbours(GViewerWindow *obj);
+
 inline GtkTreeModel *create_model ();
 inline void fill_model (GtkTreeStore *treestore, GnomeCmdFile *f);
 inline GtkWidget *create_view ();
@@ -214,11 +224,31 @@ void gviewer_window_load_file (GViewerWindow *obj, GnomeCmdFile *f)
 
     g_free (obj->priv->filename);
 
+    f->ref();
+    if (obj->priv->f)
+        obj->priv->f->unref();
+
     obj->priv->f = f;
     obj->priv->filename = f->get_real_path();
     gviewer_load_file (obj->priv->viewer, obj->priv->filename);
 
     gtk_window_set_title (GTK_WINDOW (obj), obj->priv->filename);
+
+    // the metadata shown belongs to the file viewed before
+    if (obj->priv->metadata_view)
+    {
+        gboolean visible = obj->priv->metadata_visible;
+
+        if (visible)
+            gviewer_window_hide_metadata (obj);
+
+        gtk_tree_view_set_model (GTK_TREE_VIEW (gtk_bin_get_child (GTK_BIN (obj->priv->metadata_view))), NULL);
+
+        if (visible)
+            gviewer_window_show_metadata (obj);
+    }
+
+    gviewer_window_prefetch_neighbours (obj);
 }
 
 
@@ -408,6 +438,9 @@ static void gviewer_window_destroy (GtkObject *widget)
     {
         g_object_unref (w->priv->viewer);
 
+        if (w->priv->f)
+            w->priv->f->unref();
+
         g_free (w->priv->filename);
         w->priv->filename = NULL;
 
@@ -692,6 +725,15 @@ static void create_menu_items (GtkWidget *container, GtkAccelGroup *accel, gpoin
     GtkWidget *submenu;
 
     MENU_ITEM_DATA file_menu_items[] = {
+        {MI_NORMAL, _("_Next File"), GDK_Page_Down, GDK_CONTROL_MASK, G_CALLBACK (menu_file_next),
+                GNOME_APP_PIXMAP_STOCK, GTK_STOCK_GO_FORWARD,
+                NO_GOBJ_KEY, NO_GOBJ_VAL,
+                NO_MENU_ITEM, NO_GSLIST},
+        {MI_NORMAL, _("_Previous File"), GDK_Page_Up, GDK_CONTROL_MASK, G_CALLBACK (menu_file_prev),
+                GNOME_APP_PIXMAP_STOCK, GTK_STOCK_GO_BACK,
+                NO_GOBJ_KEY, NO_GOBJ_VAL,
+                NO_MENU_ITEM, NO_GSLIST},
+        {MI_SEPERATOR},
         {MI_NORMAL, _("_Close"), GDK_Escape, NO_MODIFIER, G_CALLBACK (menu_file_close),
                 GNOME_APP_PIXMAP_STOCK, GTK_STOCK_CLOSE,
                 NO_GOBJ_KEY, NO_GOBJ_VAL,
@@ -762,6 +804,10 @@ static void create_menu_items (GtkWidget *container, GtkAccelGroup *accel, gpoin
                 GNOME_APP_PIXMAP_NONE, NO_PIXMAP_INFO,
                 NO_GOBJ_KEY, NO_GOBJ_VAL,
                 &obj->priv->wrap_mode_menu_item, NO_GSLIST},
+        {MI_CHECK, _("_Follow File"), GDK_F, NO_MODIFIER, G_CALLBACK (menu_view_follow),
+                GNOME_APP_PIXMAP_NONE, NO_PIXMAP_INFO,
+                NO_GOBJ_KEY, NO_GOBJ_VAL,
+                NO_MENU_ITEM, NO_GSLIST},
         {MI_SEPERATOR},
         {MI_SUBMENU, _("_Encoding"), NO_KEYVAL, NO_MODIFIER, G_CALLBACK (NULL),
                 GNOME_APP_PIXMAP_NONE, NO_PIXMAP_INFO,
@@ -932,6 +978,100 @@ static void menu_file_close (GtkMenuItem *item, GViewerWindow *obj)
 }
 
 
+/* Returns the file list showing the file viewed, and its row there */
+static GnomeCmdFileList *gviewer_window_find_file_list (GViewerWindow *obj, gint *row)
+{
+    if (!obj->priv->f || !main_win)
+        return NULL;
+
+    GnomeCmdFileList *fl = main_win->fs(ACTIVE)->file_list();
+
+    if ((*row = fl->get_row_from_file(obj->priv->f)) != -1)
+        return fl;
+
+    fl = main_win->fs(INACTIVE)->file_list();
+
+    if ((*row = fl->get_row_from_file(obj->priv->f)) != -1)
+        return fl;
+
+    return NULL;
+}
+
+
+inline gboolean is_viewable (GnomeCmdFile *f)
+{
+    return f->info->type!=GNOME_VFS_FILE_TYPE_DIRECTORY && f->is_local();
+}
+
+
+/* Lets the background threads decode the images next to the file viewed in the file list,
+   so stepping to them with menu_file_next() and menu_file_prev() shows them at once */
+static void gviewer_window_prefetch_neighbours (GViewerWindow *obj)
+{
+    gint row;
+    GnomeCmdFileList *fl = gviewer_window_find_file_list (obj, &row);
+
+    if (!fl)
+        return;
+
+    GList *filenames = NULL;
+
+    for (gint step=1; step>=-1; step-=2)
+    {
+        GnomeCmdFile *f;
+        gint n = 0;
+
+        for (gint i=row+step; n<PREFETCH_NEIGHBOURS && (f=fl->get_file_at_row(i)); i+=step)
+        {
+            if (!is_viewable (f))
+                continue;
+
+            if (f->info->mime_type && f->mime_begins_with("image/"))
+                filenames = g_list_append (filenames, f->get_real_path());
+
+            n++;
+        }
+    }
+
+    image_cache_prefetch (filenames);
+
+    g_list_foreach (filenames, (GFunc) g_free, NULL);
+    g_list_free (filenames);
+}
+
+
+static void gviewer_window_step_file (GViewerWindow *obj, gint step)
+{
+    gint row;
+    GnomeCmdFileList *fl = gviewer_window_find_file_list (obj, &row);
+
+    if (!fl)
+        return;
+
+    GnomeCmdFile *f;
+
+    for (gint i=row+step; (f=fl->get_file_at_row(i)); i+=step)
+        if (is_viewable (f))
+        {
+            gviewer_window_load_file (obj, f);
+            fl->focus_file(f->info->name);
+            return;
+        }
+}
+
+
+static void menu_file_next (GtkMenuItem *item, GViewerWindow *obj)
+{
+    gviewer_window_step_file (obj, 1);
+}
+
+
+static void menu_file_prev (GtkMenuItem *item, GViewerWindow *obj)
+{
+    gviewer_window_step_file (obj, -1);
+}
+
+
 static void menu_view_exif_information(GtkMenuItem *item, GViewerWindow *obj)
 {
     g_return_if_fail (obj!=NULL);
@@ -1281,6 +1421,17 @@ static void menu_view_wrap(GtkMenuItem *item, GViewerWindow *obj)
 }
 
 
+static void menu_view_follow(GtkMenuItem *item, GViewerWindow *obj)
+{
+    g_return_if_fail (obj);
+    g_return_if_fail (obj->priv->viewer);
+
+    gboolean follow = gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (item));
+
+    gviewer_set_follow_mode(obj->priv->viewer, follow);
+}
+
+
 static void menu_settings_hex_decimal_offset(GtkMenuItem *item, GViewerWindow *obj)
 {
     g_return_if_fail (obj);
@@ -0,0 +1,437 @@
+/**
+ * @file local-delete.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+
+#include "local-delete.h"
+
+using namespace std;
+
+
+#define STAGING_TEMPLATE  ".gcmd-delete-XXXXXX"
+
+
+static const gboolean never_stopped = FALSE;
+
+
+struct LocalDelete::Dir
+{
+    Dir *parent;
+    string name;                                // in the parent, the whole path of an item
+    int fd;
+    guint depth;
+    gint pending;                               // the reading of the directory and its subdirectories not removed yet
+    gint failed;                                // something is left inside, so the directory stays
+};
+
+
+LocalDelete::LocalDelete(guint threads)
+{
+    n_threads = threads ? threads : g_get_num_processors ();
+
+    stopped = &never_stopped;
+    aborted = FALSE;
+    error_func = NULL;
+    user_data = NULL;
+    pool = NULL;
+    pending = 0;
+
+    g_mutex_init (&query_mutex);
+    g_mutex_init (&progress_mutex);
+    g_mutex_init (&done_mutex);
+    g_cond_init (&done_cond);
+}
+
+
+LocalDelete::~LocalDelete()
+{
+    g_mutex_clear (&query_mutex);
+    g_mutex_clear (&progress_mutex);
+    g_mutex_clear (&done_mutex);
+    g_cond_clear (&done_cond);
+}
+
+
+void LocalDelete::add(const gchar *path)
+{
+    items.push_back(path);
+}
+
+
+gboolean LocalDelete::stage()
+{
+    map<string,string> staging;                 // by the directories of the items
+    vector<pair<string,string> > moved;
+    gboolean ok = TRUE;
+
+    for (vector<string>::const_iterator i=items.begin(); ok && i!=items.end(); ++i)
+    {
+        gchar *dir = g_path_get_dirname (i->c_str());
+        gchar *name = g_path_get_basename (i->c_str());
+        string &staging_dir = staging[dir];
+
+        if (staging_dir.empty())
+        {
+            gchar *path = g_build_filename (dir, STAGING_TEMPLATE, NULL);
+
+            if (mkdtemp (path))
+                staging_dir = path;
+
+            g_free (path);
+        }
+
+        ok = !staging_dir.empty();
+
+        if (ok)
+        {
+            gchar *dest = g_build_filename (staging_dir.c_str(), name, NULL);
+
+            ok = rename (i->c_str(), dest)==0;
+
+            if (ok)
+                moved.push_back(make_pair(*i, string(dest)));
+
+            g_free (dest);
+        }
+
+        g_free (name);
+        g_free (dir);
+    }
+
+    if (!ok)
+    {
+        for (vector<pair<string,string> >::reverse_iterator i=moved.rbegin(); i!=moved.rend(); ++i)
+            rename (i->second.c_str(), i->first.c_str());
+
+        for (map<string,string>::const_iterator i=staging.begin(); i!=staging.end(); ++i)
+            if (!i->second.empty())
+                rmdir (i->second.c_str());
+
+        return FALSE;
+    }
+
+    items.clear();
+
+    for (map<string,string>::const_iterator i=staging.begin(); i!=staging.end(); ++i)
+        items.push_back(i->second);
+
+    return TRUE;
+}
+
+
+gboolean LocalDelete::is_staged(const gchar *path)
+{
+    const gsize prefix_len = strlen (STAGING_TEMPLATE) - strlen ("XXXXXX");
+    gchar *name = g_path_get_basename (path);
+    gboolean retval = g_path_is_absolute (path) && strncmp (name, STAGING_TEMPLATE, prefix_len)==0 &&
+                      strlen (name)==strlen (STAGING_TEMPLATE);
+
+    g_free (name);
+
+    return retval;
+}
+
+
+gboolean LocalDelete::retry(const string &path, int error)
+{
+    gboolean retval = FALSE;
+
+    g_mutex_lock (&query_mutex);
+
+    if (!is_stopped())
+        switch (error_func ? error_func (path.c_str(), error, user_data) : ERROR_ANSWER_SKIP)
+        {
+            case ERROR_ANSWER_RETRY:
+                retval = TRUE;
+                break;
+
+            case ERROR_ANSWER_SKIP:
+                break;
+
+            default:
+                aborted = TRUE;
+                break;
+        }
+
+    g_mutex_unlock (&query_mutex);
+
+    return retval;
+}
+
+
+// removes name in dir_fd, or path if there is no dir_fd. An entry already gone counts as removed.
+gboolean LocalDelete::remove(int dir_fd, const string &name, const string &path, gboolean is_dir)
+{
+    for (;;)
+    {
+        int ret = dir_fd>=0 ? unlinkat (dir_fd, name.c_str(), is_dir ? AT_REMOVEDIR : 0) :
+                  is_dir ? rmdir (path.c_str()) : unlink (path.c_str());
+
+        if (ret==0 || errno==ENOENT)
+            return TRUE;
+
+        if (errno!=EINTR && !retry(path, errno))
+            return FALSE;
+    }
+}
+
+
+void LocalDelete::count(guint64 found, guint64 done, guint64 failed)
+{
+    g_mutex_lock (&progress_mutex);
+    progress.files_found += found;
+    progress.files_done += done;
+    progress.files_failed += failed;
+    g_mutex_unlock (&progress_mutex);
+}
+
+
+void LocalDelete::get_progress(Progress &p)
+{
+    g_mutex_lock (&progress_mutex);
+    p = progress;
+    g_mutex_unlock (&progress_mutex);
+}
+
+
+string LocalDelete::get_path(const Dir *dir)
+{
+    return dir->parent ? get_path(dir->parent) + G_DIR_SEPARATOR + dir->name : dir->name;
+}
+
+
+void LocalDelete::push_dir(Dir *parent, const string &name)
+{
+    Dir *dir = new Dir;
+
+    dir->parent = parent;
+    dir->name = name;
+    dir->fd = -1;
+    dir->depth = parent ? parent->depth+1 : 0;
+    dir->pending = 1;
+    dir->failed = FALSE;
+
+    // the parent stays open until its subdirectories are removed
+    if (parent)
+        g_atomic_int_inc (&parent->pending);
+
+    g_atomic_int_inc (&pending);
+    g_thread_pool_push (pool, dir, NULL);
+}
+
+
+void LocalDelete::read_dir(Dir *dir)
+{
+    string path = get_path(dir);
+
+    for (;;)
+    {
+        const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+
+        dir->fd = dir->parent ? openat (dir->parent->fd, dir->name.c_str(), flags) : open (path.c_str(), flags);
+
+        if (dir->fd>=0)
+            break;
+
+        if (errno==ENOENT)
+            return;
+
+        if (errno!=EINTR && !retry(path, errno))
+        {
+            g_atomic_int_set (&dir->failed, TRUE);
+            return;
+        }
+    }
+
+    // readdir() gets a descriptor of its own, dir->fd is needed until the subdirectories are removed
+    int dup_fd = dup (dir->fd);
+    DIR *d = dup_fd>=0 ? fdopendir (dup_fd) : NULL;
+
+    if (!d)
+    {
+        if (dup_fd>=0)
+            close (dup_fd);
+
+        g_atomic_int_set (&dir->failed, TRUE);
+        return;
+    }
+
+    struct dirent *entry;
+
+    while (!is_stopped() && (entry = readdir (d)))
+    {
+        const gchar *name = entry->d_name;
+
+        if (name[0]=='.' && (name[1]=='\0' || (name[1]=='.' && name[2]=='\0')))
+            continue;
+
+        unsigned char type = entry->d_type;
+
+        if (type == DT_UNKNOWN)
+        {
+            struct stat st;
+            int ret, err = 0;
+
+            while ((ret = fstatat (dir->fd, name, &st, AT_SYMLINK_NOFOLLOW)) != 0 && (err = errno) != ENOENT &&
+                   (err == EINTR || retry(path + G_DIR_SEPARATOR + name, err)))
+                ;
+
+            if (ret != 0)
+            {
+                // a skipped entry is reported now, not as the parent which can't be removed
+                if (err != ENOENT)
+                {
+                    count(1, 0, 1);
+                    g_atomic_int_set (&dir->failed, TRUE);
+                }
+                continue;
+            }
+
+            type = S_ISDIR (st.st_mode) ? DT_DIR : DT_REG;
+        }
+
+        if (type == DT_DIR)
+        {
+            count(1, 0, 0);
+            push_dir(dir, name);
+            continue;
+        }
+
+        gboolean removed = remove(dir->fd, name, path + G_DIR_SEPARATOR + name, FALSE);
+
+        count(1, removed, !removed);
+
+        if (!removed)
+            g_atomic_int_set (&dir->failed, TRUE);
+    }
+
+    closedir (d);
+}
+
+
+// removes dir once its subtree is empty, and the parents emptied by that
+void LocalDelete::finish_dir(Dir *dir)
+{
+    while (dir && g_atomic_int_dec_and_test (&dir->pending))
+    {
+        Dir *parent = dir->parent;
+
+        if (dir->fd>=0)
+            close (dir->fd);
+
+        if (!is_stopped())
+        {
+            gboolean removed = !g_atomic_int_get (&dir->failed) && remove(parent ? parent->fd : -1, dir->name, get_path(dir), TRUE);
+
+            count(0, removed, !removed);
+
+            if (!removed && parent)
+                g_atomic_int_set (&parent->failed, TRUE);
+        }
+
+        delete dir;
+
+        if (g_atomic_int_dec_and_test (&pending))
+        {
+            g_mutex_lock (&done_mutex);
+            g_cond_signal (&done_cond);
+            g_mutex_unlock (&done_mutex);
+        }
+
+        dir = parent;
+    }
+}
+
+
+void LocalDelete::read_dir_func(Dir *dir, LocalDelete *del)
+{
+    if (!del->is_stopped())
+        del->read_dir(dir);
+
+    del->finish_dir(dir);
+}
+
+
+// the deepest directories first, so the reading goes down the tree before it goes broad
+gint LocalDelete::compare_dirs(const Dir *a, const Dir *b, gpointer unused)
+{
+    return (gint) b->depth - (gint) a->depth;
+}
+
+
+gboolean LocalDelete::run(const gboolean *stop_flag, ErrorFunc error, gpointer data)
+{
+    stopped = stop_flag ? stop_flag : &never_stopped;
+    aborted = FALSE;
+    error_func = error;
+    user_data = data;
+    progress = Progress();
+    pending = 0;
+
+    pool = g_thread_pool_new ((GFunc) read_dir_func, this, n_threads, FALSE, NULL);
+    g_thread_pool_set_sort_function (pool, (GCompareDataFunc) compare_dirs, NULL);
+
+    for (vector<string>::const_iterator i=items.begin(); i!=items.end() && !is_stopped(); ++i)
+    {
+        struct stat st;
+        int ret, err = 0;
+
+        while ((ret = lstat (i->c_str(), &st))!=0 && (err = errno)!=ENOENT && retry(*i, err))
+            ;
+
+        if (ret!=0)
+        {
+            if (err!=ENOENT)
+                count(1, 0, 1);
+            continue;
+        }
+
+        count(1, 0, 0);
+
+        if (S_ISDIR (st.st_mode))
+            push_dir(NULL, *i);
+        else
+        {
+            gboolean removed = remove(-1, *i, *i, FALSE);
+            count(0, removed, !removed);
+        }
+    }
+
+    // directories are pushed by the pool threads themselves, so wait until none is left instead of freeing the pool at once
+    g_mutex_lock (&done_mutex);
+    while (g_atomic_int_get (&pending) > 0)
+        g_cond_wait (&done_cond, &done_mutex);
+    g_mutex_unlock (&done_mutex);
+
+    g_thread_pool_free (pool, FALSE, TRUE);
+    pool = NULL;
+
+    return !is_stopped();
+}
@@ -0,0 +1,119 @@
+/**
+ * @file local-delete.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __LOCAL_DELETE_H__
+#define __LOCAL_DELETE_H__
+
+#include <glib.h>
+
+#include <string>
+#include <vector>
+
+
+/**
+ * Deletes local files and directory trees with plain POSIX calls.
+ *
+ * Every directory is read by a pool of threads through a descriptor
+ * opened relative to its parent, and its entries are removed with
+ * unlinkat(), so no path is looked up twice. The subdirectories are
+ * handed to the pool, the deepest first, which keeps the number of open
+ * directories small. A directory is removed when its subtree is empty.
+ *
+ * For errors the function passed to run() is asked, possibly from
+ * several threads, but never from two at the same time. A skipped entry
+ * leaves its directories behind, without asking again.
+ */
+class LocalDelete
+{
+  public:
+
+    // the answers are ordered like the buttons of the dialog asking them
+    enum ErrorAnswer {ERROR_ANSWER_ABORT, ERROR_ANSWER_RETRY, ERROR_ANSWER_SKIP};
+
+    typedef ErrorAnswer (* ErrorFunc) (const gchar *path, int error, gpointer user_data);
+
+    struct Progress
+    {
+        guint64 files_done;                     // directories included
+        guint64 files_found;                    // so far
+        guint64 files_failed;                   // skipped or left behind
+
+        Progress(): files_done(0), files_found(0), files_failed(0)      {}
+    };
+
+    LocalDelete(guint n_threads=0);
+    ~LocalDelete();
+
+    void add(const gchar *path);
+    const std::vector<std::string> &get_items() const     {  return items;  }
+
+    /**
+     * Renames every item into a hidden directory next to it, which takes
+     * the items out of sight at once, and makes these directories the
+     * items to delete. Returns FALSE and leaves the items where they were
+     * if one of them can't be moved.
+     */
+    gboolean stage();
+
+    static gboolean is_staged(const gchar *path);       // TRUE for the hidden directories stage() makes
+
+    /**
+     * Blocks until all items are deleted. Returns FALSE if the deletion has
+     * been stopped or aborted, skipped files don't count as failures.
+     */
+    gboolean run(const gboolean *stop_flag=NULL, ErrorFunc error=NULL, gpointer user_data=NULL);
+
+    void get_progress(Progress &progress);      // may be called from any thread while run() is running
+
+  private:
+
+    struct Dir;
+
+    guint n_threads;
+    std::vector<std::string> items;
+
+    const gboolean *stopped;
+    gboolean aborted;
+    ErrorFunc error_func;
+    gpointer user_data;
+
+    GMutex query_mutex;                         // one question at a time
+    GMutex progress_mutex;
+    Progress progress;
+
+    GThreadPool *pool;
+    GMutex done_mutex;
+    GCond done_cond;
+    gint pending;                               // directories not removed yet
+
+    gboolean is_stopped()                       {  return aborted || *stopped;  }
+
+    gboolean retry(const std::string &path, int error);
+    gboolean remove(int dir_fd, const std::string &name, const std::string &path, gboolean is_dir);
+    void push_dir(Dir *parent, const std::string &name);
+    void read_dir(Dir *dir);
+    void finish_dir(Dir *dir);
+    void count(guint64 found, guint64 done, guint64 failed);
+
+    static std::string get_path(const Dir *dir);
+    static void read_dir_func(Dir *dir, LocalDelete *del);
+    static gint compare_dirs(const Dir *a, const Dir *b, gpointer unused);
+};
+
+#endif // __LOCAL_DELETE_H__
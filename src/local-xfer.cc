@@ -0,0 +1,1355 @@
+/**
+ * @file local-xfer.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#include <sys/file.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "local-xfer.h"
+
+using namespace std;
+
+
+#define LARGE_FILE_SIZE   (4U << 20)            // copied by the thread of run(), the smaller ones by the pool
+#define KERNEL_CHUNK_SIZE (8U << 20)            // bytes copied by the kernel between two looks at the stop flag
+#define BUFFER_SIZE       (1U << 20)
+#define CHECKPOINT_SIZE   (64U << 20)           // data copied between two checkpoints of a file, and covered by one checksum
+#define CHECKSUM_SIZE     (1U << 20)            // data read at a time for a checksum
+
+#define JOURNAL_MAGIC     "gcmd-xfer-journal\t1\n"
+
+
+static const gboolean never_stopped = FALSE;
+
+
+LocalXfer::LocalXfer(gboolean m, gboolean follow, OverwriteMode mode, guint threads): move(m), follow_links(follow), overwrite_mode(mode)
+{
+    n_threads = threads ? threads : g_get_num_processors ();
+
+    stopped = &never_stopped;
+    aborted = FALSE;
+    overwrite_func = NULL;
+    error_func = NULL;
+    user_data = NULL;
+    pool = NULL;
+    scan_thread = NULL;
+    scanning = FALSE;
+    executing = FALSE;
+    pending = 0;
+    paused = FALSE;
+    journal_fd = -1;
+    resumed = FALSE;
+
+    g_mutex_init (&query_mutex);
+    g_mutex_init (&progress_mutex);
+    g_mutex_init (&entries_mutex);
+    g_cond_init (&entries_cond);
+    g_mutex_init (&pending_mutex);
+    g_cond_init (&pending_cond);
+    g_mutex_init (&pause_mutex);
+    g_cond_init (&pause_cond);
+    g_mutex_init (&journal_mutex);
+}
+
+
+LocalXfer::~LocalXfer()
+{
+    g_mutex_clear (&query_mutex);
+    g_mutex_clear (&progress_mutex);
+    g_mutex_clear (&entries_mutex);
+    g_cond_clear (&entries_cond);
+    g_mutex_clear (&pending_mutex);
+    g_cond_clear (&pending_cond);
+    g_mutex_clear (&pause_mutex);
+    g_cond_clear (&pause_cond);
+    g_mutex_clear (&journal_mutex);
+
+    if (journal_fd >= 0)
+        close (journal_fd);
+}
+
+
+void LocalXfer::add(const gchar *src, const gchar *dest)
+{
+    items.push_back(make_pair(string(src), string(dest)));
+}
+
+
+void LocalXfer::set_journal(const gchar *path)
+{
+    journal_path = path;
+}
+
+
+guint32 LocalXfer::checksum(const gchar *data, gsize len, guint32 sum)
+{
+    guint32 a = sum & 0xffff;
+    guint32 b = sum >> 16;
+
+    while (len)
+    {
+        // the sums can't overflow within 5552 bytes
+        gsize n = MIN (len, 5552);
+
+        for (len -= n; n; --n)
+        {
+            a += (guchar) *data++;
+            b += a;
+        }
+
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return b << 16 | a;
+}
+
+
+/**
+ * Appends the checksums of the segments of CHECKPOINT_SIZE before offset
+ * to sums, from segment sums.size() on. The last one ends at offset.
+ */
+static gboolean checksum_segments (int fd, guint64 offset, vector<guint32> &sums)
+{
+    vector<gchar> buffer(CHECKSUM_SIZE);
+
+    for (guint64 start=(guint64) sums.size() * CHECKPOINT_SIZE; start<offset; start+=CHECKPOINT_SIZE)
+    {
+        guint64 end = MIN (start + CHECKPOINT_SIZE, offset);
+        guint32 sum = LocalXfer::checksum(NULL, 0);
+
+        // rolled over the segment a buffer at a time
+        for (guint64 pos=start; pos<end; )
+        {
+            ssize_t n = pread (fd, &buffer[0], MIN (end - pos, CHECKSUM_SIZE), pos);
+
+            if (n < 0 && errno==EINTR)
+                continue;
+
+            if (n <= 0)
+                return FALSE;
+
+            sum = LocalXfer::checksum(&buffer[0], n, sum);
+            pos += n;
+        }
+
+        sums.push_back(sum);
+    }
+
+    return TRUE;
+}
+
+
+static gboolean write_all (int fd, const string &s)
+{
+    for (gsize written=0; written<s.size(); )
+    {
+        ssize_t n = write (fd, s.data() + written, s.size() - written);
+
+        if (n < 0 && errno==EINTR)
+            continue;
+
+        if (n <= 0)
+            return FALSE;
+
+        written += n;
+    }
+
+    return TRUE;
+}
+
+
+// the paths in the journal are escaped, so they can't hold the tabs and newlines between the fields
+static string escape (const string &s)
+{
+    gchar *escaped = g_strescape (s.c_str(), NULL);
+    string retval = escaped;
+
+    g_free (escaped);
+
+    return retval;
+}
+
+
+static string unescape (const gchar *s)
+{
+    gchar *unescaped = g_strcompress (s);
+    string retval = unescaped;
+
+    g_free (unescaped);
+
+    return retval;
+}
+
+
+// the checksums from segment first on, the ones before are in earlier lines for the same target
+static string checkpoint_line (const string &dest, guint64 offset, guint64 size, const struct timespec &mtime, const vector<guint32> &sums, guint first)
+{
+    gchar *fields = g_strdup_printf ("part\t%llu\t%llu\t%lld\t%ld\t%u\t", (unsigned long long) offset, (unsigned long long) size, (long long) mtime.tv_sec, (long) mtime.tv_nsec, first);
+    string retval = fields;
+
+    g_free (fields);
+
+    for (guint i=first; i<sums.size(); ++i)
+    {
+        gchar *sum = g_strdup_printf (i==first ? "%u" : ",%u", sums[i]);
+        retval += sum;
+        g_free (sum);
+    }
+
+    return retval + '\t' + escape (dest) + '\n';
+}
+
+
+/**
+ * Writes the journal anew, with what is known from a resumed transfer.
+ * The new one replaces the old one at once, so a crash meanwhile doesn't
+ * lose it.
+ */
+void LocalXfer::open_journal()
+{
+    string tmp_path = journal_path + ".tmp";
+    int fd = open (tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+    // without a journal the transfer can't be resumed, but it works
+    if (fd < 0)
+        return;
+
+    flock (fd, LOCK_EX);
+
+    gchar *options = g_strdup_printf ("options\t%d\t%d\t%d\n", move, follow_links, overwrite_mode);
+    string s = string(JOURNAL_MAGIC) + options;
+
+    g_free (options);
+
+    for (vector<pair<string,string> >::const_iterator i=items.begin(); i!=items.end(); ++i)
+        s += "item\t" + escape (i->first) + '\t' + escape (i->second) + '\n';
+
+    for (set<string>::const_iterator i=dirs_made.begin(); i!=dirs_made.end(); ++i)
+        s += "dir\t" + escape (*i) + '\n';
+
+    for (set<string>::const_iterator i=files_done.begin(); i!=files_done.end(); ++i)
+        s += "done\t" + escape (*i) + '\n';
+
+    for (map<string,Checkpoint>::const_iterator i=checkpoints.begin(); i!=checkpoints.end(); ++i)
+        s += checkpoint_line (i->first, i->second.offset, i->second.size, i->second.mtime, i->second.sums, 0);
+
+    if (!write_all (fd, s) || fdatasync (fd)!=0 || rename (tmp_path.c_str(), journal_path.c_str())!=0)
+    {
+        close (fd);
+        unlink (tmp_path.c_str());
+        return;
+    }
+
+    // the lock of the old journal goes with it
+    if (journal_fd >= 0)
+        close (journal_fd);
+
+    journal_fd = fd;
+}
+
+
+void LocalXfer::write_journal(const string &line, gboolean sync)
+{
+    if (journal_fd < 0)
+        return;
+
+    g_mutex_lock (&journal_mutex);
+
+    if (write_all (journal_fd, line) && sync)
+        fdatasync (journal_fd);
+
+    g_mutex_unlock (&journal_mutex);
+}
+
+
+LocalXfer *LocalXfer::load_journal(const gchar *path, int *error)
+{
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+    int dummy;
+
+    if (!error)
+        error = &dummy;
+
+    if (fd < 0)
+    {
+        *error = errno;
+        return NULL;
+    }
+
+    if (flock (fd, LOCK_EX | LOCK_NB)!=0)
+    {
+        *error = errno==EWOULDBLOCK ? EBUSY : errno;
+        close (fd);
+        return NULL;
+    }
+
+    gchar *contents = NULL;
+    LocalXfer *xfer = NULL;
+
+    if (g_file_get_contents (path, &contents, NULL, NULL) && g_str_has_prefix (contents, JOURNAL_MAGIC))
+    {
+        gchar **lines = g_strsplit (contents + strlen (JOURNAL_MAGIC), "\n", -1);
+
+        // the last line may have been cut by a crash, it has too few fields then
+        for (gchar **line=lines; *line; ++line)
+        {
+            gchar **fields = g_strsplit (*line, "\t", -1);
+            guint n = 0;
+
+            while (fields[n])
+                ++n;
+
+            if (n==4 && strcmp (fields[0], "options")==0 && !xfer)
+                xfer = new LocalXfer(atoi (fields[1]), atoi (fields[2]), (OverwriteMode) atoi (fields[3]));
+            else
+                if (!xfer)
+                    ;
+                else
+                    if (n==3 && strcmp (fields[0], "item")==0)
+                        xfer->add(unescape (fields[1]).c_str(), unescape (fields[2]).c_str());
+                    else
+                        if (n==2 && strcmp (fields[0], "dir")==0)
+                            xfer->dirs_made.insert(unescape (fields[1]));
+                        else
+                            if (n==2 && strcmp (fields[0], "done")==0)
+                                xfer->files_done.insert(unescape (fields[1]));
+                            else
+                                if (n==8 && strcmp (fields[0], "part")==0)
+                                {
+                                    Checkpoint &c = xfer->checkpoints[unescape (fields[7])];
+
+                                    c.offset = strtoull (fields[1], NULL, 10);
+                                    c.size = strtoull (fields[2], NULL, 10);
+                                    c.mtime.tv_sec = strtoll (fields[3], NULL, 10);
+                                    c.mtime.tv_nsec = strtol (fields[4], NULL, 10);
+
+                                    // a gap left by a lost line fails the check of the target
+                                    c.sums.resize(strtoul (fields[5], NULL, 10));
+
+                                    gchar **sums = g_strsplit (fields[6], ",", -1);
+
+                                    for (gchar **sum=sums; *sum; ++sum)
+                                        c.sums.push_back(strtoul (*sum, NULL, 10));
+
+                                    g_strfreev (sums);
+                                }
+                                else
+                                    // the one checksum of the last MiB of a journal before the segments, it can't be checked
+                                    if (n==7 && strcmp (fields[0], "part")==0)
+                                    {
+                                        Checkpoint &c = xfer->checkpoints[unescape (fields[6])];
+
+                                        c.offset = strtoull (fields[1], NULL, 10);
+                                        c.size = strtoull (fields[2], NULL, 10);
+                                        c.mtime.tv_sec = strtoll (fields[3], NULL, 10);
+                                        c.mtime.tv_nsec = strtol (fields[4], NULL, 10);
+                                        c.sums.clear();
+                                    }
+
+            g_strfreev (fields);
+        }
+
+        g_strfreev (lines);
+    }
+
+    g_free (contents);
+
+    if (!xfer || xfer->items.empty())
+    {
+        delete xfer;
+        close (fd);
+        *error = EINVAL;
+        return NULL;
+    }
+
+    xfer->journal_path = path;
+    xfer->journal_fd = fd;
+    xfer->resumed = TRUE;
+
+    return xfer;
+}
+
+
+void LocalXfer::checkpoint(const Entry &e, int src_fd, int dest_fd, guint64 offset)
+{
+    Checkpoint c;
+
+    c.offset = 0;
+
+    // the segments of the previous checkpoint are kept, but its last one may have grown
+    g_mutex_lock (&journal_mutex);
+    map<string,Checkpoint>::const_iterator i = checkpoints.find(e.dest);
+    if (i!=checkpoints.end())
+        c = i->second;
+    g_mutex_unlock (&journal_mutex);
+
+    guint first = MIN (c.offset / CHECKPOINT_SIZE, c.sums.size());
+
+    c.sums.resize(first);
+    c.offset = offset;
+    c.size = e.size;
+    c.mtime = e.times[1];
+
+    if (!checksum_segments (src_fd, offset, c.sums))
+        return;
+
+    // the data has to be on the disk before the journal says so
+    if (journal_fd >= 0 && fdatasync (dest_fd)!=0)
+        return;
+
+    g_mutex_lock (&journal_mutex);
+    checkpoints[e.dest] = c;
+    g_mutex_unlock (&journal_mutex);
+
+    write_journal(checkpoint_line (e.dest, c.offset, c.size, c.mtime, c.sums, first), TRUE);
+}
+
+
+gboolean LocalXfer::has_checkpoint(const string &dest)
+{
+    g_mutex_lock (&journal_mutex);
+    gboolean retval = checkpoints.find(dest)!=checkpoints.end();
+    g_mutex_unlock (&journal_mutex);
+
+    return retval;
+}
+
+
+gboolean LocalXfer::forget_checkpoint(const string &dest)
+{
+    g_mutex_lock (&journal_mutex);
+    gboolean retval = checkpoints.erase(dest) > 0;
+    g_mutex_unlock (&journal_mutex);
+
+    return retval;
+}
+
+
+/**
+ * Opens the target of a checkpointed file positioned at the checkpoint,
+ * with the source at the same offset. Returns -1 if there is no usable
+ * checkpoint, the partial copy is removed then.
+ */
+int LocalXfer::open_checkpointed(const Entry &e, int src_fd, guint64 &offset)
+{
+    Checkpoint c;
+
+    g_mutex_lock (&journal_mutex);
+    map<string,Checkpoint>::const_iterator i = checkpoints.find(e.dest);
+    gboolean found = i!=checkpoints.end();
+    if (found)
+        c = i->second;
+    g_mutex_unlock (&journal_mutex);
+
+    if (!found)
+        return -1;
+
+    // the source must be unchanged, and the target must still hold the data up to the checkpoint
+    if (c.size==e.size && c.mtime.tv_sec==e.times[1].tv_sec && c.mtime.tv_nsec==e.times[1].tv_nsec && c.offset<=e.size)
+    {
+        int dest_fd = open (e.dest.c_str(), O_RDWR | O_CLOEXEC);
+        struct stat st;
+        vector<guint32> sums;
+
+        // every segment before the checkpoint is read again
+        if (dest_fd >= 0 && fstat (dest_fd, &st)==0 && S_ISREG (st.st_mode) && (guint64) st.st_size >= c.offset &&
+            checksum_segments (dest_fd, c.offset, sums) && sums==c.sums &&
+            ftruncate (dest_fd, c.offset)==0 &&
+            lseek (dest_fd, c.offset, SEEK_SET)==(off_t) c.offset && lseek (src_fd, c.offset, SEEK_SET)==(off_t) c.offset)
+        {
+            offset = c.offset;
+            return dest_fd;
+        }
+
+        if (dest_fd >= 0)
+            close (dest_fd);
+    }
+
+    // the partial copy is of no use, it is replaced without asking
+    forget_checkpoint(e.dest);
+    unlink (e.dest.c_str());
+
+    return -1;
+}
+
+
+// returns TRUE if a resumed transfer has copied the file before
+gboolean LocalXfer::is_done(const Entry &e)
+{
+    struct stat st;
+
+    if (!resumed || files_done.find(e.dest)==files_done.end() || lstat (e.dest.c_str(), &st)!=0)
+        return FALSE;
+
+    return e.action!=COPY_FILE || (S_ISREG (st.st_mode) && (guint64) st.st_size==e.size &&
+                                   st.st_mtim.tv_sec==e.times[1].tv_sec && st.st_mtim.tv_nsec==e.times[1].tv_nsec);
+}
+
+
+void LocalXfer::get_progress(Progress &p)
+{
+    g_mutex_lock (&progress_mutex);
+    p = progress;
+    g_mutex_unlock (&progress_mutex);
+}
+
+
+void LocalXfer::set_paused(gboolean p)
+{
+    g_mutex_lock (&pause_mutex);
+    g_atomic_int_set (&paused, p);
+    g_cond_broadcast (&pause_cond);
+    g_mutex_unlock (&pause_mutex);
+}
+
+
+gboolean LocalXfer::pause_point()
+{
+    if (g_atomic_int_get (&paused))
+    {
+        g_mutex_lock (&pause_mutex);
+
+        // the stop flag isn't signalled, so it is looked at now and then
+        while (g_atomic_int_get (&paused) && !is_stopped())
+            g_cond_wait_until (&pause_cond, &pause_mutex, g_get_monotonic_time () + G_TIME_SPAN_SECOND/10);
+
+        g_mutex_unlock (&pause_mutex);
+    }
+
+    return is_stopped();
+}
+
+
+inline void LocalXfer::add_progress(guint64 bytes)
+{
+    g_mutex_lock (&progress_mutex);
+    progress.bytes_done += bytes;
+    progress.file_bytes_done += bytes;
+    g_mutex_unlock (&progress_mutex);
+}
+
+
+inline void LocalXfer::file_done()
+{
+    g_mutex_lock (&progress_mutex);
+    ++progress.files_done;
+    g_mutex_unlock (&progress_mutex);
+}
+
+
+// returns TRUE if dest is to be replaced, asks if needed
+gboolean LocalXfer::replace(const string &src, const string &dest)
+{
+    gboolean retval = FALSE;
+
+    g_mutex_lock (&query_mutex);
+
+    if (overwrite_mode==OVERWRITE_QUERY && !is_stopped())
+        switch (overwrite_func ? overwrite_func (src.c_str(), dest.c_str(), user_data) : OVERWRITE_ANSWER_SKIP)
+        {
+            case OVERWRITE_ANSWER_REPLACE_ALL:
+                overwrite_mode = OVERWRITE_REPLACE;
+                // fall through
+            case OVERWRITE_ANSWER_REPLACE:
+                retval = TRUE;
+                break;
+
+            case OVERWRITE_ANSWER_SKIP_ALL:
+                overwrite_mode = OVERWRITE_SKIP;
+                // fall through
+            case OVERWRITE_ANSWER_SKIP:
+                break;
+
+            default:
+                aborted = TRUE;
+                break;
+        }
+    else
+        if (overwrite_mode==OVERWRITE_REPLACE)
+            retval = TRUE;
+        else
+            if (overwrite_mode==OVERWRITE_ABORT)
+                aborted = TRUE;
+
+    g_mutex_unlock (&query_mutex);
+
+    return retval && !is_stopped();
+}
+
+
+// returns TRUE if the failed operation is to be done again, FALSE to skip it
+gboolean LocalXfer::retry(const string &src, const string &dest, int error)
+{
+    gboolean retval = FALSE;
+
+    g_mutex_lock (&query_mutex);
+
+    if (!is_stopped())
+        switch (error_func ? error_func (src.c_str(), dest.c_str(), error, user_data) : ERROR_ANSWER_SKIP)
+        {
+            case ERROR_ANSWER_RETRY:
+                retval = TRUE;
+                break;
+
+            case ERROR_ANSWER_SKIP:
+                break;
+
+            default:
+                aborted = TRUE;
+                break;
+        }
+
+    g_mutex_unlock (&query_mutex);
+
+    return retval;
+}
+
+
+static gboolean is_same_file (const struct stat &st, const string &path, gboolean follow_links)
+{
+    struct stat path_st;
+
+    return (follow_links ? stat (path.c_str(), &path_st) : lstat (path.c_str(), &path_st))==0 &&
+           path_st.st_dev==st.st_dev && path_st.st_ino==st.st_ino;
+}
+
+
+void LocalXfer::scan(const string &src, const string &dest, gboolean dest_exists, dev_t dest_dev)
+{
+    struct stat st, dest_st;
+
+    while ((follow_links ? stat (src.c_str(), &st) : lstat (src.c_str(), &st)) != 0)
+    {
+        // moved before a resumed transfer was interrupted
+        if (resumed && errno==ENOENT)
+            return;
+
+        if (!retry(src, dest, errno))
+            return;
+    }
+
+    dest_exists = dest_exists && lstat (dest.c_str(), &dest_st)==0;
+
+    // the source itself under another path, e.g. through a symlinked directory: replacing it would remove the source
+    if (dest_exists && is_same_file (st, dest, follow_links))
+    {
+        retry(src, dest, EINVAL);
+        return;
+    }
+
+    gboolean merge = dest_exists && S_ISDIR (st.st_mode) && S_ISDIR (dest_st.st_mode);
+
+    Entry e;
+
+    e.src = src;
+    e.dest = dest;
+    e.mode = st.st_mode;
+    e.rdev = st.st_rdev;
+    e.size = S_ISREG (st.st_mode) ? st.st_size : 0;
+    e.times[0] = st.st_atim;
+    e.times[1] = st.st_mtim;
+    e.end = 0;
+    e.created = FALSE;
+    e.done = FALSE;
+
+    // within a file system a whole tree is moved at once, unless it is merged into an existing one
+    if (move && st.st_dev==dest_dev && !merge)
+        e.action = RENAME;
+    else
+        if (S_ISDIR (st.st_mode))
+            e.action = MAKE_DIR;
+        else
+            if (S_ISREG (st.st_mode))
+                e.action = COPY_FILE;
+            else
+                e.action = S_ISLNK (st.st_mode) ? COPY_LINK : COPY_SPECIAL;
+
+    if (e.action!=MAKE_DIR)
+    {
+        // counted before it can be done
+        g_mutex_lock (&progress_mutex);
+        ++progress.files_total;
+        progress.bytes_total += e.size;
+        g_mutex_unlock (&progress_mutex);
+
+        add_entry(e);
+
+        return;
+    }
+
+    // a followed link back to a directory above
+    for (vector<pair<dev_t,ino_t> >::const_iterator i=scan_path.begin(); i!=scan_path.end(); ++i)
+        if (i->first==st.st_dev && i->second==st.st_ino)
+        {
+            retry(src, dest, ELOOP);
+            return;
+        }
+
+    DIR *dir;
+
+    while (!(dir = opendir (src.c_str())))
+        if (!retry(src, dest, errno))
+            return;
+
+    guint n = add_entry(e);
+
+    scan_dir(dir, st, src, dest, merge, dest_dev);
+
+    g_mutex_lock (&entries_mutex);
+    set_end(n, entries.size());
+    g_mutex_unlock (&entries_mutex);
+}
+
+
+// scans the contents of directory src and closes dir
+void LocalXfer::scan_dir(DIR *dir, const struct stat &st, const string &src, const string &dest, gboolean merge, dev_t dest_dev)
+{
+    scan_path.push_back(make_pair(st.st_dev, st.st_ino));
+
+    struct dirent *entry;
+
+    while ((entry = readdir (dir)) && !is_stopped())
+    {
+        const gchar *name = entry->d_name;
+
+        if (name[0]=='.' && (name[1]=='\0' || (name[1]=='.' && name[2]=='\0')))
+            continue;
+
+        scan(src + G_DIR_SEPARATOR + name, dest + G_DIR_SEPARATOR + name, merge, dest_dev);
+    }
+
+    closedir (dir);
+
+    scan_path.pop_back();
+}
+
+
+// the contents of a directory whose rename fell back, its target exists now
+void LocalXfer::rescan(const string &src, const string &dest, dev_t dest_dev)
+{
+    struct stat st;
+    DIR *dir;
+
+    while ((follow_links ? stat (src.c_str(), &st) : lstat (src.c_str(), &st)) != 0 || !(dir = opendir (src.c_str())))
+        if (!retry(src, dest, errno))
+            return;
+
+    scan_dir(dir, st, src, dest, TRUE, dest_dev);
+}
+
+
+// returns the index of the entry, the subtree of a directory ends when it is scanned
+guint LocalXfer::add_entry(const Entry &e)
+{
+    g_mutex_lock (&entries_mutex);
+
+    guint n = entries.size();
+
+    entries.push_back(e);
+    if (e.action!=MAKE_DIR)
+        entries[n].end = n + 1;
+    g_cond_broadcast (&entries_cond);
+
+    g_mutex_unlock (&entries_mutex);
+
+    return n;
+}
+
+
+// entries_mutex has to be locked
+void LocalXfer::set_end(guint n, guint end)
+{
+    entries[n].end = end;
+    g_cond_broadcast (&entries_cond);
+}
+
+
+LocalXfer::Entry *LocalXfer::wait_for_entry(guint n)
+{
+    g_mutex_lock (&entries_mutex);
+
+    while (n>=entries.size() && (scanning || !rescans.empty()))
+        g_cond_wait (&entries_cond, &entries_mutex);
+
+    Entry *e = n<entries.size() ? &entries[n] : NULL;
+
+    g_mutex_unlock (&entries_mutex);
+
+    return e;
+}
+
+
+guint LocalXfer::wait_for_end(guint n)
+{
+    g_mutex_lock (&entries_mutex);
+
+    while (!entries[n].end)
+        g_cond_wait (&entries_cond, &entries_mutex);
+
+    guint end = entries[n].end;
+
+    g_mutex_unlock (&entries_mutex);
+
+    return end;
+}
+
+
+gpointer LocalXfer::scan_func(LocalXfer *xfer)
+{
+    for (vector<pair<string,string> >::const_iterator i=xfer->items.begin(); i!=xfer->items.end() && !xfer->is_stopped(); ++i)
+    {
+        gchar *dest_dir = g_path_get_dirname (i->second.c_str());
+        struct stat st;
+
+        xfer->scan(i->first, i->second, TRUE, stat (dest_dir, &st)==0 ? st.st_dev : 0);
+
+        g_free (dest_dir);
+    }
+
+    g_mutex_lock (&xfer->entries_mutex);
+
+    // the rescans are asked for by run() until it is done, a rescan is taken and scanned in one go for wait_for_entry()
+    for (;;)
+    {
+        xfer->scanning = FALSE;
+        g_cond_broadcast (&xfer->entries_cond);
+
+        while (xfer->rescans.empty() && xfer->executing)
+            g_cond_wait (&xfer->entries_cond, &xfer->entries_mutex);
+
+        if (xfer->rescans.empty())
+            break;
+
+        const Entry &e = xfer->entries[xfer->rescans.back().first];
+        string src = e.src;
+        string dest = e.dest;
+        dev_t dest_dev = xfer->rescans.back().second;
+
+        xfer->rescans.pop_back();
+        xfer->scanning = TRUE;
+
+        g_mutex_unlock (&xfer->entries_mutex);
+
+        if (!xfer->is_stopped())
+            xfer->rescan(src, dest, dest_dev);
+
+        g_mutex_lock (&xfer->entries_mutex);
+    }
+
+    g_mutex_unlock (&xfer->entries_mutex);
+
+    return NULL;
+}
+
+
+guint LocalXfer::execute(guint n, Entry &e)
+{
+    struct stat st;
+
+    switch (e.action)
+    {
+        case MAKE_DIR:
+            // writable until its files are copied, the permissions are set at the end
+            while (mkdir (e.dest.c_str(), S_IRWXU) != 0)
+            {
+                int error = errno;
+
+                if (error==EEXIST)
+                {
+                    if (stat (e.dest.c_str(), &st)==0 && S_ISDIR (st.st_mode))
+                    {
+                        e.created = dirs_made.find(e.dest)!=dirs_made.end();
+                        e.done = TRUE;
+                        return n + 1;
+                    }
+
+                    if (!replace(e.src, e.dest))
+                        return wait_for_end(n);
+
+                    if (unlink (e.dest.c_str())==0)
+                        continue;
+
+                    error = errno;
+                }
+
+                if (!retry(e.src, e.dest, error))
+                    return wait_for_end(n);
+            }
+
+            e.created = TRUE;
+            e.done = TRUE;
+            write_journal("dir\t" + escape (e.dest) + '\n');
+            break;
+
+        case RENAME:
+            g_mutex_lock (&progress_mutex);
+            progress.current_file = e.src;
+            g_mutex_unlock (&progress_mutex);
+
+            for (;;)
+            {
+                if (lstat (e.dest.c_str(), &st)==0)
+                {
+                    // a directory which turned up since the scan, e.g. moved there by an earlier source
+                    if (S_ISDIR (e.mode) && S_ISDIR (st.st_mode))
+                        return fall_back(n, e, st.st_dev);
+
+                    if (!replace(e.src, e.dest))
+                        break;
+                }
+
+                if (rename (e.src.c_str(), e.dest.c_str())==0)
+                {
+                    add_progress(e.size);
+                    break;
+                }
+
+                int error = errno;
+
+                // the same file system under two mount points
+                if (error==EXDEV)
+                    return fall_back(n, e, 0);
+
+                // a directory made in between, merged by the next round
+                if ((error==ENOTEMPTY || error==EEXIST) && S_ISDIR (e.mode) && lstat (e.dest.c_str(), &st)==0 && S_ISDIR (st.st_mode))
+                    continue;
+
+                if (!retry(e.src, e.dest, error))
+                    break;
+            }
+
+            file_done();
+            break;
+
+        case COPY_FILE:
+            if (e.size < LARGE_FILE_SIZE)
+            {
+                g_atomic_int_inc (&pending);
+                g_thread_pool_push (pool, &e, NULL);
+                break;
+            }
+            // fall through
+
+        default:
+            copy(e);
+            break;
+    }
+
+    return n + 1;
+}
+
+
+// copies an entry which can't be renamed, the contents of a directory are left to a rescan with dest_dev for their renames
+guint LocalXfer::fall_back(guint n, Entry &e, dev_t dest_dev)
+{
+    if (!S_ISDIR (e.mode))
+    {
+        e.action = S_ISREG (e.mode) ? COPY_FILE : S_ISLNK (e.mode) ? COPY_LINK : COPY_SPECIAL;
+        return execute(n, e);
+    }
+
+    // no longer a file of its own, the rescan counts its contents
+    g_mutex_lock (&progress_mutex);
+    --progress.files_total;
+    g_mutex_unlock (&progress_mutex);
+
+    e.action = MAKE_DIR;
+
+    guint next = execute(n, e);
+
+    if (e.done)
+    {
+        g_mutex_lock (&entries_mutex);
+        rescans.push_back(make_pair(n, dest_dev));
+        g_cond_broadcast (&entries_cond);
+        g_mutex_unlock (&entries_mutex);
+    }
+
+    return next;
+}
+
+
+gboolean LocalXfer::run(const gboolean *stop_flag, OverwriteFunc overwrite, ErrorFunc error, gpointer data)
+{
+    stopped = stop_flag ? stop_flag : &never_stopped;
+    overwrite_func = overwrite;
+    error_func = error;
+    user_data = data;
+
+    if (!journal_path.empty())
+        open_journal();
+
+    // the entries are transferred while the rest is scanned
+    scanning = TRUE;
+    executing = TRUE;
+    scan_thread = g_thread_new ("local-xfer-scan", (GThreadFunc) scan_func, this);
+    pool = g_thread_pool_new ((GFunc) copy_func, this, n_threads, FALSE, NULL);
+
+    Entry *e;
+
+    for (guint n=0; !pause_point() && (e = wait_for_entry(n)); )
+        n = execute(n, *e);
+
+    g_mutex_lock (&entries_mutex);
+    executing = FALSE;
+    g_cond_broadcast (&entries_cond);
+    g_mutex_unlock (&entries_mutex);
+
+    // a stopped scan ends after the directory entry it is reading
+    g_thread_join (scan_thread);
+    scan_thread = NULL;
+
+    g_mutex_lock (&pending_mutex);
+    while (g_atomic_int_get (&pending) > 0)
+        g_cond_wait (&pending_cond, &pending_mutex);
+    g_mutex_unlock (&pending_mutex);
+
+    g_thread_pool_free (pool, FALSE, TRUE);
+    pool = NULL;
+
+    // the directories get their permissions and times after their files, the moved ones are removed if empty
+    for (guint n=entries.size(); n-->0; )
+    {
+        const Entry &e = entries[n];
+
+        if (e.action!=MAKE_DIR || !e.done)
+            continue;
+
+        if (e.created)
+        {
+            chmod (e.dest.c_str(), e.mode & 07777);
+            utimensat (AT_FDCWD, e.dest.c_str(), e.times, 0);
+        }
+
+        if (move && !is_stopped())
+            rmdir (e.src.c_str());
+    }
+
+    if (journal_fd >= 0)
+    {
+        if (!is_stopped())
+            unlink (journal_path.c_str());
+
+        close (journal_fd);
+        journal_fd = -1;
+    }
+
+    return !is_stopped();
+}
+
+
+void LocalXfer::discard()
+{
+    g_mutex_lock (&journal_mutex);
+
+    for (map<string,Checkpoint>::const_iterator i=checkpoints.begin(); i!=checkpoints.end(); ++i)
+        unlink (i->first.c_str());
+
+    checkpoints.clear();
+
+    g_mutex_unlock (&journal_mutex);
+
+    if (!journal_path.empty())
+        unlink (journal_path.c_str());
+}
+
+
+void LocalXfer::copy_func(Entry *e, LocalXfer *xfer)
+{
+    xfer->copy(*e);
+
+    if (g_atomic_int_dec_and_test (&xfer->pending))
+    {
+        g_mutex_lock (&xfer->pending_mutex);
+        g_cond_broadcast (&xfer->pending_cond);
+        g_mutex_unlock (&xfer->pending_mutex);
+    }
+}
+
+
+void LocalXfer::copy(Entry &e)
+{
+    if (pause_point())
+        return;
+
+    g_mutex_lock (&progress_mutex);
+    progress.current_file = e.src;
+    progress.file_size = e.size;
+    progress.file_bytes_done = 0;
+    g_mutex_unlock (&progress_mutex);
+
+    if (is_done(e))
+    {
+        add_progress(e.size);
+
+        while (move && unlink (e.src.c_str())!=0 && errno!=ENOENT && retry(e.src, e.dest, errno))
+            ;
+
+        file_done();
+        return;
+    }
+
+    for (;;)
+    {
+        int error = 0;
+
+        if (e.action==COPY_FILE)
+        {
+            int src_fd = open (e.src.c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (src_fd < 0)
+                error = errno;
+            else
+            {
+                guint64 offset = 0;
+                int dest_fd = open_checkpointed(e, src_fd, offset);
+
+                if (dest_fd < 0)
+                    dest_fd = open (e.dest.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+                if (dest_fd < 0)
+                    error = errno;
+                else
+                {
+                    add_progress(offset);
+
+                    error = copy_data(src_fd, dest_fd, e, offset);
+
+                    if (!error)
+                    {
+                        fchmod (dest_fd, e.mode & 07777);
+                        futimens (dest_fd, e.times);
+                    }
+
+                    if (close (dest_fd)!=0 && !error)
+                        error = errno;
+
+                    // a checkpointed copy is kept to continue from
+                    if (error && !has_checkpoint(e.dest))
+                        unlink (e.dest.c_str());
+                }
+
+                close (src_fd);
+            }
+        }
+        else
+            if (e.action==COPY_LINK)
+            {
+                vector<gchar> target(PATH_MAX + 1);
+                ssize_t len = readlink (e.src.c_str(), &target[0], target.size()-1);
+
+                if (len < 0)
+                    error = errno;
+                else
+                {
+                    target[len] = '\0';
+
+                    if (symlink (&target[0], e.dest.c_str())!=0)
+                        error = errno;
+                }
+            }
+            else
+                if (mknod (e.dest.c_str(), e.mode, e.rdev)==0)
+                    chmod (e.dest.c_str(), e.mode & 07777);
+                else
+                    error = errno;
+
+        if (!error)
+        {
+            forget_checkpoint(e.dest);
+            write_journal("done\t" + escape (e.dest) + '\n');
+
+            while (move && unlink (e.src.c_str())!=0 && retry(e.src, e.dest, errno))
+                ;
+            break;
+        }
+
+        // a stopped transfer keeps its partial copy for the journal
+        if (error==ECANCELED)
+            return;
+
+        if (error==EEXIST)
+        {
+            if (!replace(e.src, e.dest))
+                break;
+
+            if (unlink (e.dest.c_str())==0)
+                continue;
+
+            error = errno;
+        }
+
+        if (!retry(e.src, e.dest, error))
+        {
+            if (!is_stopped() && forget_checkpoint(e.dest))
+                unlink (e.dest.c_str());
+            break;
+        }
+    }
+
+    file_done();
+}
+
+
+// copies from offset on, returns 0 or an errno, ECANCELED if the transfer has been stopped
+int LocalXfer::copy_data(int src_fd, int dest_fd, const Entry &e, guint64 offset)
+{
+    guint64 copied = 0;
+    guint64 checkpointed = offset;
+    ssize_t n;
+
+    posix_fadvise (src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+#ifdef FICLONE
+    // a file system with copy on write shares the data
+    if (e.size && ioctl (dest_fd, FICLONE, src_fd)==0)
+    {
+        add_progress(e.size - offset);
+        return 0;
+    }
+#endif
+
+#ifdef SYS_copy_file_range
+    static gboolean have_copy_file_range = TRUE;
+
+    while (have_copy_file_range)
+    {
+        n = syscall (SYS_copy_file_range, src_fd, NULL, dest_fd, NULL, (size_t) KERNEL_CHUNK_SIZE, 0);
+
+        if (n > 0)
+        {
+            copied += n;
+            add_progress(n);
+
+            if (offset + copied - checkpointed >= CHECKPOINT_SIZE)
+                checkpoint(e, src_fd, dest_fd, checkpointed = offset + copied);
+
+            if (pause_point())
+                return ECANCELED;
+
+            continue;
+        }
+
+        if (n==0)
+            return 0;
+
+        if (errno==EINTR)
+            continue;
+
+        if (copied)
+            return errno;
+
+        // an old kernel, or two file systems the kernel can't copy between
+        if (errno==ENOSYS)
+            have_copy_file_range = FALSE;
+        else
+            if (errno!=EXDEV && errno!=EINVAL && errno!=EOPNOTSUPP)
+                return errno;
+
+        break;
+    }
+#endif
+
+    for (;;)
+    {
+        n = sendfile (dest_fd, src_fd, NULL, KERNEL_CHUNK_SIZE);
+
+        if (n > 0)
+        {
+            copied += n;
+            add_progress(n);
+
+            if (offset + copied - checkpointed >= CHECKPOINT_SIZE)
+                checkpoint(e, src_fd, dest_fd, checkpointed = offset + copied);
+
+            if (pause_point())
+                return ECANCELED;
+
+            continue;
+        }
+
+        if (n==0)
+            return 0;
+
+        if (errno==EINTR)
+            continue;
+
+        if (copied || (errno!=EINVAL && errno!=ENOSYS))
+            return errno;
+
+        break;
+    }
+
+    vector<gchar> buffer(BUFFER_SIZE);
+
+    for (;;)
+    {
+        n = read (src_fd, &buffer[0], buffer.size());
+
+        if (n < 0)
+        {
+            if (errno==EINTR)
+                continue;
+
+            return errno;
+        }
+
+        if (n==0)
+            return 0;
+
+        for (ssize_t written=0; written<n; )
+        {
+            ssize_t w = write (dest_fd, &buffer[written], n - written);
+
+            if (w < 0)
+            {
+                if (errno==EINTR)
+                    continue;
+
+                return errno;
+            }
+
+            written += w;
+        }
+
+        copied += n;
+        add_progress(n);
+
+        if (offset + copied - checkpointed >= CHECKPOINT_SIZE)
+            checkpoint(e, src_fd, dest_fd, checkpointed = offset + copied);
+
+        if (pause_point())
+            return ECANCELED;
+    }
+}
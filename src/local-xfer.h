@@ -0,0 +1,239 @@
+/**
+ * @file local-xfer.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __LOCAL_XFER_H__
+#define __LOCAL_XFER_H__
+
+#include <glib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <time.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+
+/**
+ * Copies or moves local files and directory trees with plain POSIX calls.
+ *
+ * A move within a file system is a rename(). Everything else is copied:
+ * the directories first, then the files. A rename() which fails with
+ * EXDEV, e.g. between two bind mounts of the same file system, falls back
+ * to a copy, and a directory renamed onto one which turned up since the
+ * scan is merged into it, its contents scanned once more. The sources are scanned by a
+ * thread of their own, and the transfer starts with the first entries
+ * found, so the totals grow while it runs. Small files are copied by a
+ * pool of threads, large ones by the thread of run() meanwhile. The data goes
+ * through a reflink where the file system can share it, otherwise through
+ * copy_file_range(), sendfile() or a plain read/write loop with a large
+ * buffer, whichever the kernel supports. Permissions and times are kept.
+ *
+ * Existing directories are merged. A target which turns out to be the
+ * source itself is reported as an EINVAL error and skipped. For existing
+ * files and errors the functions passed to run() are asked, possibly from
+ * several threads, but never from two at the same time.
+ *
+ * A paused transfer holds all its threads after the chunk of data they
+ * are copying, until it is resumed or stopped.
+ *
+ * Large files are checkpointed every 64 MiB: the copied data is synced,
+ * and the offset is remembered with a checksum of each 64 MiB segment
+ * before it, rolled over the segment a MiB at a time. A retried file
+ * continues from its last checkpoint if the checksums of all segments of
+ * the target still match, otherwise it starts again.
+ *
+ * With a journal the checkpoints survive the transfer. The journal holds
+ * the files to transfer, the directories made, the files done and the
+ * checkpoints. It is removed when the transfer completes, a stopped or
+ * crashed transfer leaves it behind for load_journal(). A transfer that
+ * won't be resumed is cleaned up with discard().
+ */
+class LocalXfer
+{
+  public:
+
+    enum OverwriteMode
+    {
+        OVERWRITE_QUERY,
+        OVERWRITE_REPLACE,
+        OVERWRITE_SKIP,
+        OVERWRITE_ABORT
+    };
+
+    // the answers are ordered like the buttons of the dialogs asking them
+    enum OverwriteAnswer {OVERWRITE_ANSWER_ABORT, OVERWRITE_ANSWER_REPLACE, OVERWRITE_ANSWER_REPLACE_ALL, OVERWRITE_ANSWER_SKIP, OVERWRITE_ANSWER_SKIP_ALL};
+    enum ErrorAnswer {ERROR_ANSWER_ABORT, ERROR_ANSWER_RETRY, ERROR_ANSWER_SKIP};
+
+    typedef OverwriteAnswer (* OverwriteFunc) (const gchar *src, const gchar *dest, gpointer user_data);
+    typedef ErrorAnswer (* ErrorFunc) (const gchar *src, const gchar *dest, int error, gpointer user_data);
+
+    struct Progress
+    {
+        guint64 files_done;
+        guint64 files_total;
+        guint64 bytes_done;
+        guint64 bytes_total;
+        guint64 file_bytes_done;                // of the current file
+        guint64 file_size;
+        std::string current_file;               // source path
+
+        Progress(): files_done(0), files_total(0), bytes_done(0), bytes_total(0), file_bytes_done(0), file_size(0)     {}
+    };
+
+    LocalXfer(gboolean move, gboolean follow_links, OverwriteMode mode, guint n_threads=0);
+    ~LocalXfer();
+
+    void add(const gchar *src, const gchar *dest);
+    const std::vector<std::pair<std::string,std::string> > &get_items() const     {  return items;  }
+
+    gboolean is_move() const                    {  return move;  }
+    gboolean is_following_links() const         {  return follow_links;  }
+
+    void set_journal(const gchar *path);
+    const std::string &get_journal() const      {  return journal_path;  }
+
+    /**
+     * Recreates the transfer left behind in the journal at @a path, which
+     * skips the files done and continues the checkpointed ones. Returns
+     * NULL and sets @a error to EBUSY if a running transfer still writes
+     * the journal, or to another errno if it can't be read.
+     */
+    static LocalXfer *load_journal(const gchar *path, int *error=NULL);
+
+    static guint32 checksum(const gchar *data, gsize len, guint32 sum=1);      // Adler-32, continuing sum of the data before
+
+    /**
+     * Blocks until all files are transferred. Returns FALSE if the transfer
+     * has been stopped or aborted, skipped files don't count as failures.
+     */
+    gboolean run(const gboolean *stop_flag=NULL, OverwriteFunc overwrite=NULL, ErrorFunc error=NULL, gpointer user_data=NULL);
+
+    /**
+     * Removes what a stopped transfer has left behind for resuming: the
+     * partial copies of the checkpointed files and the journal.
+     */
+    void discard();
+
+    void get_progress(Progress &progress);      // may be called from any thread while run() is running
+    void set_paused(gboolean paused);           // likewise
+
+  private:
+
+    enum Action {RENAME, MAKE_DIR, COPY_FILE, COPY_LINK, COPY_SPECIAL};
+
+    struct Checkpoint
+    {
+        guint64 offset;                         // the data before it is synced
+        guint64 size;                           // and the mtime, of the source
+        struct timespec mtime;
+        std::vector<guint32> sums;              // of the segments of CHECKPOINT_SIZE before offset
+    };
+
+    struct Entry
+    {
+        std::string src;
+        std::string dest;
+        Action action;
+        mode_t mode;
+        dev_t rdev;
+        guint64 size;
+        struct timespec times[2];               // atime and mtime
+        guint end;                              // the index after the subtree of a directory, 0 until it is scanned
+        gboolean created;                       // a directory made by the transfer, it gets its permissions and times at the end
+        gboolean done;
+    };
+
+    gboolean move;
+    gboolean follow_links;
+    OverwriteMode overwrite_mode;
+    guint n_threads;
+
+    std::vector<std::pair<std::string,std::string> > items;
+    std::deque<Entry> entries;                  // appended while they are transferred, an entry stays where it is
+    std::vector<std::pair<dev_t,ino_t> > scan_path;     // the directories scan() is in, to find loops of followed links
+
+    GThread *scan_thread;
+    GMutex entries_mutex;                       // for adding entries and their ends while others are read
+    GCond entries_cond;
+    gboolean scanning;
+    gboolean executing;                         // run() may still ask for rescans
+    std::vector<std::pair<guint,dev_t> > rescans;       // directory entries whose rename fell back, with the device of their target
+
+    const gboolean *stopped;
+    gboolean aborted;
+    OverwriteFunc overwrite_func;
+    ErrorFunc error_func;
+    gpointer user_data;
+
+    GMutex query_mutex;                         // one question at a time
+    GMutex progress_mutex;
+    Progress progress;
+
+    GThreadPool *pool;
+    GMutex pending_mutex;
+    GCond pending_cond;
+    gint pending;                               // files pushed to the pool but not copied yet
+
+    GMutex pause_mutex;
+    GCond pause_cond;
+    gint paused;
+
+    std::string journal_path;
+    int journal_fd;                             // locked while the journal is in use
+    GMutex journal_mutex;
+    std::map<std::string,Checkpoint> checkpoints;       // by target, protected by journal_mutex
+    std::set<std::string> dirs_made;            // the targets of a resumed transfer
+    std::set<std::string> files_done;
+    gboolean resumed;
+
+    gboolean is_stopped()                       {  return aborted || *stopped;  }
+    gboolean pause_point();                     // waits while paused, returns is_stopped()
+
+    void scan(const std::string &src, const std::string &dest, gboolean dest_exists, dev_t dest_dev);
+    void scan_dir(DIR *dir, const struct stat &st, const std::string &src, const std::string &dest, gboolean merge, dev_t dest_dev);
+    void rescan(const std::string &src, const std::string &dest, dev_t dest_dev);
+    guint add_entry(const Entry &e);
+    void set_end(guint n, guint end);
+    Entry *wait_for_entry(guint n);             // NULL if the scan and the rescans are over before there is entry n
+    guint wait_for_end(guint n);
+    gboolean replace(const std::string &src, const std::string &dest);
+    gboolean retry(const std::string &src, const std::string &dest, int error);
+    guint execute(guint n, Entry &e);           // returns the index of the next entry
+    guint fall_back(guint n, Entry &e, dev_t dest_dev);
+    void copy(Entry &e);
+    int copy_data(int src_fd, int dest_fd, const Entry &e, guint64 offset);
+    int open_checkpointed(const Entry &e, int src_fd, guint64 &offset);
+    void checkpoint(const Entry &e, int src_fd, int dest_fd, guint64 offset);
+    gboolean has_checkpoint(const std::string &dest);
+    gboolean forget_checkpoint(const std::string &dest);      // returns TRUE if there was one
+    gboolean is_done(const Entry &e);
+    void open_journal();
+    void write_journal(const std::string &line, gboolean sync=FALSE);
+    void add_progress(guint64 bytes);
+    void file_done();
+
+    static gpointer scan_func(LocalXfer *xfer);
+    static void copy_func(Entry *e, LocalXfer *xfer);
+};
+
+#endif // __LOCAL_XFER_H__
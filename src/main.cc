@@ -44,6 +44,9 @@ extern "C"
 #include "ls_colors.h"
 #include "imageloader.h"
 #include "plugin_manager.h"
+#include "gnome-cmd-search-index.h"
+#include "gnome-cmd-xfer.h"
+#include "dialogs/gnome-cmd-delete-dialog.h"
 #include "gnome-cmd-python-plugin.h"
 #include "tags/gnome-cmd-tags.h"
 
@@ -179,10 +182,13 @@ int main (int argc, char *argv[])
         gcmd_owner.load_async();
 
         gcmd_tags_init();
+        gcmd_search_index_init();
         plugin_manager_init ();
 #ifdef HAVE_PYTHON
         python_plugin_manager_init ();
 #endif
+        gnome_cmd_xfer_init ();
+        gnome_cmd_delete_init ();
 
         gtk_main ();
 
@@ -190,6 +196,7 @@ int main (int argc, char *argv[])
         python_plugin_manager_shutdown ();
 #endif
         plugin_manager_shutdown ();
+        gcmd_search_index_shutdown ();
         gcmd_tags_shutdown ();
         gcmd_user_actions.shutdown();
         gnome_cmd_data.save();
@@ -0,0 +1,1240 @@
+/**
+ * @file search-engine.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "search-engine.h"
+
+using namespace std;
+
+
+#define SEARCH_JUMP_SIZE     4096U
+#define SEARCH_BUFFER_SIZE  (SEARCH_JUMP_SIZE * 64U)
+
+
+/**
+ * Returns the closing ']' of the bracket expression starting at @a s, or
+ * NULL if there is none.
+ */
+static const gchar *find_bracket_end (const gchar *s)
+{
+    ++s;
+
+    if (*s=='^')
+        ++s;
+    if (*s==']')
+        ++s;
+
+    for (; *s; ++s)
+        if (*s==']')
+            return s;
+        else
+            if (*s=='[' && (s[1]==':' || s[1]=='=' || s[1]=='.'))
+            {
+                // classes like [:digit:] end in a ']' of their own
+                const gchar class_end[] = {s[1], ']', '\0'};
+
+                s = strstr (s+2, class_end);
+                if (!s)
+                    return NULL;
+                ++s;
+            }
+
+    return NULL;
+}
+
+
+/**
+ * Returns the ')' closing the group of an extended regular expression
+ * which starts at @a s, or NULL if there is none or it can't be told easily.
+ */
+static const gchar *find_group_end (const gchar *s)
+{
+    gint depth = 0;
+
+    for (; *s; ++s)
+        switch (*s)
+        {
+            case '(':
+                ++depth;
+                break;
+
+            case ')':
+                if (--depth==0)
+                    return s;
+                break;
+
+            case '[':
+                s = find_bracket_end (s);
+                if (!s)
+                    return NULL;
+                break;
+
+            case '\\':
+                return NULL;
+
+            default:
+                break;
+        }
+
+    return NULL;
+}
+
+
+// TRUE if the quantifier at s, if there is one, lets the preceding item be missing
+static gboolean allows_none (const gchar *s)
+{
+    if (*s=='?' || *s=='*')
+        return TRUE;
+
+    return *s=='{' && (s[1]==',' || strtol (s+1, NULL, 10)==0);
+}
+
+
+/**
+ * Returns the longest run of plain characters every match of the regular
+ * expression @a pattern has to contain, or NULL if it can't be told easily.
+ * @a whole is set to TRUE if the pattern is nothing but that run.
+ */
+static gchar *get_required_literal (const gchar *pattern, gboolean extended, gboolean &whole)
+{
+    string best, run;
+
+    whole = TRUE;
+
+    for (const gchar *s=pattern; *s; ++s)
+    {
+        gboolean optional = *s=='*' || (extended && (*s=='?' || *s=='{'));
+        gboolean special = optional || strchr (".[]^$", *s) || (extended && strchr ("+()", *s));
+
+        if (*s=='\\' || (extended && *s=='|'))      // escapes and alternatives - give up
+            return NULL;
+
+        if (!special)
+        {
+            run += *s;
+            continue;
+        }
+
+        if (optional && !run.empty())               // the last character may be missing
+            run.erase(g_utf8_find_prev_char (run.c_str(), run.c_str()+run.size()) - run.c_str());
+
+        // skip bracket expressions and intervals, their characters are no plain text
+        if (*s=='[')
+        {
+            s = find_bracket_end (s);
+            if (!s)
+                return NULL;
+        }
+        else
+            if (*s=='{')
+            {
+                s = strchr (s, '}');
+                if (!s)
+                    return NULL;
+            }
+            else
+                if (*s=='(')
+                {
+                    const gchar *end = find_group_end (s);
+
+                    if (!end)
+                        return NULL;
+
+                    // nothing in an optional group is required, skip it up to its quantifier
+                    if (allows_none (end+1))
+                        s = end;
+                }
+
+        whole = FALSE;
+        if (run.size() > best.size())
+            best = run;
+        run.clear();
+    }
+
+    if (run.size() > best.size())
+        best = run;
+
+    return best.empty() ? NULL : g_strdup (best.c_str());
+}
+
+
+static const gchar *find_literal (const gchar *buf, gsize len, const gchar *literal, gsize literal_len, gboolean match_case)
+{
+    if (literal_len > len)
+        return NULL;
+
+    if (match_case)
+        return (const gchar *) memmem (buf, len, literal, literal_len);
+
+    const gchar *last = buf + len - literal_len;
+
+    for (const gchar *s=buf; s<=last; ++s)
+    {
+        gsize i = 0;
+
+        while (i<literal_len && g_ascii_tolower (s[i])==g_ascii_tolower (literal[i]))
+            ++i;
+
+        if (i==literal_len)
+            return s;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Returns the longest run of plain characters every name matching the
+ * fnmatch pattern @a pattern has to contain, or NULL if there is none.
+ */
+static gchar *get_fnmatch_literal (const gchar *pattern)
+{
+    string best, run;
+
+    for (const gchar *s=pattern; *s; ++s)
+    {
+        if (*s!='*' && *s!='?' && *s!='[')
+        {
+            run += *s;
+            continue;
+        }
+
+        if (*s=='[')
+        {
+            const gchar *end = s+1;
+
+            if (*end=='!' || *end=='^')
+                ++end;
+            if (*end==']')
+                ++end;
+            end = strchr (end, ']');
+            if (!end)                               // an unclosed bracket is taken literally, don't bother
+                return NULL;
+            s = end;
+        }
+
+        if (run.size() > best.size())
+            best = run;
+        run.clear();
+    }
+
+    if (run.size() > best.size())
+        best = run;
+
+    return best.empty() ? NULL : g_strdup (best.c_str());
+}
+
+
+ContentMatcher::ContentMatcher(const gchar *pattern, gboolean case_sens, gboolean extended): match_case(case_sens)
+{
+    regex_ok = regcomp (&regex, pattern, (case_sens ? 0 : REG_ICASE) | (extended ? REG_EXTENDED : 0) | REG_NOSUB) == 0;
+
+    literal = get_required_literal (pattern, extended, literal_only);
+
+    // the prefilter folds ASCII letters only
+    if (literal && !match_case && !g_str_is_ascii (literal))
+    {
+        g_free (literal);
+        literal = NULL;
+    }
+
+    literal_len = literal ? strlen (literal) : 0;
+}
+
+
+ContentMatcher::~ContentMatcher()
+{
+    if (regex_ok)
+        regfree (&regex);
+    g_free (literal);
+}
+
+
+gboolean ContentMatcher::buffer_matches(const gchar *buf, gsize len) const
+{
+    if (literal)
+    {
+        if (!find_literal (buf, len, literal, literal_len, match_case))
+            return FALSE;
+
+        if (literal_only)
+            return TRUE;
+    }
+
+    return regex_ok && regexec (&regex, buf, 0, NULL, 0) == 0;
+}
+
+
+gboolean ContentMatcher::matches(ReadFunc read_func, gpointer handle, guint64 size, const gboolean *stopped) const
+{
+    if (size==0)
+        return FALSE;
+
+    gsize buf_size = MIN (size, SEARCH_BUFFER_SIZE);
+    gchar *buf = (gchar *) g_malloc (buf_size + 1);
+    gsize len = 0;
+    gboolean found = FALSE;
+    gboolean eof = FALSE;
+
+    while (!found && !eof && !*stopped)
+    {
+        // fill the buffer with big sequential reads...
+        while (len < buf_size)
+        {
+            gssize bytes_read = read_func (handle, buf+len, buf_size-len);
+
+            if (bytes_read <= 0)
+            {
+                eof = TRUE;
+                break;
+            }
+
+            len += bytes_read;
+        }
+
+        buf[len] = '\0';
+
+        found = len>0 && buffer_matches(buf, len);
+
+        // ...and keep the end of the buffer, to give the regex a chance to match across the buffer boundary
+        if (len > SEARCH_JUMP_SIZE)
+        {
+            memmove (buf, buf+len-SEARCH_JUMP_SIZE, SEARCH_JUMP_SIZE);
+            len = SEARCH_JUMP_SIZE;
+        }
+        else
+            eof = TRUE;
+    }
+
+    g_free (buf);
+
+    return found;
+}
+
+
+NameMatcher::NameMatcher(const gchar *pattern, Filter::Type type, gboolean case_sens):
+    syntax(type), fn_pattern(NULL), fn_flags(FNM_NOESCAPE), regex_ok(FALSE), literal(NULL), literal_len(0), match_case(case_sens)
+{
+    if (!pattern)
+        pattern = "";
+
+    gboolean whole;
+
+    switch (syntax)
+    {
+        case Filter::TYPE_FNMATCH:
+            // like the search command did: no pattern matches everything, and a pattern without wildcards matches anywhere in the name
+            if (!*pattern)
+                fn_pattern = g_strdup ("*");
+            else
+                if (!strchr (pattern, '*') && !strchr (pattern, '?'))
+                    fn_pattern = g_strconcat ("*", pattern, "*", NULL);
+                else
+                    fn_pattern = g_strdup (pattern);
+#ifdef FNM_CASEFOLD
+            if (!match_case)
+                fn_flags |= FNM_CASEFOLD;
+#endif
+            literal = get_fnmatch_literal (fn_pattern);
+            break;
+
+        case Filter::TYPE_REGEX:
+            regex_ok = regcomp (&regex, pattern, REG_EXTENDED | REG_NOSUB | (match_case ? 0 : REG_ICASE)) == 0;
+            literal = get_required_literal (pattern, TRUE, whole);
+            break;
+
+        default:
+            break;
+    }
+
+    // the prefilter folds ASCII letters only
+    if (literal && !match_case && !g_str_is_ascii (literal))
+    {
+        g_free (literal);
+        literal = NULL;
+    }
+
+    literal_len = literal ? strlen (literal) : 0;
+}
+
+
+NameMatcher::~NameMatcher()
+{
+    if (regex_ok)
+        regfree (&regex);
+    g_free (fn_pattern);
+    g_free (literal);
+}
+
+
+gboolean NameMatcher::matches(const gchar *name) const
+{
+    if (literal && !find_literal (name, strlen (name), literal, literal_len, match_case))
+        return FALSE;
+
+    switch (syntax)
+    {
+        case Filter::TYPE_FNMATCH:
+            return fnmatch (fn_pattern, name, fn_flags) == 0;
+
+        case Filter::TYPE_REGEX:
+            return regex_ok && regexec (&regex, name, 0, NULL, 0) == 0;
+
+        default:
+            return FALSE;
+    }
+}
+
+
+struct LocalSearch::DirTask
+{
+    gchar *path;
+    gint level;                 // how many levels below path are searched, negative for no limit
+};
+
+
+LocalSearch::LocalSearch(const gchar *name_pattern, Filter::Type syntax, gboolean match_case, gint depth, const gchar *text_pattern, guint threads):
+    names(name_pattern, syntax, match_case), max_depth(depth), content(NULL), index(NULL),
+    never_stopped(FALSE), stopped(&never_stopped), pending(0), pool(NULL), found(NULL), user_data(NULL)
+{
+    if (text_pattern)
+        content = new ContentMatcher(text_pattern, match_case, TRUE);
+
+    n_threads = threads ? threads : g_get_num_processors ();
+
+    g_mutex_init (&done_mutex);
+    g_cond_init (&done_cond);
+}
+
+
+LocalSearch::~LocalSearch()
+{
+    delete content;
+
+    g_mutex_clear (&done_mutex);
+    g_cond_clear (&done_cond);
+}
+
+
+void LocalSearch::push_dir(gchar *path, gint level)
+{
+    DirTask *task = g_new (DirTask, 1);
+
+    task->path = path;
+    task->level = level;
+
+    g_atomic_int_inc (&pending);
+    g_thread_pool_push (pool, task, NULL);
+}
+
+
+static gssize read_fd (gpointer handle, gchar *buf, gsize count)
+{
+    gssize n;
+
+    do
+        n = read (GPOINTER_TO_INT (handle), buf, count);
+    while (n < 0 && errno == EINTR);
+
+    return n;
+}
+
+
+void LocalSearch::search_dir(DirTask *task)
+{
+    int dir_fd = open (task->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd < 0)
+        return;
+
+    DIR *dir = fdopendir (dir_fd);
+
+    if (!dir)
+    {
+        close (dir_fd);
+        return;
+    }
+
+    struct dirent *entry;
+
+    while (!*stopped && (entry = readdir (dir)))
+    {
+        const gchar *name = entry->d_name;
+
+        if (name[0]=='.' && (name[1]=='\0' || (name[1]=='.' && name[2]=='\0')))
+            continue;
+
+        unsigned char type = entry->d_type;
+
+        if (type == DT_UNKNOWN)
+        {
+            struct stat st;
+
+            if (fstatat (dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+
+            type = S_ISDIR (st.st_mode) ? DT_DIR :
+                   S_ISREG (st.st_mode) ? DT_REG :
+                   S_ISLNK (st.st_mode) ? DT_LNK : DT_UNKNOWN;
+        }
+
+        // symlinked directories are not followed
+        if (type == DT_DIR && task->level != 0)
+            push_dir (g_build_filename (task->path, name, NULL), task->level-1);
+
+        if (!names.matches(name))
+            continue;
+
+        if (content)
+        {
+            if (type != DT_REG && type != DT_LNK)
+                continue;
+
+            // check the target of symlinks before opening it, opening a fifo would block
+            struct stat st;
+
+            if (type == DT_LNK && (fstatat (dir_fd, name, &st, 0) != 0 || !S_ISREG (st.st_mode)))
+                continue;
+
+            int fd = openat (dir_fd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+
+            if (fd < 0)
+                continue;
+
+            gboolean content_found = fstat (fd, &st) == 0 && S_ISREG (st.st_mode) &&
+                                     content->matches(read_fd, GINT_TO_POINTER (fd), st.st_size, stopped);
+            close (fd);
+
+            if (!content_found)
+                continue;
+        }
+
+        gchar *path = g_build_filename (task->path, name, NULL);
+        found (path, user_data);
+        g_free (path);
+    }
+
+    closedir (dir);
+}
+
+
+void LocalSearch::search_dir_func(DirTask *task, LocalSearch *search)
+{
+    if (!*search->stopped)
+        search->search_dir(task);
+
+    g_free (task->path);
+    g_free (task);
+
+    if (g_atomic_int_dec_and_test (&search->pending))
+    {
+        g_mutex_lock (&search->done_mutex);
+        g_cond_signal (&search->done_cond);
+        g_mutex_unlock (&search->done_mutex);
+    }
+}
+
+
+void LocalSearch::run(const gchar *start_dir, FoundFunc found_func, gpointer data, const gboolean *stop_flag)
+{
+    found = found_func;
+    user_data = data;
+    stopped = stop_flag ? stop_flag : &never_stopped;
+    pending = 0;
+
+    if (index && !content && index->search(start_dir, names, max_depth, found, user_data, stopped))
+        return;
+
+    pool = g_thread_pool_new ((GFunc) search_dir_func, this, n_threads, FALSE, NULL);
+
+    push_dir (g_strdup (start_dir), max_depth);
+
+    // directories are pushed by the pool threads themselves, so wait until none is left instead of freeing the pool at once
+    g_mutex_lock (&done_mutex);
+    while (g_atomic_int_get (&pending) > 0)
+        g_cond_wait (&done_cond, &done_mutex);
+    g_mutex_unlock (&done_mutex);
+
+    g_thread_pool_free (pool, FALSE, TRUE);
+    pool = NULL;
+}
+
+
+#define INDEX_MAGIC       "GCMDIDX"
+#define INDEX_VERSION     1
+#define INDEX_BYTE_ORDER  0x01020304U
+
+
+struct IndexFileHeader
+{
+    gchar magic[8];
+    guint32 byte_order;         // INDEX_BYTE_ORDER as written by the machine which made the file
+    guint32 version;
+    guint32 root_len;           // the root path follows the header, padded to 8 bytes
+    guint32 n_dirs;
+    guint32 n_entries;
+    guint32 pool_size;
+};
+
+
+const guint32 SearchIndex::NO_DIR;
+
+
+static inline gsize padded_root_size (gsize root_len)
+{
+    return (root_len + 1 + 7) & ~(gsize) 7;
+}
+
+
+/**
+ * One version of the index. A table is never changed once it is complete,
+ * searches keep a reference to it so a refresh can replace it any time.
+ */
+struct SearchIndex::Table
+{
+    gint ref_count;
+
+    GMappedFile *mapped;        // the loaded index file, or NULL if the table has been built in memory
+    vector<Dir> dir_vec;
+    vector<guint32> entry_vec;
+    string pool_str;
+
+    const Dir *dirs;
+    guint32 n_dirs;
+    const guint32 *entries;
+    guint32 n_entries;
+    const gchar *pool;
+    gsize pool_size;
+
+    Table(): ref_count(1), mapped(NULL), dirs(NULL), n_dirs(0), entries(NULL), n_entries(0), pool(NULL), pool_size(0)     {}
+    ~Table()                                        {  if (mapped) g_mapped_file_unref (mapped);  }
+
+    Table *ref()                                    {  g_atomic_int_inc (&ref_count);  return this;  }
+    void unref()                                    {  if (g_atomic_int_dec_and_test (&ref_count))  delete this;  }
+
+    const gchar *dir_name(guint32 i) const          {  return pool + dirs[i].name;  }
+    const gchar *entry_name(guint32 i) const        {  return pool + entries[i];  }
+
+    guint32 add_name(const gchar *name);
+    void finish();
+};
+
+
+inline guint32 SearchIndex::Table::add_name(const gchar *name)
+{
+    guint32 offset = pool_str.size();
+
+    pool_str.append(name, strlen (name) + 1);
+
+    return offset;
+}
+
+
+// points the table at the vectors it has been built in
+inline void SearchIndex::Table::finish()
+{
+    dirs = dir_vec.empty() ? NULL : &dir_vec[0];
+    n_dirs = dir_vec.size();
+    entries = entry_vec.empty() ? NULL : &entry_vec[0];
+    n_entries = entry_vec.size();
+    pool = pool_str.data();
+    pool_size = pool_str.size();
+}
+
+
+/**
+ * Builds a new table from the file system. Directories whose mtime is the
+ * one recorded in the old table are not read again, their names are taken
+ * from the old table.
+ */
+struct IndexBuilder
+{
+    typedef SearchIndex::Dir Dir;
+
+    const SearchIndex::Table *old;
+    SearchIndex::Table *table;
+    const gboolean *stopped;
+
+    gboolean scan(const string &path, guint32 name, guint32 old_dir, guint32 parent, guint32 depth);
+};
+
+
+static inline gint64 get_mtime (const struct stat &st)
+{
+    return (gint64) st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec;
+}
+
+
+gboolean IndexBuilder::scan(const string &path, guint32 name, guint32 old_dir, guint32 parent, guint32 depth)
+{
+    if (*stopped)
+        return FALSE;
+
+    struct stat st;
+
+    if (lstat (path.c_str(), &st) != 0 || !S_ISDIR (st.st_mode))
+        return TRUE;
+
+    guint32 i = table->dir_vec.size();
+    Dir dir;
+
+    dir.parent = parent;
+    dir.name = name;
+    dir.subtree_end = i + 1;
+    dir.first_entry = table->entry_vec.size();
+    dir.n_entries = 0;
+    dir.depth = depth;
+    dir.mtime = get_mtime (st);
+
+    vector<pair<guint32,guint32> > subdirs;        // the new name offset and the old index of every subdirectory
+
+    if (old_dir != SearchIndex::NO_DIR && old->dirs[old_dir].mtime == dir.mtime)
+    {
+        const Dir &o = old->dirs[old_dir];
+        map<guint32,guint32> offsets;               // old to new name offsets
+
+        for (guint32 e=o.first_entry; e<o.first_entry+o.n_entries; ++e)
+        {
+            guint32 offset = table->add_name(old->entry_name(e));
+            table->entry_vec.push_back(offset);
+            offsets[old->entries[e]] = offset;
+        }
+
+        for (guint32 c=old_dir+1; c<o.subtree_end; c=old->dirs[c].subtree_end)
+        {
+            map<guint32,guint32>::const_iterator offset = offsets.find(old->dirs[c].name);
+
+            if (offset != offsets.end())
+                subdirs.push_back(make_pair(offset->second, c));
+        }
+    }
+    else
+    {
+        DIR *d = opendir (path.c_str());
+
+        if (!d)
+            return TRUE;
+
+        map<string,guint32> old_subdirs;
+
+        if (old_dir != SearchIndex::NO_DIR)
+            for (guint32 c=old_dir+1; c<old->dirs[old_dir].subtree_end; c=old->dirs[c].subtree_end)
+                old_subdirs[old->dir_name(c)] = c;
+
+        struct dirent *entry;
+
+        while ((entry = readdir (d)))
+        {
+            const gchar *entry_name = entry->d_name;
+
+            if (entry_name[0]=='.' && (entry_name[1]=='\0' || (entry_name[1]=='.' && entry_name[2]=='\0')))
+                continue;
+
+            guint32 offset = table->add_name(entry_name);
+            table->entry_vec.push_back(offset);
+
+            gboolean is_dir = entry->d_type == DT_DIR;
+
+            if (entry->d_type == DT_UNKNOWN)
+            {
+                struct stat entry_st;
+                is_dir = lstat ((path + G_DIR_SEPARATOR + entry_name).c_str(), &entry_st) == 0 && S_ISDIR (entry_st.st_mode);
+            }
+
+            // symlinked directories are not followed
+            if (is_dir)
+            {
+                map<string,guint32>::const_iterator c = old_subdirs.find(entry_name);
+                subdirs.push_back(make_pair(offset, c!=old_subdirs.end() ? c->second : SearchIndex::NO_DIR));
+            }
+        }
+
+        closedir (d);
+    }
+
+    dir.n_entries = table->entry_vec.size() - dir.first_entry;
+    table->dir_vec.push_back(dir);
+
+    // the offsets into the pool have to fit into 32 bits
+    if (table->pool_str.size() > G_MAXUINT32)
+        return FALSE;
+
+    for (vector<pair<guint32,guint32> >::const_iterator c=subdirs.begin(); c!=subdirs.end(); ++c)
+    {
+        string subdir = path;
+
+        if (subdir[subdir.size()-1] != G_DIR_SEPARATOR)
+            subdir += G_DIR_SEPARATOR;
+        subdir += table->pool_str.c_str() + c->first;
+
+        if (!scan(subdir, c->first, c->second, i, depth+1))
+            return FALSE;
+    }
+
+    table->dir_vec[i].subtree_end = table->dir_vec.size();
+
+    return TRUE;
+}
+
+
+SearchIndex::SearchIndex(const gchar *root_dir): table(NULL), dirty(FALSE)
+{
+    gsize len = strlen (root_dir);
+
+    while (len>1 && root_dir[len-1]==G_DIR_SEPARATOR)
+        --len;
+
+    root = g_strndup (root_dir, len);
+
+    g_mutex_init (&mutex);
+}
+
+
+SearchIndex::~SearchIndex()
+{
+    if (table)
+        table->unref();
+
+    g_free (root);
+    g_mutex_clear (&mutex);
+}
+
+
+inline gboolean SearchIndex::below(const string &path, const string &dir)
+{
+    if (dir.size()==1 && dir[0]==G_DIR_SEPARATOR)
+        return path.size()>1 && path[0]==G_DIR_SEPARATOR;
+
+    return path.size()>dir.size() && path[dir.size()]==G_DIR_SEPARATOR && path.compare(0, dir.size(), dir)==0;
+}
+
+
+gboolean SearchIndex::covers(const gchar *path) const
+{
+    return strcmp (path, root)==0 || below(path, root);
+}
+
+
+guint32 SearchIndex::find_dir(const Table *t, const gchar *path) const
+{
+    if (!t || !t->n_dirs || !covers(path))
+        return NO_DIR;
+
+    guint32 i = 0;
+    gchar **components = g_strsplit (path + strlen (root), G_DIR_SEPARATOR_S, -1);
+
+    for (gchar **c=components; *c && i!=NO_DIR; ++c)
+    {
+        if (!**c)
+            continue;
+
+        guint32 child = NO_DIR;
+
+        for (guint32 j=i+1; j<t->dirs[i].subtree_end; j=t->dirs[j].subtree_end)
+            if (strcmp (t->dir_name(j), *c)==0)
+            {
+                child = j;
+                break;
+            }
+
+        i = child;
+    }
+
+    g_strfreev (components);
+
+    return i;
+}
+
+
+gboolean SearchIndex::has_path(const Table *t, const string &path) const
+{
+    if (path==root)
+        return t && t->n_dirs>0;
+
+    string::size_type slash = path.rfind(G_DIR_SEPARATOR);
+
+    if (slash==string::npos)
+        return FALSE;
+
+    guint32 i = find_dir(t, slash ? path.substr(0, slash).c_str() : G_DIR_SEPARATOR_S);
+
+    if (i==NO_DIR)
+        return FALSE;
+
+    const gchar *name = path.c_str() + slash + 1;
+    const Dir &dir = t->dirs[i];
+
+    for (guint32 e=dir.first_entry; e<dir.first_entry+dir.n_entries; ++e)
+        if (strcmp (t->entry_name(e), name)==0)
+            return TRUE;
+
+    return FALSE;
+}
+
+
+gboolean SearchIndex::load(const gchar *index_file)
+{
+    GMappedFile *mapped = g_mapped_file_new (index_file, FALSE, NULL);
+
+    if (!mapped)
+        return FALSE;
+
+    const gchar *data = g_mapped_file_get_contents (mapped);
+    guint64 len = g_mapped_file_get_length (mapped);
+    const IndexFileHeader *header = (const IndexFileHeader *) data;
+
+    guint64 root_offset = sizeof(IndexFileHeader);
+    guint64 dirs_offset = 0;
+    guint64 entries_offset = 0;
+    guint64 pool_offset = 0;
+
+    gboolean ok = len >= sizeof(IndexFileHeader) &&
+                  memcmp (header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC))==0 &&
+                  header->byte_order==INDEX_BYTE_ORDER &&
+                  header->version==INDEX_VERSION &&
+                  header->root_len==strlen (root) &&
+                  header->n_dirs>0 && header->pool_size>0;
+
+    if (ok)
+    {
+        dirs_offset = root_offset + padded_root_size (header->root_len);
+        entries_offset = dirs_offset + (guint64) header->n_dirs * sizeof(Dir);
+        pool_offset = entries_offset + (guint64) header->n_entries * sizeof(guint32);
+
+        ok = pool_offset + header->pool_size == len &&
+             memcmp (data + root_offset, root, header->root_len)==0 &&
+             data[len-1]=='\0';
+    }
+
+    Table *t = new Table;
+
+    if (ok)
+    {
+        t->mapped = mapped;
+        t->dirs = (const Dir *) (data + dirs_offset);
+        t->n_dirs = header->n_dirs;
+        t->entries = (const guint32 *) (data + entries_offset);
+        t->n_entries = header->n_entries;
+        t->pool = data + pool_offset;
+        t->pool_size = header->pool_size;
+
+        // don't trust the file more than necessary, an offset out of range would crash every search
+        for (guint32 i=0; ok && i<t->n_dirs; ++i)
+        {
+            const Dir &dir = t->dirs[i];
+
+            ok = dir.name < t->pool_size &&
+                 dir.subtree_end > i && dir.subtree_end <= t->n_dirs &&
+                 dir.first_entry <= t->n_entries && dir.n_entries <= t->n_entries - dir.first_entry &&
+                 (i==0 ? dir.parent==NO_DIR : dir.parent<i);
+        }
+
+        for (guint32 e=0; ok && e<t->n_entries; ++e)
+            ok = t->entries[e] < t->pool_size;
+    }
+    else
+        g_mapped_file_unref (mapped);
+
+    if (!ok)
+    {
+        delete t;
+        return FALSE;
+    }
+
+    g_mutex_lock (&mutex);
+    Table *old = table;
+    table = t;
+    added.clear();
+    removed.clear();
+    dirty = FALSE;
+    g_mutex_unlock (&mutex);
+
+    if (old)
+        old->unref();
+
+    return TRUE;
+}
+
+
+gboolean SearchIndex::save(const gchar *index_file)
+{
+    g_mutex_lock (&mutex);
+    Table *t = table ? table->ref() : NULL;
+    g_mutex_unlock (&mutex);
+
+    if (!t)
+        return FALSE;
+
+    IndexFileHeader header;
+
+    memset (&header, 0, sizeof(header));
+    memcpy (header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.byte_order = INDEX_BYTE_ORDER;
+    header.version = INDEX_VERSION;
+    header.root_len = strlen (root);
+    header.n_dirs = t->n_dirs;
+    header.n_entries = t->n_entries;
+    header.pool_size = t->pool_size;
+
+    // write a new file and move it over the old one, the old one may still be mapped
+    gchar *tmp_file = g_strconcat (index_file, ".tmp", NULL);
+    FILE *f = fopen (tmp_file, "wb");
+    gboolean ok = f != NULL;
+
+    if (ok)
+    {
+        vector<gchar> root_buf(padded_root_size (header.root_len), '\0');
+
+        memcpy (&root_buf[0], root, header.root_len);
+
+        ok = fwrite (&header, sizeof(header), 1, f)==1 &&
+             fwrite (&root_buf[0], root_buf.size(), 1, f)==1 &&
+             fwrite (t->dirs, sizeof(Dir), t->n_dirs, f)==t->n_dirs &&
+             fwrite (t->entries, sizeof(guint32), t->n_entries, f)==t->n_entries &&
+             fwrite (t->pool, 1, t->pool_size, f)==t->pool_size;
+
+        ok = fclose (f)==0 && ok;
+        ok = ok && rename (tmp_file, index_file)==0;
+
+        if (!ok)
+            unlink (tmp_file);
+    }
+
+    g_free (tmp_file);
+    t->unref();
+
+    if (ok)
+        dirty = FALSE;
+
+    return ok;
+}
+
+
+void SearchIndex::refresh(const gboolean *stop_flag)
+{
+    gboolean never_stopped = FALSE;
+
+    // only refresh() and load() replace the table, so it can't go away
+    const Table *old = table;
+
+    IndexBuilder builder;
+
+    builder.old = old;
+    builder.table = new Table;
+    builder.stopped = stop_flag ? stop_flag : &never_stopped;
+
+    guint32 name = builder.table->add_name(root);
+
+    if (!builder.scan(root, name, old && old->n_dirs ? 0 : NO_DIR, NO_DIR, 0) || builder.table->dir_vec.empty())
+    {
+        delete builder.table;
+        return;
+    }
+
+    Table *t = builder.table;
+
+    t->finish();
+
+    g_mutex_lock (&mutex);
+
+    table = t;
+
+    // keep what the monitors have reported while the file system was read, if the new table has missed it
+    struct stat st;
+
+    for (set<string>::iterator i=added.begin(); i!=added.end(); )
+        if (!has_path(t, *i) && lstat (i->c_str(), &st)==0)
+            ++i;
+        else
+            added.erase(i++);
+
+    for (set<string>::iterator i=removed.begin(); i!=removed.end(); )
+        if (has_path(t, *i) && lstat (i->c_str(), &st)!=0)
+            ++i;
+        else
+            removed.erase(i++);
+
+    dirty = TRUE;
+
+    g_mutex_unlock (&mutex);
+
+    if (old)
+        ((Table *) old)->unref();
+}
+
+
+void SearchIndex::add(const gchar *path)
+{
+    if (!covers(path))
+        return;
+
+    g_mutex_lock (&mutex);
+
+    if (!removed.erase(path) && !has_path(table, path))
+        added.insert(path);
+
+    g_mutex_unlock (&mutex);
+}
+
+
+void SearchIndex::remove(const gchar *path)
+{
+    if (!covers(path))
+        return;
+
+    string dir = path;
+
+    g_mutex_lock (&mutex);
+
+    // forget the names created below a removed directory, too
+    added.erase(dir);
+    for (set<string>::iterator i=added.lower_bound(dir + G_DIR_SEPARATOR); i!=added.end() && below(*i, dir); )
+        added.erase(i++);
+
+    if (has_path(table, dir))
+        removed.insert(dir);
+
+    g_mutex_unlock (&mutex);
+}
+
+
+gboolean SearchIndex::search(const gchar *start_dir, const NameMatcher &names, gint max_depth,
+                             LocalSearch::FoundFunc found, gpointer user_data, const gboolean *stop_flag)
+{
+    gboolean never_stopped = FALSE;
+    const gboolean *stopped = stop_flag ? stop_flag : &never_stopped;
+
+    string start = start_dir;
+
+    while (start.size()>1 && start[start.size()-1]==G_DIR_SEPARATOR)
+        start.erase(start.size()-1);
+
+    // don't hold the lock while reporting, the callback may wait for the thread which reports changes
+    g_mutex_lock (&mutex);
+    Table *t = table ? table->ref() : NULL;
+    guint32 first = find_dir(t, start.c_str());
+    set<string> added_paths = added;
+    set<string> removed_paths = removed;
+    g_mutex_unlock (&mutex);
+
+    if (first==NO_DIR)
+    {
+        if (t)
+            t->unref();
+        return FALSE;
+    }
+
+    guint32 base_depth = t->dirs[first].depth;
+    vector<string> paths(1, start);                 // the path of the current directory and its parents, by level
+
+    for (guint32 i=first; i<t->dirs[first].subtree_end && !*stopped; )
+    {
+        const Dir &dir = t->dirs[i];
+        guint32 level = dir.depth - base_depth;
+
+        if (i!=first)
+        {
+            paths.resize(level+1);
+            paths[level] = paths[level-1];
+            if (paths[level][paths[level].size()-1] != G_DIR_SEPARATOR)
+                paths[level] += G_DIR_SEPARATOR;
+            paths[level] += t->dir_name(i);
+
+            if (!removed_paths.empty() && removed_paths.count(paths[level]))
+            {
+                i = dir.subtree_end;
+                continue;
+            }
+        }
+
+        for (guint32 e=dir.first_entry; e<dir.first_entry+dir.n_entries; ++e)
+        {
+            const gchar *name = t->entry_name(e);
+
+            if (!names.matches(name))
+                continue;
+
+            string path = paths[level];
+
+            if (path[path.size()-1] != G_DIR_SEPARATOR)
+                path += G_DIR_SEPARATOR;
+            path += name;
+
+            if (removed_paths.empty() || !removed_paths.count(path))
+                found (path.c_str(), user_data);
+        }
+
+        i = max_depth>=0 && level>=(guint32) max_depth ? dir.subtree_end : i+1;
+    }
+
+    t->unref();
+
+    // and the names created since the last refresh
+    for (set<string>::const_iterator i=added_paths.begin(); i!=added_paths.end() && !*stopped; ++i)
+    {
+        if (!below(*i, start))
+            continue;
+
+        const gchar *rel = i->c_str() + start.size() + (start.size()>1 ? 1 : 0);
+        const gchar *name = strrchr (rel, G_DIR_SEPARATOR);
+        gint level = 0;
+
+        for (const gchar *s=rel; *s; ++s)
+            if (*s==G_DIR_SEPARATOR)
+                ++level;
+
+        if ((max_depth<0 || level<=max_depth) && names.matches(name ? name+1 : rel))
+            found (i->c_str(), user_data);
+    }
+
+    return TRUE;
+}
+
+
+guint SearchIndex::get_dirs_count() const
+{
+    g_mutex_lock (&mutex);
+    guint n = table ? table->n_dirs : 0;
+    g_mutex_unlock (&mutex);
+
+    return n;
+}
+
+
+guint SearchIndex::get_entries_count() const
+{
+    g_mutex_lock (&mutex);
+    guint n = table ? table->n_entries : 0;
+    g_mutex_unlock (&mutex);
+
+    return n;
+}
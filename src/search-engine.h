@@ -0,0 +1,214 @@
+/**
+ * @file search-engine.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SEARCH_ENGINE_H__
+#define __SEARCH_ENGINE_H__
+
+#include <glib.h>
+#include <regex.h>
+
+#include <set>
+#include <string>
+
+#include "filter.h"
+
+
+/**
+ * Matches the content of files against a POSIX regular expression. Files
+ * are read in big chunks, and a chunk is only handed to regexec() if it
+ * contains the plain text every match of the pattern has to contain.
+ * matches() may be called from several threads at once.
+ */
+struct ContentMatcher
+{
+    /**
+     * Reads up to @a count bytes into @a buf, returns the number of bytes
+     * read, 0 at the end of the file or -1 on error.
+     */
+    typedef gssize (* ReadFunc) (gpointer handle, gchar *buf, gsize count);
+
+    regex_t regex;
+    gboolean regex_ok;
+    gchar *literal;             // plain text every match has to contain, or NULL
+    gsize literal_len;
+    gboolean literal_only;      // the pattern is nothing but literal
+    gboolean match_case;
+
+    ContentMatcher(const gchar *pattern, gboolean match_case, gboolean extended);
+    ~ContentMatcher();
+
+    gboolean buffer_matches(const gchar *buf, gsize len) const;
+    gboolean matches(ReadFunc read_func, gpointer handle, guint64 size, const gboolean *stopped) const;
+};
+
+
+/**
+ * Matches file names against the name pattern of a search profile. The
+ * pattern is interpreted like the find command line which was used before:
+ * an fnmatch pattern without wildcards matches anywhere in the name, and
+ * regular expressions are extended ones.
+ */
+struct NameMatcher
+{
+    NameMatcher(const gchar *pattern, Filter::Type syntax, gboolean match_case);
+    ~NameMatcher();
+
+    gboolean matches(const gchar *name) const;
+
+  private:
+
+    Filter::Type syntax;
+    gchar *fn_pattern;
+    int fn_flags;
+    regex_t regex;
+    gboolean regex_ok;
+    gchar *literal;             // plain text every matching name has to contain, or NULL
+    gsize literal_len;
+    gboolean match_case;
+};
+
+
+class SearchIndex;
+
+
+/**
+ * Searches a local directory tree with plain POSIX calls. Every directory
+ * is listed and its matching files are checked by the next free thread of
+ * a pool, so both the traversal and the content matching run in parallel.
+ * Symlinked directories are not followed, and only regular files are
+ * searched for content. Searches for names only are answered from a
+ * SearchIndex instead, if one has been given which covers the start dir.
+ */
+struct LocalSearch
+{
+    typedef void (* FoundFunc) (const gchar *path, gpointer user_data);    // called from the search threads
+
+    LocalSearch(const gchar *name_pattern, Filter::Type syntax, gboolean match_case, gint max_depth,
+                const gchar *text_pattern=NULL, guint n_threads=0);
+    ~LocalSearch();
+
+    void use_index(SearchIndex *search_index)      {  index = search_index;  }
+
+    // returns after the whole tree has been searched, or as soon as *stop_flag is set
+    void run(const gchar *start_dir, FoundFunc found, gpointer user_data, const gboolean *stop_flag=NULL);
+
+  private:
+
+    struct DirTask;
+
+    NameMatcher names;
+    gint max_depth;
+    ContentMatcher *content;
+    SearchIndex *index;
+    guint n_threads;
+
+    gboolean never_stopped;
+    const gboolean *stopped;
+    gint pending;               // directories pushed to the pool but not searched yet
+    GMutex done_mutex;
+    GCond done_cond;
+    GThreadPool *pool;
+
+    FoundFunc found;
+    gpointer user_data;
+
+    void push_dir(gchar *path, gint level);
+    void search_dir(DirTask *task);
+
+    static void search_dir_func(DirTask *task, LocalSearch *search);
+};
+
+
+/**
+ * A persistent index of all names below a local directory, for answering
+ * name searches without walking the file system.
+ *
+ * The index file holds the directories in depth-first order, so every
+ * subtree is a contiguous range of the directory table, the names of the
+ * entries of every directory, and a pool of the name strings. A loaded
+ * index file is memory-mapped and used as it is.
+ *
+ * refresh() brings the index up to date by comparing the mtime of every
+ * directory with the one recorded, so only changed directories are read
+ * again. Changes reported by the directory monitors in between are kept in
+ * an overlay by add() and remove(), which is merged by the next refresh().
+ *
+ * All methods but refresh() may be called from any thread, one refresh()
+ * may run alongside them.
+ */
+class SearchIndex
+{
+  public:
+
+    explicit SearchIndex(const gchar *root_dir);
+    ~SearchIndex();
+
+    const gchar *get_root() const           {  return root;  }
+    gboolean covers(const gchar *path) const;
+
+    gboolean load(const gchar *index_file);             // returns FALSE if the file is missing, damaged or was made for another root
+    gboolean save(const gchar *index_file);
+    void refresh(const gboolean *stop_flag=NULL);       // builds the whole index if nothing has been loaded
+    gboolean is_dirty() const               {  return dirty;  }
+
+    void add(const gchar *path);
+    void remove(const gchar *path);
+
+    /**
+     * Reports all names below @a start_dir matching @a names, up to @a max_depth
+     * levels deep (negative for no limit). Returns FALSE without reporting
+     * anything if @a start_dir is not in the index.
+     */
+    gboolean search(const gchar *start_dir, const NameMatcher &names, gint max_depth,
+                    LocalSearch::FoundFunc found, gpointer user_data, const gboolean *stop_flag=NULL);
+
+    guint get_dirs_count() const;
+    guint get_entries_count() const;
+
+    struct Dir                      // as stored in the index file
+    {
+        guint32 parent;             // index of the parent directory, NO_DIR for the root
+        guint32 name;               // offset of the name in the string pool
+        guint32 subtree_end;        // index past the last directory below this one
+        guint32 first_entry;        // index of the first name of this directory in the entry table
+        guint32 n_entries;
+        guint32 depth;
+        gint64 mtime;
+    };
+
+    static const guint32 NO_DIR = G_MAXUINT32;
+
+  private:
+
+    struct Table;
+    friend struct IndexBuilder;
+
+    gchar *root;
+    Table *table;
+    std::set<std::string> added;            // paths created since the last refresh
+    std::set<std::string> removed;          // paths of the table deleted since the last refresh
+    gboolean dirty;
+    mutable GMutex mutex;
+
+    guint32 find_dir(const Table *t, const gchar *path) const;
+    gboolean has_path(const Table *t, const std::string &path) const;
+    static gboolean below(const std::string &path, const std::string &dir);
+};
+
+#endif // __SEARCH_ENGINE_H__
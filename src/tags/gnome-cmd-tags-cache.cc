@@ -0,0 +1,308 @@
+/**
+ * @file gnome-cmd-tags-cache.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "gnome-cmd-tags-cache.h"
+
+using namespace std;
+
+
+#define CACHE_MAGIC       "GCMDMDC"
+#define CACHE_VERSION     1
+#define CACHE_BYTE_ORDER  0x01020304U
+
+
+struct CacheFileHeader
+{
+    gchar magic[8];
+    guint32 byte_order;         // CACHE_BYTE_ORDER as written by the machine which made the file
+    guint32 version;
+    guint64 n_entries;
+    guint64 clock;
+};
+
+
+struct CacheFileEntry           // followed by the data, padded to 8 bytes
+{
+    guint64 device;
+    guint64 inode;
+    gint64 mtime;
+    guint64 size;
+    guint64 stamp;
+    guint64 len;
+};
+
+
+static inline guint64 padded_size (guint64 len)
+{
+    return (len + 7) & ~(guint64) 7;
+}
+
+
+MetadataCache::MetadataCache(gsize max): size(0), max_size(max), clock(0), dirty(FALSE)
+{
+    g_mutex_init (&mutex);
+}
+
+
+MetadataCache::~MetadataCache()
+{
+    g_mutex_clear (&mutex);
+}
+
+
+gboolean MetadataCache::load(const gchar *cache_file)
+{
+    GMappedFile *mapped = g_mapped_file_new (cache_file, FALSE, NULL);
+
+    if (!mapped)
+        return FALSE;
+
+    const gchar *data = g_mapped_file_get_contents (mapped);
+    guint64 len = g_mapped_file_get_length (mapped);
+    const CacheFileHeader *header = (const CacheFileHeader *) data;
+
+    gboolean ok = len >= sizeof(CacheFileHeader) &&
+                  memcmp (header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC))==0 &&
+                  header->byte_order==CACHE_BYTE_ORDER &&
+                  header->version==CACHE_VERSION;
+
+    ENTRIES loaded;
+    guint64 offset = sizeof(CacheFileHeader);
+
+    // don't trust the file more than necessary, a length out of range would read past the mapping
+    for (guint64 n=0; ok && n<header->n_entries; ++n)
+    {
+        ok = len - offset >= sizeof(CacheFileEntry);
+
+        if (!ok)
+            break;
+
+        const CacheFileEntry *e = (const CacheFileEntry *) (data + offset);
+
+        offset += sizeof(CacheFileEntry);
+        ok = e->len <= len - offset && padded_size (e->len) <= len - offset;
+
+        if (!ok)
+            break;
+
+        Entry &entry = loaded[Key(e->device, e->inode, e->mtime, e->size)];
+
+        entry.data.assign (data + offset, e->len);
+        entry.stamp = e->stamp;
+
+        offset += padded_size (e->len);
+    }
+
+    ok = ok && offset==len;
+
+    guint64 file_clock = ok ? header->clock : 0;
+
+    g_mapped_file_unref (mapped);
+
+    if (!ok)
+        return FALSE;
+
+    g_mutex_lock (&mutex);
+
+    // the entries inserted meanwhile are newer than the ones of the file
+    for (ENTRIES::iterator i=loaded.begin(); i!=loaded.end(); ++i)
+    {
+        Entry &entry = entries[i->first];
+
+        if (entry.data.empty())
+        {
+            entry.data.swap (i->second.data);
+            entry.stamp = i->second.stamp;
+            size += entry.data.size();
+        }
+    }
+
+    clock = max(clock, file_clock);
+    evict();
+
+    g_mutex_unlock (&mutex);
+
+    return TRUE;
+}
+
+
+gboolean MetadataCache::save(const gchar *cache_file)
+{
+    // write a new file and move it over the old one, the old one may still be mapped by load()
+    gchar *tmp_file = g_strconcat (cache_file, ".tmp", NULL);
+    FILE *f = fopen (tmp_file, "wb");
+    gboolean ok = f != NULL;
+
+    g_mutex_lock (&mutex);
+
+    if (ok)
+    {
+        CacheFileHeader header;
+
+        memset (&header, 0, sizeof(header));
+        memcpy (header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.byte_order = CACHE_BYTE_ORDER;
+        header.version = CACHE_VERSION;
+        header.n_entries = entries.size();
+        header.clock = clock;
+
+        ok = fwrite (&header, sizeof(header), 1, f)==1;
+
+        static const gchar padding[8] = {0};
+
+        for (ENTRIES::const_iterator i=entries.begin(); ok && i!=entries.end(); ++i)
+        {
+            CacheFileEntry e;
+
+            e.device = i->first.device;
+            e.inode = i->first.inode;
+            e.mtime = i->first.mtime;
+            e.size = i->first.size;
+            e.stamp = i->second.stamp;
+            e.len = i->second.data.size();
+
+            ok = fwrite (&e, sizeof(e), 1, f)==1 &&
+                 fwrite (i->second.data.data(), 1, e.len, f)==e.len &&
+                 fwrite (padding, 1, padded_size (e.len) - e.len, f)==padded_size (e.len) - e.len;
+        }
+
+        ok = fclose (f)==0 && ok;
+        ok = ok && rename (tmp_file, cache_file)==0;
+
+        if (!ok)
+            unlink (tmp_file);
+    }
+
+    if (ok)
+        dirty = FALSE;
+
+    g_mutex_unlock (&mutex);
+
+    g_free (tmp_file);
+
+    return ok;
+}
+
+
+gboolean MetadataCache::is_dirty() const
+{
+    g_mutex_lock (&mutex);
+    gboolean retval = dirty;
+    g_mutex_unlock (&mutex);
+
+    return retval;
+}
+
+
+gboolean MetadataCache::lookup(const Key &key, string &data)
+{
+    g_mutex_lock (&mutex);
+
+    ENTRIES::iterator i = entries.find(key);
+    gboolean found = i!=entries.end();
+
+    if (found)
+    {
+        data = i->second.data;
+        i->second.stamp = ++clock;
+        dirty = TRUE;                           // the order of use is saved too
+    }
+
+    g_mutex_unlock (&mutex);
+
+    return found;
+}
+
+
+void MetadataCache::insert(const Key &key, const string &data)
+{
+    g_mutex_lock (&mutex);
+
+    Entry &entry = entries[key];
+
+    size -= entry.data.size();
+    entry.data = data;
+    entry.stamp = ++clock;
+    size += entry.data.size();
+    dirty = TRUE;
+
+    evict();
+
+    g_mutex_unlock (&mutex);
+}
+
+
+guint MetadataCache::get_count() const
+{
+    g_mutex_lock (&mutex);
+    guint n = entries.size();
+    g_mutex_unlock (&mutex);
+
+    return n;
+}
+
+
+gsize MetadataCache::get_size() const
+{
+    g_mutex_lock (&mutex);
+    gsize n = size;
+    g_mutex_unlock (&mutex);
+
+    return n;
+}
+
+
+inline bool stamp_is_older (const pair<guint64,MetadataCache::Key> &e1, const pair<guint64,MetadataCache::Key> &e2)
+{
+    return e1.first < e2.first;
+}
+
+
+// called with the mutex locked
+void MetadataCache::evict()
+{
+    if (size <= max_size)
+        return;
+
+    vector<pair<guint64,Key> > by_age;
+
+    by_age.reserve(entries.size());
+
+    for (ENTRIES::const_iterator i=entries.begin(); i!=entries.end(); ++i)
+        by_age.push_back(make_pair(i->second.stamp, i->first));
+
+    sort (by_age.begin(), by_age.end(), stamp_is_older);
+
+    for (vector<pair<guint64,Key> >::const_iterator i=by_age.begin(); i!=by_age.end() && size > max_size/4*3; ++i)
+    {
+        ENTRIES::iterator e = entries.find(i->second);
+
+        size -= e->second.data.size();
+        entries.erase(e);
+    }
+
+    dirty = TRUE;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file gnome-cmd-tags-cache.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GNOME_CMD_TAGS_CACHE_H__
+#define __GNOME_CMD_TAGS_CACHE_H__
+
+#include <glib.h>
+
+#include <map>
+#include <string>
+
+
+/**
+ * A persistent cache of the metadata of files, stored as opaque strings.
+ * The files are identified by device, inode, mtime and size, so an entry of
+ * a changed file is simply not found any more.
+ *
+ * Every lookup and insert stamps the entry with the time of the use. When
+ * the data grows beyond the size limit, the least recently used entries
+ * are dropped until a quarter of the limit is free again. The stamps are
+ * saved with the entries, so the order of use survives the sessions.
+ *
+ * All methods may be called from any thread.
+ */
+class MetadataCache
+{
+  public:
+
+    struct Key
+    {
+        guint64 device;
+        guint64 inode;
+        gint64 mtime;
+        guint64 size;
+
+        Key(guint64 d, guint64 i, gint64 m, guint64 s): device(d), inode(i), mtime(m), size(s)     {}
+
+        bool operator < (const Key &k) const;
+    };
+
+    explicit MetadataCache(gsize max_size);
+    ~MetadataCache();
+
+    gboolean load(const gchar *cache_file);             // returns FALSE if the file is missing or damaged, keeps the entries inserted already
+    gboolean save(const gchar *cache_file);
+    gboolean is_dirty() const;
+
+    gboolean lookup(const Key &key, std::string &data);
+    void insert(const Key &key, const std::string &data);
+
+    guint get_count() const;
+    gsize get_size() const;                             // of all data strings
+
+  private:
+
+    struct Entry
+    {
+        std::string data;
+        guint64 stamp;
+    };
+
+    typedef std::map<Key,Entry> ENTRIES;
+
+    ENTRIES entries;
+    gsize size;
+    gsize max_size;
+    guint64 clock;                                      // the stamp of the last use
+    gboolean dirty;
+    mutable GMutex mutex;
+
+    void evict();
+};
+
+
+inline bool MetadataCache::Key::operator < (const Key &k) const
+{
+    if (inode!=k.inode)     return inode<k.inode;
+    if (device!=k.device)   return device<k.device;
+    if (mtime!=k.mtime)     return mtime<k.mtime;
+    return size<k.size;
+}
+
+#endif // __GNOME_CMD_TAGS_CACHE_H__
@@ -468,12 +468,25 @@ void gcmd_tags_libgsf_load_metadata(GnomeCmdFile *f)
 
     if (!f->metadata)  return;
 
-    f->metadata->mark_as_accessed(TAG_DOC);
+    gchar *fname = f->is_local() ? f->get_real_path() : NULL;
 
-    if (!f->is_local())  return;
+    gcmd_tags_libgsf_load_metadata(f->metadata, fname);
+
+    g_free (fname);
+#endif
+}
+
+
+void gcmd_tags_libgsf_load_metadata(GnomeCmdFileMetadata *metadata, const gchar *fname)
+{
+    g_return_if_fail (metadata != NULL);
+
+#ifdef HAVE_GSF
+    metadata->mark_as_accessed(TAG_DOC);
+
+    if (!fname)  return;
 
     GError *err = NULL;
-    gchar *fname = f->get_real_path();
 
     DEBUG('t', "Loading doc metadata for '%s'\n", fname);
 
@@ -486,19 +499,16 @@ void gcmd_tags_libgsf_load_metadata(GnomeCmdFile *f)
         g_return_if_fail (err != NULL);
         g_warning ("'%s' error: %s", fname, err->message);
         g_error_free (err);
-        g_free (fname);
         return;
     }
 
-    g_free (fname);
-
     GsfInfile *infile = NULL;
 
     if ((infile = gsf_infile_msole_new (input, NULL)))
-        process_msole_infile(infile, f->metadata);
+        process_msole_infile(infile, metadata);
     else
         if ((infile = gsf_infile_zip_new (input, NULL)))
-            process_opendoc_infile(infile, f->metadata);
+            process_opendoc_infile(infile, metadata);
 
     if (infile)
         g_object_unref (infile);
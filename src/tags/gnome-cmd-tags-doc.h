@@ -29,5 +29,6 @@ void gcmd_tags_libgsf_init();
 void gcmd_tags_libgsf_shutdown();
 
 void gcmd_tags_libgsf_load_metadata(GnomeCmdFile *f);
+void gcmd_tags_libgsf_load_metadata(GnomeCmdFileMetadata *metadata, const gchar *fname);   // fname may be NULL, it may be called from any thread
 
 #endif // __GNOME_CMD_TAGS_DOC_H__
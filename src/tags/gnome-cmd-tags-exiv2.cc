@@ -33,6 +33,12 @@
 #ifdef HAVE_EXIV2
 #include <exiv2/exif.hpp>
 #include <exiv2/image.hpp>
+#include <exiv2/version.hpp>
+#if EXIV2_TEST_VERSION(0,26,0)
+#include <exiv2/xmp_exiv2.hpp>
+#elif EXIV2_TEST_VERSION(0,21,0)
+#include <exiv2/xmp.hpp>
+#endif
 #endif
 
 using namespace std;
@@ -361,6 +367,21 @@ void gcmd_tags_exiv2_init()
                    };
 
     load_data (exiv2_tags, exiv2_data, G_N_ELEMENTS(exiv2_data));
+
+#if EXIV2_TEST_VERSION(0,21,0)
+    // the metadata is read in pool threads, but the XMP toolkit can't initialize itself there safely
+    XmpParser::initialize();
+#endif
+#endif
+}
+
+
+void gcmd_tags_exiv2_shutdown()
+{
+#ifdef HAVE_EXIV2
+#if EXIV2_TEST_VERSION(0,21,0)
+    XmpParser::terminate();
+#endif
 #endif
 }
 
@@ -377,15 +398,25 @@ void gcmd_tags_exiv2_load_metadata(GnomeCmdFile *f)
 
     if (!f->metadata)  return;
 
-    f->metadata->mark_as_accessed(TAG_IMAGE);
+    gchar *fname = f->is_local() ? f->get_real_path() : NULL;
+
+    gcmd_tags_exiv2_load_metadata(f->metadata, fname);
+
+    g_free (fname);
+}
+
+
+void gcmd_tags_exiv2_load_metadata(GnomeCmdFileMetadata *metadata, const gchar *fname)
+{
+    g_return_if_fail (metadata != NULL);
+
+    metadata->mark_as_accessed(TAG_IMAGE);
 #ifdef HAVE_EXIV2
-    f->metadata->mark_as_accessed(TAG_EXIF);
-    f->metadata->mark_as_accessed(TAG_IPTC);
+    metadata->mark_as_accessed(TAG_EXIF);
+    metadata->mark_as_accessed(TAG_IPTC);
 #endif
 
-    if (!f->is_local())  return;
-
-    gchar *fname = f->get_real_path();
+    if (!fname)  return;
 
     DEBUG('t', "Loading image metadata for '%s'\n", fname);
 
@@ -396,8 +427,8 @@ void gcmd_tags_exiv2_load_metadata(GnomeCmdFile *f)
 
         image->readMetadata();
 
-        readTags(f->metadata, image->exifData());
-        readTags(f->metadata, image->iptcData());
+        readTags(metadata, image->exifData());
+        readTags(metadata, image->iptcData());
     }
 
     catch (AnyError &e)
@@ -408,11 +439,9 @@ void gcmd_tags_exiv2_load_metadata(GnomeCmdFile *f)
     gint width, height;
     GdkPixbufFormat *fmt = gdk_pixbuf_get_file_info (fname, &width, &height);
 
-    g_free (fname);
-
     if (!fmt)
         return;
 
-    f->metadata->addf (TAG_IMAGE_WIDTH, "%i", width);
-    f->metadata->addf (TAG_IMAGE_HEIGHT, "%i", height);
+    metadata->addf (TAG_IMAGE_WIDTH, "%i", width);
+    metadata->addf (TAG_IMAGE_HEIGHT, "%i", height);
 }
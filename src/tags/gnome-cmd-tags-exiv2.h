@@ -26,8 +26,9 @@
 #include "gnome-cmd-tags.h"
 
 void gcmd_tags_exiv2_init();
-inline void gcmd_tags_exiv2_shutdown()      {}
+void gcmd_tags_exiv2_shutdown();
 
 void gcmd_tags_exiv2_load_metadata(GnomeCmdFile *f);
+void gcmd_tags_exiv2_load_metadata(GnomeCmdFileMetadata *metadata, const gchar *fname);     // fname may be NULL, it may be called from any thread
 
 #endif // __GNOME_CMD_TAGS_EXIV2_H__
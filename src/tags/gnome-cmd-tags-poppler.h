@@ -22,8 +22,16 @@
 #ifndef __GNOME_CMD_TAGS_POPPLER_H__
 #define __GNOME_CMD_TAGS_POPPLER_H__
 
+#include <string.h>
+
 #include "gnome-cmd-file.h"
 
 void gcmd_tags_poppler_load_metadata(GnomeCmdFile *f);
+void gcmd_tags_poppler_load_metadata(GnomeCmdFileMetadata *metadata, const gchar *fname);  // fname may be NULL, it may be called from any thread
+
+inline gboolean gcmd_tags_poppler_is_pdf(const gchar *mime_type)
+{
+    return mime_type && strstr (mime_type, "pdf");
+}
 
 #endif // __GNOME_CMD_TAGS_POPPLER_H__
@@ -429,15 +429,27 @@ void gcmd_tags_taglib_load_metadata(GnomeCmdFile *finfo)
 
     if (!finfo->metadata)  return;
 
-    finfo->metadata->mark_as_accessed(TAG_AUDIO);
-    finfo->metadata->mark_as_accessed(TAG_APE);
-    finfo->metadata->mark_as_accessed(TAG_FLAC);
-    finfo->metadata->mark_as_accessed(TAG_ID3);
-    finfo->metadata->mark_as_accessed(TAG_VORBIS);
+    gchar *fname = finfo->is_local() ? finfo->get_real_path() : NULL;
 
-    if (!finfo->is_local())  return;
+    gcmd_tags_taglib_load_metadata(finfo->metadata, fname);
 
-    const gchar *fname = finfo->get_real_path();
+    g_free (fname);
+#endif
+}
+
+
+void gcmd_tags_taglib_load_metadata(GnomeCmdFileMetadata *metadata, const gchar *fname)
+{
+    g_return_if_fail (metadata != NULL);
+
+#ifdef HAVE_ID3
+    metadata->mark_as_accessed(TAG_AUDIO);
+    metadata->mark_as_accessed(TAG_APE);
+    metadata->mark_as_accessed(TAG_FLAC);
+    metadata->mark_as_accessed(TAG_ID3);
+    metadata->mark_as_accessed(TAG_VORBIS);
+
+    if (!fname)  return;
 
     DEBUG('t', "Loading audio metadata for '%s'\n", fname);
 
@@ -446,7 +458,7 @@ void gcmd_tags_taglib_load_metadata(GnomeCmdFile *finfo)
     if (f.isNull())
         return;
 
-    getAudioProperties(*finfo->metadata, f.audioProperties());
-    getTag(*finfo->metadata, f.file(), f.tag());
+    getAudioProperties(*metadata, f.audioProperties());
+    getTag(*metadata, f.file(), f.tag());
 #endif
 }
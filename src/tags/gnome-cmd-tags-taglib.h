@@ -28,5 +28,6 @@ void gcmd_tags_taglib_init();
 inline void gcmd_tags_taglib_shutdown()     {}
 
 void gcmd_tags_taglib_load_metadata(GnomeCmdFile *f);
+void gcmd_tags_taglib_load_metadata(GnomeCmdFileMetadata *metadata, const gchar *fname);   // fname may be NULL, it may be called from any thread
 
 #endif // __GNOME_CMD_TAGS_TAGLIB_H__
@@ -22,12 +22,16 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 
 #include <vector>
 
 #include "gnome-cmd-includes.h"
+#include "gnome-cmd-data.h"
 #include "gnome-cmd-tags.h"
+#include "gnome-cmd-tags-cache.h"
 #include "gnome-cmd-tags-file.h"
 #include "gnome-cmd-tags-exiv2.h"
 #include "gnome-cmd-tags-taglib.h"
@@ -80,7 +84,7 @@ static char no_support_for_poppler_tags_string[] = N_("<PDF tags not supported>"
 
 void GnomeCmdFileMetadata::addf(const GnomeCmdTag tag, const gchar *fmt, ...)
 {
-    static vector<char> buff(16);
+    vector<char> buff(64);      // not static, the loader threads add values at the same time
 
     va_list args;
 
@@ -102,6 +106,468 @@ void GnomeCmdFileMetadata::addf(const GnomeCmdTag tag, const gchar *fmt, ...)
 }
 
 
+// the data is a sequence of nul terminated fields: 'c' and the number of an accessed
+// class, or 't' and the name of a tag followed by a field with one of its values
+void GnomeCmdFileMetadata::serialize(string &data) const
+{
+    data.clear();
+
+    for (ACCESSED_COLL::const_iterator i=accessed.begin(); i!=accessed.end(); ++i)
+        if (i->second && i->first!=TAG_FILE)
+        {
+            gchar buff[16];
+
+            g_snprintf (buff, sizeof(buff), "c%i", i->first);
+            data.append(buff, strlen(buff)+1);
+        }
+
+    for (METADATA_COLL::const_iterator i=metadata.begin(); i!=metadata.end(); ++i)
+    {
+        if (gcmd_tags_get_class(i->first)==TAG_FILE)
+            continue;
+
+        const gchar *name = gcmd_tags_get_name(i->first);
+
+        for (set<string>::const_iterator v=i->second.begin(); v!=i->second.end(); ++v)
+        {
+            data += 't';
+            data.append(name, strlen(name)+1);
+            data.append(v->c_str(), v->size()+1);
+        }
+    }
+}
+
+
+gboolean GnomeCmdFileMetadata::deserialize(const string &data)
+{
+    const gchar *s = data.data();
+    const gchar *end = s + data.size();
+
+    if (data.empty() || end[-1]!='\0')
+        return FALSE;
+
+    while (s<end)
+    {
+        const gchar *field = s;
+
+        s += strlen(s) + 1;
+
+        switch (*field)
+        {
+            case 'c':
+                accessed[(GnomeCmdTagClass) atoi(field+1)] = TRUE;
+                break;
+
+            case 't':
+                {
+                    if (s>=end)
+                        return FALSE;
+
+                    const gchar *value = s;
+                    GnomeCmdTag tag = gcmd_tags_get_tag_by_name(field+1);
+
+                    s += strlen(s) + 1;
+
+                    // tags unknown to this version are dropped
+                    if (tag!=TAG_NONE)
+                        metadata[tag].insert(value);
+                }
+                break;
+
+            default:
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+#define TAGS_LOAD_INTERVAL      100         // ms between deliveries of loaded metadata
+#define TAGS_CACHE_MAX_SIZE     (64 << 20)  // bytes of metadata kept in the cache file
+#define TAGS_CACHE_FILE         "metadata-cache.db"
+
+enum
+{
+    LOADER_EXIV2    = 1 << 0,
+    LOADER_TAGLIB   = 1 << 1,
+    LOADER_LIBGSF   = 1 << 2,
+    LOADER_POPPLER  = 1 << 3
+};
+
+static const guint LOADERS_AVAILABLE = LOADER_EXIV2
+#ifdef HAVE_ID3
+                                       | LOADER_TAGLIB
+#endif
+#ifdef HAVE_GSF
+                                       | LOADER_LIBGSF
+#endif
+#ifdef HAVE_PDF
+                                       | LOADER_POPPLER
+#endif
+                                       ;
+
+
+struct TagsLoadRequest
+{
+    guint id;
+    GnomeCmdTagsLoadFunc func;
+    gpointer user_data;
+    guint remaining;                        // jobs not delivered yet
+    gint cancelled;                         // read by the loader threads
+    gboolean updated;
+};
+
+
+inline MetadataCache::Key tags_get_key(GnomeCmdFile *f)
+{
+    return MetadataCache::Key(f->info->device, f->info->inode, f->info->mtime, f->info->size);
+}
+
+
+struct TagsLoadJob
+{
+    TagsLoadRequest *request;
+    GnomeCmdFile *f;
+    MetadataCache::Key key;
+    gchar *fname;
+    gboolean is_pdf;
+    guint loaders;
+    GnomeCmdFileMetadata metadata;          // filled by the loader thread
+
+    TagsLoadJob(TagsLoadRequest *r, GnomeCmdFile *file, guint l): request(r), f(file->ref()), key(tags_get_key(file)), fname(file->get_real_path()),
+                                                                  is_pdf(gcmd_tags_poppler_is_pdf(file->info->mime_type)), loaders(l)    {}
+    ~TagsLoadJob()                          {  f->unref();  g_free (fname);  }
+};
+
+
+static GThreadPool *tags_pool = NULL;
+static GAsyncQueue *tags_done = NULL;      // jobs loaded by the pool
+static GList *tags_requests = NULL;
+static guint tags_last_id = 0;
+static guint tags_timeout_id = 0;
+static map<GnomeCmdFile *,guint> tags_pending;                          // number of jobs per file not delivered yet
+static MetadataCache *tags_cache = NULL;                                 // persistent, shared by all files
+static GThread *tags_cache_thread = NULL;                               // loads the cache file
+
+
+static guint tags_get_loaders(const GnomeCmdTagClass tag_class)
+{
+    switch (tag_class)
+    {
+        case TAG_IMAGE:
+        case TAG_EXIF:
+        case TAG_IPTC:
+            return LOADER_EXIV2;
+
+        case TAG_AUDIO:
+        case TAG_APE:
+        case TAG_FLAC:
+        case TAG_ID3:
+        case TAG_VORBIS:
+            return LOADER_TAGLIB;
+
+        case TAG_DOC:
+            return LOADER_LIBGSF | LOADER_POPPLER;
+
+        case TAG_PDF:
+            return LOADER_POPPLER;
+
+        default:
+            return 0;
+    }
+}
+
+
+// returns the loaders which have not run for md yet
+static guint tags_get_missing_loaders(GnomeCmdFileMetadata *md, guint loaders)
+{
+    if (!md)
+        return loaders;
+
+    if (md->is_accessed(TAG_IMAGE))  loaders &= ~LOADER_EXIV2;
+    if (md->is_accessed(TAG_AUDIO))  loaders &= ~LOADER_TAGLIB;
+    if (md->is_accessed(TAG_DOC))    loaders &= ~LOADER_LIBGSF;
+    if (md->is_accessed(TAG_PDF))    loaders &= ~LOADER_POPPLER;
+
+    return loaders;
+}
+
+
+static void tags_merge_cached(GnomeCmdFile *f)
+{
+    string data;
+    GnomeCmdFileMetadata md;
+
+    if (!tags_cache || !tags_cache->lookup(tags_get_key(f), data) || !md.deserialize(data))
+        return;
+
+    if (!f->metadata)
+        f->metadata = new GnomeCmdFileMetadata;
+    f->metadata->merge(md);
+}
+
+
+static void tags_store_cached(GnomeCmdFile *f, const MetadataCache::Key &key)
+{
+    if (!tags_cache || !f->metadata)
+        return;
+
+    string data;
+
+    f->metadata->serialize(data);
+
+    if (!data.empty())
+        tags_cache->insert(key, data);
+}
+
+
+// runs the loaders synchronously, unless their values are in the cache already
+static void tags_load(GnomeCmdFile *f, guint loaders)
+{
+    loaders = tags_get_missing_loaders(f->metadata, loaders & LOADERS_AVAILABLE);
+
+    if (!loaders)
+        return;
+
+    gboolean is_local = f->is_local();
+
+    if (is_local)
+    {
+        tags_merge_cached(f);
+        loaders = tags_get_missing_loaders(f->metadata, loaders);
+
+        if (!loaders)
+            return;
+    }
+
+    if (loaders & LOADER_EXIV2)
+        gcmd_tags_exiv2_load_metadata(f);
+    if (loaders & LOADER_TAGLIB)
+        gcmd_tags_taglib_load_metadata(f);
+    if (loaders & LOADER_LIBGSF)
+        gcmd_tags_libgsf_load_metadata(f);
+    if (loaders & LOADER_POPPLER)
+        gcmd_tags_poppler_load_metadata(f);
+
+    if (is_local)
+        tags_store_cached(f, tags_get_key(f));
+}
+
+
+static void tags_load_func(TagsLoadJob *job, gpointer unused)
+{
+    if (!g_atomic_int_get (&job->request->cancelled))
+    {
+        if (job->loaders & LOADER_EXIV2)
+            gcmd_tags_exiv2_load_metadata(&job->metadata, job->fname);
+        if (job->loaders & LOADER_TAGLIB)
+            gcmd_tags_taglib_load_metadata(&job->metadata, job->fname);
+        if (job->loaders & LOADER_LIBGSF)
+            gcmd_tags_libgsf_load_metadata(&job->metadata, job->fname);
+        if (job->loaders & LOADER_POPPLER)
+            gcmd_tags_poppler_load_metadata(&job->metadata, job->is_pdf ? job->fname : NULL);
+    }
+
+    g_async_queue_push (tags_done, job);
+}
+
+
+static void tags_deliver_job(TagsLoadJob *job)
+{
+    map<GnomeCmdFile *,guint>::iterator pending = tags_pending.find(job->f);
+
+    if (pending!=tags_pending.end() && --pending->second==0)
+        tags_pending.erase(pending);
+
+    TagsLoadRequest *request = job->request;
+
+    if (!request->cancelled)
+    {
+        if (!job->f->metadata)
+            job->f->metadata = new GnomeCmdFileMetadata;
+        job->f->metadata->merge(job->metadata);
+
+        tags_store_cached(job->f, job->key);
+
+        request->updated = TRUE;
+    }
+
+    request->remaining--;
+
+    delete job;
+}
+
+
+// calls back the requests which got new values, and forgets the finished ones
+static void tags_notify_requests()
+{
+    GList *requests = g_list_copy (tags_requests);
+
+    for (GList *i=requests; i; i=i->next)
+    {
+        TagsLoadRequest *request = (TagsLoadRequest *) i->data;
+
+        if (request->updated && !request->cancelled && request->func)
+        {
+            request->updated = FALSE;
+            request->func(request->remaining==0, request->user_data);
+        }
+    }
+
+    g_list_free (requests);
+
+    for (GList *i=tags_requests, *next; i; i=next)
+    {
+        TagsLoadRequest *request = (TagsLoadRequest *) i->data;
+
+        next = i->next;
+
+        if (request->remaining==0)
+        {
+            tags_requests = g_list_delete_link (tags_requests, i);
+            g_free (request);
+        }
+    }
+}
+
+
+static gboolean tags_deliver(gpointer unused)
+{
+    TagsLoadJob *job;
+
+    while ((job = (TagsLoadJob *) g_async_queue_try_pop (tags_done)))
+        tags_deliver_job(job);
+
+    tags_notify_requests();
+
+    if (tags_requests)
+        return TRUE;
+
+    tags_timeout_id = 0;
+
+    return FALSE;
+}
+
+
+static TagsLoadRequest *tags_find_request(guint id)
+{
+    for (GList *i=tags_requests; i; i=i->next)
+        if (((TagsLoadRequest *) i->data)->id==id)
+            return (TagsLoadRequest *) i->data;
+
+    return NULL;
+}
+
+
+guint gcmd_tags_load_async(GList *files, const set<GnomeCmdTagClass> &tag_classes, GnomeCmdTagsLoadFunc func, gpointer user_data)
+{
+    guint loaders = 0;
+
+    for (set<GnomeCmdTagClass>::const_iterator i=tag_classes.begin(); i!=tag_classes.end(); ++i)
+        loaders |= tags_get_loaders(*i);
+
+    loaders &= LOADERS_AVAILABLE;
+
+    if (!loaders)
+        return 0;
+
+    if (!tags_pool)
+    {
+        tags_done = g_async_queue_new ();
+        tags_pool = g_thread_pool_new ((GFunc) tags_load_func, NULL, g_get_num_processors (), FALSE, NULL);
+    }
+
+    TagsLoadRequest *request = g_new0 (TagsLoadRequest, 1);
+
+    if (!++tags_last_id)
+        ++tags_last_id;
+
+    request->id = tags_last_id;
+    request->func = func;
+    request->user_data = user_data;
+
+    for (GList *i=files; i; i=i->next)
+    {
+        GnomeCmdFile *f = (GnomeCmdFile *) i->data;
+
+        if (!f->is_local())
+            continue;
+
+        guint missing = tags_get_missing_loaders(f->metadata, loaders);
+
+        if (!missing)
+            continue;
+
+        tags_merge_cached(f);
+        missing = tags_get_missing_loaders(f->metadata, missing);
+
+        if (!missing)
+            continue;
+
+        tags_pending[f]++;
+        request->remaining++;
+        g_thread_pool_push (tags_pool, new TagsLoadJob(request, f, missing), NULL);
+    }
+
+    if (!request->remaining)
+    {
+        g_free (request);
+        return 0;
+    }
+
+    tags_requests = g_list_append (tags_requests, request);
+
+    if (!tags_timeout_id)
+        tags_timeout_id = g_timeout_add (TAGS_LOAD_INTERVAL, tags_deliver, NULL);
+
+    return request->id;
+}
+
+
+void gcmd_tags_cancel_load(guint id)
+{
+    TagsLoadRequest *request = tags_find_request(id);
+
+    if (request)
+        g_atomic_int_set (&request->cancelled, TRUE);
+}
+
+
+void gcmd_tags_wait_load(guint id)
+{
+    TagsLoadRequest *request = tags_find_request(id);
+
+    if (!request)
+        return;
+
+    while (request->remaining)
+        tags_deliver_job((TagsLoadJob *) g_async_queue_pop (tags_done));
+
+    tags_notify_requests();
+}
+
+
+static gchar *tags_get_cache_file()
+{
+    return config_dir ? g_build_filename (config_dir, TAGS_CACHE_FILE, NULL) : g_build_filename (g_get_home_dir (), "." PACKAGE, TAGS_CACHE_FILE, NULL);
+}
+
+
+static gpointer tags_load_cache(gpointer unused)
+{
+    gchar *cache_file = tags_get_cache_file();
+
+    // until the file is loaded, the lookups simply miss
+    if (!tags_cache->load(cache_file))
+        DEBUG ('t', "no usable metadata cache in %s\n", cache_file);
+
+    g_free (cache_file);
+
+    return NULL;
+}
+
+
 void gcmd_tags_init()
 {
     static struct
@@ -543,11 +1009,39 @@ void gcmd_tags_init()
     gcmd_tags_exiv2_init();
     gcmd_tags_taglib_init();
     gcmd_tags_libgsf_init();
+
+    tags_cache = new MetadataCache(TAGS_CACHE_MAX_SIZE);
+    tags_cache_thread = g_thread_new ("metadata-cache", tags_load_cache, NULL);
 }
 
 
 void gcmd_tags_shutdown()
 {
+    if (tags_pool)
+    {
+        for (GList *i=tags_requests; i; i=i->next)
+            g_atomic_int_set (&((TagsLoadRequest *) i->data)->cancelled, TRUE);
+        g_thread_pool_free (tags_pool, FALSE, TRUE);
+        tags_pool = NULL;
+    }
+
+    if (tags_cache_thread)
+        g_thread_join (tags_cache_thread);
+    tags_cache_thread = NULL;
+
+    if (tags_cache && tags_cache->is_dirty())
+    {
+        gchar *cache_file = tags_get_cache_file();
+
+        if (!tags_cache->save(cache_file))
+            g_warning ("Failed to save the metadata cache to %s", cache_file);
+
+        g_free (cache_file);
+    }
+
+    delete tags_cache;
+    tags_cache = NULL;
+
     gcmd_tags_exiv2_shutdown();
     gcmd_tags_taglib_shutdown();
     gcmd_tags_libgsf_shutdown();
@@ -559,10 +1053,7 @@ GnomeCmdFileMetadata *gcmd_tags_bulk_load(GnomeCmdFile *f)
     g_return_val_if_fail (f != NULL, NULL);
 
     gcmd_tags_file_load_metadata(f);
-    gcmd_tags_exiv2_load_metadata(f);
-    gcmd_tags_taglib_load_metadata(f);
-    gcmd_tags_libgsf_load_metadata(f);
-    gcmd_tags_poppler_load_metadata(f);
+    tags_load(f, LOADERS_AVAILABLE);
 
     return f->metadata;
 }
@@ -723,6 +1214,10 @@ const std::string gcmd_tags_get_value_string(GnomeCmdFile *f, const GnomeCmdTag
 
     std::string ret_val = empty_string;
 
+    // the values are on their way from gcmd_tags_load_async()
+    if (metatags[tag].tag_class!=TAG_FILE && tags_pending.find(f)!=tags_pending.end())
+        return empty_string;
+
     switch (metatags[tag].tag_class)
     {
         case TAG_IMAGE:
@@ -731,7 +1226,7 @@ const std::string gcmd_tags_get_value_string(GnomeCmdFile *f, const GnomeCmdTag
 #ifndef HAVE_EXIV2
                         return _(no_support_for_exiv2_tags_string);
 #endif
-                        gcmd_tags_exiv2_load_metadata(f);
+                        tags_load(f, LOADER_EXIV2);
                         ret_val = f->metadata->operator [] (tag).c_str();
                         break;
 
@@ -743,7 +1238,7 @@ const std::string gcmd_tags_get_value_string(GnomeCmdFile *f, const GnomeCmdTag
 #ifndef HAVE_ID3
                         return _(no_support_for_taglib_tags_string);
 #endif
-                        gcmd_tags_taglib_load_metadata(f);
+                        tags_load(f, LOADER_TAGLIB);
                         ret_val = f->metadata->operator [] (tag).c_str();
                         break;
 
@@ -753,8 +1248,7 @@ const std::string gcmd_tags_get_value_string(GnomeCmdFile *f, const GnomeCmdTag
                         return _(no_support_for_libgsf_tags_string);
 #endif
 #endif
-                        gcmd_tags_libgsf_load_metadata(f);
-                        gcmd_tags_poppler_load_metadata(f);
+                        tags_load(f, LOADER_LIBGSF | LOADER_POPPLER);
                         ret_val = f->metadata->operator [] (tag).c_str();
                         break;
 
@@ -762,7 +1256,7 @@ const std::string gcmd_tags_get_value_string(GnomeCmdFile *f, const GnomeCmdTag
 #ifndef HAVE_PDF
                         return _(no_support_for_poppler_tags_string);
 #endif
-                        gcmd_tags_poppler_load_metadata(f);
+                        tags_load(f, LOADER_POPPLER);
                         ret_val = f->metadata->operator [] (tag).c_str();
                         break;
 
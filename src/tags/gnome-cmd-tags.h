@@ -486,6 +486,25 @@ void gcmd_tags_shutdown();
 
 GnomeCmdFileMetadata *gcmd_tags_bulk_load(GnomeCmdFile *f);
 
+typedef void (* GnomeCmdTagsLoadFunc) (gboolean done, gpointer user_data);
+
+/**
+ * gcmd_tags_load_async() loads the metadata of tag_classes for all files
+ * in a pool of threads. Only the loaders needed for the given classes run,
+ * and the results are kept in the metadata cache file (by device, inode,
+ * mtime and size), so files already seen, in this session or an earlier
+ * one, are not read again. func is called in the main loop
+ * whenever new values have been stored in f->metadata, done is TRUE on the
+ * last call. While a file is being loaded, gcmd_tags_get_value_string()
+ * returns empty values for it instead of loading it synchronously.
+ *
+ * Returns 0 if nothing has to be loaded (func is not called then), or an
+ * id for gcmd_tags_cancel_load() and gcmd_tags_wait_load().
+ */
+guint gcmd_tags_load_async(GList *files, const std::set<GnomeCmdTagClass> &tag_classes, GnomeCmdTagsLoadFunc func, gpointer user_data);
+void gcmd_tags_cancel_load(guint id);       // func is not called any more
+void gcmd_tags_wait_load(guint id);         // blocks until all files of the request are loaded
+
 const gchar *gcmd_tags_get_name(const GnomeCmdTag tag);
 GnomeCmdTagClass gcmd_tags_get_class(const GnomeCmdTag tag);
 const gchar *gcmd_tags_get_class_name(const GnomeCmdTag tag);
@@ -547,6 +566,11 @@ class GnomeCmdFileMetadata
 
     gboolean has_tag (const GnomeCmdTag tag);
 
+    void merge (const GnomeCmdFileMetadata &md);                    // takes over the accessed classes and the values of md
+
+    void serialize (std::string &data) const;                       // leaves out the TAG_FILE class, it's not bound to the contents
+    gboolean deserialize (const std::string &data);
+
     const std::string operator[] (const GnomeCmdTag tag);
 
     METADATA_COLL::const_iterator begin()                           {  return metadata.begin();     }
@@ -604,6 +628,17 @@ inline gboolean GnomeCmdFileMetadata::has_tag (const GnomeCmdTag tag)
 }
 
 
+inline void GnomeCmdFileMetadata::merge (const GnomeCmdFileMetadata &md)
+{
+    for (ACCESSED_COLL::const_iterator i=md.accessed.begin(); i!=md.accessed.end(); ++i)
+        if (i->second)
+            accessed[i->first] = TRUE;
+
+    for (METADATA_COLL::const_iterator i=md.metadata.begin(); i!=md.metadata.end(); ++i)
+        metadata[i->first].insert(i->second.begin(), i->second.end());
+}
+
+
 inline const std::string GnomeCmdFileMetadata::operator[] (const GnomeCmdTag tag)
 {
     METADATA_COLL::const_iterator pos = metadata.find(tag);
@@ -0,0 +1,303 @@
+/**
+ * @file tree-size.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <set>
+#include <vector>
+
+#include "tree-size.h"
+
+using namespace std;
+
+
+#define TREE_SIZE_CACHE_MAX_DIRS  200000U
+
+
+struct HardLink
+{
+    dev_t dev;
+    ino_t ino;
+    guint64 size;
+};
+
+
+struct TreeSizeService::DirListing
+{
+    gint64 mtime;
+    guint64 files_size;             // files with a single link
+    guint64 files_count;
+    vector<HardLink> links;         // files with more than one link, they are counted once per calculation
+    vector<string> subdirs;
+};
+
+
+struct TreeSizeService::Calculation
+{
+    TreeSize total;
+    set<pair<dev_t,ino_t> > links_seen;
+    const gboolean *stopped;
+    ProgressFunc progress;
+    gpointer user_data;
+
+    gint pending;                   // directories pushed to the pool but not read yet
+    GMutex mutex;
+    GCond done_cond;
+};
+
+
+struct TreeSizeService::DirTask
+{
+    Calculation *calc;
+    gchar *path;
+};
+
+
+static inline gint64 get_mtime (const struct stat &st)
+{
+    return (gint64) st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec;
+}
+
+
+static gboolean read_dir (const gchar *path, vector<HardLink> &links, vector<string> &subdirs, guint64 &files_size, guint64 &files_count)
+{
+    int dir_fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd < 0)
+        return FALSE;
+
+    DIR *dir = fdopendir (dir_fd);
+
+    if (!dir)
+    {
+        close (dir_fd);
+        return FALSE;
+    }
+
+    struct dirent *entry;
+
+    while ((entry = readdir (dir)))
+    {
+        const gchar *name = entry->d_name;
+
+        if (name[0]=='.' && (name[1]=='\0' || (name[1]=='.' && name[2]=='\0')))
+            continue;
+
+        // the size of directories themselves is not counted, so they don't need a stat()
+        if (entry->d_type == DT_DIR)
+        {
+            subdirs.push_back(name);
+            continue;
+        }
+
+        struct stat st;
+
+        if (fstatat (dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+
+        // symlinked directories are not followed
+        if (S_ISDIR (st.st_mode))
+            subdirs.push_back(name);
+        else
+            if (st.st_nlink > 1)
+            {
+                HardLink link = {st.st_dev, st.st_ino, (guint64) st.st_size};
+                links.push_back(link);
+            }
+            else
+            {
+                files_size += st.st_size;
+                ++files_count;
+            }
+    }
+
+    closedir (dir);
+
+    return TRUE;
+}
+
+
+TreeSizeService::TreeSizeService(guint n_threads)
+{
+    g_mutex_init (&cache_mutex);
+
+    pool = g_thread_pool_new ((GFunc) process_func, this, n_threads ? n_threads : g_get_num_processors (), FALSE, NULL);
+}
+
+
+TreeSizeService::~TreeSizeService()
+{
+    g_thread_pool_free (pool, TRUE, TRUE);
+    g_mutex_clear (&cache_mutex);
+}
+
+
+void TreeSizeService::process(DirTask *task)
+{
+    Calculation *calc = task->calc;
+    struct stat st;
+
+    if (*calc->stopped || lstat (task->path, &st) != 0 || !S_ISDIR (st.st_mode))
+        return;
+
+    DirListing listing;
+    gboolean cached = FALSE;
+
+    g_mutex_lock (&cache_mutex);
+    map<string,DirListing>::const_iterator i = cache.find(task->path);
+    if (i != cache.end() && i->second.mtime == get_mtime (st))
+    {
+        listing = i->second;
+        cached = TRUE;
+    }
+    g_mutex_unlock (&cache_mutex);
+
+    if (!cached)
+    {
+        listing.mtime = get_mtime (st);
+        listing.files_size = 0;
+        listing.files_count = 0;
+
+        // directories which can't be read count for nothing, like before
+        if (!read_dir (task->path, listing.links, listing.subdirs, listing.files_size, listing.files_count))
+            return;
+
+        g_mutex_lock (&cache_mutex);
+        if (cache.size() >= TREE_SIZE_CACHE_MAX_DIRS)
+            cache.clear();
+        cache[task->path] = listing;
+        g_mutex_unlock (&cache_mutex);
+    }
+
+    g_mutex_lock (&calc->mutex);
+
+    calc->total.size += listing.files_size;
+    calc->total.count += listing.files_count + 1;
+
+    for (vector<HardLink>::const_iterator link=listing.links.begin(); link!=listing.links.end(); ++link)
+        if (calc->links_seen.insert(make_pair(link->dev, link->ino)).second)
+        {
+            calc->total.size += link->size;
+            ++calc->total.count;
+        }
+
+    TreeSize done = calc->total;
+
+    g_mutex_unlock (&calc->mutex);
+
+    if (calc->progress)
+        calc->progress (done, calc->user_data);
+
+    for (vector<string>::const_iterator subdir=listing.subdirs.begin(); subdir!=listing.subdirs.end(); ++subdir)
+    {
+        DirTask *subtask = g_new (DirTask, 1);
+
+        subtask->calc = calc;
+        subtask->path = g_build_filename (task->path, subdir->c_str(), NULL);
+
+        g_atomic_int_inc (&calc->pending);
+        g_thread_pool_push (pool, subtask, NULL);
+    }
+}
+
+
+void TreeSizeService::process_func(DirTask *task, TreeSizeService *service)
+{
+    Calculation *calc = task->calc;
+
+    service->process(task);
+
+    g_free (task->path);
+    g_free (task);
+
+    // calc() returns and frees calc as soon as it sees no task left, so don't touch calc after unlocking its mutex
+    g_mutex_lock (&calc->mutex);
+    if (g_atomic_int_dec_and_test (&calc->pending))
+        g_cond_signal (&calc->done_cond);
+    g_mutex_unlock (&calc->mutex);
+}
+
+
+gboolean TreeSizeService::calc(const gchar *path, TreeSize &result, const gboolean *stop_flag, ProgressFunc progress, gpointer user_data)
+{
+    gboolean never_stopped = FALSE;
+    struct stat st;
+
+    result = TreeSize();
+
+    if (lstat (path, &st) != 0)
+        return FALSE;
+
+    if (!S_ISDIR (st.st_mode))
+    {
+        result.size = st.st_size;
+        result.count = 1;
+        return TRUE;
+    }
+
+    Calculation calc;
+
+    calc.stopped = stop_flag ? stop_flag : &never_stopped;
+    calc.progress = progress;
+    calc.user_data = user_data;
+    calc.pending = 1;
+    g_mutex_init (&calc.mutex);
+    g_cond_init (&calc.done_cond);
+
+    DirTask *task = g_new (DirTask, 1);
+
+    task->calc = &calc;
+    task->path = g_strdup (path);
+
+    g_thread_pool_push (pool, task, NULL);
+
+    g_mutex_lock (&calc.mutex);
+    while (g_atomic_int_get (&calc.pending) > 0)
+        g_cond_wait (&calc.done_cond, &calc.mutex);
+    result = calc.total;
+    g_mutex_unlock (&calc.mutex);
+
+    g_mutex_clear (&calc.mutex);
+    g_cond_clear (&calc.done_cond);
+
+    return !*calc.stopped;
+}
+
+
+void TreeSizeService::forget(const gchar *dir)
+{
+    g_mutex_lock (&cache_mutex);
+    cache.erase(dir);
+    g_mutex_unlock (&cache_mutex);
+}
+
+
+guint TreeSizeService::get_cache_size()
+{
+    g_mutex_lock (&cache_mutex);
+    guint n = cache.size();
+    g_mutex_unlock (&cache_mutex);
+
+    return n;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file tree-size.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __TREE_SIZE_H__
+#define __TREE_SIZE_H__
+
+#include <glib.h>
+
+#include <map>
+#include <string>
+
+
+struct TreeSize
+{
+    guint64 size;               // sum of the sizes of all files, every hard linked file counted once
+    guint64 count;              // number of files and directories, the top directory included
+
+    TreeSize(): size(0), count(0)     {}
+};
+
+
+/**
+ * Computes the size of local directory trees. The directories of all
+ * running calculations are read by one shared pool of threads.
+ *
+ * The listing of every directory read is cached with the mtime of the
+ * directory, so unchanged directories need a single stat() the next time.
+ * Files which change their size in place don't touch the mtime of their
+ * directory, forget() drops a directory whose files are known to have
+ * changed.
+ */
+class TreeSizeService
+{
+  public:
+
+    typedef void (* ProgressFunc) (const TreeSize &done, gpointer user_data);     // called from the service threads
+
+    explicit TreeSizeService(guint n_threads=0);
+    ~TreeSizeService();
+
+    /**
+     * Blocks until the size of the tree at @a path is known. @a progress is
+     * called with the totals so far after every directory. Returns FALSE if
+     * @a path doesn't exist or the calculation has been stopped.
+     */
+    gboolean calc(const gchar *path, TreeSize &result, const gboolean *stop_flag=NULL, ProgressFunc progress=NULL, gpointer user_data=NULL);
+
+    void forget(const gchar *dir);
+    guint get_cache_size();
+
+  private:
+
+    struct Calculation;
+    struct DirTask;
+    struct DirListing;
+
+    GThreadPool *pool;
+    GMutex cache_mutex;
+    std::map<std::string,DirListing> cache;
+
+    void process(DirTask *task);
+
+    static void process_func(DirTask *task, TreeSizeService *service);
+};
+
+#endif // __TREE_SIZE_H__
@@ -749,25 +749,51 @@ GList *strings_to_uris (gchar *data)
 }
 
 
-GnomeVFSFileSize calc_tree_size (const GnomeVFSURI *dir_uri, gulong *count)
+static TreeSizeService *tree_size_service = NULL;
+
+
+// the service is shared by all threads computing tree sizes, and created by the first of them
+static TreeSizeService &get_tree_size_service ()
 {
-    if (!dir_uri)
-        return -1;
+    static gsize created = 0;
+
+    if (g_once_init_enter (&created))
+    {
+        g_atomic_pointer_set (&tree_size_service, new TreeSizeService);
+        g_once_init_leave (&created, 1);
+    }
+
+    return *tree_size_service;
+}
+
+
+struct VfsTreeSize
+{
+    TreeSize total;
+    const gboolean *stopped;
+    TreeSizeService::ProgressFunc progress;
+    gpointer user_data;
+};
+
+
+// walks trees which are not local, one directory after the other
+static void calc_tree_size_vfs (const GnomeVFSURI *dir_uri, VfsTreeSize &data)
+{
+    if (*data.stopped)
+        return;
 
     gchar *dir_uri_str = gnome_vfs_uri_to_string (dir_uri, GNOME_VFS_URI_HIDE_PASSWORD);
 
-    g_return_val_if_fail (dir_uri_str != NULL, -1);
+    g_return_if_fail (dir_uri_str != NULL);
 
     GList *list = NULL;
-    GnomeVFSFileSize size = 0;
 
     GnomeVFSResult result = gnome_vfs_directory_list_load (&list, dir_uri_str, GNOME_VFS_FILE_INFO_DEFAULT);
 
     if (result==GNOME_VFS_OK && list)
     {
-        if (count!=NULL) {
-            (*count)++; // Count the directory too
-        }
+        data.total.count++;     // Count the directory too
+
         for (GList *i = list; i; i = i->next)
         {
             GnomeVFSFileInfo *info = (GnomeVFSFileInfo *) i->data;
@@ -776,16 +802,14 @@ GnomeVFSFileSize calc_tree_size (const GnomeVFSURI *dir_uri, gulong *count)
                 if (info->type == GNOME_VFS_FILE_TYPE_DIRECTORY)
                 {
                     GnomeVFSURI *new_dir_uri = gnome_vfs_uri_append_file_name (dir_uri, info->name);
-                    size += calc_tree_size (new_dir_uri,count);
+                    calc_tree_size_vfs (new_dir_uri, data);
                     gnome_vfs_uri_unref (new_dir_uri);
                 }
                 else
-		{
-                    size += info->size;
-                    if (count!=NULL) {
-                        (*count)++;
-                    }
-		}
+                {
+                    data.total.size += info->size;
+                    data.total.count++;
+                }
             }
         }
 
@@ -794,22 +818,79 @@ GnomeVFSFileSize calc_tree_size (const GnomeVFSURI *dir_uri, gulong *count)
 
         g_list_free (list);
 
-    } else if (result==GNOME_VFS_ERROR_NOT_A_DIRECTORY) 
+        if (data.progress)
+            data.progress (data.total, data.user_data);
+
+    } else if (result==GNOME_VFS_ERROR_NOT_A_DIRECTORY)
     {
         // A file
         GnomeVFSFileInfo *info = gnome_vfs_file_info_new ();
         result = gnome_vfs_get_file_info (dir_uri_str, info, GNOME_VFS_FILE_INFO_DEFAULT);
-        size += info->size;
-        if (count!=NULL) {
-            (*count)++;
-        }
+        data.total.size += info->size;
+        data.total.count++;
         gnome_vfs_file_info_unref (info);
-
-   }
+    }
 
     g_free (dir_uri_str);
+}
+
+
+/**
+ * Returns the size of all files below @a dir_uri and adds their number to
+ * @a count. Local trees are read in parallel by the shared tree size
+ * service, which remembers the directories which haven't changed since.
+ * @a progress is called with the totals so far, from other threads.
+ */
+GnomeVFSFileSize calc_tree_size (const GnomeVFSURI *dir_uri, gulong *count, const gboolean *stop, TreeSizeService::ProgressFunc progress, gpointer user_data)
+{
+    if (!dir_uri)
+        return -1;
+
+    gboolean never_stopped = FALSE;
+    VfsTreeSize data;
+
+    data.stopped = stop ? stop : &never_stopped;
+    data.progress = progress;
+    data.user_data = user_data;
+
+    gchar *path = gnome_vfs_uri_is_local (dir_uri) ? gnome_vfs_unescape_string (gnome_vfs_uri_get_path (dir_uri), NULL) : NULL;
+
+    if (!path || (!get_tree_size_service().calc(path, data.total, data.stopped, progress, user_data) && !*data.stopped))
+    {
+        data.total = TreeSize();
+        calc_tree_size_vfs (dir_uri, data);
+    }
+
+    g_free (path);
+
+    if (count)
+        *count += data.total.count;
 
-    return size;
+    return data.total.size;
+}
+
+
+/**
+ * Makes the tree size service read the directory of @a uri_str again, for
+ * files which have changed in place.
+ */
+void forget_tree_size (const gchar *uri_str)
+{
+    TreeSizeService *service = (TreeSizeService *) g_atomic_pointer_get (&tree_size_service);
+
+    if (!service)
+        return;
+
+    gchar *path = gnome_vfs_get_local_path_from_uri (uri_str);
+
+    if (!path)
+        return;
+
+    gchar *dir = g_path_get_dirname (path);
+    service->forget(dir);
+
+    g_free (dir);
+    g_free (path);
 }
 
 
@@ -35,6 +35,7 @@
 #include "gnome-cmd-types.h"
 #include "gnome-cmd-pixmap.h"
 #include "gnome-cmd-app.h"
+#include "tree-size.h"
 
 #define TRACE(s)  std::cout << __FILE__ "(" << __LINE__ << ") " << __PRETTY_FUNCTION__ << "\t" #s ": `" << (s) << "'" << std::endl
 
@@ -178,7 +179,8 @@ inline gboolean state_is_ctrl_alt_shift (gint state)
 
 GList *strings_to_uris (gchar *data);
 
-GnomeVFSFileSize calc_tree_size (const GnomeVFSURI *dir_uri, gulong *count);
+GnomeVFSFileSize calc_tree_size (const GnomeVFSURI *dir_uri, gulong *count, const gboolean *stop=NULL, TreeSizeService::ProgressFunc progress=NULL, gpointer user_data=NULL);
+void forget_tree_size (const gchar *uri_str);
 gchar *create_nice_size_str (GnomeVFSFileSize size);
 
 inline gchar *quote_if_needed (const gchar *in)
@@ -0,0 +1,207 @@
+/**
+ * @file xfer-queue.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <sys/sysmacros.h>
+#include <algorithm>
+
+#include "xfer-queue.h"
+
+using namespace std;
+
+
+#define ROTATIONAL_LIMIT      1U
+#define NON_ROTATIONAL_LIMIT  4U
+#define OTHER_LIMIT           2U                //  network and virtual file systems, remote hosts
+
+
+XferQueue::XferQueue(LimitFunc func): limit_func(func)
+{
+}
+
+
+void XferQueue::add(gpointer job, const vector<string> &job_devices)
+{
+    Job j;
+
+    j.job = job;
+    j.running = FALSE;
+    j.paused = FALSE;
+
+    for (vector<string>::const_iterator i=job_devices.begin(); i!=job_devices.end(); ++i)
+    {
+        // a copy within a device takes a single place of it
+        if (std::find (j.devices.begin(), j.devices.end(), *i)!=j.devices.end())
+            continue;
+
+        j.devices.push_back(*i);
+
+        if (devices.find(*i)==devices.end())
+        {
+            Device &d = devices[*i];
+
+            d.limit = MAX (limit_func (*i), 1U);
+            d.running = 0;
+        }
+    }
+
+    jobs.push_back(j);
+}
+
+
+void XferQueue::remove(gpointer job)
+{
+    gint n = find(job);
+
+    if (n<0)
+        return;
+
+    if (jobs[n].running)
+        for (vector<string>::const_iterator i=jobs[n].devices.begin(); i!=jobs[n].devices.end(); ++i)
+            --devices[*i].running;
+
+    jobs.erase(jobs.begin()+n);
+}
+
+
+inline gboolean XferQueue::may_start(const Job &job)
+{
+    if (job.running || job.paused)
+        return FALSE;
+
+    for (vector<string>::const_iterator i=job.devices.begin(); i!=job.devices.end(); ++i)
+    {
+        const Device &d = devices[*i];
+
+        if (d.running >= d.limit)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+gpointer XferQueue::next()
+{
+    for (vector<Job>::iterator j=jobs.begin(); j!=jobs.end(); ++j)
+        if (may_start(*j))
+        {
+            for (vector<string>::const_iterator i=j->devices.begin(); i!=j->devices.end(); ++i)
+                ++devices[*i].running;
+
+            j->running = TRUE;
+
+            return j->job;
+        }
+
+    return NULL;
+}
+
+
+void XferQueue::move(gpointer job, guint pos)
+{
+    gint n = find(job);
+
+    if (n<0)
+        return;
+
+    Job j = jobs[n];
+
+    jobs.erase(jobs.begin()+n);
+    jobs.insert(jobs.begin()+MIN(pos,jobs.size()), j);
+}
+
+
+void XferQueue::set_paused(gpointer job, gboolean paused)
+{
+    gint n = find(job);
+
+    if (n>=0)
+        jobs[n].paused = paused;
+}
+
+
+gint XferQueue::find(gpointer job) const
+{
+    for (guint n=0; n<jobs.size(); ++n)
+        if (jobs[n].job==job)
+            return n;
+
+    return -1;
+}
+
+
+gboolean XferQueue::is_running(gpointer job) const
+{
+    gint n = find(job);
+
+    return n>=0 && jobs[n].running;
+}
+
+
+gboolean XferQueue::is_paused(gpointer job) const
+{
+    gint n = find(job);
+
+    return n>=0 && jobs[n].paused;
+}
+
+
+string XferQueue::local_device(dev_t dev)
+{
+    gchar buf[32];
+
+    g_snprintf (buf, sizeof(buf), "dev:%u:%u", major (dev), minor (dev));
+
+    return buf;
+}
+
+
+/**
+ * The limit of a local device follows the rotational flag of its disk,
+ * looked up in sysfs. A partition has no flag of its own, its disk is the
+ * parent directory. Devices without a disk, e.g. of network file systems,
+ * get the limit of remote hosts.
+ */
+guint XferQueue::device_limit(const string &device)
+{
+    guint maj, min;
+
+    if (sscanf (device.c_str(), "dev:%u:%u", &maj, &min)!=2 || maj==0)
+        return OTHER_LIMIT;
+
+    static const gchar *paths[] = {"/sys/dev/block/%u:%u/queue/rotational", "/sys/dev/block/%u:%u/../queue/rotational"};
+
+    for (guint i=0; i<G_N_ELEMENTS(paths); ++i)
+    {
+        gchar *path = g_strdup_printf (paths[i], maj, min);
+        gchar *contents = NULL;
+        gboolean found = g_file_get_contents (path, &contents, NULL, NULL);
+        gboolean rotational = found && contents[0]=='1';
+
+        g_free (contents);
+        g_free (path);
+
+        if (found)
+            return rotational ? ROTATIONAL_LIMIT : NON_ROTATIONAL_LIMIT;
+    }
+
+    return OTHER_LIMIT;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file xfer-queue.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __XFER_QUEUE_H__
+#define __XFER_QUEUE_H__
+
+#include <glib.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * Decides which of the queued transfers may run. Every transfer names the
+ * devices it reads from and writes to, and every device runs only a few
+ * transfers at a time: a spinning disk one, as two streams make its heads
+ * jump between them, a solid state disk more, a network file system a
+ * couple. Transfers on different devices run side by side.
+ *
+ * The waiting transfers start in the order of the queue, but one which has
+ * to wait for its devices doesn't hold up the transfers behind it. Paused
+ * transfers don't start. A running transfer keeps its devices while it is
+ * paused, so resuming it doesn't find the devices taken.
+ */
+class XferQueue
+{
+  public:
+
+    typedef guint (* LimitFunc) (const std::string &device);      // the number of transfers @a device may run at a time
+
+    explicit XferQueue(LimitFunc limit_func=device_limit);
+
+    void add(gpointer job, const std::vector<std::string> &devices);
+    void remove(gpointer job);                  // finished or cancelled
+
+    /**
+     * Returns the first waiting job whose devices are free and marks it as
+     * running, or NULL if none can start now.
+     */
+    gpointer next();
+
+    void move(gpointer job, guint pos);
+    void set_paused(gpointer job, gboolean paused);
+
+    guint size() const                          {  return jobs.size();  }
+    gpointer get(guint n) const                 {  return jobs[n].job;  }
+    gint find(gpointer job) const;              // -1 if not queued
+    gboolean is_running(gpointer job) const;
+    gboolean is_paused(gpointer job) const;
+
+    static std::string local_device(dev_t dev);
+    static guint device_limit(const std::string &device);
+
+  private:
+
+    struct Job
+    {
+        gpointer job;
+        std::vector<std::string> devices;
+        gboolean running;
+        gboolean paused;
+    };
+
+    struct Device
+    {
+        guint limit;
+        guint running;
+    };
+
+    LimitFunc limit_func;
+    std::vector<Job> jobs;
+    std::map<std::string,Device> devices;
+
+    gboolean may_start(const Job &job);
+};
+
+#endif // __XFER_QUEUE_H__
@@ -0,0 +1,87 @@
+/**
+ * @file xfer-rate.cc
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <math.h>
+
+#include "xfer-rate.h"
+
+
+#define XFER_RATE_MIN_INTERVAL  0.5
+
+
+XferRate::XferRate(gdouble tc): time_constant(tc), started(FALSE), known(FALSE), last_time(0), last_bytes(0), last_files(0), bytes_rate(0), files_rate(0)
+{
+}
+
+
+void XferRate::update(gdouble now, guint64 bytes_done, guint64 files_done)
+{
+    if (!started)
+    {
+        started = TRUE;
+        last_time = now;
+        last_bytes = bytes_done;
+        last_files = files_done;
+        return;
+    }
+
+    gdouble interval = now - last_time;
+
+    if (interval < XFER_RATE_MIN_INTERVAL)
+        return;
+
+    // the totals may be corrected downwards, e.g. for skipped files
+    gdouble bytes = bytes_done>last_bytes ? bytes_done-last_bytes : 0;
+    gdouble files = files_done>last_files ? files_done-last_files : 0;
+
+    if (known)
+    {
+        // the weight of the new sample grows with the time it covers
+        gdouble weight = 1.0 - exp (-interval/time_constant);
+
+        bytes_rate += weight * (bytes/interval - bytes_rate);
+        files_rate += weight * (files/interval - files_rate);
+    }
+    else
+    {
+        bytes_rate = bytes/interval;
+        files_rate = files/interval;
+        known = TRUE;
+    }
+
+    last_time = now;
+    last_bytes = bytes_done;
+    last_files = files_done;
+}
+
+
+gint64 XferRate::get_eta(guint64 bytes_left, guint64 files_left) const
+{
+    if (!bytes_left && !files_left)
+        return 0;
+
+    if (!known)
+        return -1;
+
+    gdouble eta = bytes_left ? bytes_left/bytes_rate : files_left/files_rate;
+
+    // a stalled transfer has no end in sight
+    return eta < G_MAXINT ? (gint64) ceil (eta) : -1;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file xfer-rate.h
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __XFER_RATE_H__
+#define __XFER_RATE_H__
+
+#include <glib.h>
+
+
+/**
+ * Estimates the throughput of a transfer from the totals done so far, as
+ * exponentially weighted moving averages of bytes and files per second.
+ * Older samples fade out with @a time_constant seconds, so the rate
+ * follows a change of speed without jumping with every single file.
+ *
+ * Samples closer together than half a second are merged with the next one.
+ */
+class XferRate
+{
+  public:
+
+    explicit XferRate(gdouble time_constant=5.0);
+
+    void update(gdouble now, guint64 bytes_done, guint64 files_done);     // @a now in seconds, from any monotonic clock
+
+    gboolean is_known() const                   {  return known;  }
+    gdouble get_bytes_per_sec() const           {  return bytes_rate;  }
+    gdouble get_files_per_sec() const           {  return files_rate;  }
+
+    /**
+     * Returns the seconds until @a bytes_left and @a files_left are done, or
+     * -1 while the rate isn't known yet. The time follows the bytes, which
+     * already include the cost of every file started; the files only count
+     * once no bytes are left, e.g. for directories and empty files.
+     */
+    gint64 get_eta(guint64 bytes_left, guint64 files_left) const;
+
+  private:
+
+    gdouble time_constant;
+    gboolean started;
+    gboolean known;
+    gdouble last_time;
+    guint64 last_bytes;
+    guint64 last_files;
+    gdouble bytes_rate;
+    gdouble files_rate;
+};
+
+#endif // __XFER_RATE_H__
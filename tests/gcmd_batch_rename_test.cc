@@ -0,0 +1,293 @@
+/**
+ * @file gcmd_batch_rename_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks that the batch renamer renames chains and cycles of
+ * files in the right order, refuses conflicting renames before touching
+ * anything, and restores all names when a rename fails and a rollback is
+ * requested. Without a rollback, a file of a cycle which can't get back
+ * its old name has to be reported under its temporary one.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+
+#include "gcmd_test_utils.h"
+#include "batch-rename.h"
+
+using namespace std;
+
+
+class BatchRenameTest : public TempDirTest
+{
+  protected:
+
+    BatchRenameTest(): TempDirTest("gcmd-rename-XXXXXX")     {}
+
+    void write(const gchar *name, const gchar *contents);
+    string read(const gchar *name);
+    guint count();
+};
+
+
+// every file holds its original name, so it can be followed through the renames
+void BatchRenameTest::write(const gchar *name, const gchar *contents)
+{
+    gchar *path = g_build_filename (root, name, NULL);
+    ASSERT_TRUE (g_file_set_contents (path, contents, -1, NULL));
+    g_free (path);
+}
+
+
+string BatchRenameTest::read(const gchar *name)
+{
+    gchar *path = g_build_filename (root, name, NULL);
+    gchar *contents = NULL;
+    string retval;
+
+    if (g_file_get_contents (path, &contents, NULL, NULL))
+        retval = contents;
+
+    g_free (contents);
+    g_free (path);
+
+    return retval;
+}
+
+
+guint BatchRenameTest::count()
+{
+    GDir *d = g_dir_open (root, 0, NULL);
+    guint n = 0;
+
+    while (d && g_dir_read_name (d))
+        ++n;
+
+    if (d)
+        g_dir_close (d);
+
+    return n;
+}
+
+
+TEST_F(BatchRenameTest, chain)
+{
+    write ("a", "a");
+    write ("b", "b");
+    write ("c", "c");
+
+    BatchRename batch;
+
+    // each new name is held by the next file, which has to be renamed first
+    batch.add(root, "a", "b");
+    batch.add(root, "b", "c");
+    batch.add(root, "c", "d");
+    batch.add(root, "e", "e");
+
+    EXPECT_EQ (0, batch.check());
+    EXPECT_EQ (BatchRename::UNCHANGED, batch.get_status(3));
+    ASSERT_TRUE (batch.run(TRUE));
+
+    for (guint n=0; n<3; ++n)
+        EXPECT_EQ (BatchRename::DONE, batch.get_status(n));
+
+    EXPECT_EQ ("", read ("a"));
+    EXPECT_EQ ("a", read ("b"));
+    EXPECT_EQ ("b", read ("c"));
+    EXPECT_EQ ("c", read ("d"));
+}
+
+
+TEST_F(BatchRenameTest, cycle)
+{
+    write ("a", "a");
+    write ("b", "b");
+    write ("c", "c");
+    write ("x", "x");
+    write ("y", "y");
+
+    BatchRename batch;
+
+    batch.add(root, "a", "b");
+    batch.add(root, "b", "c");
+    batch.add(root, "c", "a");
+    batch.add(root, "x", "y");
+    batch.add(root, "y", "x");
+
+    EXPECT_EQ (0, batch.check());
+    ASSERT_TRUE (batch.run(TRUE));
+
+    EXPECT_EQ ("c", read ("a"));
+    EXPECT_EQ ("a", read ("b"));
+    EXPECT_EQ ("b", read ("c"));
+    EXPECT_EQ ("y", read ("x"));
+    EXPECT_EQ ("x", read ("y"));
+
+    // no temporary file is left
+    EXPECT_EQ (5, count());
+}
+
+
+TEST_F(BatchRenameTest, conflicts)
+{
+    write ("a", "a");
+    write ("b", "b");
+    write ("c", "c");
+    write ("d", "d");
+    write ("e", "e");
+    write ("f", "f");
+
+    BatchRename batch;
+
+    batch.add(root, "a", "x");           // the same new name as the next one
+    batch.add(root, "b", "x");
+    batch.add(root, "c", "f");           // f exists and isn't renamed
+    batch.add(root, "d", "c");           // c keeps its name, so d can't get it
+    batch.add(root, "e", "sub/e");
+    batch.add(root, "missing", "g");
+
+    EXPECT_EQ (6, batch.check());
+
+    EXPECT_EQ (BatchRename::CONFLICT, batch.get_status(0));
+    EXPECT_EQ (EEXIST, batch.get_error(0));
+    EXPECT_EQ (BatchRename::CONFLICT, batch.get_status(1));
+    EXPECT_EQ (BatchRename::CONFLICT, batch.get_status(2));
+    EXPECT_EQ (EEXIST, batch.get_error(2));
+    EXPECT_EQ (BatchRename::CONFLICT, batch.get_status(3));
+    EXPECT_EQ (EEXIST, batch.get_error(3));
+    EXPECT_EQ (BatchRename::CONFLICT, batch.get_status(4));
+    EXPECT_EQ (EINVAL, batch.get_error(4));
+    EXPECT_EQ (BatchRename::CONFLICT, batch.get_status(5));
+    EXPECT_EQ (ENOENT, batch.get_error(5));
+
+    // nothing is left to do
+    EXPECT_TRUE (batch.run(TRUE));
+
+    EXPECT_EQ ("a", read ("a"));
+    EXPECT_EQ ("c", read ("c"));
+    EXPECT_EQ ("d", read ("d"));
+    EXPECT_EQ (6, count());
+}
+
+
+TEST_F(BatchRenameTest, rollback)
+{
+    write ("a", "a");
+    write ("b", "b");
+    write ("c", "c");
+
+    BatchRename batch;
+
+    batch.add(root, "a", "b");
+    batch.add(root, "b", "x");
+    batch.add(root, "c", "y");
+
+    EXPECT_EQ (0, batch.check());
+
+    // the name is taken after the check, so the last rename fails
+    write ("y", "late");
+
+    EXPECT_FALSE (batch.run(TRUE));
+
+    EXPECT_EQ (BatchRename::ROLLED_BACK, batch.get_status(0));
+    EXPECT_EQ (BatchRename::ROLLED_BACK, batch.get_status(1));
+    EXPECT_EQ (BatchRename::FAILED, batch.get_status(2));
+    EXPECT_EQ (EEXIST, batch.get_error(2));
+
+    EXPECT_EQ ("a", read ("a"));
+    EXPECT_EQ ("b", read ("b"));
+    EXPECT_EQ ("c", read ("c"));
+    EXPECT_EQ ("late", read ("y"));
+    EXPECT_EQ (4, count());
+}
+
+
+// takes the name the file on its temporary name is going to get
+static void take_name (guint done, guint total, const gchar *path)
+{
+    if (done < total)
+        g_file_set_contents (path, "late", -1, NULL);
+}
+
+
+TEST_F(BatchRenameTest, cycle_without_rollback)
+{
+    BatchRename batch;
+
+    // enough renames before the cycle to get the progress function called between its steps
+    for (guint n=0; n<254; ++n)
+    {
+        gchar *name = g_strdup_printf ("f%u", n);
+        gchar *new_name = g_strdup_printf ("g%u", n);
+
+        write (name, name);
+        batch.add(root, name, new_name);
+
+        g_free (new_name);
+        g_free (name);
+    }
+
+    write ("a", "a");
+    write ("b", "b");
+
+    guint a = batch.add(root, "a", "b");
+    guint b = batch.add(root, "b", "a");
+
+    EXPECT_EQ (0, batch.check());
+
+    // after a has been moved aside and b renamed to a, b is taken again
+    gchar *path = g_build_filename (root, "b", NULL);
+    EXPECT_FALSE (batch.run(FALSE, NULL, (BatchRename::ProgressFunc) take_name, path));
+    g_free (path);
+
+    EXPECT_EQ (BatchRename::DONE, batch.get_status(b));
+    EXPECT_EQ (NULL, batch.get_tmp_name(b));
+    EXPECT_EQ ("b", read ("a"));
+    EXPECT_EQ ("late", read ("b"));
+
+    // a can't get back its old name, so it is reported under the temporary one
+    EXPECT_EQ (BatchRename::FAILED, batch.get_status(a));
+    EXPECT_EQ (EEXIST, batch.get_error(a));
+    ASSERT_TRUE (batch.get_tmp_name(a) != NULL);
+    EXPECT_EQ ("a", read (batch.get_tmp_name(a)));
+    EXPECT_EQ (254 + 3, count());
+}
+
+
+TEST_F(BatchRenameTest, stop)
+{
+    write ("a", "a");
+    write ("b", "b");
+
+    BatchRename batch;
+    gboolean stop = TRUE;
+
+    batch.add(root, "a", "b");
+    batch.add(root, "b", "c");
+
+    EXPECT_EQ (0, batch.check());
+    EXPECT_FALSE (batch.run(TRUE, &stop));
+
+    EXPECT_EQ ("a", read ("a"));
+    EXPECT_EQ ("b", read ("b"));
+}
@@ -0,0 +1,160 @@
+/**
+ * @file gcmd_content_matcher_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks the plain text a content pattern is prefiltered with:
+ * it has to be part of every match, so nothing from bracket expressions,
+ * optional characters or optional groups may end up in it.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "gtest/gtest.h"
+#include <glib.h>
+#include <string.h>
+
+#include "search-engine.h"
+
+
+TEST(ContentMatcherTest, plain_text)
+{
+    ContentMatcher m("hello", TRUE, TRUE);
+
+    ASSERT_TRUE (m.regex_ok);
+    EXPECT_STREQ ("hello", m.literal);
+    EXPECT_TRUE (m.literal_only);
+}
+
+
+TEST(ContentMatcherTest, longest_run)
+{
+    ContentMatcher m("ab.cdef$", TRUE, TRUE);
+
+    EXPECT_STREQ ("cdef", m.literal);
+    EXPECT_FALSE (m.literal_only);
+}
+
+
+TEST(ContentMatcherTest, optional_characters)
+{
+    ContentMatcher question("abcd?", TRUE, TRUE);
+    EXPECT_STREQ ("abc", question.literal);
+
+    ContentMatcher star("abc*de", TRUE, TRUE);
+    EXPECT_STREQ ("ab", star.literal);
+
+    ContentMatcher interval("abcx{0,2}", TRUE, TRUE);
+    EXPECT_STREQ ("abc", interval.literal);
+
+    // '?' is a plain character in basic regular expressions
+    ContentMatcher basic("ab?", TRUE, FALSE);
+    EXPECT_STREQ ("ab?", basic.literal);
+    EXPECT_TRUE (basic.literal_only);
+}
+
+
+TEST(ContentMatcherTest, give_up)
+{
+    ContentMatcher escape("a\\.b", TRUE, TRUE);
+    EXPECT_EQ (NULL, escape.literal);
+
+    ContentMatcher alternative("abc|def", TRUE, TRUE);
+    EXPECT_EQ (NULL, alternative.literal);
+}
+
+
+TEST(ContentMatcherTest, groups)
+{
+    ContentMatcher required("(abc)x", TRUE, TRUE);
+    EXPECT_STREQ ("abc", required.literal);
+
+    ContentMatcher repeated("(abcd)+x", TRUE, TRUE);
+    EXPECT_STREQ ("abcd", repeated.literal);
+
+    ContentMatcher question("(abc)?x", TRUE, TRUE);
+    EXPECT_STREQ ("x", question.literal);
+    EXPECT_FALSE (question.literal_only);
+
+    ContentMatcher star("yy(abcd)*x", TRUE, TRUE);
+    EXPECT_STREQ ("yy", star.literal);
+
+    ContentMatcher none("(abcd){0,3}xy", TRUE, TRUE);
+    EXPECT_STREQ ("xy", none.literal);
+
+    ContentMatcher twice("(abcd){2}xy", TRUE, TRUE);
+    EXPECT_STREQ ("abcd", twice.literal);
+
+    // the inner group is optional, the outer one is not
+    ContentMatcher nested("((abcd)?ef)x", TRUE, TRUE);
+    EXPECT_STREQ ("ef", nested.literal);
+
+    // alternatives in an optional group don't matter
+    ContentMatcher alternative("(abc|def)?xy", TRUE, TRUE);
+    EXPECT_STREQ ("xy", alternative.literal);
+
+    ContentMatcher bracket("([)]abcd)?xy", TRUE, TRUE);
+    EXPECT_STREQ ("xy", bracket.literal);
+}
+
+
+TEST(ContentMatcherTest, group_matches)
+{
+    const gchar *text = "x marks the spot";
+
+    ContentMatcher m("(abc)?x", TRUE, TRUE);
+    EXPECT_TRUE (m.buffer_matches(text, strlen (text)));
+}
+
+
+TEST(ContentMatcherTest, bracket_expressions)
+{
+    ContentMatcher digits("[0-9]", TRUE, TRUE);
+
+    EXPECT_EQ (NULL, digits.literal);
+    EXPECT_FALSE (digits.literal_only);
+
+    ContentMatcher around("ab[0-9]cde", TRUE, TRUE);
+
+    EXPECT_STREQ ("cde", around.literal);
+    EXPECT_FALSE (around.literal_only);
+
+    // a ']' right after '[' or '[^' is one of the characters
+    ContentMatcher bracket("[]xyz]ab", TRUE, TRUE);
+    EXPECT_STREQ ("ab", bracket.literal);
+
+    ContentMatcher negated("[^]xyz]ab", TRUE, TRUE);
+    EXPECT_STREQ ("ab", negated.literal);
+
+    // the ']' of a class doesn't end the bracket expression
+    ContentMatcher cls("x[[:digit:]abcd]y", TRUE, TRUE);
+    EXPECT_STREQ ("x", cls.literal);
+
+    ContentMatcher basic("[a-z]*foo", TRUE, FALSE);
+    EXPECT_STREQ ("foo", basic.literal);
+}
+
+
+TEST(ContentMatcherTest, bracket_matches)
+{
+    const gchar *text = "version 42";
+
+    ContentMatcher m("[0-9][0-9]", TRUE, TRUE);
+    EXPECT_TRUE (m.buffer_matches(text, strlen (text)));
+
+    ContentMatcher cls("n [[:digit:]]+", TRUE, TRUE);
+    EXPECT_TRUE (cls.buffer_matches(text, strlen (text)));
+}
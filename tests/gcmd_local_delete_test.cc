@@ -0,0 +1,218 @@
+/**
+ * @file gcmd_local_delete_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks that the local delete engine removes whole directory
+ * trees without following symlinks, leaves the directories above a
+ * skipped file behind, and moves the items out of sight before deleting
+ * them when asked to.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gcmd_test_utils.h"
+#include "local-delete.h"
+
+using namespace std;
+
+
+class LocalDeleteTest : public TempDirTest
+{
+  protected:
+
+    LocalDeleteTest(): TempDirTest("gcmd-delete-XXXXXX")     {}
+
+    string path(const gchar *rel)       {  return string(root) + G_DIR_SEPARATOR + rel;  }
+    void make_tree(const gchar *rel, guint depth);
+    void write(const gchar *rel);
+    gboolean exists(const gchar *rel);
+    guint count(const gchar *rel);
+};
+
+
+// every directory holds three files and three subdirectories, down to depth
+void LocalDeleteTest::make_tree(const gchar *rel, guint depth)
+{
+    g_mkdir (path(rel).c_str(), 0755);
+
+    for (guint i=0; i<3; ++i)
+    {
+        gchar *file = g_strdup_printf ("%s/file%u", rel, i);
+        write (file);
+        g_free (file);
+
+        if (depth > 0)
+        {
+            gchar *dir = g_strdup_printf ("%s/dir%u", rel, i);
+            make_tree (dir, depth-1);
+            g_free (dir);
+        }
+    }
+}
+
+
+void LocalDeleteTest::write(const gchar *rel)
+{
+    ASSERT_TRUE (g_file_set_contents (path(rel).c_str(), rel, -1, NULL));
+}
+
+
+gboolean LocalDeleteTest::exists(const gchar *rel)
+{
+    struct stat st;
+
+    return lstat (path(rel).c_str(), &st)==0;
+}
+
+
+guint LocalDeleteTest::count(const gchar *rel)
+{
+    GDir *dir = g_dir_open (path(rel).c_str(), 0, NULL);
+    guint n = 0;
+
+    while (dir && g_dir_read_name (dir))
+        ++n;
+
+    if (dir)
+        g_dir_close (dir);
+
+    return n;
+}
+
+
+static LocalDelete::ErrorAnswer skip (const gchar *path, int error, guint *asked)
+{
+    ++*asked;
+    return LocalDelete::ERROR_ANSWER_SKIP;
+}
+
+
+TEST_F(LocalDeleteTest, tree)
+{
+    make_tree ("tree", 4);
+    make_tree ("outside", 0);
+    write ("file");
+    ASSERT_EQ (0, symlink (path("outside").c_str(), path("tree/dir0/link").c_str()));
+
+    LocalDelete del(4);
+
+    del.add(path("tree").c_str());
+    del.add(path("file").c_str());
+    del.add(path("missing").c_str());
+
+    guint asked = 0;
+    EXPECT_TRUE (del.run(NULL, (LocalDelete::ErrorFunc) skip, &asked));
+    EXPECT_EQ (0, asked);
+
+    EXPECT_FALSE (exists ("tree"));
+    EXPECT_FALSE (exists ("file"));
+
+    // the directory behind the symlink isn't touched
+    EXPECT_EQ (3, count ("outside"));
+
+    LocalDelete::Progress progress;
+    del.get_progress(progress);
+
+    // 121 directories with 3 files each, the symlink and file
+    EXPECT_EQ (121+3*121+2, progress.files_found);
+    EXPECT_EQ (progress.files_found, progress.files_done);
+    EXPECT_EQ (0, progress.files_failed);
+}
+
+
+TEST_F(LocalDeleteTest, skip)
+{
+    if (geteuid ()==0)
+        return;             // root may delete anything
+
+    make_tree ("tree", 1);
+    g_chmod (path("tree/dir1").c_str(), 0555);
+
+    LocalDelete del(2);
+
+    del.add(path("tree").c_str());
+
+    guint asked = 0;
+    EXPECT_TRUE (del.run(NULL, (LocalDelete::ErrorFunc) skip, &asked));
+
+    // the files of tree/dir1 are asked for, the directories above them are left quietly
+    EXPECT_EQ (3, asked);
+    EXPECT_EQ (3, count ("tree/dir1"));
+    EXPECT_EQ (1, count ("tree"));
+
+    LocalDelete::Progress progress;
+    del.get_progress(progress);
+
+    EXPECT_EQ (5, progress.files_failed);
+}
+
+
+TEST_F(LocalDeleteTest, stage)
+{
+    g_mkdir (path("dir").c_str(), 0755);
+    make_tree ("dir/a", 2);
+    write ("dir/b");
+    write ("dir/c");
+
+    LocalDelete del;
+
+    del.add(path("dir/a").c_str());
+    del.add(path("dir/b").c_str());
+
+    ASSERT_TRUE (del.stage());
+
+    // the items are gone at once, into one hidden directory
+    EXPECT_FALSE (exists ("dir/a"));
+    EXPECT_FALSE (exists ("dir/b"));
+    ASSERT_EQ (1, del.get_items().size());
+    EXPECT_EQ (2, count (del.get_items()[0].c_str() + strlen (root) + 1));
+    EXPECT_EQ (2, count ("dir"));
+
+    // only such directories are deleted when left behind
+    EXPECT_TRUE (LocalDelete::is_staged(del.get_items()[0].c_str()));
+    EXPECT_FALSE (LocalDelete::is_staged(path("dir").c_str()));
+    EXPECT_FALSE (LocalDelete::is_staged(".gcmd-delete-abcdef"));
+
+    EXPECT_TRUE (del.run());
+    EXPECT_EQ (1, count ("dir"));
+    EXPECT_TRUE (exists ("dir/c"));
+}
+
+
+TEST_F(LocalDeleteTest, stop)
+{
+    make_tree ("tree", 1);
+
+    gboolean stop = TRUE;
+    LocalDelete del;
+
+    del.add(path("tree").c_str());
+
+    EXPECT_FALSE (del.run(&stop));
+    EXPECT_EQ (6, count ("tree"));
+}
@@ -0,0 +1,235 @@
+/**
+ * @file gcmd_local_search_bm_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Compares the native local search engine with the find/grep
+ * command line the search dialog used to spawn. A directory tree is
+ * generated in a temporary directory, both backends search it for the
+ * same name and content patterns, the results have to be identical and
+ * the timings are printed. The comparison is skipped if find or grep is
+ * not installed.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <set>
+#include <string>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gcmd_test_utils.h"
+#include "search-engine.h"
+
+using namespace std;
+
+static const guint TOP_DIRS = 20;
+static const guint SUB_DIRS = 10;
+static const guint FILES_PER_DIR = 20;
+
+
+class LocalSearchBenchmark : public TempDirTest
+{
+  protected:
+
+    LocalSearchBenchmark(): TempDirTest("gcmd-search-XXXXXX")     {}
+
+    virtual void SetUp();
+
+    void search_native(const gchar *name_pattern, Filter::Type syntax, const gchar *text_pattern, set<string> &result, gdouble &elapsed);
+    gboolean search_find(const gchar *find_args, set<string> &result, gdouble &elapsed);
+};
+
+
+static void write_file (const gchar *dir, guint n)
+{
+    gchar *name = g_strdup_printf ("file-%03u.%s", n, n%3 ? "txt" : "dat");
+    gchar *path = g_build_filename (dir, name, NULL);
+    GString *content = g_string_sized_new (8192);
+
+    for (guint line=0; line<128; ++line)
+        g_string_append_printf (content, "line %u of some text which does not matter at all\n", line);
+
+    // every seventh file contains the text looked for, near its end
+    if (n%7 == 0)
+        g_string_append (content, "here is the needle\n");
+
+    g_file_set_contents (path, content->str, content->len, NULL);
+
+    g_string_free (content, TRUE);
+    g_free (path);
+    g_free (name);
+}
+
+
+
+void LocalSearchBenchmark::SetUp()
+{
+    ASSERT_NO_FATAL_FAILURE (TempDirTest::SetUp());
+
+    for (guint i=0; i<TOP_DIRS; ++i)
+    {
+        gchar *top = g_strdup_printf ("%s/dir-%02u", root, i);
+
+        for (guint j=0; j<SUB_DIRS; ++j)
+        {
+            gchar *sub = g_strdup_printf ("%s/sub-%02u", top, j);
+
+            g_mkdir_with_parents (sub, 0700);
+
+            for (guint n=0; n<FILES_PER_DIR; ++n)
+                write_file (sub, n);
+
+            g_free (sub);
+        }
+
+        g_free (top);
+    }
+}
+
+
+struct FoundFiles
+{
+    GMutex mutex;
+    set<string> *paths;
+};
+
+
+static void add_found (const gchar *path, FoundFiles *found)
+{
+    g_mutex_lock (&found->mutex);
+    found->paths->insert(path);
+    g_mutex_unlock (&found->mutex);
+}
+
+
+void LocalSearchBenchmark::search_native(const gchar *name_pattern, Filter::Type syntax, const gchar *text_pattern, set<string> &result, gdouble &elapsed)
+{
+    FoundFiles found;
+
+    g_mutex_init (&found.mutex);
+    found.paths = &result;
+
+    GTimer *timer = g_timer_new ();
+
+    LocalSearch search(name_pattern, syntax, TRUE, -1, text_pattern);
+    search.run(root, (LocalSearch::FoundFunc) add_found, &found);
+
+    elapsed = g_timer_elapsed (timer, NULL);
+
+    g_timer_destroy (timer);
+    g_mutex_clear (&found.mutex);
+}
+
+
+gboolean LocalSearchBenchmark::search_find(const gchar *find_args, set<string> &result, gdouble &elapsed)
+{
+    gchar *find = g_find_program_in_path ("find");
+    gchar *grep = g_find_program_in_path ("grep");
+    gboolean available = find && grep;
+
+    g_free (find);
+    g_free (grep);
+
+    if (!available)
+    {
+        printf("find or grep is not installed, skipping the comparison\n");
+        return FALSE;
+    }
+
+    gchar *command = g_strdup_printf ("find '%s' %s -print", root, find_args);
+    gchar *out = NULL;
+    gint status = 0;
+
+    GTimer *timer = g_timer_new ();
+
+    gboolean ok = g_spawn_command_line_sync (command, &out, NULL, &status, NULL);
+
+    elapsed = g_timer_elapsed (timer, NULL);
+
+    g_timer_destroy (timer);
+    g_free (command);
+
+    EXPECT_TRUE (ok);
+
+    if (out)
+    {
+        gchar **lines = g_strsplit (out, "\n", -1);
+
+        for (gchar **line=lines; *line; ++line)
+            if (**line)
+                result.insert(*line);
+
+        g_strfreev (lines);
+        g_free (out);
+    }
+
+    return ok;
+}
+
+
+TEST_F(LocalSearchBenchmark, names)
+{
+    set<string> native, find;
+    gdouble t_native, t_find;
+
+    search_native ("*.txt", Filter::TYPE_FNMATCH, NULL, native, t_native);
+
+    if (!search_find ("-name '*.txt'", find, t_find))
+        return;
+
+    printf("%-24s %6zu files, native: %8.4f s, find: %8.4f s\n", "name search", native.size(), t_native, t_find);
+
+    EXPECT_EQ (TOP_DIRS * SUB_DIRS * (FILES_PER_DIR - (FILES_PER_DIR+2)/3), native.size());
+    EXPECT_TRUE (native == find);
+}
+
+
+TEST_F(LocalSearchBenchmark, names_by_regex)
+{
+    set<string> native, find;
+    gdouble t_native, t_find;
+
+    search_native ("^file-0[0-4].\\.dat$", Filter::TYPE_REGEX, NULL, native, t_native);
+
+    if (!search_find ("-regextype posix-extended -regex '.*/file-0[0-4].\\.dat'", find, t_find))
+        return;
+
+    printf("%-24s %6zu files, native: %8.4f s, find: %8.4f s\n", "regex name search", native.size(), t_native, t_find);
+
+    EXPECT_FALSE (native.empty());
+    EXPECT_TRUE (native == find);
+}
+
+
+TEST_F(LocalSearchBenchmark, content)
+{
+    set<string> native, find;
+    gdouble t_native, t_find;
+
+    search_native ("*.txt", Filter::TYPE_FNMATCH, "ne+dle", native, t_native);
+
+    if (!search_find ("-name '*.txt' '!' -type p -exec grep -E -q 'ne+dle' {} \\;", find, t_find))
+        return;
+
+    printf("%-24s %6zu files, native: %8.4f s, find/grep: %8.4f s\n", "content search", native.size(), t_native, t_find);
+
+    EXPECT_FALSE (native.empty());
+    EXPECT_TRUE (native == find);
+}
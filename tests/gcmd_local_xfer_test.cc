@@ -0,0 +1,630 @@
+/**
+ * @file gcmd_local_xfer_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks that the local transfer engine copies directory trees
+ * with their contents, permissions, times and symlinks, moves them by
+ * renaming, merges into existing directories, follows the answers about
+ * existing files, refuses to copy a file onto itself and can be paused and
+ * stopped. Stopped transfers are resumed from their journal, continuing a
+ * large file from its checkpoint if the data before it is unchanged, or
+ * discarded with their partial copies.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mount.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gcmd_test_utils.h"
+#include "local-xfer.h"
+
+using namespace std;
+
+
+class LocalXferTest : public TempDirTest
+{
+  protected:
+
+    LocalXferTest(): TempDirTest("gcmd-xfer-XXXXXX")     {}
+
+    virtual void SetUp();
+
+    string path(const gchar *rel)       {  return string(root) + G_DIR_SEPARATOR + rel;  }
+    void write(const gchar *rel, const string &contents);
+    void interrupt(const string &big, const string &partial);
+    string read(const gchar *rel);
+    gboolean exists(const gchar *rel);
+};
+
+
+void LocalXferTest::SetUp()
+{
+    ASSERT_NO_FATAL_FAILURE (TempDirTest::SetUp());
+
+    g_mkdir (path("src").c_str(), 0755);
+    g_mkdir (path("src/sub").c_str(), 0750);
+    g_mkdir (path("dest").c_str(), 0755);
+}
+
+
+void LocalXferTest::write(const gchar *rel, const string &contents)
+{
+    ASSERT_TRUE (g_file_set_contents (path(rel).c_str(), contents.data(), contents.size(), NULL));
+}
+
+
+string LocalXferTest::read(const gchar *rel)
+{
+    gchar *contents = NULL;
+    gsize len = 0;
+    string retval;
+
+    if (g_file_get_contents (path(rel).c_str(), &contents, &len, NULL))
+        retval.assign (contents, len);
+
+    g_free (contents);
+
+    return retval;
+}
+
+
+gboolean LocalXferTest::exists(const gchar *rel)
+{
+    struct stat st;
+
+    return lstat (path(rel).c_str(), &st)==0;
+}
+
+
+static LocalXfer::OverwriteAnswer skip_all (const gchar *src, const gchar *dest, guint *asked)
+{
+    ++*asked;
+    return LocalXfer::OVERWRITE_ANSWER_SKIP_ALL;
+}
+
+
+static LocalXfer::OverwriteAnswer replace (const gchar *src, const gchar *dest, guint *asked)
+{
+    ++*asked;
+    return LocalXfer::OVERWRITE_ANSWER_REPLACE;
+}
+
+
+TEST_F(LocalXferTest, copy_tree)
+{
+    string large(5 << 20, 'x');
+
+    for (gsize i=0; i<large.size(); i+=4096)
+        large[i] = 'a' + i/4096 % 26;
+
+    write ("src/small", "small");
+    write ("src/empty", "");
+    write ("src/sub/large", large);
+    chmod (path("src/small").c_str(), 0640);
+    ASSERT_EQ (0, symlink ("../small", path("src/sub/link").c_str()));
+
+    for (guint n=0; n<100; ++n)
+    {
+        gchar *name = g_strdup_printf ("src/sub/file%u", n);
+        write (name, name);
+        g_free (name);
+    }
+
+    struct timespec times[2] = {{1000000000, 0}, {1234567890, 0}};
+    utimensat (AT_FDCWD, path("src/small").c_str(), times, 0);
+
+    LocalXfer xfer(FALSE, FALSE, LocalXfer::OVERWRITE_QUERY, 4);
+
+    xfer.add(path("src").c_str(), path("dest/copy").c_str());
+
+    ASSERT_TRUE (xfer.run());
+
+    EXPECT_EQ ("small", read ("dest/copy/small"));
+    EXPECT_EQ ("", read ("dest/copy/empty"));
+    EXPECT_TRUE (large == read ("dest/copy/sub/large"));
+    EXPECT_EQ ("src/sub/file42", read ("dest/copy/sub/file42"));
+
+    struct stat st;
+
+    ASSERT_EQ (0, stat (path("dest/copy/small").c_str(), &st));
+    EXPECT_EQ (0640, st.st_mode & 07777);
+    EXPECT_EQ (1234567890, st.st_mtime);
+
+    ASSERT_EQ (0, stat (path("dest/copy/sub").c_str(), &st));
+    EXPECT_EQ (0750, st.st_mode & 07777);
+
+    gchar target[64] = {0};
+    ASSERT_LT (0, readlink (path("dest/copy/sub/link").c_str(), target, sizeof(target)-1));
+    EXPECT_STREQ ("../small", target);
+
+    LocalXfer::Progress progress;
+    xfer.get_progress(progress);
+    EXPECT_EQ (104, progress.files_total);
+    EXPECT_EQ (progress.files_total, progress.files_done);
+    EXPECT_EQ (progress.bytes_total, progress.bytes_done);
+
+    // the sources are untouched
+    EXPECT_EQ ("small", read ("src/small"));
+}
+
+
+TEST_F(LocalXferTest, move)
+{
+    write ("src/sub/a", "a");
+    write ("src/b", "b");
+
+    LocalXfer xfer(TRUE, FALSE, LocalXfer::OVERWRITE_QUERY);
+
+    xfer.add(path("src/sub").c_str(), path("dest/sub").c_str());
+    xfer.add(path("src/b").c_str(), path("dest/b").c_str());
+
+    ASSERT_TRUE (xfer.run());
+
+    EXPECT_EQ ("a", read ("dest/sub/a"));
+    EXPECT_EQ ("b", read ("dest/b"));
+    EXPECT_FALSE (exists ("src/sub"));
+    EXPECT_FALSE (exists ("src/b"));
+
+    // the renamed file counts for the bytes done, like a copied one
+    LocalXfer::Progress progress;
+    xfer.get_progress(progress);
+    EXPECT_EQ (2, progress.files_done);
+    EXPECT_EQ (progress.bytes_total, progress.bytes_done);
+    EXPECT_EQ (1, progress.bytes_done);
+}
+
+
+static gpointer run_func (LocalXfer *xfer)
+{
+    return GINT_TO_POINTER (xfer->run());
+}
+
+
+TEST_F(LocalXferTest, move_onto_moved)
+{
+    write ("src/sub/a", "a");
+    g_mkdir (path("src/other").c_str(), 0755);
+    g_mkdir (path("src/other/sub").c_str(), 0755);
+    write ("src/other/sub/b", "b");
+
+    LocalXfer xfer(TRUE, FALSE, LocalXfer::OVERWRITE_QUERY);
+
+    xfer.add(path("src/sub").c_str(), path("dest/sub").c_str());
+    xfer.add(path("src/other/sub").c_str(), path("dest/sub").c_str());
+    xfer.set_paused(TRUE);
+
+    GThread *thread = g_thread_new (NULL, (GThreadFunc) run_func, &xfer);
+
+    // both are scanned as renames before the first one is moved, the second one is merged into it
+    LocalXfer::Progress progress;
+    gint64 deadline = g_get_monotonic_time () + 10 * G_TIME_SPAN_SECOND;
+
+    for (xfer.get_progress(progress); progress.files_total < 2 && g_get_monotonic_time () < deadline; xfer.get_progress(progress))
+        g_usleep (1000);
+
+    xfer.set_paused(FALSE);
+
+    EXPECT_TRUE (GPOINTER_TO_INT (g_thread_join (thread)));
+    EXPECT_EQ ("a", read ("dest/sub/a"));
+    EXPECT_EQ ("b", read ("dest/sub/b"));
+    EXPECT_FALSE (exists ("src/sub"));
+    EXPECT_FALSE (exists ("src/other/sub"));
+
+    xfer.get_progress(progress);
+    EXPECT_EQ (2, progress.files_total);
+    EXPECT_EQ (2, progress.files_done);
+}
+
+
+TEST_F(LocalXferTest, move_across_bind_mount)
+{
+    if (geteuid ()!=0)
+        return;             // only root may bind mount
+
+    write ("src/sub/a", "a");
+    write ("src/b", "b");
+    g_mkdir (path("mnt").c_str(), 0755);
+
+    // the same file system, rename() fails with EXDEV all the same
+    ASSERT_EQ (0, mount (path("dest").c_str(), path("mnt").c_str(), NULL, MS_BIND, NULL));
+
+    LocalXfer xfer(TRUE, FALSE, LocalXfer::OVERWRITE_QUERY);
+
+    xfer.add(path("src/sub").c_str(), path("mnt/sub").c_str());
+    xfer.add(path("src/b").c_str(), path("mnt/b").c_str());
+
+    gboolean done = xfer.run();
+
+    umount (path("mnt").c_str());
+
+    EXPECT_TRUE (done);
+    EXPECT_EQ ("a", read ("dest/sub/a"));
+    EXPECT_EQ ("b", read ("dest/b"));
+    EXPECT_FALSE (exists ("src/sub"));
+    EXPECT_FALSE (exists ("src/b"));
+
+    LocalXfer::Progress progress;
+    xfer.get_progress(progress);
+    EXPECT_EQ (2, progress.files_total);
+    EXPECT_EQ (2, progress.files_done);
+    EXPECT_EQ (2, progress.bytes_done);
+}
+
+
+TEST_F(LocalXferTest, merge_and_overwrite)
+{
+    write ("src/sub/a", "new a");
+    write ("src/sub/b", "new b");
+    write ("src/sub/c", "new c");
+    g_mkdir (path("dest/sub").c_str(), 0755);
+    write ("dest/sub/a", "old a");
+    write ("dest/sub/b", "old b");
+
+    guint asked = 0;
+    LocalXfer skipping(TRUE, FALSE, LocalXfer::OVERWRITE_QUERY);
+
+    skipping.add(path("src/sub").c_str(), path("dest/sub").c_str());
+
+    ASSERT_TRUE (skipping.run(NULL, (LocalXfer::OverwriteFunc) skip_all, NULL, &asked));
+
+    // asked once, the answer holds for the other file
+    EXPECT_EQ (1, asked);
+    EXPECT_EQ ("old a", read ("dest/sub/a"));
+    EXPECT_EQ ("old b", read ("dest/sub/b"));
+    EXPECT_EQ ("new c", read ("dest/sub/c"));
+
+    // the skipped files are left in the source directory
+    EXPECT_EQ ("new a", read ("src/sub/a"));
+    EXPECT_FALSE (exists ("src/sub/c"));
+
+    LocalXfer replacing(FALSE, FALSE, LocalXfer::OVERWRITE_QUERY);
+
+    asked = 0;
+    replacing.add(path("src/sub").c_str(), path("dest/sub").c_str());
+
+    ASSERT_TRUE (replacing.run(NULL, (LocalXfer::OverwriteFunc) replace, NULL, &asked));
+
+    EXPECT_EQ (2, asked);
+    EXPECT_EQ ("new a", read ("dest/sub/a"));
+    EXPECT_EQ ("new b", read ("dest/sub/b"));
+}
+
+
+static LocalXfer::ErrorAnswer skip_error (const gchar *src, const gchar *dest, int error, vector<int> *errors)
+{
+    errors->push_back(error);
+    return LocalXfer::ERROR_ANSWER_SKIP;
+}
+
+
+TEST_F(LocalXferTest, onto_itself)
+{
+    write ("src/a", "a");
+    write ("src/sub/b", "b");
+    ASSERT_EQ (0, symlink ("../src", path("dest/link").c_str()));
+
+    vector<int> errors;
+    LocalXfer xfer(FALSE, FALSE, LocalXfer::OVERWRITE_REPLACE);
+
+    xfer.add(path("src/a").c_str(), path("src/a").c_str());
+    xfer.add(path("src/a").c_str(), path("dest/link/a").c_str());
+    xfer.add(path("src/sub").c_str(), path("dest/link/sub").c_str());
+
+    // skipped, so not a failure
+    ASSERT_TRUE (xfer.run(NULL, NULL, (LocalXfer::ErrorFunc) skip_error, &errors));
+
+    // the merged directory is refused as a whole, not file by file
+    ASSERT_EQ (3, errors.size());
+    EXPECT_EQ (EINVAL, errors[0]);
+    EXPECT_EQ ("a", read ("src/a"));
+    EXPECT_EQ ("b", read ("src/sub/b"));
+
+    // moving a file onto itself doesn't lose it either
+    LocalXfer move(TRUE, FALSE, LocalXfer::OVERWRITE_REPLACE);
+
+    move.add(path("src/a").c_str(), path("dest/link/a").c_str());
+
+    ASSERT_TRUE (move.run(NULL, NULL, (LocalXfer::ErrorFunc) skip_error, &errors));
+    EXPECT_EQ (4, errors.size());
+    EXPECT_EQ ("a", read ("src/a"));
+}
+
+
+TEST_F(LocalXferTest, pause)
+{
+    write ("src/a", "a");
+
+    LocalXfer xfer(FALSE, FALSE, LocalXfer::OVERWRITE_QUERY);
+
+    xfer.add(path("src").c_str(), path("dest/src").c_str());
+    xfer.set_paused(TRUE);
+
+    GThread *thread = g_thread_new (NULL, (GThreadFunc) run_func, &xfer);
+
+    // the sources are scanned while the transfer holds at its first pause point, however long that takes
+    LocalXfer::Progress progress;
+    gint64 deadline = g_get_monotonic_time () + 10 * G_TIME_SPAN_SECOND;
+
+    for (xfer.get_progress(progress); progress.files_total < 1 && g_get_monotonic_time () < deadline; xfer.get_progress(progress))
+        g_usleep (1000);
+
+    // nothing is copied
+    EXPECT_EQ (1, progress.files_total);
+    EXPECT_EQ (0, progress.files_done);
+    EXPECT_FALSE (exists ("dest/src"));
+
+    xfer.set_paused(FALSE);
+
+    EXPECT_TRUE (GPOINTER_TO_INT (g_thread_join (thread)));
+    EXPECT_EQ ("a", read ("dest/src/a"));
+}
+
+
+struct CopyWait
+{
+    string path;
+    gboolean copied;
+};
+
+
+// asked by the scan, it waits for the copy of an earlier file
+static LocalXfer::ErrorAnswer wait_for_copy (const gchar *src, const gchar *dest, int error, CopyWait *wait)
+{
+    gint64 deadline = g_get_monotonic_time () + 10 * G_TIME_SPAN_SECOND;
+
+    while (!(wait->copied = g_file_test (wait->path.c_str(), G_FILE_TEST_EXISTS)) && g_get_monotonic_time () < deadline)
+        g_usleep (1000);
+
+    return LocalXfer::ERROR_ANSWER_SKIP;
+}
+
+
+TEST_F(LocalXferTest, copy_while_scanning)
+{
+    write ("src/a", "a");
+    write ("src/sub/c", "c");
+    ASSERT_EQ (0, symlink (".", path("src/sub/loop").c_str()));
+
+    LocalXfer xfer(FALSE, TRUE, LocalXfer::OVERWRITE_QUERY);
+    CopyWait wait = {path("dest/a"), FALSE};
+
+    xfer.add(path("src/a").c_str(), wait.path.c_str());
+    xfer.add(path("src/sub").c_str(), path("dest/sub").c_str());
+
+    // the followed link is found by the scan, which asks while a is copied
+    EXPECT_TRUE (xfer.run(NULL, NULL, (LocalXfer::ErrorFunc) wait_for_copy, &wait));
+    EXPECT_TRUE (wait.copied);
+    EXPECT_EQ ("a", read ("dest/a"));
+    EXPECT_EQ ("c", read ("dest/sub/c"));
+}
+
+
+TEST_F(LocalXferTest, stop)
+{
+    write ("src/a", "a");
+
+    gboolean stop = TRUE;
+    LocalXfer xfer(FALSE, FALSE, LocalXfer::OVERWRITE_QUERY);
+
+    xfer.add(path("src").c_str(), path("dest/src").c_str());
+
+    EXPECT_FALSE (xfer.run(&stop));
+    EXPECT_FALSE (exists ("dest/src/a"));
+}
+
+
+TEST_F(LocalXferTest, journal)
+{
+    write ("src/a", "a");
+
+    gboolean stop = TRUE;
+    LocalXfer xfer(FALSE, FALSE, LocalXfer::OVERWRITE_QUERY);
+
+    xfer.add(path("src").c_str(), path("dest/src").c_str());
+    xfer.set_journal(path("journal").c_str());
+
+    EXPECT_FALSE (xfer.run(&stop));
+    ASSERT_TRUE (exists ("journal"));
+
+    int error = 0;
+    LocalXfer *resumed = LocalXfer::load_journal(path("journal").c_str(), &error);
+
+    ASSERT_TRUE (resumed != NULL);
+    ASSERT_EQ (1, resumed->get_items().size());
+    EXPECT_EQ (path("dest/src"), resumed->get_items()[0].second);
+
+    // the journal is locked by the transfer resumed
+    EXPECT_TRUE (LocalXfer::load_journal(path("journal").c_str(), &error) == NULL);
+    EXPECT_EQ (EBUSY, error);
+
+    EXPECT_TRUE (resumed->run());
+    EXPECT_EQ ("a", read ("dest/src/a"));
+    EXPECT_FALSE (exists ("journal"));
+
+    delete resumed;
+}
+
+
+// leaves what a transfer of src to dest/copy leaves when it is interrupted while copying big, with partial checkpointed
+void LocalXferTest::interrupt(const string &big, const string &partial)
+{
+    g_mkdir (path("dest/copy").c_str(), 0700);
+    g_mkdir (path("dest/copy/sub").c_str(), 0700);
+    write ("src/small", "small");
+    write ("src/sub/big", big);
+    write ("dest/copy/small", "small");
+    write ("dest/copy/sub/big", partial);
+
+    struct stat st;
+    struct timespec times[2];
+
+    stat (path("src/small").c_str(), &st);
+    times[0] = st.st_atim;
+    times[1] = st.st_mtim;
+    utimensat (AT_FDCWD, path("dest/copy/small").c_str(), times, 0);
+
+    stat (path("src/sub/big").c_str(), &st);
+
+    gchar *journal = g_strdup_printf ("gcmd-xfer-journal\t1\n"
+                                      "options\t0\t0\t0\n"
+                                      "item\t%s\t%s\n"
+                                      "dir\t%s\n"
+                                      "dir\t%s\n"
+                                      "done\t%s\n",
+                                      path("src").c_str(), path("dest/copy").c_str(),
+                                      path("dest/copy").c_str(),
+                                      path("dest/copy/sub").c_str(),
+                                      path("dest/copy/small").c_str());
+    string lines = journal;
+
+    g_free (journal);
+
+    // a checkpoint every 64 MiB, each with the checksum of its segment
+    for (gsize start=0; start<partial.size(); start+=64 << 20)
+    {
+        gsize end = MIN (start + (64 << 20), partial.size());
+        gchar *line = g_strdup_printf ("part\t%llu\t%llu\t%lld\t%ld\t%u\t%u\t%s\n",
+                                       (unsigned long long) end, (unsigned long long) big.size(), (long long) st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+                                       (guint) (start >> 26), LocalXfer::checksum(partial.data() + start, end - start), path("dest/copy/sub/big").c_str());
+        lines += line;
+        g_free (line);
+    }
+
+    write ("journal", lines);
+}
+
+
+TEST_F(LocalXferTest, resume_checkpoint)
+{
+    string big(6 << 20, 'x');
+
+    for (gsize i=0; i<big.size(); i+=4096)
+        big[i] = 'a' + i/4096 % 26;
+
+    // a partial copy which matches its checksums is continued, not copied again
+    string partial = big.substr(0, 3 << 20);
+    partial.replace(0, 1 << 20, 1 << 20, 'Z');
+
+    interrupt (big, partial);
+
+    LocalXfer *xfer = LocalXfer::load_journal(path("journal").c_str());
+    ASSERT_TRUE (xfer != NULL);
+
+    guint asked = 0;
+    ASSERT_TRUE (xfer->run(NULL, (LocalXfer::OverwriteFunc) replace, NULL, &asked));
+    delete xfer;
+
+    // neither the file done nor the partial copy are files to overwrite
+    EXPECT_EQ (0, asked);
+
+    string copied = read ("dest/copy/sub/big");
+    ASSERT_EQ (big.size(), copied.size());
+    EXPECT_EQ (string(1 << 20, 'Z'), copied.substr(0, 1 << 20));
+    EXPECT_TRUE (big.substr(1 << 20) == copied.substr(1 << 20));
+
+    // the directories made before get their permissions
+    struct stat st;
+    ASSERT_EQ (0, stat (path("dest/copy/sub").c_str(), &st));
+    EXPECT_EQ (0750, st.st_mode & 07777);
+
+    EXPECT_FALSE (exists ("journal"));
+}
+
+
+TEST_F(LocalXferTest, restart_on_mismatch)
+{
+    string big(6 << 20, 'x');
+
+    for (gsize i=0; i<big.size(); i+=4096)
+        big[i] = 'a' + i/4096 % 26;
+
+    interrupt (big, big.substr(0, 3 << 20));
+
+    // a torn write anywhere before the checkpoint, not only in its last MiB
+    string partial = read ("dest/copy/sub/big");
+    partial[10] = 'Z';
+    write ("dest/copy/sub/big", partial);
+
+    LocalXfer *xfer = LocalXfer::load_journal(path("journal").c_str());
+    ASSERT_TRUE (xfer != NULL);
+
+    guint asked = 0;
+    ASSERT_TRUE (xfer->run(NULL, (LocalXfer::OverwriteFunc) replace, NULL, &asked));
+    delete xfer;
+
+    EXPECT_EQ (0, asked);
+    EXPECT_TRUE (big == read ("dest/copy/sub/big"));
+}
+
+
+TEST_F(LocalXferTest, resume_segments)
+{
+    string big(72 << 20, 'x');
+
+    for (gsize i=0; i<big.size(); i+=4096)
+        big[i] = 'a' + i/4096 % 26;
+
+    // the checksum of the second segment is written after the one of the first
+    string partial = big.substr(0, 70 << 20);
+    partial[10] = 'Z';
+
+    interrupt (big, partial);
+
+    LocalXfer *xfer = LocalXfer::load_journal(path("journal").c_str());
+    ASSERT_TRUE (xfer != NULL);
+    ASSERT_TRUE (xfer->run());
+    delete xfer;
+
+    string copied = read ("dest/copy/sub/big");
+    ASSERT_EQ (big.size(), copied.size());
+    EXPECT_EQ ('Z', copied[10]);
+    EXPECT_TRUE (big.substr(11) == copied.substr(11));
+}
+
+
+TEST_F(LocalXferTest, discard)
+{
+    string big(6 << 20, 'x');
+
+    interrupt (big, big.substr(0, 3 << 20));
+
+    LocalXfer *xfer = LocalXfer::load_journal(path("journal").c_str());
+    ASSERT_TRUE (xfer != NULL);
+
+    gboolean stop = TRUE;
+    EXPECT_FALSE (xfer->run(&stop));
+    EXPECT_TRUE (exists ("dest/copy/sub/big"));
+
+    // the partial copy isn't left under the name of the file, and the files done stay
+    xfer->discard();
+    delete xfer;
+
+    EXPECT_FALSE (exists ("dest/copy/sub/big"));
+    EXPECT_FALSE (exists ("journal"));
+    EXPECT_EQ ("small", read ("dest/copy/small"));
+}
@@ -0,0 +1,267 @@
+/**
+ * @file gcmd_search_index_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks that the persistent filename index answers name searches
+ * like a walk of the file system does: after building it, after saving and
+ * loading it, after an incremental refresh, and with the changes reported
+ * by the directory monitors in between. The time of an indexed search is
+ * printed next to the time of the walk.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <set>
+#include <string>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gcmd_test_utils.h"
+#include "search-engine.h"
+
+using namespace std;
+
+
+class SearchIndexTest : public TempDirTest
+{
+  protected:
+
+    gchar *index_file;
+
+    SearchIndexTest(): TempDirTest("gcmd-index-XXXXXX"), index_file(NULL)     {}
+
+    virtual void SetUp();
+    virtual void TearDown();
+
+    gchar *path(const gchar *rel)       {  return g_build_filename (root, rel, NULL);  }
+    void touch(const gchar *rel);
+
+    set<string> walk(const gchar *pattern, Filter::Type syntax, gint max_depth=-1, const gchar *start=NULL);
+    set<string> lookup(SearchIndex &index, const gchar *pattern, Filter::Type syntax, gint max_depth=-1, const gchar *start=NULL);
+};
+
+
+void SearchIndexTest::touch(const gchar *rel)
+{
+    gchar *file = path(rel);
+    gchar *dir = g_path_get_dirname (file);
+
+    g_mkdir_with_parents (dir, 0700);
+    g_file_set_contents (file, "", 0, NULL);
+
+    g_free (dir);
+    g_free (file);
+}
+
+
+void SearchIndexTest::SetUp()
+{
+    ASSERT_NO_FATAL_FAILURE (TempDirTest::SetUp());
+
+    index_file = g_strconcat (root, ".idx", NULL);
+
+    for (guint i=0; i<10; ++i)
+        for (guint j=0; j<10; ++j)
+            for (guint n=0; n<30; ++n)
+            {
+                gchar *rel = g_strdup_printf ("dir-%u/sub-%u/%s-%02u.%s", i, j, n%2 ? "Report" : "notes", n, n%3 ? "txt" : "odt");
+                touch (rel);
+                g_free (rel);
+            }
+}
+
+
+void SearchIndexTest::TearDown()
+{
+    if (index_file)
+        g_remove (index_file);
+    g_free (index_file);
+
+    TempDirTest::TearDown();
+}
+
+
+static void add_found (const gchar *path, set<string> *found)
+{
+    found->insert(path);
+}
+
+
+set<string> SearchIndexTest::walk(const gchar *pattern, Filter::Type syntax, gint max_depth, const gchar *start)
+{
+    set<string> found;
+    gchar *start_dir = path(start ? start : "");
+
+    LocalSearch search(pattern, syntax, TRUE, max_depth, NULL, 1);
+    search.run(start_dir, (LocalSearch::FoundFunc) add_found, &found);
+
+    g_free (start_dir);
+
+    return found;
+}
+
+
+set<string> SearchIndexTest::lookup(SearchIndex &index, const gchar *pattern, Filter::Type syntax, gint max_depth, const gchar *start)
+{
+    set<string> found;
+    gchar *start_dir = path(start ? start : "");
+    NameMatcher names(pattern, syntax, TRUE);
+
+    EXPECT_TRUE (index.search(start_dir, names, max_depth, (LocalSearch::FoundFunc) add_found, &found));
+
+    g_free (start_dir);
+
+    return found;
+}
+
+
+TEST_F(SearchIndexTest, build)
+{
+    SearchIndex index(root);
+
+    index.refresh();
+
+    EXPECT_EQ (1 + 10 + 100, index.get_dirs_count());
+    EXPECT_EQ (10 + 100 + 3000, index.get_entries_count());
+
+    EXPECT_EQ (walk ("Report", Filter::TYPE_FNMATCH), lookup (index, "Report", Filter::TYPE_FNMATCH));
+    EXPECT_EQ (walk ("*.odt", Filter::TYPE_FNMATCH), lookup (index, "*.odt", Filter::TYPE_FNMATCH));
+    EXPECT_EQ (walk ("^sub-[0-3]$", Filter::TYPE_REGEX), lookup (index, "^sub-[0-3]$", Filter::TYPE_REGEX));
+    EXPECT_EQ (walk ("", Filter::TYPE_FNMATCH, 1), lookup (index, "", Filter::TYPE_FNMATCH, 1));
+    EXPECT_EQ (walk ("*.txt", Filter::TYPE_FNMATCH, 0, "dir-3/sub-4"), lookup (index, "*.txt", Filter::TYPE_FNMATCH, 0, "dir-3/sub-4"));
+
+    NameMatcher names("*", Filter::TYPE_FNMATCH, TRUE);
+    set<string> found;
+
+    EXPECT_FALSE (index.search("/nonexistent", names, -1, (LocalSearch::FoundFunc) add_found, &found));
+    EXPECT_TRUE (found.empty());
+}
+
+
+TEST_F(SearchIndexTest, save_and_load)
+{
+    SearchIndex index(root);
+
+    index.refresh();
+    ASSERT_TRUE (index.save(index_file));
+    EXPECT_FALSE (index.is_dirty());
+
+    SearchIndex loaded(root);
+
+    ASSERT_TRUE (loaded.load(index_file));
+    EXPECT_EQ (index.get_dirs_count(), loaded.get_dirs_count());
+    EXPECT_EQ (index.get_entries_count(), loaded.get_entries_count());
+    EXPECT_EQ (walk ("*notes*", Filter::TYPE_FNMATCH), lookup (loaded, "*notes*", Filter::TYPE_FNMATCH));
+
+    // the file belongs to another root
+    SearchIndex other("/tmp");
+    EXPECT_FALSE (other.load(index_file));
+
+    // a damaged file is rejected
+    gchar *data;
+    gsize len;
+
+    ASSERT_TRUE (g_file_get_contents (index_file, &data, &len, NULL));
+    ASSERT_TRUE (g_file_set_contents (index_file, data, len/2, NULL));
+    g_free (data);
+
+    SearchIndex truncated(root);
+    EXPECT_FALSE (truncated.load(index_file));
+}
+
+
+TEST_F(SearchIndexTest, refresh)
+{
+    SearchIndex index(root);
+
+    index.refresh();
+    ASSERT_TRUE (index.save(index_file));
+
+    SearchIndex loaded(root);
+    ASSERT_TRUE (loaded.load(index_file));
+
+    touch ("dir-2/sub-2/Report-new.txt");
+    touch ("dir-2/new-dir/deeper/notes-new.txt");
+    gchar *gone = path("dir-5");
+    remove_tree (gone);
+    g_free (gone);
+
+    loaded.refresh();
+
+    EXPECT_EQ (walk ("*", Filter::TYPE_FNMATCH), lookup (loaded, "*", Filter::TYPE_FNMATCH));
+    EXPECT_EQ (1 + 9 + 90 + 2, loaded.get_dirs_count());
+}
+
+
+TEST_F(SearchIndexTest, monitor_changes)
+{
+    SearchIndex index(root);
+
+    index.refresh();
+
+    touch ("dir-1/sub-1/Report-created.txt");
+    gchar *created = path("dir-1/sub-1/Report-created.txt");
+    index.add(created);
+
+    gchar *deleted = path("dir-1/sub-1/Report-01.txt");
+    g_remove (deleted);
+    index.remove(deleted);
+
+    gchar *deleted_dir = path("dir-7");
+    remove_tree (deleted_dir);
+    index.remove(deleted_dir);
+
+    EXPECT_EQ (walk ("Report", Filter::TYPE_FNMATCH), lookup (index, "Report", Filter::TYPE_FNMATCH));
+    EXPECT_EQ (walk ("", Filter::TYPE_FNMATCH, 0, "dir-1/sub-1"), lookup (index, "", Filter::TYPE_FNMATCH, 0, "dir-1/sub-1"));
+
+    // a refresh takes the changes over into the table
+    index.refresh();
+    EXPECT_EQ (walk ("*", Filter::TYPE_FNMATCH), lookup (index, "*", Filter::TYPE_FNMATCH));
+
+    g_free (deleted_dir);
+    g_free (deleted);
+    g_free (created);
+}
+
+
+TEST_F(SearchIndexTest, timing)
+{
+    SearchIndex index(root);
+
+    index.refresh();
+
+    GTimer *timer = g_timer_new ();
+    set<string> walked = walk ("Report", Filter::TYPE_FNMATCH);
+    gdouble t_walk = g_timer_elapsed (timer, NULL);
+
+    g_timer_start (timer);
+    set<string> indexed = lookup (index, "Report", Filter::TYPE_FNMATCH);
+    gdouble t_index = g_timer_elapsed (timer, NULL);
+
+    g_timer_start (timer);
+    index.refresh();
+    gdouble t_refresh = g_timer_elapsed (timer, NULL);
+
+    g_timer_destroy (timer);
+
+    printf("%6zu matches, walk: %8.4f s, index: %8.4f s, refresh: %8.4f s\n", indexed.size(), t_walk, t_index, t_refresh);
+
+    EXPECT_EQ (walked, indexed);
+}
@@ -0,0 +1,225 @@
+/**
+ * @file gcmd_table_bm_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Micro-benchmark for the collection of a directory listing.
+ * GnomeCmd::Table is timed for 100k and 1M entries, the GList path it
+ * replaced (g_list_append(), g_list_length() and g_list_remove() next to a
+ * hash table) for 5k and 50k entries, because it is quadratic and would
+ * take hours for 1M. The table is timed for 50k entries, too. Each run adds
+ * all entries, counts them, filters out every third one, the way hidden
+ * files are, removes these and counts again. The timings and the growth
+ * ratio for ten times as many entries are printed, a linear collection
+ * grows about 10 times, a quadratic one about 100 times. Nothing is
+ * asserted about the timings.
+ *
+ * It takes a while, so it isn't run by make check: run ./gcmd_table_bm.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+
+#include "gnome-cmd-table.h"
+
+using namespace std;
+
+
+struct Item
+{
+    guint n;
+    gint refs;
+};
+
+
+static gchar *get_key (Item *item)
+{
+    return g_strdup_printf ("file%u", item->n);
+}
+
+
+static void ref_item (Item *item)
+{
+    ++item->refs;
+}
+
+
+static void unref_item (Item *item)
+{
+    --item->refs;
+}
+
+
+static gboolean is_filtered (Item *item)
+{
+    return item->n % 3 == 0;
+}
+
+
+// what GnomeCmdFileCollection was before it used the table
+class ListCollection
+{
+    GHashTable *map;
+    GList *list;
+
+  public:
+
+    ListCollection()
+    {
+        map = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) unref_item);
+        list = NULL;
+    }
+
+    ~ListCollection()
+    {
+        g_hash_table_destroy (map);
+        g_list_free (list);
+    }
+
+    guint size()        {  return g_list_length (list);  }
+    GList *get_list()   {  return list;  }
+
+    void add(Item *item)
+    {
+        list = g_list_append (list, item);
+        g_hash_table_insert (map, get_key (item), item);
+        ref_item (item);
+    }
+
+    void remove(Item *item)
+    {
+        list = g_list_remove (list, item);
+
+        gchar *key = get_key (item);
+        g_hash_table_remove (map, key);
+        g_free (key);
+    }
+};
+
+
+class TableBenchmark : public ::testing::Test
+{
+  protected:
+
+    vector<Item> items;
+
+    void make_items(guint n);
+    gdouble time_table(guint n);
+    gdouble time_list(guint n);
+    void report(const gchar *name, guint n, gdouble t_small, gdouble t_large);
+};
+
+
+void TableBenchmark::make_items(guint n)
+{
+    items.assign(n, Item());
+
+    for (guint i=0; i<n; ++i)
+        items[i].n = i;
+}
+
+
+gdouble TableBenchmark::time_table(guint n)
+{
+    make_items(n);
+
+    GTimer *timer = g_timer_new ();
+    GnomeCmd::Table<Item> table(get_key, ref_item, unref_item);
+
+    for (guint i=0; i<n; ++i)
+        table.add(&items[i]);
+
+    EXPECT_EQ (n, table.size());
+
+    vector<Item *> filtered;
+
+    for (GList *i=table.get_list(); i; i=i->next)
+        if (is_filtered ((Item *) i->data))
+            filtered.push_back((Item *) i->data);
+
+    for (vector<Item *>::const_iterator i=filtered.begin(); i!=filtered.end(); ++i)
+        table.remove(*i);
+
+    EXPECT_EQ (n - filtered.size(), table.size());
+
+    gdouble elapsed = g_timer_elapsed (timer, NULL);
+
+    g_timer_destroy (timer);
+
+    return elapsed;
+}
+
+
+gdouble TableBenchmark::time_list(guint n)
+{
+    make_items(n);
+
+    GTimer *timer = g_timer_new ();
+    ListCollection collection;
+
+    for (guint i=0; i<n; ++i)
+        collection.add(&items[i]);
+
+    EXPECT_EQ (n, collection.size());
+
+    vector<Item *> filtered;
+
+    for (GList *i=collection.get_list(); i; i=i->next)
+        if (is_filtered ((Item *) i->data))
+            filtered.push_back((Item *) i->data);
+
+    for (vector<Item *>::const_iterator i=filtered.begin(); i!=filtered.end(); ++i)
+        collection.remove(*i);
+
+    EXPECT_EQ (n - filtered.size(), collection.size());
+
+    gdouble elapsed = g_timer_elapsed (timer, NULL);
+
+    g_timer_destroy (timer);
+
+    return elapsed;
+}
+
+
+void TableBenchmark::report(const gchar *name, guint n, gdouble t_small, gdouble t_large)
+{
+    printf("%-8s %8u entries: %9.4f s, %8u entries: %9.4f s, growth %.1f\n", name, n, t_small, 10*n, t_large, t_large / MAX (t_small, 1e-6));
+}
+
+
+TEST_F(TableBenchmark, glist)
+{
+    gdouble t_small = time_list(5000);
+    gdouble t_large = time_list(50000);
+    gdouble t_table = time_table(50000);
+
+    report("GList", 5000, t_small, t_large);
+    printf("%-8s %8u entries: %9.4f s, %.0f times faster\n", "table", 50000, t_table, t_large / MAX (t_table, 1e-6));
+}
+
+
+// last, the heap its million entries leave behind slows down the GList
+TEST_F(TableBenchmark, table)
+{
+    time_table(100000);                     // warm up the allocator
+
+    report("table", 100000, time_table(100000), time_table(1000000));
+}
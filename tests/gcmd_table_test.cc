@@ -0,0 +1,266 @@
+/**
+ * @file gcmd_table_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks the table behind GnomeCmdFileCollection: the table and
+ * its GList view keep the same order through adding, removing, sorting
+ * and reordering, items are found by key and by themselves, and every
+ * item added is unreferenced exactly once.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+
+#include "gnome-cmd-table.h"
+
+using namespace std;
+
+
+struct Item
+{
+    guint n;
+    gint refs;
+};
+
+
+static gchar *get_key (Item *item)
+{
+    return g_strdup_printf ("item%u", item->n);
+}
+
+
+static void ref_item (Item *item)
+{
+    ++item->refs;
+}
+
+
+static void unref_item (Item *item)
+{
+    --item->refs;
+}
+
+
+typedef GnomeCmd::Table<Item> ItemTable;
+
+
+class TableTest : public ::testing::Test
+{
+  protected:
+
+    vector<Item> items;
+
+    virtual void SetUp();
+
+    void check_order(ItemTable &table, const vector<guint> &expected);
+};
+
+
+void TableTest::SetUp()
+{
+    items.resize(1000);
+
+    for (guint i=0; i<items.size(); ++i)
+    {
+        items[i].n = i;
+        items[i].refs = 0;
+    }
+}
+
+
+// the table, its GList view and the lookups by key agree
+void TableTest::check_order(ItemTable &table, const vector<guint> &expected)
+{
+    ASSERT_EQ (expected.size(), table.size());
+    ASSERT_EQ (expected.size(), g_list_length (table.get_list()));
+
+    GList *l = table.get_list();
+    guint n = 0;
+
+    for (ItemTable::const_iterator i=table.begin(); i!=table.end(); ++i, l=l->next, ++n)
+    {
+        EXPECT_EQ (expected[n], (*i)->n);
+        EXPECT_EQ (*i, l->data);
+        EXPECT_EQ (*i, table[n]);
+
+        gchar *key = get_key (*i);
+        EXPECT_EQ (*i, table.find(key));
+        g_free (key);
+    }
+}
+
+
+static gint compare_parity (Item *a, Item *b, gpointer unused)
+{
+    return (gint) (a->n % 2) - (gint) (b->n % 2);
+}
+
+
+TEST_F(TableTest, add_and_remove)
+{
+    ItemTable table(get_key, ref_item, unref_item);
+    vector<guint> expected;
+
+    for (guint i=0; i<items.size(); ++i)
+    {
+        table.add(&items[i]);
+        expected.push_back(i);
+    }
+
+    check_order (table, expected);
+
+    // remove every third item, by key and by itself in turn, which squeezes the holes out on the way
+    expected.clear();
+
+    for (guint i=0; i<items.size(); ++i)
+        if (i % 3)
+            expected.push_back(i);
+        else
+            if (i % 2)
+                EXPECT_TRUE (table.remove(&items[i]));
+            else
+            {
+                gchar *key = get_key (&items[i]);
+                EXPECT_TRUE (table.remove(key));
+                g_free (key);
+            }
+
+    EXPECT_FALSE (table.remove(&items[0]));
+    EXPECT_FALSE (table.remove("item0"));
+    EXPECT_TRUE (table.find("item0") == NULL);
+    EXPECT_FALSE (table.contain(&items[0]));
+    EXPECT_TRUE (table.contain(&items[1]));
+    EXPECT_EQ (0, items[0].refs);
+    EXPECT_EQ (1, items[1].refs);
+
+    check_order (table, expected);
+
+    // the tail is still right for appending
+    table.add(&items[0]);
+    expected.push_back(0);
+    check_order (table, expected);
+}
+
+
+TEST_F(TableTest, remove_the_last)
+{
+    ItemTable table(get_key, ref_item, unref_item);
+
+    table.add(&items[0]);
+    table.add(&items[1]);
+    EXPECT_TRUE (table.remove(&items[1]));
+    table.add(&items[2]);
+    EXPECT_TRUE (table.remove(&items[0]));
+    EXPECT_TRUE (table.remove(&items[2]));
+
+    EXPECT_TRUE (table.empty());
+    EXPECT_TRUE (table.get_list() == NULL);
+
+    table.add(&items[3]);
+
+    vector<guint> expected(1, 3);
+    check_order (table, expected);
+}
+
+
+TEST_F(TableTest, replace)
+{
+    ItemTable table(get_key, ref_item, unref_item);
+    Item twin = {1, 0};
+
+    table.add(&items[0]);
+    table.add(&items[1]);
+    table.add(&items[2]);
+
+    // the same key replaces the old item, the same item moves to the end
+    table.add(&twin);
+    table.add(&items[0]);
+
+    EXPECT_EQ (&twin, table.find("item1"));
+    EXPECT_EQ (0, items[1].refs);
+    EXPECT_EQ (1, items[0].refs);
+
+    vector<guint> expected;
+    expected.push_back(2);
+    expected.push_back(1);
+    expected.push_back(0);
+    check_order (table, expected);
+}
+
+
+TEST_F(TableTest, sort_and_reorder)
+{
+    ItemTable table(get_key, ref_item, unref_item);
+
+    for (guint i=0; i<10; ++i)
+        table.add(&items[i]);
+
+    table.remove(&items[4]);
+
+    GList *link = g_list_nth (table.get_list(), 2);
+
+    // stable, so the even items keep their order
+    table.sort((GCompareDataFunc) compare_parity, NULL);
+
+    guint sorted[] = {0, 2, 6, 8, 1, 3, 5, 7, 9};
+    check_order (table, vector<guint>(sorted, sorted+G_N_ELEMENTS(sorted)));
+
+    // the nodes of the GList view are reused
+    EXPECT_EQ (link, g_list_nth (table.get_list(), 2));
+
+    vector<Item *> reversed(table.begin(), table.end());
+    std::reverse (reversed.begin(), reversed.end());
+    table.reorder(reversed);
+
+    guint reordered[] = {9, 7, 5, 3, 1, 8, 6, 2, 0};
+    check_order (table, vector<guint>(reordered, reordered+G_N_ELEMENTS(reordered)));
+
+    // the moved items are removed from the right places
+    table.remove(&items[1]);
+    table.remove(&items[9]);
+
+    guint left[] = {7, 5, 3, 8, 6, 2, 0};
+    check_order (table, vector<guint>(left, left+G_N_ELEMENTS(left)));
+}
+
+
+TEST_F(TableTest, references)
+{
+    {
+        ItemTable table(get_key, ref_item, unref_item);
+
+        table.add(&items[0]);
+        table.add(&items[1]);
+        table.clear();
+
+        EXPECT_EQ (0, items[0].refs);
+        EXPECT_TRUE (table.empty());
+
+        table.add(&items[2]);
+        table.add(&items[3]);
+        table.remove(&items[2]);
+        EXPECT_EQ (1, items[3].refs);
+    }
+
+    for (guint i=0; i<items.size(); ++i)
+        EXPECT_EQ (0, items[i].refs);
+}
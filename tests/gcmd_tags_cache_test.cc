@@ -0,0 +1,179 @@
+/**
+ * @file gcmd_tags_cache_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks that the persistent metadata cache finds what has been
+ * stored for a file only as long as the file is unchanged, drops the least
+ * recently used entries beyond its size limit, and survives saving and
+ * loading while rejecting damaged files.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+
+#include "gcmd_test_utils.h"
+#include "tags/gnome-cmd-tags-cache.h"
+
+using namespace std;
+
+
+class MetadataCacheTest : public TempDirTest
+{
+  protected:
+
+    gchar *cache_file;
+
+    MetadataCacheTest(): TempDirTest("gcmd-metadata-XXXXXX"), cache_file(NULL)     {}
+
+    virtual void SetUp();
+    virtual void TearDown();
+};
+
+
+void MetadataCacheTest::SetUp()
+{
+    ASSERT_NO_FATAL_FAILURE (TempDirTest::SetUp());
+
+    cache_file = g_build_filename (root, "metadata-cache.db", NULL);
+}
+
+
+void MetadataCacheTest::TearDown()
+{
+    g_free (cache_file);
+
+    TempDirTest::TearDown();
+}
+
+
+static const gchar EXIF_MODEL[] = "tExif.Model\0Camera";
+
+
+static string value(guint n)
+{
+    return string(100, 'a' + n%26);
+}
+
+
+TEST_F(MetadataCacheTest, lookup)
+{
+    MetadataCache cache(1 << 20);
+    string data;
+
+    cache.insert(MetadataCache::Key(1, 42, 1000, 5000), string(EXIF_MODEL, sizeof(EXIF_MODEL)));
+
+    ASSERT_TRUE (cache.lookup(MetadataCache::Key(1, 42, 1000, 5000), data));
+    EXPECT_EQ (string(EXIF_MODEL, sizeof(EXIF_MODEL)), data);
+
+    // the same inode after a change of the file, or on another device
+    EXPECT_FALSE (cache.lookup(MetadataCache::Key(1, 42, 1001, 5000), data));
+    EXPECT_FALSE (cache.lookup(MetadataCache::Key(1, 42, 1000, 5001), data));
+    EXPECT_FALSE (cache.lookup(MetadataCache::Key(2, 42, 1000, 5000), data));
+
+    cache.insert(MetadataCache::Key(1, 42, 1000, 5000), "other");
+    EXPECT_EQ (1, cache.get_count());
+    EXPECT_EQ (5, cache.get_size());
+}
+
+
+TEST_F(MetadataCacheTest, eviction)
+{
+    MetadataCache cache(100 * 100);
+    string data;
+
+    for (guint n=0; n<100; ++n)
+        cache.insert(MetadataCache::Key(1, n, 0, 0), value(n));
+
+    // the first one is used again, so the second one is the least recently used
+    ASSERT_TRUE (cache.lookup(MetadataCache::Key(1, 0, 0, 0), data));
+
+    cache.insert(MetadataCache::Key(1, 100, 0, 0), value(100));
+
+    EXPECT_LE (cache.get_size(), 100 * 100 / 4 * 3);
+    EXPECT_TRUE (cache.lookup(MetadataCache::Key(1, 0, 0, 0), data));
+    EXPECT_FALSE (cache.lookup(MetadataCache::Key(1, 1, 0, 0), data));
+    EXPECT_TRUE (cache.lookup(MetadataCache::Key(1, 100, 0, 0), data));
+}
+
+
+TEST_F(MetadataCacheTest, use_is_saved)
+{
+    MetadataCache cache(100 * 100);
+    string data;
+
+    for (guint n=0; n<100; ++n)
+        cache.insert(MetadataCache::Key(1, n, 0, 0), value(n));
+
+    ASSERT_TRUE (cache.save(cache_file));
+
+    // using an entry changes its age, which has to be saved again
+    ASSERT_TRUE (cache.lookup(MetadataCache::Key(1, 0, 0, 0), data));
+    EXPECT_TRUE (cache.is_dirty());
+    ASSERT_TRUE (cache.save(cache_file));
+
+    MetadataCache loaded(100 * 100);
+
+    ASSERT_TRUE (loaded.load(cache_file));
+    loaded.insert(MetadataCache::Key(1, 100, 0, 0), value(100));
+
+    EXPECT_TRUE (loaded.lookup(MetadataCache::Key(1, 0, 0, 0), data));
+    EXPECT_FALSE (loaded.lookup(MetadataCache::Key(1, 1, 0, 0), data));
+}
+
+
+TEST_F(MetadataCacheTest, save_and_load)
+{
+    MetadataCache cache(1 << 20);
+
+    for (guint n=0; n<1000; ++n)
+        cache.insert(MetadataCache::Key(1, n, n, n+1), value(n));
+
+    EXPECT_TRUE (cache.is_dirty());
+    ASSERT_TRUE (cache.save(cache_file));
+    EXPECT_FALSE (cache.is_dirty());
+
+    MetadataCache loaded(1 << 20);
+    string data;
+
+    // an entry inserted before the file is loaded is newer than the one of the file
+    loaded.insert(MetadataCache::Key(1, 7, 7, 8), "newer");
+
+    ASSERT_TRUE (loaded.load(cache_file));
+    EXPECT_EQ (1000, loaded.get_count());
+    ASSERT_TRUE (loaded.lookup(MetadataCache::Key(1, 7, 7, 8), data));
+    EXPECT_EQ ("newer", data);
+    ASSERT_TRUE (loaded.lookup(MetadataCache::Key(1, 999, 999, 1000), data));
+    EXPECT_EQ (value(999), data);
+
+    // a damaged file is rejected
+    gchar *contents;
+    gsize len;
+
+    ASSERT_TRUE (g_file_get_contents (cache_file, &contents, &len, NULL));
+    ASSERT_TRUE (g_file_set_contents (cache_file, contents, len/2, NULL));
+    g_free (contents);
+
+    MetadataCache truncated(1 << 20);
+    EXPECT_FALSE (truncated.load(cache_file));
+    EXPECT_EQ (0, truncated.get_count());
+
+    EXPECT_FALSE (truncated.load("/nonexistent"));
+}
@@ -0,0 +1,77 @@
+/**
+ * @file gcmd_test_utils.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Helpers shared by the tests working on real files.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+
+#include "gcmd_test_utils.h"
+
+
+void remove_tree (const gchar *path)
+{
+    struct stat st;
+
+    if (lstat (path, &st)!=0)
+        return;
+
+    // symlinks are removed, not followed
+    if (S_ISDIR (st.st_mode))
+    {
+        g_chmod (path, 0700);
+
+        GDir *dir = g_dir_open (path, 0, NULL);
+
+        if (dir)
+        {
+            const gchar *name;
+
+            while ((name = g_dir_read_name (dir)))
+            {
+                gchar *child = g_build_filename (path, name, NULL);
+                remove_tree (child);
+                g_free (child);
+            }
+
+            g_dir_close (dir);
+        }
+    }
+
+    g_remove (path);
+}
+
+
+void TempDirTest::SetUp()
+{
+    root = g_dir_make_tmp (tmpl, NULL);
+    ASSERT_TRUE (root != NULL);
+}
+
+
+void TempDirTest::TearDown()
+{
+    if (root)
+        remove_tree (root);
+    g_free (root);
+    root = NULL;
+}
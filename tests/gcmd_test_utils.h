@@ -0,0 +1,57 @@
+/**
+ * @file gcmd_test_utils.h
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Helpers shared by the tests working on real files.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GCMD_TEST_UTILS_H__
+#define __GCMD_TEST_UTILS_H__
+
+#include "gtest/gtest.h"
+#include <glib.h>
+
+
+// removes path and everything below it, even the directories a test has made read-only
+void remove_tree (const gchar *path);
+
+
+/**
+ * A fixture working in a temporary directory, root, which is made before
+ * each test and removed with its contents afterwards. Fixtures deriving
+ * from it call TempDirTest::SetUp() and TempDirTest::TearDown() from their
+ * own ones.
+ */
+class TempDirTest : public ::testing::Test
+{
+  protected:
+
+    gchar *root;
+
+    explicit TempDirTest(const gchar *tmpl): root(NULL), tmpl(tmpl)     {}
+
+    virtual void SetUp();
+    virtual void TearDown();
+
+  private:
+
+    const gchar *tmpl;                  // for g_dir_make_tmp()
+};
+
+#endif // __GCMD_TEST_UTILS_H__
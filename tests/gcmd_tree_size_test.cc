@@ -0,0 +1,232 @@
+/**
+ * @file gcmd_tree_size_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks the tree size service against a plain recursive walk,
+ * the counting of hard linked files, the reuse of cached directories and
+ * stopping a calculation. The time of the first and of a cached
+ * calculation is printed next to the time of the walk.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gcmd_test_utils.h"
+#include "tree-size.h"
+
+using namespace std;
+
+
+class TreeSizeTest : public TempDirTest
+{
+  protected:
+
+    TreeSizeTest(): TempDirTest("gcmd-tree-size-XXXXXX")     {}
+
+    virtual void SetUp();
+
+    gchar *path(const gchar *rel)       {  return g_build_filename (root, rel, NULL);  }
+    void write(const gchar *rel, gsize size);
+};
+
+
+// the size of a tree the way calc_tree_size() used to compute it, without caring about hard links
+static void walk (const gchar *path, TreeSize &total)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+
+    if (!dir)
+        return;
+
+    ++total.count;
+
+    const gchar *name;
+
+    while ((name = g_dir_read_name (dir)))
+    {
+        gchar *child = g_build_filename (path, name, NULL);
+        struct stat st;
+
+        if (lstat (child, &st) == 0)
+        {
+            if (S_ISDIR (st.st_mode))
+                walk (child, total);
+            else
+            {
+                total.size += st.st_size;
+                ++total.count;
+            }
+        }
+
+        g_free (child);
+    }
+
+    g_dir_close (dir);
+}
+
+
+void TreeSizeTest::write(const gchar *rel, gsize size)
+{
+    gchar *file = path(rel);
+    gchar *dir = g_path_get_dirname (file);
+    gchar *content = (gchar *) g_malloc0 (size + 1);
+
+    g_mkdir_with_parents (dir, 0700);
+    g_file_set_contents (file, content, size, NULL);
+
+    g_free (content);
+    g_free (dir);
+    g_free (file);
+}
+
+
+void TreeSizeTest::SetUp()
+{
+    ASSERT_NO_FATAL_FAILURE (TempDirTest::SetUp());
+
+    for (guint i=0; i<20; ++i)
+        for (guint j=0; j<10; ++j)
+            for (guint n=0; n<20; ++n)
+            {
+                gchar *rel = g_strdup_printf ("dir-%u/sub-%u/file-%u", i, j, n);
+                write (rel, i*j*n % 4099);
+                g_free (rel);
+            }
+}
+
+
+static void count_progress (const TreeSize &done, guint *calls)
+{
+    g_atomic_int_inc ((gint *) calls);
+}
+
+
+TEST_F(TreeSizeTest, same_as_walk)
+{
+    TreeSizeService service;
+    TreeSize expected, result;
+    guint calls = 0;
+
+    walk (root, expected);
+
+    ASSERT_TRUE (service.calc(root, result, NULL, (TreeSizeService::ProgressFunc) count_progress, &calls));
+
+    EXPECT_EQ (expected.size, result.size);
+    EXPECT_EQ (expected.count, result.count);
+    EXPECT_EQ (1 + 20 + 200, calls);
+
+    gchar *file = path("dir-3/sub-4/file-5");
+    ASSERT_TRUE (service.calc(file, result));
+    EXPECT_EQ (3*4*5, result.size);
+    EXPECT_EQ (1, result.count);
+    g_free (file);
+
+    EXPECT_FALSE (service.calc("/nonexistent/directory", result));
+}
+
+
+TEST_F(TreeSizeTest, hard_links)
+{
+    TreeSizeService service;
+    TreeSize before, after;
+
+    write ("links/original", 10000);
+
+    ASSERT_TRUE (service.calc(root, before));
+
+    gchar *original = path("links/original");
+    gchar *link1 = path("links/link");
+    gchar *link2 = path("dir-1/link");
+
+    ASSERT_EQ (0, link (original, link1));
+    ASSERT_EQ (0, link (original, link2));
+
+    ASSERT_TRUE (service.calc(root, after));
+
+    EXPECT_EQ (before.size, after.size);
+    EXPECT_EQ (before.count, after.count);
+
+    g_free (link2);
+    g_free (link1);
+    g_free (original);
+}
+
+
+TEST_F(TreeSizeTest, cache)
+{
+    TreeSizeService service;
+    TreeSize first, second, changed, expected;
+
+    GTimer *timer = g_timer_new ();
+    walk (root, expected);
+    gdouble t_walk = g_timer_elapsed (timer, NULL);
+
+    g_timer_start (timer);
+    ASSERT_TRUE (service.calc(root, first));
+    gdouble t_first = g_timer_elapsed (timer, NULL);
+
+    g_timer_start (timer);
+    ASSERT_TRUE (service.calc(root, second));
+    gdouble t_second = g_timer_elapsed (timer, NULL);
+
+    g_timer_destroy (timer);
+
+    printf("%6llu files, walk: %8.4f s, service: %8.4f s, cached: %8.4f s\n", (unsigned long long) first.count, t_walk, t_first, t_second);
+
+    EXPECT_EQ (1 + 20 + 200, service.get_cache_size());
+    EXPECT_EQ (first.size, second.size);
+    EXPECT_EQ (first.count, second.count);
+
+    // a new file changes the mtime of its directory
+    write ("dir-7/sub-7/new-file", 777);
+    ASSERT_TRUE (service.calc(root, changed));
+    EXPECT_EQ (first.size + 777, changed.size);
+    EXPECT_EQ (first.count + 1, changed.count);
+
+    // a file growing in place doesn't, until its directory is forgotten
+    gchar *dir = path("dir-7/sub-7");
+    gchar *file = path("dir-7/sub-7/new-file");
+
+    ASSERT_EQ (0, truncate (file, 1000));
+    ASSERT_TRUE (service.calc(root, changed));
+    EXPECT_EQ (first.size + 777, changed.size);
+
+    service.forget(dir);
+    ASSERT_TRUE (service.calc(root, changed));
+    EXPECT_EQ (first.size + 1000, changed.size);
+
+    g_free (file);
+    g_free (dir);
+}
+
+
+TEST_F(TreeSizeTest, stop)
+{
+    TreeSizeService service;
+    TreeSize result;
+    gboolean stop = TRUE;
+
+    EXPECT_FALSE (service.calc(root, result, &stop));
+    EXPECT_EQ (0, result.count);
+}
@@ -0,0 +1,152 @@
+/**
+ * @file gcmd_xfer_queue_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks that the transfer queue runs transfers on different
+ * devices side by side, keeps the transfers on one device within its
+ * limit, lets transfers overtake one waiting for its devices, and follows
+ * pausing and reordering.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <sys/sysmacros.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include <glib.h>
+
+#include "xfer-queue.h"
+
+using namespace std;
+
+
+static guint test_limit (const string &device)
+{
+    return device=="ssd" ? 2 : 1;
+}
+
+
+static vector<string> devices (const gchar *first, const gchar *second=NULL)
+{
+    vector<string> v(1, first);
+
+    if (second)
+        v.push_back(second);
+
+    return v;
+}
+
+
+static gint a, b, c, d;
+
+
+TEST(XferQueueTest, one_device)
+{
+    XferQueue queue(test_limit);
+
+    queue.add(&a, devices ("hdd"));
+    queue.add(&b, devices ("hdd", "hdd"));
+
+    EXPECT_EQ (&a, queue.next());
+    EXPECT_EQ (NULL, queue.next());
+    EXPECT_TRUE (queue.is_running(&a));
+    EXPECT_FALSE (queue.is_running(&b));
+
+    queue.remove(&a);
+
+    EXPECT_EQ (&b, queue.next());
+    EXPECT_EQ (1, queue.size());
+
+    // two places on the solid state disk
+    queue.add(&c, devices ("ssd"));
+    queue.add(&d, devices ("ssd"));
+    queue.add(&a, devices ("ssd"));
+
+    EXPECT_EQ (&c, queue.next());
+    EXPECT_EQ (&d, queue.next());
+    EXPECT_EQ (NULL, queue.next());
+}
+
+
+TEST(XferQueueTest, overtaking)
+{
+    XferQueue queue(test_limit);
+
+    queue.add(&a, devices ("hdd1", "hdd2"));
+    queue.add(&b, devices ("hdd1", "hdd3"));
+    queue.add(&c, devices ("hdd4"));
+
+    // b waits for hdd1, c doesn't wait for b
+    EXPECT_EQ (&a, queue.next());
+    EXPECT_EQ (&c, queue.next());
+    EXPECT_EQ (NULL, queue.next());
+
+    queue.remove(&a);
+
+    EXPECT_EQ (&b, queue.next());
+}
+
+
+TEST(XferQueueTest, pause_and_move)
+{
+    XferQueue queue(test_limit);
+
+    queue.add(&a, devices ("hdd"));
+    queue.add(&b, devices ("hdd"));
+    queue.add(&c, devices ("hdd"));
+    queue.add(&d, devices ("hdd"));
+
+    EXPECT_EQ (&a, queue.next());
+
+    // a keeps its device while it is paused
+    queue.set_paused(&a, TRUE);
+    EXPECT_TRUE (queue.is_paused(&a));
+    EXPECT_EQ (NULL, queue.next());
+
+    queue.set_paused(&b, TRUE);
+    queue.move(&d, 1);
+
+    EXPECT_EQ (1, queue.find(&d));
+    EXPECT_EQ (2, queue.find(&b));
+    EXPECT_EQ (-1, queue.find(NULL));
+
+    queue.remove(&a);
+
+    EXPECT_EQ (&d, queue.next());
+
+    queue.remove(&d);
+
+    // b is paused
+    EXPECT_EQ (&c, queue.next());
+
+    queue.remove(&c);
+    EXPECT_EQ (NULL, queue.next());
+
+    queue.set_paused(&b, FALSE);
+    EXPECT_EQ (&b, queue.next());
+}
+
+
+TEST(XferQueueTest, device_limit)
+{
+    EXPECT_EQ ("dev:8:1", XferQueue::local_device(makedev (8, 1)));
+    EXPECT_EQ (2, XferQueue::device_limit("sftp://host"));
+    EXPECT_EQ (2, XferQueue::device_limit(XferQueue::local_device(makedev (0, 42))));
+}
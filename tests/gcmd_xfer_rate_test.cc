@@ -0,0 +1,83 @@
+/**
+ * @file gcmd_xfer_rate_test.cc
+ * @brief Part of GNOME Commander - A GNOME based file manager
+ *
+ * @details Checks that the transfer rate estimator starts with the
+ * first measured rate, follows a change of speed smoothly, and computes
+ * the remaining time from the bytes or, without bytes left, the files.
+ *
+ * @copyright (C) 2013-2017 Uwe Scholz\n
+ *
+ * @copyright This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * @copyright This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * @copyright You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "gtest/gtest.h"
+#include <glib.h>
+
+#include "xfer-rate.h"
+
+
+TEST(XferRateTest, first_rate)
+{
+    XferRate rate;
+
+    rate.update(10.0, 0, 0);
+    EXPECT_FALSE (rate.is_known());
+    EXPECT_EQ (-1, rate.get_eta(1000, 1));
+
+    // too close to the start to tell anything
+    rate.update(10.1, 100, 1);
+    EXPECT_FALSE (rate.is_known());
+
+    rate.update(12.0, 2000, 10);
+    ASSERT_TRUE (rate.is_known());
+    EXPECT_DOUBLE_EQ (1000.0, rate.get_bytes_per_sec());
+    EXPECT_DOUBLE_EQ (5.0, rate.get_files_per_sec());
+
+    EXPECT_EQ (3, rate.get_eta(3000, 100));
+    EXPECT_EQ (20, rate.get_eta(0, 100));
+    EXPECT_EQ (0, rate.get_eta(0, 0));
+}
+
+
+TEST(XferRateTest, change_of_speed)
+{
+    XferRate rate(5.0);
+    guint64 bytes = 0;
+
+    rate.update(0.0, bytes, 0);
+
+    for (guint t=1; t<=10; ++t)
+        rate.update(t, bytes += 1000, 0);
+
+    EXPECT_DOUBLE_EQ (1000.0, rate.get_bytes_per_sec());
+
+    // the speed doubles, the estimate moves towards it without jumping
+    rate.update(11.0, bytes += 2000, 0);
+    EXPECT_GT (rate.get_bytes_per_sec(), 1000.0);
+    EXPECT_LT (rate.get_bytes_per_sec(), 1500.0);
+
+    for (guint t=12; t<=60; ++t)
+        rate.update(t, bytes += 2000, 0);
+
+    EXPECT_NEAR (2000.0, rate.get_bytes_per_sec(), 1.0);
+
+    // a stall lets the rate fade, until the time left is unknown
+    for (guint t=61; t<=600; ++t)
+        rate.update(t, bytes, 0);
+
+    EXPECT_LT (rate.get_bytes_per_sec(), 1e-30);
+    EXPECT_EQ (-1, rate.get_eta(1000, 0));
+}
@@ -26,11 +26,14 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <unistd.h>
+
 #include "gtest/gtest.h"
-#include <bm_byte.h>
+#include <libgviewer.h>
 #include <gvtypes.h>
 #include <viewer-utils.h>
 #include <bm_chartype.h>
+#include <glib/gstdio.h>
 
 /**
  *  The fixture for testing class BmByteTest.
@@ -64,57 +67,24 @@ class BmByteTest : public ::testing::Test {
 ////////////////////////////////////////////////////////////////////////
 
 /**
- * In this test a short pattern of integers is searched inside a 
- * bigger array of integers.
+ * In this test a short pattern of integers is searched inside a
+ * bigger array of integers, forwards and backwards.
  * (see definitions in @link BmByteTest @endlink)
  */
 TEST_F(BmByteTest, match_test) {
 
-    GViewerBMByteData *data;
-    int expected_good_data[7] {5, 5, 5, 5, 5, 7, 1};
-    int expected_bad_data[4] {1, 5, 4, 3,};
-
-    data = create_bm_byte_data(pattern,sizeof(pattern));
-
-    printf("Good suffices table:\n");
-    for (int i = 0; i < data->pattern_len; i++)
-    {
-        ASSERT_EQ(data->good[i], expected_good_data[i]) << "Vectors data->good and expected_good_data differ at index " << i;
-
-        printf("%d ", data->good[i]);
-    }
-    printf("\n\n");
-
-    printf("Bad characters table:\nChar(ASCII)\tValue\n");
-    for (int i = 0, j = 0; i < 256; i++)
-    {
-        if (data->bad[i] != data->pattern_len)
-        {
-            ASSERT_EQ(data->bad[i], expected_bad_data[j]) << "Vectors data->bad and expected_bad_data differ at index " << j;
-            j++;
-            printf("%c(%d)\t\t%d\n",i , i, data->bad[i]);
-        }
-    }
-    printf("(All other characters have value of %d)\n\n", data->pattern_len);
-
-    // Do the actual search: The test search should find a match at 
+    // The test search should find a match at
     // position 142 and 248, nowhere else in the sample text.
-    int m = data->pattern_len;
-    int n = sizeof(text);
-    int i; 
-    int j = 0;
-    while (j <= n - m) {
-        for (i = m - 1; i >= 0 && pattern[i] == text[i + j]; --i);
-        if (i < 0) {
-            printf(" Found match at offset = %d\n", j);
-            ASSERT_TRUE(j == 142 || j == 248);
-            j += data->good[0];
-        }
-        else
-            j += MAX(data->good[i], data->bad[(int)text[i + j]] - m + 1 + i);
-    }
+    gssize first = mem_find(text, sizeof(text), pattern, sizeof(pattern));
+    ASSERT_EQ(142, first);
 
-    free_bm_byte_data(data);
+    gssize next = mem_find(text + first + 1, sizeof(text) - first - 1, pattern, sizeof(pattern));
+    ASSERT_NE(-1, next);
+    EXPECT_EQ(248, first + 1 + next);
+    EXPECT_EQ(-1, mem_find(text + 249, sizeof(text) - 249, pattern, sizeof(pattern)));
+
+    EXPECT_EQ(248, mem_find_last(text, sizeof(text), pattern, sizeof(pattern)));
+    EXPECT_EQ(142, mem_find_last(text, 248 + sizeof(pattern) - 1, pattern, sizeof(pattern)));
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -188,3 +158,145 @@ TEST_F(BmByteTest, chartype_test) {
     g_free(ct_text);
     free_bm_chartype_data(data);
 }
+
+////////////////////////////////////////////////////////////////////////
+
+/**
+ * The fixture for measuring the throughput of the viewer's searcher:
+ * a text file of 8 MiB, with the searched text at a known offset near its end.
+ */
+class SearcherBenchmark : public ::testing::Test
+{
+  protected:
+
+    gchar *file_path;
+    offset_type size;
+    offset_type needle_offset;
+    ViewerFileOps *fops;
+    GVInputModesData *imd;
+
+    virtual void SetUp();
+    virtual void TearDown();
+
+    offset_type search_text(const gchar *input_mode, const gchar *text, gboolean case_sensitive, gboolean forward, offset_type start);
+    offset_type search_hex(const guint8 *buffer, guint buflen, offset_type start);
+    void report(const gchar *what, gdouble elapsed);
+};
+
+
+void SearcherBenchmark::SetUp()
+{
+    GString *content = g_string_sized_new (8 << 20);
+
+    for (guint line=0; content->len < (8 << 20); ++line)
+        g_string_append_printf (content, "line %u of the text, neither a needl nor an eedl\xc3\xa9 is here\n", line);
+
+    // the control character is shown, and searched for, as '.'
+    needle_offset = content->len - 1000;
+    memcpy (content->str + needle_offset, "Needle\x01in a haystack", 22);
+    size = content->len;
+
+    gint fd = g_file_open_tmp ("gcmd-search-XXXXXX", &file_path, NULL);
+    ASSERT_NE (-1, fd);
+    ASSERT_EQ ((ssize_t) size, write (fd, content->str, size));
+    close (fd);
+    g_string_free (content, TRUE);
+
+    fops = gv_fileops_new();
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+
+    imd = gv_input_modes_new();
+    gv_init_input_modes(imd, (get_byte_proc) gv_file_get_byte, fops);
+    gv_set_input_modes_range_proc(imd, (get_range_proc) gv_file_get_range);
+}
+
+
+void SearcherBenchmark::TearDown()
+{
+    gv_free_input_modes(imd);
+    g_free(imd);
+    gv_file_free(fops);
+    g_free(fops);
+    g_unlink (file_path);
+    g_free (file_path);
+}
+
+
+offset_type SearcherBenchmark::search_text(const gchar *input_mode, const gchar *text, gboolean case_sensitive, gboolean forward, offset_type start)
+{
+    gv_set_input_mode(imd, input_mode);
+
+    GViewerSearcher *searcher = g_viewer_searcher_new();
+    g_viewer_searcher_setup_new_text_search(searcher, imd, start, size, text, case_sensitive);
+    g_viewer_searcher_start_search(searcher, forward);
+    g_viewer_searcher_join(searcher);
+
+    offset_type result = g_viewer_searcher_get_end_of_search(searcher) ? INVALID_OFFSET : g_viewer_searcher_get_search_result(searcher);
+
+    g_object_unref (searcher);
+
+    return result;
+}
+
+
+offset_type SearcherBenchmark::search_hex(const guint8 *buffer, guint buflen, offset_type start)
+{
+    GViewerSearcher *searcher = g_viewer_searcher_new();
+    g_viewer_searcher_setup_new_hex_search(searcher, imd, start, size, buffer, buflen);
+    g_viewer_searcher_start_search(searcher, TRUE);
+    g_viewer_searcher_join(searcher);
+
+    offset_type result = g_viewer_searcher_get_end_of_search(searcher) ? INVALID_OFFSET : g_viewer_searcher_get_search_result(searcher);
+
+    g_object_unref (searcher);
+
+    return result;
+}
+
+
+void SearcherBenchmark::report(const gchar *what, gdouble elapsed)
+{
+    printf("%-40s %8.4f s, %8.1f MiB/s\n", what, elapsed, needle_offset / elapsed / (1 << 20));
+}
+
+
+TEST_F(SearcherBenchmark, text_search)
+{
+    GTimer *timer = g_timer_new ();
+
+    // these are searched for in the bytes of the file
+    g_timer_start (timer);
+    EXPECT_EQ (needle_offset, search_text("UTF8", "Needle", TRUE, TRUE, 0));
+    report("UTF-8 text", g_timer_elapsed (timer, NULL));
+
+    g_timer_start (timer);
+    EXPECT_EQ (needle_offset, search_text("ASCII", "NEEDLE", FALSE, TRUE, 0));
+    report("ASCII text, ignoring case", g_timer_elapsed (timer, NULL));
+
+    g_timer_start (timer);
+    EXPECT_EQ (needle_offset + 6, search_text("UTF8", "needle", FALSE, FALSE, size));
+    report("UTF-8 text, backwards", g_timer_elapsed (timer, NULL));
+
+    // and this one with Boyer-Moore on the characters, as the '.' stands for any control character
+    g_timer_start (timer);
+    EXPECT_EQ (needle_offset, search_text("ASCII", "Needle.in", TRUE, TRUE, 0));
+    report("ASCII text with '.', by characters", g_timer_elapsed (timer, NULL));
+
+    EXPECT_EQ (INVALID_OFFSET, search_text("UTF8", "Needle", TRUE, TRUE, needle_offset + 1));
+    EXPECT_EQ (INVALID_OFFSET, search_text("UTF8", "needle", TRUE, TRUE, 0));
+
+    g_timer_destroy (timer);
+}
+
+
+TEST_F(SearcherBenchmark, hex_search)
+{
+    const guint8 pattern[] = {'N', 'e', 'e', 'd', 'l', 'e', 0x01};
+
+    GTimer *timer = g_timer_new ();
+
+    EXPECT_EQ (needle_offset, search_hex(pattern, sizeof(pattern), 0));
+    report("hex", g_timer_elapsed (timer, NULL));
+
+    g_timer_destroy (timer);
+}
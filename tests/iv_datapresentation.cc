@@ -21,7 +21,12 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <unistd.h>
+
 #include <libgviewer.h>
+#include <gvtypes.h>
+#include <fileops.h>
+#include <glib/gstdio.h>
 #include "gtest/gtest.h"
 
 const gchar *filename = "../INSTALL";
@@ -44,7 +49,225 @@ TEST_P(DataPresentationEncodingTest, gv_set_data_presentation_mode_test) {
     g_free(dp);
 }
 
+
 ////////////////////////////////////////////////////////////////////////
 
+// A text file of about 1 MiB with short, long and very long lines, tabs, CR/LF and UTF-8 characters
+class LineIndexTest : public ::testing::TestWithParam<PRESENTATION>
+{
+  protected:
+
+    gchar *file_path;
+    ViewerFileOps *fops;
+    GVInputModesData *imd;
+    offset_type size;
+
+    virtual void SetUp();
+    virtual void TearDown();
+
+    GVDataPresentation *new_presentation();
+};
+
+
+INSTANTIATE_TEST_CASE_P(LineIndex,
+                        LineIndexTest,
+                        ::testing::Values(PRSNT_WRAP, PRSNT_NO_WRAP));
+
+
+void LineIndexTest::SetUp()
+{
+    GString *text = g_string_new ("\n");
+
+    for (guint line=0; line<2000; ++line)
+    {
+        guint len = line%400==0 ? 100000 : line%7 * 40;
+
+        for (guint i=0; i<len; ++i)
+            g_string_append (text, i%31==0 ? "\t" : i%17==0 ? "\xc3\xa4" : "x");
+
+        g_string_append (text, line%3 ? "\n" : "\r\n");
+    }
+
+    gint fd = g_file_open_tmp ("gcmd-lineindex-XXXXXX", &file_path, NULL);
+    ASSERT_NE (-1, fd);
+    ASSERT_EQ ((gssize) text->len, write (fd, text->str, text->len));
+    close (fd);
+
+    size = text->len;
+    g_string_free (text, TRUE);
+
+    fops = gv_fileops_new();
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+
+    imd = gv_input_modes_new();
+    gv_init_input_modes(imd, (get_byte_proc) gv_file_get_byte, fops);
+    gv_set_input_mode(imd, "UTF8");
+}
+
+
+void LineIndexTest::TearDown()
+{
+    gv_free_input_modes(imd);
+    g_free (imd);
+    gv_file_free(fops);
+    g_free (fops);
+    g_unlink (file_path);
+    g_free (file_path);
+}
+
+
+GVDataPresentation *LineIndexTest::new_presentation()
+{
+    GVDataPresentation *dp = gv_data_presentation_new();
+
+    gv_init_data_presentation(dp, imd, size);
+    gv_set_wrap_limit(dp, 80);
+    gv_set_data_presentation_mode(dp, GetParam());
+
+    return dp;
+}
+
+
+TEST_P(LineIndexTest, indexed_lines_equal_scanned_lines)
+{
+    for (guint tab_size=8; tab_size>=4; tab_size-=4)
+    {
+        GVDataPresentation *indexed = new_presentation();
+        gv_set_tab_size(indexed, tab_size);
+
+        // the first lookup starts the index, the main loop builds it
+        gv_align_offset_to_line_start(indexed, size/2);
+        while (g_main_context_iteration (NULL, FALSE));
+
+        // this one has no index yet, as the main loop doesn't run again
+        GVDataPresentation *scanned = new_presentation();
+        gv_set_tab_size(scanned, tab_size);
+
+        for (offset_type offset=0; offset<size; offset+=size/61)
+        {
+            offset_type line_start = gv_align_offset_to_line_start(scanned, offset);
 
+            ASSERT_EQ (line_start, gv_align_offset_to_line_start(indexed, offset)) << "offset " << offset;
+            ASSERT_EQ (gv_get_end_of_line_offset(scanned, line_start), gv_get_end_of_line_offset(indexed, line_start)) << "offset " << offset;
 
+            for (int delta=-3; delta<=3; delta+=2)
+                ASSERT_EQ (gv_scroll_lines(scanned, line_start, delta), gv_scroll_lines(indexed, line_start, delta)) << "offset " << offset << ", delta " << delta;
+        }
+
+        gv_free_data_presentation(scanned);
+        g_free (scanned);
+        gv_free_data_presentation(indexed);
+        g_free (indexed);
+    }
+}
+
+
+static void compare_lines(GVDataPresentation *scanned, GVDataPresentation *indexed, offset_type size)
+{
+    for (offset_type offset=0; offset<size; offset+=size/61)
+    {
+        offset_type line_start = gv_align_offset_to_line_start(scanned, offset);
+
+        ASSERT_EQ (line_start, gv_align_offset_to_line_start(indexed, offset)) << "offset " << offset;
+        ASSERT_EQ (gv_get_end_of_line_offset(scanned, line_start), gv_get_end_of_line_offset(indexed, line_start)) << "offset " << offset;
+        ASSERT_EQ (gv_scroll_lines(scanned, line_start, -3), gv_scroll_lines(indexed, line_start, -3)) << "offset " << offset;
+    }
+}
+
+
+TEST_P(LineIndexTest, index_follows_growing_and_replaced_file)
+{
+    gchar *text;
+    gsize len;
+
+    ASSERT_TRUE (g_file_get_contents (file_path, &text, &len, NULL));
+
+    // a copy of the first third of the file, which is followed
+    gchar *followed_path;
+    gint fd = g_file_open_tmp ("gcmd-follow-XXXXXX", &followed_path, NULL);
+    ASSERT_NE (-1, fd);
+    ASSERT_EQ ((gssize) len/3, write (fd, text, len/3));
+
+    ViewerFileOps *followed_fops = gv_fileops_new();
+    ASSERT_NE (-1, gv_file_open(followed_fops, followed_path));
+
+    GVInputModesData *followed_imd = gv_input_modes_new();
+    gv_init_input_modes(followed_imd, (get_byte_proc) gv_file_get_byte, followed_fops);
+    gv_set_input_mode(followed_imd, "UTF8");
+
+    GVDataPresentation *indexed = gv_data_presentation_new();
+    gv_init_data_presentation(indexed, followed_imd, gv_file_get_max_offset(followed_fops));
+    gv_set_wrap_limit(indexed, 80);
+    gv_set_data_presentation_mode(indexed, GetParam());
+
+    gv_align_offset_to_line_start(indexed, len/6);
+    while (g_main_context_iteration (NULL, FALSE));
+
+    // the rest is appended
+    ASSERT_EQ ((gssize) (len-len/3), write (fd, text+len/3, len-len/3));
+    ASSERT_EQ (GV_FILE_GROWN, gv_file_update(followed_fops));
+    gv_set_max_offset(indexed, gv_file_get_max_offset(followed_fops));
+    while (g_main_context_iteration (NULL, FALSE));
+
+    GVDataPresentation *scanned = new_presentation();
+    compare_lines(scanned, indexed, size);
+    gv_free_data_presentation(scanned);
+    g_free (scanned);
+
+    // and the file is replaced by its second half
+    ASSERT_EQ (0, ftruncate (fd, 0));
+    ASSERT_EQ ((gssize) (len-len/2), pwrite (fd, text+len/2, len-len/2, 0));
+    ASSERT_EQ (GV_FILE_REPLACED, gv_file_update(followed_fops));
+    gv_reset_data_presentation(indexed, gv_file_get_max_offset(followed_fops));
+
+    gv_align_offset_to_line_start(indexed, len/4);
+    while (g_main_context_iteration (NULL, FALSE));
+
+    scanned = gv_data_presentation_new();
+    gv_init_data_presentation(scanned, followed_imd, gv_file_get_max_offset(followed_fops));
+    gv_set_wrap_limit(scanned, 80);
+    gv_set_data_presentation_mode(scanned, GetParam());
+    compare_lines(scanned, indexed, len-len/2);
+
+    gv_free_data_presentation(scanned);
+    g_free (scanned);
+    gv_free_data_presentation(indexed);
+    g_free (indexed);
+    gv_free_input_modes(followed_imd);
+    g_free (followed_imd);
+    gv_file_free(followed_fops);
+    g_free (followed_fops);
+    close (fd);
+    g_unlink (followed_path);
+    g_free (followed_path);
+    g_free (text);
+}
+
+
+TEST_P(LineIndexTest, timing)
+{
+    GVDataPresentation *dp = new_presentation();
+    GTimer *timer = g_timer_new ();
+    gint n = 0;
+
+    gv_align_offset_to_line_start(dp, size/2);
+    while (g_main_context_iteration (NULL, FALSE))
+        ++n;
+
+    gdouble t_build = g_timer_elapsed (timer, NULL);
+
+    // scroll back from the middle of a 100000 byte line
+    g_timer_start (timer);
+    offset_type offset = gv_align_offset_to_line_start(dp, size-50000);
+    offset = gv_scroll_lines(dp, offset, -2);
+    gdouble t_scroll = g_timer_elapsed (timer, NULL);
+
+    g_timer_destroy (timer);
+
+    printf("%lu bytes indexed in %d steps: %8.4f s, scrolling back: %8.6f s\n", (unsigned long) size, n, t_build, t_scroll);
+
+    EXPECT_LT (offset, size);
+
+    gv_free_data_presentation(dp);
+    g_free (dp);
+}
@@ -21,10 +21,13 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <unistd.h>
+
 #include "gtest/gtest.h"
 #include <libgviewer.h>
 #include <gvtypes.h>
 #include <fileops.h>
+#include <glib/gstdio.h>
 
 // The fixture for testing class FileOpsTest.
 class FileOpsTest : public ::testing::Test {};
@@ -52,3 +55,288 @@ TEST_F(FileOpsTest, gv_file_get_byte_does_read) {
     gv_file_free(fops);
     g_free(fops);
 }
+
+
+// A file of 20 MiB, more than the window cache holds, whose bytes are a function of their offset
+class WindowedFileOpsTest : public ::testing::Test
+{
+  protected:
+
+    gchar *file_path;
+    offset_type size;
+
+    virtual void SetUp();
+    virtual void TearDown();
+
+    static unsigned char expected(offset_type offset)    {  return (offset * 7 + offset / 4093) & 0xFF;  }
+};
+
+
+void WindowedFileOpsTest::SetUp()
+{
+    size = 20 * 1024 * 1024 + 123;
+
+    gint fd = g_file_open_tmp ("gcmd-fileops-XXXXXX", &file_path, NULL);
+    ASSERT_NE (-1, fd);
+
+    unsigned char *content = (unsigned char *) g_malloc (size);
+    for (offset_type i = 0; i < size; i++)
+        content[i] = expected(i);
+
+    ASSERT_EQ ((ssize_t) size, write (fd, content, size));
+
+    g_free (content);
+    close (fd);
+}
+
+
+void WindowedFileOpsTest::TearDown()
+{
+    g_unlink (file_path);
+    g_free (file_path);
+}
+
+
+TEST_F(WindowedFileOpsTest, gv_file_get_byte_through_windows) {
+    ViewerFileOps *fops = gv_fileops_new();
+
+    gv_file_set_max_mapping(fops, 0);
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+    ASSERT_EQ (size, gv_file_get_max_offset(fops));
+
+    for (offset_type current = 0; current < size; current += 997)
+        ASSERT_EQ (expected(current), gv_file_get_byte(fops, current));
+
+    // backwards, and jumping between windows which have been evicted
+    for (offset_type current = 0; current < size; current += 1048573)
+    {
+        ASSERT_EQ (expected(size-1-current), gv_file_get_byte(fops, size-1-current));
+        ASSERT_EQ (expected(current), gv_file_get_byte(fops, current));
+    }
+
+    ASSERT_EQ (-1, gv_file_get_byte(fops, size));
+
+    gv_file_free(fops);
+    g_free(fops);
+}
+
+
+TEST_F(WindowedFileOpsTest, gv_file_get_range_spans_windows) {
+    ViewerFileOps *fops = gv_fileops_new();
+
+    gv_file_set_max_mapping(fops, 0);
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+
+    const offset_type len = 3 * 1024 * 1024;
+    unsigned char *buf = (unsigned char *) g_malloc (len);
+
+    offset_type starts[] = {0, 1024 * 1024 - 10, 5 * 1024 * 1024 + 17, size - len};
+
+    for (guint i = 0; i < G_N_ELEMENTS (starts); i++)
+    {
+        ASSERT_EQ (len, gv_file_get_range(fops, starts[i], buf, len));
+
+        for (offset_type j = 0; j < len; j++)
+            ASSERT_EQ (expected(starts[i]+j), buf[j]);
+    }
+
+    // the end of the file
+    ASSERT_EQ (100, gv_file_get_range(fops, size-100, buf, len));
+    ASSERT_EQ (expected(size-1), buf[99]);
+    ASSERT_EQ (0, gv_file_get_range(fops, size, buf, len));
+
+    g_free(buf);
+    gv_file_free(fops);
+    g_free(fops);
+}
+
+
+TEST_F(WindowedFileOpsTest, gv_file_get_range_of_mapped_file) {
+    ViewerFileOps *fops = gv_fileops_new();
+
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+
+    unsigned char buf[4096];
+
+    ASSERT_EQ (sizeof(buf), gv_file_get_range(fops, 12345, buf, sizeof(buf)));
+
+    for (offset_type j = 0; j < sizeof(buf); j++)
+        ASSERT_EQ (expected(12345+j), buf[j]);
+
+    gv_file_free(fops);
+    g_free(fops);
+}
+
+
+// A log file which is appended to, truncated and rotated while it is viewed
+class FollowedFileOpsTest : public ::testing::Test
+{
+  protected:
+
+    gchar *file_path;
+    gchar *rotated_path;
+
+    virtual void SetUp();
+    virtual void TearDown();
+
+    void append(offset_type from, offset_type len);
+    void check(ViewerFileOps *fops, offset_type from, offset_type len);
+
+    static unsigned char expected(offset_type offset)    {  return (offset * 13 + offset / 1021) & 0xFF;  }
+};
+
+
+void FollowedFileOpsTest::SetUp()
+{
+    gint fd = g_file_open_tmp ("gcmd-follow-XXXXXX", &file_path, NULL);
+    ASSERT_NE (-1, fd);
+    close (fd);
+
+    rotated_path = g_strconcat (file_path, ".1", NULL);
+}
+
+
+void FollowedFileOpsTest::TearDown()
+{
+    g_unlink (file_path);
+    g_unlink (rotated_path);
+    g_free (rotated_path);
+    g_free (file_path);
+}
+
+
+void FollowedFileOpsTest::append(offset_type from, offset_type len)
+{
+    FILE *f = fopen (file_path, "ab");
+    ASSERT_TRUE (f != NULL);
+
+    for (offset_type i = from; i < from + len; i++)
+        fputc (expected(i), f);
+
+    fclose (f);
+}
+
+
+void FollowedFileOpsTest::check(ViewerFileOps *fops, offset_type from, offset_type len)
+{
+    unsigned char *buf = (unsigned char *) g_malloc (len);
+
+    ASSERT_EQ (len, gv_file_get_range(fops, from, buf, len));
+
+    for (offset_type i = 0; i < len; i++)
+        ASSERT_EQ (expected(from+i), buf[i]);
+
+    g_free (buf);
+}
+
+
+TEST_F(FollowedFileOpsTest, gv_file_update_of_mapped_file) {
+    append(0, 1000);
+
+    ViewerFileOps *fops = gv_fileops_new();
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+    check(fops, 0, 1000);
+
+    ASSERT_EQ (GV_FILE_UNCHANGED, gv_file_update(fops));
+
+    append(1000, 3000);
+
+    ASSERT_EQ (GV_FILE_GROWN, gv_file_update(fops));
+    ASSERT_EQ (4000, gv_file_get_max_offset(fops));
+    check(fops, 0, 4000);
+    ASSERT_EQ (-1, gv_file_get_byte(fops, 4000));
+
+    ASSERT_EQ (GV_FILE_UNCHANGED, gv_file_update(fops));
+
+    gv_file_free(fops);
+    g_free(fops);
+}
+
+
+TEST_F(FollowedFileOpsTest, gv_file_update_through_windows) {
+    const offset_type size = 3 * 1024 * 1024 / 2;
+
+    append(0, size);
+
+    ViewerFileOps *fops = gv_fileops_new();
+    gv_file_set_max_mapping(fops, 0);
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+
+    // the window at the end of the file is shorter than the others
+    check(fops, size-100, 100);
+
+    append(size, 1024 * 1024);
+
+    ASSERT_EQ (GV_FILE_GROWN, gv_file_update(fops));
+    ASSERT_EQ (size + 1024 * 1024, gv_file_get_max_offset(fops));
+    check(fops, size-100, 200);
+    check(fops, 0, size + 1024 * 1024);
+
+    gv_file_free(fops);
+    g_free(fops);
+}
+
+
+TEST_F(FollowedFileOpsTest, gv_file_update_of_truncated_file) {
+    append(0, 5000);
+
+    ViewerFileOps *fops = gv_fileops_new();
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+
+    ASSERT_EQ (0, truncate (file_path, 0));
+    append(0, 10);
+
+    ASSERT_EQ (GV_FILE_REPLACED, gv_file_update(fops));
+    ASSERT_EQ (10, gv_file_get_max_offset(fops));
+    check(fops, 0, 10);
+    ASSERT_EQ (-1, gv_file_get_byte(fops, 10));
+
+    gv_file_free(fops);
+    g_free(fops);
+}
+
+
+TEST_F(FollowedFileOpsTest, gv_file_get_byte_of_followed_file_truncated) {
+    append(0, 20000);
+
+    ViewerFileOps *fops = gv_fileops_new();
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+    gv_file_set_following(fops, TRUE);
+    check(fops, 0, 100);
+
+    // until the next update the data read before is shown, where a mapping would raise SIGBUS
+    ASSERT_EQ (0, truncate (file_path, 0));
+    ASSERT_EQ (expected(15000), gv_file_get_byte(fops, 15000));
+    check(fops, 10000, 10000);
+
+    ASSERT_EQ (GV_FILE_REPLACED, gv_file_update(fops));
+    ASSERT_EQ (0, gv_file_get_max_offset(fops));
+    ASSERT_EQ (-1, gv_file_get_byte(fops, 15000));
+
+    gv_file_free(fops);
+    g_free(fops);
+}
+
+
+TEST_F(FollowedFileOpsTest, gv_file_update_of_rotated_file) {
+    append(0, 5000);
+
+    ViewerFileOps *fops = gv_fileops_new();
+    ASSERT_NE (-1, gv_file_open(fops, file_path));
+
+    // the old file is renamed and a new one is written in its place
+    ASSERT_EQ (0, g_rename (file_path, rotated_path));
+    append(0, 7000);
+
+    ASSERT_EQ (GV_FILE_REPLACED, gv_file_update(fops));
+    ASSERT_EQ (7000, gv_file_get_max_offset(fops));
+    check(fops, 0, 7000);
+
+    append(7000, 500);
+
+    ASSERT_EQ (GV_FILE_GROWN, gv_file_update(fops));
+    check(fops, 0, 7500);
+
+    gv_file_free(fops);
+    g_free(fops);
+}
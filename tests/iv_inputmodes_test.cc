@@ -26,8 +26,12 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <string.h>
+
 #include "gtest/gtest.h"
 #include <libgviewer.h>
+#include <gvtypes.h>
+#include <inputmodes.h>
 
 class ViewerInputModeTest : public ::testing::TestWithParam<const char *> {};
 
@@ -46,3 +50,105 @@ TEST_P(ViewerInputModeTest, gv_set_input_mode_test)
     gv_free_input_modes(imd);
     g_free(imd);
 }
+
+
+// Text with ASCII runs, UTF-8 characters, invalid bytes, tabs and CR/LF pairs
+struct DecodeTestData
+{
+    unsigned char bytes[4096];
+    offset_type size;
+};
+
+
+static int get_test_byte (DecodeTestData *data, offset_type offset)
+{
+    return offset<data->size ? data->bytes[offset] : -1;
+}
+
+
+static offset_type get_test_range (DecodeTestData *data, offset_type start, unsigned char *buf, offset_type count)
+{
+    if (start>=data->size)
+        return 0;
+
+    count = MIN(count, data->size - start);
+    memcpy(buf, data->bytes + start, count);
+
+    return count;
+}
+
+
+static void fill_test_data (DecodeTestData *data, const char *tail)
+{
+    static const char *pieces[] = {"plain ascii text, long enough for the fast path ", "\xc3\xa4", "\xe2\x82\xac", "\xf0\x9f\x98\x80",
+                                   "\t", "\r\n", "\n", "\r", "\x80", "\xc3", "\xe2\x82", "\xff", "<&>"};
+    guint32 seed = 1;
+
+    data->size = 0;
+
+    while (data->size < sizeof(data->bytes) - 128)
+    {
+        seed = seed * 1103515245 + 12345;
+        const char *piece = pieces[(seed >> 16) % G_N_ELEMENTS(pieces)];
+
+        memcpy(data->bytes + data->size, piece, strlen(piece));
+        data->size += strlen(piece);
+    }
+
+    memcpy(data->bytes + data->size, tail, strlen(tail));
+    data->size += strlen(tail);
+}
+
+
+TEST_P(ViewerInputModeTest, gv_input_mode_decode_test)
+{
+    static const char *tails[] = {"a cut UTF-8 character: \xe2\x82", "ASCII characters only"};
+    DecodeTestData data;
+
+    for (guint test=0; test<2*G_N_ELEMENTS(tails); test++)
+    {
+        gboolean with_range = test & 1;
+
+        fill_test_data (&data, tails[test/2]);
+
+        GVInputModesData *imd = gv_input_modes_new();
+
+        gv_init_input_modes(imd, (get_byte_proc) get_test_byte, &data);
+        if (with_range)
+            gv_set_input_modes_range_proc(imd, (get_range_proc) get_test_range);
+        gv_set_input_mode(imd, GetParam());
+
+        static const int max_chars[] = {1, 7, 8, 9, 100, 5000};
+
+        for (guint m=0; m<G_N_ELEMENTS(max_chars); m++)
+            for (offset_type start=0; start<=data.size; start+=start<data.size-40 ? 37 : 1)
+            {
+                char_type chars[5000];
+                offset_type offsets[5001];
+
+                int count = gv_input_mode_decode(imd, start, chars, offsets, max_chars[m]);
+                offset_type offset = start;
+                int i;
+
+                for (i=0; i<max_chars[m]; i++)
+                {
+                    char_type value = gv_input_mode_get_utf8_char(imd, offset);
+
+                    if (value==INVALID_CHAR)
+                        break;
+
+                    ASSERT_LT (i, count) << "start " << start;
+                    ASSERT_EQ (offset, offsets[i]) << "start " << start << ", char " << i;
+                    ASSERT_EQ (value, chars[i]) << "start " << start << ", char " << i;
+
+                    offset = gv_input_get_next_char_offset(imd, offset);
+                }
+
+                ASSERT_EQ (i, count) << "start " << start;
+                ASSERT_EQ (offset, offsets[count]) << "start " << start;
+            }
+
+        gv_free_input_modes(imd);
+        g_free(imd);
+    }
+}